@@ -0,0 +1,144 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * admission_control.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ADMISSION_CONTROL_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ADMISSION_CONTROL_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/**
+ * The cost classes that requests are put into. Each class has its
+ * own limits so that expensive requests can't hold up the cheap ones.
+ */
+typedef enum AdmissionClass
+{
+	/** Marker lookups and prefix searches. */
+	AC_LIGHT,
+
+	/** Population and full-record searches and small submissions. */
+	AC_HEAVY,
+
+	/** Large submissions. */
+	AC_BULK,
+
+	/** The number of classes, this must be the last entry. */
+	AC_NUM_CLASSES
+} AdmissionClass;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Set the admission limits from the service configuration.
+ *
+ * The limits are shared by the search and submission services. Each
+ * class is configured by an object keyed by its name, "light", "heavy"
+ * or "bulk", with the keys:
+ *
+ * - "max_running": The number of requests that can run at once. 0 means no limit.
+ * - "max_queued": The number of requests that can wait for a slot. Any more are rejected.
+ * - "max_wait_ms": How long a request can wait for a slot before it is rejected.
+ *
+ * "bulk_threshold_cells" sets the number of genotype values above which
+ * a submission counts as bulk.
+ *
+ * @param config_p The "admission_control" object from the service configuration.
+ * If this is <code>NULL</code>, the defaults are used.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ConfigureAdmissionControl (const json_t *config_p);
+
+
+/**
+ * Get the cost class of a search.
+ *
+ * @param marker_s The marker to search for, if any.
+ * @param population_s The population to search for, if any.
+ * @param full_record_flag Will the full populations be returned?
+ * @return The cost class.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL AdmissionClass GetSearchAdmissionClass (const char *marker_s, const char *population_s, const bool full_record_flag);
+
+
+/**
+ * Get the cost class of a submission from the size of its table.
+ *
+ * @param data_json_p The submitted table.
+ * @return The cost class.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL AdmissionClass GetSubmissionAdmissionClass (const json_t *data_json_p);
+
+
+/**
+ * Get the cost class of a submission from the number of cells in its table.
+ *
+ * @param num_cells The number of rows times the number of columns.
+ * @return The cost class.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL AdmissionClass GetSubmissionAdmissionClassByCells (const uint64 num_cells);
+
+
+/**
+ * Wait for a slot to run a request in the given class.
+ *
+ * Requests in the same class are admitted in the order that they
+ * arrive. Each successful call must be balanced by a call to
+ * LeaveAdmissionControl ().
+ *
+ * @param ac The cost class of the request.
+ * @param end_time The monotonic time, in nanoseconds, after which the
+ * caller no longer wants to wait, or 0 to just use the class's limit.
+ * @return <code>true</code> if the request can run, <code>false</code> if
+ * it has been rejected because the queue is full or it waited for too long.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool EnterAdmissionControl (const AdmissionClass ac, const uint64 end_time);
+
+
+/**
+ * Release the slot taken by EnterAdmissionControl () and let the next
+ * waiting request in the class run.
+ *
+ * @param ac The cost class of the request.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void LeaveAdmissionControl (const AdmissionClass ac);
+
+
+/**
+ * Get the name of a cost class.
+ *
+ * @param ac The cost class.
+ * @return The name.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL const char *GetAdmissionClassAsString (const AdmissionClass ac);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ADMISSION_CONTROL_H_ */
@@ -0,0 +1,103 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * arrow_export.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ARROW_EXPORT_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ARROW_EXPORT_H_
+
+#include <stdio.h>
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/**
+ * A writer for an Arrow IPC file of a population's genotypes.
+ */
+typedef struct ArrowMatrixWriter ArrowMatrixWriter;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Start writing an Arrow IPC file, also known as Feather version 2,
+ * with a row for each marker.
+ *
+ * The columns are "marker", "chromosome" and "mapping_position" followed
+ * by a column for each progeny line. The progeny columns are dictionary-encoded
+ * with missing calls stored as nulls. The rows are buffered and written
+ * in record batches so the memory used doesn't depend upon the number of
+ * markers.
+ *
+ * @param out_f The file to write to, which must be at its start.
+ * @param accessions_ss The accessions of the progeny lines in column order.
+ * @param num_progeny The number of progeny lines.
+ * @param call_indexes_p A JSON object mapping each distinct non-missing call
+ * to its index in the dictionary, counting up from 0. This must stay valid
+ * until the writer is freed.
+ * @return The newly-allocated ArrowMatrixWriter, which has written the schema
+ * and dictionaries, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL ArrowMatrixWriter *AllocateArrowMatrixWriter (FILE *out_f, const char **accessions_ss, const uint32 num_progeny, const json_t *call_indexes_p);
+
+
+/**
+ * Add a marker's row.
+ *
+ * @param writer_p The ArrowMatrixWriter.
+ * @param marker_s The name of the marker.
+ * @param chromosome_s The chromosome, or <code>NULL</code> or empty if it
+ * doesn't have one.
+ * @param position The mapping position, or HUGE_VAL if it doesn't have one.
+ * @param row_ss The calls for the marker in the same order as the progeny
+ * accessions. Any that are <code>NULL</code> or missing calls are written as nulls.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddArrowMatrixRow (ArrowMatrixWriter *writer_p, const char *marker_s, const char *chromosome_s, const double64 position, const char **row_ss);
+
+
+/**
+ * Write any remaining rows and the file's footer.
+ *
+ * @param writer_p The ArrowMatrixWriter.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool FinishArrowMatrix (ArrowMatrixWriter *writer_p);
+
+
+/**
+ * Free an ArrowMatrixWriter. This doesn't close its file.
+ *
+ * @param writer_p The ArrowMatrixWriter.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void FreeArrowMatrixWriter (ArrowMatrixWriter *writer_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_ARROW_EXPORT_H_ */
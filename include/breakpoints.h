@@ -0,0 +1,87 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * breakpoints.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BREAKPOINTS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BREAKPOINTS_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Find the recombination breakpoints for each progeny line in a population
+ * and store them on the line's progeny document.
+ *
+ * The markers are walked once in map order and a breakpoint is recorded
+ * wherever a line's calls switch between parent A, parent B and
+ * heterozygous. Missing calls are skipped over, so a breakpoint spans
+ * from the last marker with the old call to the first one with the new
+ * call. Each breakpoint has its chromosome, the names and mapping
+ * positions of the markers either side of it and the calls that
+ * it goes from and to.
+ *
+ * @param id_p The id of the population.
+ * @param population_s The name of the population.
+ * @param population_p The whole population document.
+ * @param parents_p The parents' genotypes for each marker from
+ * GetParentGenotypesByMarker().
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the breakpoints were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SaveBreakpoints (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the stored breakpoints for a progeny line or for all of the lines
+ * in a population.
+ *
+ * @param accession_s If this is not <code>NULL</code> or empty, only the
+ * breakpoints for the line with this accession are returned.
+ * @param population_s If this is not <code>NULL</code> or empty, only the
+ * breakpoints for lines in the population with this name are returned.
+ * @param chromosome_s If this is not <code>NULL</code> or empty, only the
+ * breakpoints on this chromosome are returned.
+ * @param start_p If this is not <code>NULL</code>, only the breakpoints that
+ * end at or after this mapping position are returned.
+ * @param end_p If this is not <code>NULL</code>, only the breakpoints that
+ * start at or before this mapping position are returned.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array with an entry for each line that has
+ * any matching breakpoints, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetBreakpoints (const char *accession_s, const char *population_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BREAKPOINTS_H_ */
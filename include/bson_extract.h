@@ -0,0 +1,67 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * bson_extract.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BSON_EXTRACT_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BSON_EXTRACT_H_
+
+#include "parental_genotype_service_library.h"
+#include "jansson.h"
+#include "bson.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get a top-level string value from a BSON document without
+ * converting anything else.
+ *
+ * @param doc_p The document.
+ * @param key_s The key of the value to get.
+ * @return The value, which points into doc_p, or <code>NULL</code> if
+ * there is no string value for the given key.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL const char *GetBSONString (const bson_t *doc_p, const char *key_s);
+
+
+/**
+ * Convert the value that a bson_iter_t is currently on into JSON.
+ *
+ * Documents and arrays are converted recursively. Strings, numbers,
+ * booleans and nulls are converted directly and any other types are
+ * skipped.
+ *
+ * @param iter_p The iterator.
+ * @return The newly-allocated JSON value or <code>NULL</code> upon error
+ * or if the type isn't supported.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetBSONIterAsJSON (const bson_iter_t *iter_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_BSON_EXTRACT_H_ */
@@ -0,0 +1,57 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * collection_indexes.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COLLECTION_INDEXES_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COLLECTION_INDEXES_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Check that the indexes used by the search and submission services
+ * exist on the varieties, populations, population summaries, progeny,
+ * parent genotypes and marker statistics collections.
+ *
+ * For each index, the query that relies upon it is explained by the
+ * server and a warning is logged if it would need a collection scan.
+ *
+ * @param data_p The configuration data for the service.
+ * @param create_flag If this is <code>true</code> then any missing indexes
+ * will be created.
+ * @return <code>true</code> if all of the indexes are available,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool CheckCollectionIndexes (ParentalGenotypeServiceData *data_p, const bool create_flag);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COLLECTION_INDEXES_H_ */
@@ -0,0 +1,99 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * compact_format.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COMPACT_FORMAT_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COMPACT_FORMAT_H_
+
+#include "parental_genotype_service_library.h"
+#include "jansson.h"
+#include "job_arena.h"
+
+
+/**
+ * The different ways that population results can be sent back.
+ */
+typedef enum ResponseFormat
+{
+	/** The default layout where each marker maps accession names to genotypes. */
+	RF_JSON,
+
+	/**
+	 * The accession names are listed once per population and each marker
+	 * has an array of genotypes in the same order.
+	 */
+	RF_COMPACT,
+
+	/** As RF_COMPACT but gzip-compressed and base64-encoded. */
+	RF_COMPACT_GZIP
+} ResponseFormat;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Convert a population document into the compact layout.
+ *
+ * The population's name and parents are copied as they are and
+ * the escaped marker names are converted back to their original form.
+ *
+ * @param src_p The population document as stored in the database.
+ * @param format The format to use. If this is RF_COMPACT_GZIP, the
+ * compact document is compressed and stored as a base64 string.
+ * @param arena_p The JobArena to use for the unescaped marker names.
+ * It is reset before this returns.
+ * @return The newly-allocated compact document or <code>NULL</code>
+ * upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetPopulationInCompactFormat (const json_t *src_p, const ResponseFormat format, JobArena *arena_p);
+
+
+/**
+ * Compress a JSON document for sending back as an RF_COMPACT_GZIP result.
+ *
+ * @param compact_p The document to compress.
+ * @return A newly-allocated document with the population name, if
+ * compact_p has one, the encoding and the gzip-compressed, base64-encoded
+ * serialisation of compact_p, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetCompressedDocument (const json_t *compact_p);
+
+
+/**
+ * Encode binary data as base64 so that it can be sent back in a JSON result.
+ *
+ * @param data_p The data to encode.
+ * @param length The length of data_p in bytes.
+ * @return The newly-allocated base64 string which should be freed with
+ * FreeMemory (), or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL char *GetAsBase64 (const unsigned char *data_p, const size_t length);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_COMPACT_FORMAT_H_ */
@@ -0,0 +1,260 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * flatbuffer_builder.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_FLATBUFFER_BUILDER_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_FLATBUFFER_BUILDER_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+
+
+/**
+ * The most fields that a table can have.
+ */
+#define FBB_MAX_FIELDS (16)
+
+
+/**
+ * A minimal FlatBuffers builder, which is all that is needed to write
+ * the metadata of Arrow IPC files without depending upon the FlatBuffers
+ * or Arrow libraries.
+ *
+ * As with the FlatBuffers libraries, the buffer is built from back to front
+ * so each child object has to be finished before its parent is started.
+ * Objects are referred to by their offset from the end of the buffer.
+ *
+ * Rather than checking every call, any failure is remembered and reported
+ * by FinishFlatBuffer (). Values are written in the host's byte order
+ * so this assumes a little-endian host.
+ */
+typedef struct FlatBufferBuilder
+{
+	/** The buffer, with the data built so far at its end. */
+	uint8 *fbb_buffer_p;
+
+	size_t fbb_capacity;
+
+	/** The number of bytes at the end of fbb_buffer_p that are in use. */
+	size_t fbb_size;
+
+	/** The largest alignment that has been needed so far. */
+	size_t fbb_min_align;
+
+	/** The size of the buffer when the current table was started. */
+	size_t fbb_table_start;
+
+	/** The offsets of the current table's fields, 0 if not set. */
+	uint32 fbb_fields [FBB_MAX_FIELDS];
+
+	/** One more than the highest field id set in the current table. */
+	uint16 fbb_num_fields;
+
+	bool fbb_failed_flag;
+} FlatBufferBuilder;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Initialise a FlatBufferBuilder.
+ *
+ * @param builder_p The FlatBufferBuilder to initialise.
+ * @param capacity The number of bytes to allocate initially. The buffer
+ * grows as needed.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool InitFlatBufferBuilder (FlatBufferBuilder *builder_p, const size_t capacity);
+
+
+/**
+ * Free the memory used by a FlatBufferBuilder.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ClearFlatBufferBuilder (FlatBufferBuilder *builder_p);
+
+
+/**
+ * Empty a FlatBufferBuilder so that it can build another buffer,
+ * keeping its memory.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ResetFlatBufferBuilder (FlatBufferBuilder *builder_p);
+
+
+/**
+ * Add a string.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param value_s The string.
+ * @return The offset of the string.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint32 CreateFlatBufferString (FlatBufferBuilder *builder_p, const char *value_s);
+
+
+/**
+ * Start a table. Its fields must be added before EndFlatBufferTable ()
+ * is called, without starting any other objects in between.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void StartFlatBufferTable (FlatBufferBuilder *builder_p);
+
+
+/**
+ * Add a one-byte field, such as a bool or a union type, to the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param field The id of the field.
+ * @param value The value.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddFlatBufferUInt8 (FlatBufferBuilder *builder_p, const uint16 field, const uint8 value);
+
+
+/**
+ * Add a two-byte field, such as a short enum, to the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param field The id of the field.
+ * @param value The value.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddFlatBufferInt16 (FlatBufferBuilder *builder_p, const uint16 field, const int16 value);
+
+
+/**
+ * Add a four-byte integer field to the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param field The id of the field.
+ * @param value The value.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddFlatBufferInt32 (FlatBufferBuilder *builder_p, const uint16 field, const int32 value);
+
+
+/**
+ * Add an eight-byte integer field to the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param field The id of the field.
+ * @param value The value.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddFlatBufferInt64 (FlatBufferBuilder *builder_p, const uint16 field, const int64 value);
+
+
+/**
+ * Add a field that refers to a string, vector or table to the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param field The id of the field.
+ * @param offset The offset of the object.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddFlatBufferOffset (FlatBufferBuilder *builder_p, const uint16 field, const uint32 offset);
+
+
+/**
+ * Finish the current table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @return The offset of the table.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint32 EndFlatBufferTable (FlatBufferBuilder *builder_p);
+
+
+/**
+ * Start a vector. Its elements must then be pushed in reverse order.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param element_size The size of each element.
+ * @param num_elements The number of elements.
+ * @param alignment The alignment of each element.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void StartFlatBufferVector (FlatBufferBuilder *builder_p, const size_t element_size, const size_t num_elements, const size_t alignment);
+
+
+/**
+ * Push a reference to an object onto the current vector.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param offset The offset of the object.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void PushFlatBufferOffset (FlatBufferBuilder *builder_p, const uint32 offset);
+
+
+/**
+ * Push a struct onto the current vector.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param struct_p The struct, laid out as FlatBuffers expects with any padding.
+ * @param size The size of the struct.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void PushFlatBufferStruct (FlatBufferBuilder *builder_p, const void *struct_p, const size_t size);
+
+
+/**
+ * Finish the current vector.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param num_elements The number of elements that were pushed.
+ * @return The offset of the vector.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint32 EndFlatBufferVector (FlatBufferBuilder *builder_p, const size_t num_elements);
+
+
+/**
+ * Finish the buffer by adding the reference to its root table.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @param root The offset of the root table.
+ * @return <code>true</code> if the whole buffer was built successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool FinishFlatBuffer (FlatBufferBuilder *builder_p, const uint32 root);
+
+
+/**
+ * Get the finished buffer.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @return The buffer, which is valid until the builder is next changed.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL const uint8 *GetFlatBufferData (const FlatBufferBuilder *builder_p);
+
+
+/**
+ * Get the size of the finished buffer.
+ *
+ * @param builder_p The FlatBufferBuilder.
+ * @return The size in bytes.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL size_t GetFlatBufferSize (const FlatBufferBuilder *builder_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_FLATBUFFER_BUILDER_H_ */
@@ -0,0 +1,95 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * genetic_map.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENETIC_MAP_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENETIC_MAP_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/**
+ * A marker from a population document along with where it is on the map.
+ */
+typedef struct MapMarker
+{
+	/** The escaped name of the marker. */
+	const char *mm_name_s;
+
+	/** The chromosome or linkage group. */
+	const char *mm_chromosome_s;
+
+	/** The mapping position as it was submitted. */
+	const char *mm_position_s;
+
+	/**
+	 * The mapping position used for sorting. This is HUGE_VAL if the
+	 * marker doesn't have a numeric position.
+	 */
+	double64 mm_position;
+
+	/** The marker object from the population document. */
+	const json_t *mm_marker_p;
+} MapMarker;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the markers of a population sorted by chromosome and then by
+ * mapping position.
+ *
+ * @param population_p The population document.
+ * @param chromosome_s If this is not <code>NULL</code>, only the markers on
+ * this chromosome are returned.
+ * @param unmapped_flag If this is <code>true</code>, any markers without a
+ * chromosome are returned as being on an unnamed chromosome, "", which sorts
+ * before all of the others. Otherwise they are skipped.
+ * @param num_markers_p Where the number of markers will be stored.
+ * @return The newly-allocated array of markers, which points into
+ * population_p and should be freed with FreeMemory (), or <code>NULL</code>
+ * upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL MapMarker *GetMarkersInMapOrder (const json_t *population_p, const char *chromosome_s, const bool unmapped_flag, uint32 *num_markers_p);
+
+
+/**
+ * Get the index of each progeny line that has a call at any of the given markers.
+ *
+ * @param markers_p The markers.
+ * @param num_markers The number of markers.
+ * @return A newly-allocated JSON object mapping each accession to its
+ * index, counting up from 0, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetAccessionIndexes (const MapMarker *markers_p, const uint32 num_markers);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENETIC_MAP_H_ */
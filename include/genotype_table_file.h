@@ -0,0 +1,112 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * genotype_table_file.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENOTYPE_TABLE_FILE_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENOTYPE_TABLE_FILE_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "job_arena.h"
+
+
+/**
+ * A tab- or comma-separated genotype table that has been mapped into memory.
+ *
+ * The rows are laid out in the same way as a submitted table: the marker
+ * names, their chromosomes, their mapping positions, Parent A, Parent B
+ * and then a row for each progeny line. The first column of each row
+ * holds the row's name.
+ */
+typedef struct GenotypeTableFile GenotypeTableFile;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Open a genotype table file.
+ *
+ * The file is mapped into memory and scanned once to count its rows and
+ * columns. It is tab-separated if its first row has a tab in it and
+ * comma-separated otherwise. Fields can be quoted as they are in CSV files.
+ *
+ * @param filename_s The full path to the file.
+ * @return The newly-allocated GenotypeTableFile or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL GenotypeTableFile *OpenGenotypeTableFile (const char *filename_s);
+
+
+/**
+ * Get the number of rows in a genotype table file, not counting the
+ * row of marker names.
+ *
+ * @param file_p The GenotypeTableFile.
+ * @return The number of rows.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL size_t GetGenotypeTableFileNumRows (const GenotypeTableFile *file_p);
+
+
+/**
+ * Get the number of cells in a genotype table file.
+ *
+ * @param file_p The GenotypeTableFile.
+ * @return The number of rows times the number of columns.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint64 GetGenotypeTableFileNumCells (const GenotypeTableFile *file_p);
+
+
+/**
+ * Add the markers and genotypes in a genotype table file to a population
+ * document.
+ *
+ * Each field is copied straight from the mapped file into the marker that
+ * its column belongs to, so the rows are never built up as a table first.
+ *
+ * @param file_p The GenotypeTableFile.
+ * @param doc_p The population document to add the markers to.
+ * @param parent_a_row_pp Where to store Parent A's row, which has the same
+ * keys as a row of a submitted table. This belongs to file_p.
+ * @param parent_b_row_pp Where to store Parent B's row, which belongs to file_p.
+ * @param data_p The configuration data for the service, whose name mappings
+ * are applied to the progeny accessions.
+ * @param arena_p The JobArena to use for each row, which is reset after it.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddGenotypeTableFileToPopulation (GenotypeTableFile *file_p, json_t *doc_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, const ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+
+/**
+ * Unmap and free a GenotypeTableFile.
+ *
+ * @param file_p The GenotypeTableFile.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void CloseGenotypeTableFile (GenotypeTableFile *file_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_GENOTYPE_TABLE_FILE_H_ */
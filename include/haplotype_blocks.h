@@ -0,0 +1,126 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * haplotype_blocks.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_HAPLOTYPE_BLOCKS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_HAPLOTYPE_BLOCKS_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Store the progeny calls of a population as run-length encoded
+ * haplotype blocks.
+ *
+ * The markers are ordered by chromosome and mapping position and each
+ * progeny line is stored as runs of the same call along them. Calls that
+ * match either parent are coded by which parent they came from and any
+ * others are coded by their index in a table of the population's other
+ * calls. Since neighbouring markers usually come from the same parent,
+ * this is far smaller than the marker-by-marker population document.
+ *
+ * Each line also has a skip index with the offset of each chromosome's
+ * runs, so a single marker or interval can be decoded without reading
+ * the runs for the chromosomes before it.
+ *
+ * Markers without a chromosome aren't on the map so they are stored on
+ * an unnamed chromosome, "", without a mapping position. This means that
+ * the blocks hold all of the calls and can be used in place of the
+ * marker-by-marker population document when that is too large to save.
+ *
+ * @param id_p The id of the population.
+ * @param population_s The name of the population.
+ * @param population_p The whole population document.
+ * @param parents_p The parents' genotypes for each marker from
+ * GetParentGenotypesByMarker().
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the haplotype blocks were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SaveHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Decode the calls for a progeny line from the haplotype blocks
+ * of the populations with a given name.
+ *
+ * @param population_s The name of the population.
+ * @param accession_s The accession of the progeny line.
+ * @param marker_s If this is not <code>NULL</code> or empty, only the call
+ * at the marker with this name is decoded.
+ * @param chromosome_s If this is not <code>NULL</code> or empty, only the calls
+ * on this chromosome are decoded.
+ * @param start_p If this is not <code>NULL</code>, only the calls at markers with
+ * a mapping position of at least this value are decoded.
+ * @param end_p If this is not <code>NULL</code>, only the calls at markers with
+ * a mapping position of at most this value are decoded.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array with an entry for each population
+ * with the given name that has the progeny line, or <code>NULL</code>
+ * upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetHaplotypeBlockGenotypes (const char *population_s, const char *accession_s, const char *marker_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+/**
+ * Check whether a population document only has the names of its markers
+ * because its calls were too large to save in it and are stored in its
+ * haplotype blocks instead.
+ *
+ * @param population_p The population document.
+ * @return <code>true</code> if the population's calls are only in its
+ * haplotype blocks, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool IsHaplotypeBlocksOnlyPopulation (const json_t *population_p);
+
+
+/**
+ * Decode the haplotype blocks of a population that was stored without
+ * its calls and add its markers back into its population document, so
+ * it can be used in the same way as any other population.
+ *
+ * @param population_p The population document, with its <code>_id</code>,
+ * that the markers will be added to.
+ * @param marker_s If this is not <code>NULL</code> or empty, only the marker
+ * with this unescaped name is added.
+ * @param data_p The configuration data for the service. This will switch its
+ * MongoTool to the haplotype blocks collection.
+ * @param deadline_p The deadline for the query.
+ * @return <code>true</code> if the markers were added successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddHaplotypeBlockMarkers (json_t *population_p, const char *marker_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_HAPLOTYPE_BLOCKS_H_ */
@@ -0,0 +1,144 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * job_arena.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_ARENA_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_ARENA_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+#include "service_job.h"
+
+
+/**
+ * A block of memory that a JobArena hands out allocations from.
+ */
+typedef struct JobArenaChunk JobArenaChunk;
+
+
+/**
+ * A scratch allocator for the short-lived strings that a single
+ * search or submission builds, such as escaped marker names and
+ * field paths.
+ *
+ * Allocations are carved out of large chunks and are never freed
+ * individually. Instead the whole arena is reset, which keeps its
+ * first chunk for reuse, or cleared once the job has finished.
+ * A JobArena must only be used by one thread at a time.
+ */
+typedef struct JobArena
+{
+	/** The chunks, with the one currently being allocated from first. */
+	JobArenaChunk *ja_chunks_p;
+
+	/** The number of allocations made since the arena was initialised. */
+	uint64 ja_num_allocations;
+
+	/** The number of bytes allocated since the arena was initialised. */
+	uint64 ja_num_bytes;
+
+	/** The number of chunks that have had to be allocated from the heap. */
+	uint32 ja_num_chunks;
+
+	/** The number of times that the arena has been reset. */
+	uint32 ja_num_resets;
+} JobArena;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Initialise an empty JobArena. No memory is allocated until it is needed.
+ *
+ * @param arena_p The JobArena to initialise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void InitJobArena (JobArena *arena_p);
+
+
+/**
+ * Allocate some memory from a JobArena.
+ *
+ * @param arena_p The JobArena.
+ * @param size The number of bytes to allocate.
+ * @return The memory, which is valid until the arena is next reset or cleared,
+ * or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void *AllocFromJobArena (JobArena *arena_p, const size_t size);
+
+
+/**
+ * Concatenate a NULL-terminated list of strings into a JobArena.
+ *
+ * @param arena_p The JobArena.
+ * @return The concatenated string or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL char *ConcatenateVarargsStringsInJobArena (JobArena *arena_p, ...);
+
+
+/**
+ * Replace every occurrence of one substring with another.
+ *
+ * @param arena_p The JobArena to allocate the new string from.
+ * @param src_s The string to search.
+ * @param to_find_s The substring to replace.
+ * @param replacement_s The replacement.
+ * @return src_s itself if it does not contain to_find_s, the new string
+ * from the arena if it does, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL const char *SearchAndReplaceInStringInJobArena (JobArena *arena_p, const char *src_s, const char *to_find_s, const char *replacement_s);
+
+
+/**
+ * Release all of the allocations made from a JobArena at once.
+ * Its first chunk is kept to be reused.
+ *
+ * @param arena_p The JobArena.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ResetJobArena (JobArena *arena_p);
+
+
+/**
+ * Free all of the memory used by a JobArena.
+ *
+ * @param arena_p The JobArena.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ClearJobArena (JobArena *arena_p);
+
+
+/**
+ * Add the allocation counts for a JobArena to a ServiceJob's metadata.
+ *
+ * @param arena_p The JobArena.
+ * @param job_p The ServiceJob.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddJobArenaToServiceJob (const JobArena *arena_p, ServiceJob *job_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_ARENA_H_ */
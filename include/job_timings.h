@@ -0,0 +1,178 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * job_timings.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_TIMINGS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_TIMINGS_H_
+
+#include "parental_genotype_service_library.h"
+#include "jansson.h"
+#include "service_job.h"
+
+
+/**
+ * The stages of a search or submission that are timed.
+ */
+typedef enum JobTimingStage
+{
+	/** Getting the population ids for a parent from the varieties collection. */
+	JTS_VARIETIES_LOOKUP,
+
+	/** The per-id fetches of the populations for a parent. */
+	JTS_POPULATION_FETCH,
+
+	/** The query for all populations containing a given marker. */
+	JTS_MARKER_FETCH,
+
+	/** Merging the results that belong to the same population. */
+	JTS_AMALGAMATION,
+
+	/** Converting the escaped marker names back to their original form. */
+	JTS_UNESCAPE_KEYS,
+
+	/** Wrapping each result up as a DataResource and adding it to the ServiceJob. */
+	JTS_RESULT_WRAPPING,
+
+	/** Building the population document from the submitted table. */
+	JTS_BUILD_MARKERS,
+
+	/** Converting the population document to BSON and saving it. */
+	JTS_SAVE_MARKERS,
+
+	/** Adding the population id to each of its parents. */
+	JTS_SAVE_VARIETIES,
+
+	/** Writing each progeny's genotypes to the progeny collection. */
+	JTS_SAVE_PROGENY,
+
+	/** Calculating and saving the segregation statistics for each marker. */
+	JTS_SAVE_MARKER_STATS,
+
+	/** Finding and saving the recombination breakpoints for each progeny. */
+	JTS_SAVE_BREAKPOINTS,
+
+	/** Encoding and saving the haplotype blocks for each progeny. */
+	JTS_SAVE_HAPLOTYPE_BLOCKS,
+
+	/** The number of stages, this must be the last entry. */
+	JTS_NUM_STAGES
+} JobTimingStage;
+
+
+/**
+ * The timers and counters recorded for a single ServiceJob.
+ *
+ * If jt_enabled_flag is false, all of the functions that
+ * operate on this are no-ops.
+ */
+typedef struct JobTimings
+{
+	/** Are the timers switched on? */
+	bool jt_enabled_flag;
+
+	/** The accumulated time in nanoseconds for each stage. */
+	uint64 jt_stage_times [JTS_NUM_STAGES];
+
+	/** The number of times that each stage was run. */
+	uint32 jt_stage_calls [JTS_NUM_STAGES];
+
+	/** The number of queries sent to the database. */
+	uint32 jt_round_trips;
+
+	/** The number of documents returned by the database. */
+	uint64 jt_docs_fetched;
+
+	/** The approximate number of bytes returned by the database. */
+	uint64 jt_bytes_fetched;
+} JobTimings;
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+PARENTAL_GENOTYPE_SERVICE_LOCAL void InitJobTimings (JobTimings *timings_p, const bool enabled_flag);
+
+
+/**
+ * Start timing a stage.
+ *
+ * @param timings_p The JobTimings to use.
+ * @return The start time to pass to StopJobTimer () or 0 if
+ * timing is disabled.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint64 StartJobTimer (const JobTimings *timings_p);
+
+
+PARENTAL_GENOTYPE_SERVICE_LOCAL void StopJobTimer (JobTimings *timings_p, const JobTimingStage stage, const uint64 start_time);
+
+
+/**
+ * Get the current value of the monotonic clock.
+ *
+ * @return The time in nanoseconds from an arbitrary starting point.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint64 GetMonotonicTimeInNanoseconds (void);
+
+
+/**
+ * Record a database query and the documents that it returned.
+ *
+ * The number of round trips and documents are always counted, the
+ * number of bytes is only calculated if timing is enabled.
+ *
+ * @param timings_p The JobTimings to update.
+ * @param results_p The array of documents returned by the query. This can be
+ * <code>NULL</code> if the query failed.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddMongoFetchToJobTimings (JobTimings *timings_p, const json_t *results_p);
+
+
+/**
+ * Record a database query whose documents were read directly
+ * from the cursor rather than converted to JSON.
+ *
+ * @param timings_p The JobTimings to update.
+ * @param num_docs The number of documents returned by the query.
+ * @param num_bytes The total size of the BSON documents.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddBSONFetchToJobTimings (JobTimings *timings_p, const uint64 num_docs, const uint64 num_bytes);
+
+
+/**
+ * Store the recorded timings and counters in the metadata of a ServiceJob.
+ *
+ * @param timings_p The JobTimings to store.
+ * @param job_p The ServiceJob whose metadata will be updated.
+ * @return <code>true</code> if the timings were added successfully or if
+ * timing is disabled, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddJobTimingsToServiceJob (const JobTimings *timings_p, ServiceJob *job_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_JOB_TIMINGS_H_ */
@@ -0,0 +1,91 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * marker_index.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_INDEX_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_INDEX_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load the in-memory dictionary of marker names from the populations
+ * collection.
+ *
+ * The dictionary is shared by all of the services in this process so it
+ * is only read from the database the first time that this is called.
+ * Each successful call must be balanced by a call to ReleaseMarkerIndex ().
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the dictionary is available, <code>false</code>
+ * otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool LoadMarkerIndex (ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Release a reference to the in-memory dictionary of marker names. The
+ * memory is freed when the last reference is released.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ReleaseMarkerIndex (void);
+
+
+/**
+ * Add the markers of a newly-saved population to the in-memory dictionary.
+ * This does nothing if the dictionary has not been loaded.
+ *
+ * @param id_p The id of the population.
+ * @param name_s The name of the population.
+ * @param doc_p The population document. Each of its child objects is a marker
+ * keyed by its escaped name.
+ * @return <code>true</code> if the markers were added successfully or the
+ * dictionary is not in use, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddPopulationToMarkerIndex (const bson_oid_t *id_p, const char *name_s, const json_t *doc_p);
+
+
+/**
+ * Find the markers that match a given prefix or wildcard pattern.
+ *
+ * @param pattern_s The pattern to match. If this contains '*' or '?' it is treated
+ * as a shell-style wildcard pattern, otherwise it is a prefix.
+ * @param max_results The maximum number of markers to return.
+ * @param num_matches_p If this is not <code>NULL</code>, it will be set to the number of
+ * markers that matched, which may be greater than the number returned.
+ * @return A newly-allocated JSON array of objects containing the marker name and the names
+ * of the populations that contain it, or <code>NULL</code> if the dictionary is not
+ * available or upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *SearchMarkerIndex (const char *pattern_s, const size_t max_results, size_t *num_matches_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_INDEX_H_ */
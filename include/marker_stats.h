@@ -0,0 +1,102 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * marker_stats.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_STATS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_STATS_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+/**
+ * The filters for a marker statistics query. Any of them can be
+ * <code>NULL</code> to not filter on that field.
+ */
+typedef struct MarkerStatsFilter
+{
+	/** Only get the markers in the population with this name. */
+	const char *msf_population_s;
+
+	/** Only get the markers on this chromosome. */
+	const char *msf_chromosome_s;
+
+	/** Only get the markers with at most this proportion of missing calls. */
+	const double64 *msf_max_missing_rate_p;
+
+	/** Only get the markers with at most this proportion of heterozygous calls. */
+	const double64 *msf_max_heterozygosity_p;
+
+	/**
+	 * Only get the markers whose segregation distortion test has
+	 * at least this p-value.
+	 */
+	const double64 *msf_min_p_value_p;
+} MarkerStatsFilter;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Calculate the segregation statistics for each marker in a population
+ * and write them to the marker statistics collection.
+ *
+ * Each progeny call is counted as parent A's genotype, parent B's
+ * genotype, heterozygous or missing. From these counts come the
+ * heterozygosity, the missing rate and a chi-square test of the
+ * parental classes against the 1:1 ratio expected without
+ * segregation distortion.
+ *
+ * @param id_p The id of the population.
+ * @param population_s The name of the population.
+ * @param population_p The whole population document.
+ * @param parents_p The parents' genotypes for each marker from
+ * GetParentGenotypesByMarker().
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the statistics were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SaveMarkerStats (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the segregation statistics for the markers that pass the given filters.
+ *
+ * @param filter_p The filters to use.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array of the statistics for each matching
+ * marker, sorted by population, chromosome and marker, or <code>NULL</code>
+ * upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetMarkerStats (const MarkerStatsFilter *filter_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MARKER_STATS_H_ */
@@ -0,0 +1,113 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * matrix_export.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MATRIX_EXPORT_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MATRIX_EXPORT_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+#include "result_spool.h"
+
+
+/**
+ * The file formats that populations can be exported as.
+ */
+typedef enum ExportFormat
+{
+	/** Tab-separated with the genotypes as they were submitted. */
+	EF_TSV,
+
+	/** Comma-separated with the genotypes as they were submitted. */
+	EF_CSV,
+
+	/**
+	 * Comma-separated with each genotype coded as A or B for the matching
+	 * parent, H for any other call and - for a missing call, which is
+	 * R/qtl's rotated "csvr" layout.
+	 */
+	EF_ABH,
+
+	/**
+	 * An Arrow IPC file with the same columns as EF_TSV. Each progeny
+	 * column is dictionary-encoded and missing calls are nulls. The
+	 * file is spooled in base64-encoded parts which can be decoded
+	 * separately or joined and then decoded in one go.
+	 */
+	EF_ARROW
+} ExportFormat;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Export populations as marker by progeny matrices, with one per
+ * population. Each matrix is written to a spool in parts of a fixed
+ * size, so only one part is held in memory at a time, and is then
+ * collected page by page with the spool's token.
+ *
+ * Each matrix has a header row of "marker", "chromosome", "mapping_position"
+ * and then the progeny accessions, followed by a row for each marker
+ * sorted by chromosome and then by mapping position. For EF_ARROW these
+ * are the names of the columns and each marker is a row of the table.
+ * The populations are read one at a time straight from the database
+ * cursor rather than being converted to JSON first.
+ *
+ * Each spooled part has the population's name, its "part" number,
+ * counting from 0, and the part of the matrix as "data". Joining the
+ * parts back together in order gives the whole matrix. A text part
+ * ends with a complete row wherever a row fits within a part. For
+ * EF_ARROW, each part is base64-encoded and its "encoding" is "base64".
+ *
+ * @param population_s If this is not <code>NULL</code> or empty, only the
+ * population with this name is exported.
+ * @param markers_s If this is not <code>NULL</code> or empty, only these
+ * markers, separated by commas or whitespace, are exported from each
+ * population that has at least one of them.
+ * @param chromosome_s If this is not <code>NULL</code> or empty, only the
+ * markers on this chromosome are exported.
+ * @param start_p If this is not <code>NULL</code>, only the markers with a
+ * mapping position of at least this value are exported.
+ * @param end_p If this is not <code>NULL</code>, only the markers with a
+ * mapping position of at most this value are exported.
+ * @param format The format of the matrices.
+ * @param spool_p The ResultSpool to write the matrices to. The caller
+ * needs to call FinishResultSpool () afterwards to get the token.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the export.
+ * @return A newly-allocated JSON array with an entry for each exported
+ * population giving its name, the number of markers and progeny and the
+ * number of parts, "num_parts", that its matrix was spooled in, or
+ * <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *ExportPopulationMatrices (const char *population_s, const char *markers_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, const ExportFormat format, ResultSpool *spool_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_MATRIX_EXPORT_H_ */
@@ -0,0 +1,143 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * parent_genotypes.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PARENT_GENOTYPES_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PARENT_GENOTYPES_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+/**
+ * The classes that a progeny's call at a marker can fall into,
+ * relative to the genotypes of the population's parents.
+ */
+typedef enum GenotypeClass
+{
+	/** The call is the same as parent A's genotype. */
+	GC_PARENT_A,
+
+	/** The call is the same as parent B's genotype. */
+	GC_PARENT_B,
+
+	/** The call is neither missing nor either parent's genotype. */
+	GC_HETEROZYGOUS,
+
+	/** The call is missing. */
+	GC_MISSING,
+
+	/** The number of classes, this must be the last entry. */
+	GC_NUM_CLASSES
+} GenotypeClass;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Save the genotypes of both parents of a population along with the set
+ * of markers where they differ.
+ *
+ * The markers, their chromosomes and mapping positions and the two parents'
+ * genotypes are stored as parallel arrays in a single document with the
+ * same id as the population. The polymorphic markers are stored as a bitset
+ * with bit i set if the parents have different, non-missing, genotypes
+ * for marker i.
+ *
+ * @param id_p The id of the population.
+ * @param population_s The name of the population.
+ * @param doc_p The population document, or just the new markers when appending.
+ * @param parent_a_row_p The row of the submitted table with parent A's genotypes.
+ * @param parent_b_row_p The row of the submitted table with parent B's genotypes.
+ * @param append_flag If this is <code>true</code> then the markers are merged
+ * into the population's existing parent genotypes rather than replacing them.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the parent genotypes were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SaveParentGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, const bool append_flag, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the markers that are polymorphic between the parents of a population.
+ *
+ * @param population_s The name of the population.
+ * @param chromosome_s If this is not <code>NULL</code> or empty, only the markers
+ * on this chromosome are returned.
+ * @param start_p If this is not <code>NULL</code>, only the markers with a mapping
+ * position of at least this value are returned.
+ * @param end_p If this is not <code>NULL</code>, only the markers with a mapping
+ * position of at most this value are returned.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array with an entry for each population with the
+ * given name, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetPolymorphicMarkers (const char *population_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+/**
+ * Get the genotypes of both parents for each marker in a population.
+ *
+ * @param id_p The id of the population.
+ * @param data_p The configuration data for the service.
+ * @return A newly-allocated JSON object mapping each escaped marker name
+ * to an array of parent A's and parent B's genotypes, or <code>NULL</code>
+ * upon error. This is empty for populations that were submitted before
+ * the parent genotypes were stored.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetParentGenotypesByMarker (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the genotypes to compare a marker's progeny calls against.
+ *
+ * If either parent's genotype is missing, or they are the same, the
+ * calls can't be told apart by parent so they are treated as being
+ * ABH-coded and the genotypes are set to "A" and "B".
+ *
+ * @param parent_a_ss Parent A's genotype, which may be updated.
+ * @param parent_b_ss Parent B's genotype, which may be updated.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ResolveParentGenotypes (const char **parent_a_ss, const char **parent_b_ss);
+
+
+/**
+ * Get the class of a progeny's call at a marker.
+ *
+ * @param genotype_s The call.
+ * @param parent_a_s Parent A's genotype from ResolveParentGenotypes().
+ * @param parent_b_s Parent B's genotype from ResolveParentGenotypes().
+ * @return The GenotypeClass.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL GenotypeClass GetGenotypeClass (const char *genotype_s, const char *parent_a_s, const char *parent_b_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PARENT_GENOTYPES_H_ */
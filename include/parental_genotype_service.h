@@ -28,6 +28,26 @@ PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_VARIETY_IDS_S PARENTAL_GENOTYPE
 
 PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_ESCAPED_DOT_S PARENTAL_GENOTYPE_SERVICE_VAL ("[dot]");
 
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_ACCESSION_S PARENTAL_GENOTYPE_SERVICE_VAL ("accession");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_POPULATION_ID_S PARENTAL_GENOTYPE_SERVICE_VAL ("population_id");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_POPULATION_S PARENTAL_GENOTYPE_SERVICE_VAL ("population");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_GENOTYPES_S PARENTAL_GENOTYPE_SERVICE_VAL ("genotypes");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_MARKER_S PARENTAL_GENOTYPE_SERVICE_VAL ("marker");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_BREAKPOINTS_S PARENTAL_GENOTYPE_SERVICE_VAL ("breakpoints");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_REVISION_S PARENTAL_GENOTYPE_SERVICE_VAL ("revision");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_CLAIMED_NAME_S PARENTAL_GENOTYPE_SERVICE_VAL ("claimed_name");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_HAPLOTYPE_BLOCKS_ONLY_S PARENTAL_GENOTYPE_SERVICE_VAL ("haplotype_blocks_only");
+
+PARENTAL_GENOTYPE_SERVICE_PREFIX const char *PGS_MARKERS_S PARENTAL_GENOTYPE_SERVICE_VAL ("markers");
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -58,6 +78,42 @@ PARENTAL_GENOTYPE_SERVICE_API void ReleaseServices (ServicesArray *services_p);
 
 PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddErrorMessage (ServiceJob *job_p, const json_t *value_p, const char *error_s, const int index);
 
+
+/**
+ * Check whether a key within a marker object is one of the marker's
+ * own fields rather than the name of an accession.
+ *
+ * @param key_s The key to check.
+ * @return <code>true</code> if the key is a marker field, <code>false</code>
+ * if it is an accession.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool IsMarkerMetadataKey (const char *key_s);
+
+
+/**
+ * Check whether a top-level entry in a population document is a marker.
+ *
+ * Each marker is an object, whereas the name and parents are not. The
+ * id of a document built for submission is also an object so that
+ * is skipped explicitly.
+ *
+ * @param key_s The key of the entry.
+ * @param value_p The value of the entry.
+ * @return <code>true</code> if the entry is a marker, <code>false</code>
+ * otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool IsMarkerEntry (const char *key_s, const json_t *value_p);
+
+
+/**
+ * Check whether a genotype call is missing.
+ *
+ * @param genotype_s The genotype to check.
+ * @return <code>true</code> if the genotype is <code>NULL</code>, empty,
+ * "-" or "NA", <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool IsMissingGenotype (const char *genotype_s);
+
 #ifdef __cplusplus
 }
 #endif
@@ -33,6 +33,8 @@
 
 #include "service.h"
 #include "mongodb_tool.h"
+#include "service_metrics.h"
+#include "job_arena.h"
 
 
 
@@ -80,6 +82,184 @@ typedef struct /*PARENTAL_GENOTYPE_SERVICE_LOCAL*/ ParentalGenotypeServiceData
 
 	json_t *pgsd_name_mappings_p;
 
+
+	/**
+	 * @private
+	 *
+	 * Should the time taken for each stage of a job be recorded in
+	 * its metadata?
+	 */
+	bool pgsd_timings_flag;
+
+
+	/**
+	 * @private
+	 *
+	 * The process-wide counters that are shared between the
+	 * search and submission services.
+	 */
+	ServiceMetrics *pgsd_metrics_p;
+
+
+	/**
+	 * @private
+	 *
+	 * Does this service hold a reference to the in-memory
+	 * dictionary of marker names?
+	 */
+	bool pgsd_marker_index_flag;
+
+
+	/**
+	 * @private
+	 *
+	 * The maximum number of markers to return from a prefix search.
+	 */
+	uint32 pgsd_marker_index_max_results;
+
+
+	/**
+	 * @private
+	 *
+	 * Does this service hold a reference to the in-memory Bloom
+	 * filters of each population's marker names?
+	 */
+	bool pgsd_population_filters_flag;
+
+
+	/**
+	 * @private
+	 *
+	 * Should identical searches that run at the same time share
+	 * a single set of database queries?
+	 */
+	bool pgsd_coalesce_searches_flag;
+
+
+	/**
+	 * @private
+	 *
+	 * The default maximum time, in milliseconds, that a search can take
+	 * before returning what it has found so far. 0 means no limit.
+	 */
+	uint32 pgsd_search_timeout_ms;
+
+
+	/**
+	 * @private
+	 *
+	 * The number of bytes of results that a single job can keep in
+	 * memory before the rest are written to a temporary file.
+	 * 0 means no limit.
+	 */
+	uint64 pgsd_result_budget;
+
+
+	/**
+	 * @private
+	 *
+	 * The directory where results that are over budget are written.
+	 */
+	const char *pgsd_spool_directory_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The number of seconds that spooled results are kept for if
+	 * they are not collected. 0 means until they are collected.
+	 */
+	uint32 pgsd_spool_expiry_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The collection holding a small summary document for
+	 * each population.
+	 */
+	const char *pgsd_summaries_collection_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The collection holding the genotypes of each progeny line,
+	 * with one document per line in each population.
+	 */
+	const char *pgsd_progeny_collection_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The collection holding the parental genotypes of each population
+	 * along with which of its markers are polymorphic between the parents.
+	 */
+	const char *pgsd_parent_genotypes_collection_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The collection holding the segregation statistics of each marker,
+	 * with one document per marker in each population.
+	 */
+	const char *pgsd_marker_stats_collection_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The collection holding each population's progeny calls as
+	 * run-length encoded haplotype blocks along the map.
+	 */
+	const char *pgsd_haplotype_blocks_collection_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The maximum number of threads to use for each recombination matrix.
+	 */
+	uint32 pgsd_recombination_threads;
+
+
+	/**
+	 * @private
+	 *
+	 * The maximum number of markers on a chromosome that a recombination
+	 * matrix can be calculated for, since its size grows with the square
+	 * of this.
+	 */
+	uint32 pgsd_recombination_max_markers;
+
+
+	/**
+	 * @private
+	 *
+	 * The maximum number of threads to use to match a genotype pattern
+	 * against the populations.
+	 */
+	uint32 pgsd_pattern_threads;
+
+
+	/**
+	 * @private
+	 *
+	 * The directory that genotype files can be submitted from. If this
+	 * is <code>NULL</code>, only tables can be submitted.
+	 */
+	const char *pgsd_import_directory_s;
+
+
+	/**
+	 * @private
+	 *
+	 * The maximum number of threads to use to parse a VCF file.
+	 */
+	uint32 pgsd_import_threads;
+
 } ParentalGenotypeServiceData;
 
 
@@ -115,6 +295,34 @@ PARENTAL_GENOTYPE_SERVICE_LOCAL void FreeParentalGenotypeServiceData (ParentalGe
 
 PARENTAL_GENOTYPE_SERVICE_LOCAL bool ConfigureParentalGenotypeService (ParentalGenotypeServiceData *data_p, GrassrootsServer *grassroots_p);
 
+
+/**
+ * Get the accession to store a progeny line under, using the service's
+ * configured name mappings. For instance, a mapping of "Paragon x Watkins 1190"
+ * to "ParW" would turn "Paragon x Watkins 1190123" into "ParW123".
+ *
+ * @param accession_s The accession as it was submitted.
+ * @param data_p The configuration data for the service.
+ * @param arena_p The JobArena to allocate any renamed accession from.
+ * @return The accession to use, which is accession_s itself if no mappings
+ * apply, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL const char *GetMappedAccession (const char *accession_s, const ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+
+/**
+ * Get the full path of a file that has been submitted for import.
+ *
+ * Relative paths are taken from the service's import directory and any
+ * path that resolves to somewhere outside of it is rejected.
+ *
+ * @param filename_s The submitted path.
+ * @param data_p The configuration data for the service.
+ * @return The newly-allocated full path, which should be freed with
+ * FreeCopiedString (), or <code>NULL</code> if the file can't be imported.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL char *GetImportFilePath (const char *filename_s, const ParentalGenotypeServiceData *data_p);
+
 #ifdef __cplusplus
 }
 #endif
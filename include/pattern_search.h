@@ -0,0 +1,124 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * pattern_search.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PATTERN_SEARCH_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PATTERN_SEARCH_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "parent_genotypes.h"
+#include "search_deadline.h"
+#include "job_arena.h"
+
+
+/**
+ * A single marker and the call that a progeny line must have there.
+ */
+typedef struct PatternTerm
+{
+	/** The escaped name of the marker. */
+	const char *pt_marker_s;
+
+	/** The call as it was given in the pattern. */
+	const char *pt_genotype_s;
+
+	/**
+	 * The class of call to match, relative to each population's parents.
+	 * If this is GC_NUM_CLASSES, the call must be pt_genotype_s exactly.
+	 */
+	GenotypeClass pt_class;
+} PatternTerm;
+
+
+/**
+ * A multi-marker genotype pattern that a progeny line must match
+ * at every one of its markers.
+ */
+typedef struct GenotypePattern
+{
+	PatternTerm *gp_terms_p;
+
+	uint32 gp_num_terms;
+
+	/** The arena that the terms and their strings are allocated from. */
+	JobArena gp_arena;
+} GenotypePattern;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Parse a genotype pattern.
+ *
+ * The pattern is a list of marker=call pairs separated by commas, semicolons
+ * or new lines, e.g. "BS00021805=B, BS00022391=B". A call of "A" or "B"
+ * matches the lines with the genotype of that parent of each population,
+ * "H" matches any other non-missing call and "-" matches a missing call.
+ * Any other call has to match exactly.
+ *
+ * @param pattern_s The pattern to parse.
+ * @return The newly-allocated GenotypePattern which should be freed with
+ * FreeGenotypePattern (), or <code>NULL</code> if the pattern is empty or
+ * invalid.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL GenotypePattern *ParseGenotypePattern (const char *pattern_s);
+
+
+/**
+ * Free a GenotypePattern.
+ *
+ * @param pattern_p The GenotypePattern to free.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void FreeGenotypePattern (GenotypePattern *pattern_p);
+
+
+/**
+ * Find the progeny lines that match a genotype pattern across all of the
+ * populations that have every one of its markers.
+ *
+ * Only the pattern's markers are fetched from each population. Each marker's
+ * matching lines are then packed into a bitset and the bitsets are ANDed
+ * together, with the populations shared between up to
+ * pgsd_pattern_threads threads.
+ *
+ * @param pattern_p The pattern to match.
+ * @param population_s If this is not <code>NULL</code> or empty, only the
+ * populations with this name or with this as one of their parents are searched.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the search.
+ * @return A newly-allocated JSON array with an entry for each population
+ * that has at least one matching line, or <code>NULL</code> upon error.
+ * Each entry has the population's name and parents, the number of lines
+ * that were checked and the accessions of the matching lines.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetProgenyMatchingPattern (const GenotypePattern *pattern_p, const char *population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PATTERN_SEARCH_H_ */
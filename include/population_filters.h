@@ -0,0 +1,120 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * population_filters.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_FILTERS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_FILTERS_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Load a Bloom filter of the escaped marker names for each of the
+ * populations in the populations collection.
+ *
+ * The filters are shared by all of the services in this process so they
+ * are only built from the database the first time that this is called.
+ * Each successful call must be balanced by a call to ReleasePopulationFilters ().
+ *
+ * The filters are only ever used to skip the populations that are known
+ * not to have a marker. Any population without a filter, such as one saved
+ * by another process, is always searched. Each filter also records the
+ * population's revision, which is increased on every append, so a
+ * population that has been changed since its filter was built is
+ * searched too.
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the filters are available, <code>false</code>
+ * otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool LoadPopulationFilters (ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Release a reference to the population filters. The memory is freed
+ * when the last reference is released.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void ReleasePopulationFilters (void);
+
+
+/**
+ * Add the markers of a newly-saved population to its filter. If the
+ * population already has a filter, such as when it is being appended to,
+ * the markers are added to the existing one. This does nothing if the
+ * filters have not been loaded.
+ *
+ * @param id_p The id of the population.
+ * @param doc_p The population document. Each of its child objects is a marker
+ * keyed by its escaped name.
+ * @param revision The population's revision after it was saved. This is 0 for
+ * a population that has never been appended to. If an existing filter is not
+ * at the previous revision, the population has also been changed elsewhere so
+ * its filter is no longer used to skip it.
+ * @return <code>true</code> if the markers were added successfully or the
+ * filters are not in use, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddPopulationToFilters (const bson_oid_t *id_p, const json_t *doc_p, const int64 revision);
+
+
+/**
+ * Stop a query for a single population from returning it if its filter
+ * shows that it doesn't have a given marker.
+ *
+ * A "$nor" clause is added to the query that matches the population as
+ * long as it is still at the revision that its filter was built from.
+ *
+ * @param query_p The query to add the clause to.
+ * @param id_p The id of the population.
+ * @param escaped_marker_s The escaped name of the marker.
+ * @return 1 if the clause was added, 0 if the population might have the
+ * marker so the query is left unchanged, or -1 upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL int32 AddPopulationFilterToQuery (bson_t *query_p, const bson_oid_t *id_p, const char *escaped_marker_s);
+
+
+/**
+ * Stop a query from returning the populations whose filters show that
+ * they don't have a given marker.
+ *
+ * A "$nor" clause is added to the query with each of these populations at
+ * the revision that its filter was built from. The query still returns any
+ * populations that don't have a filter or that have changed since.
+ *
+ * @param query_p The query to add the clause to.
+ * @param escaped_marker_s The escaped name of the marker.
+ * @return The number of populations that were excluded, 0 if there were
+ * none so the query is left unchanged, or -1 upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL int32 AddPopulationFiltersToQuery (bson_t *query_p, const char *escaped_marker_s);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_FILTERS_H_ */
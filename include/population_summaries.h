@@ -0,0 +1,97 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * population_summaries.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_SUMMARIES_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_SUMMARIES_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Write the summary for a population to the summaries collection,
+ * replacing any previous summary for it.
+ *
+ * The summary has the same id as the population and holds its name,
+ * parents, the number of markers and progeny, the sorted list of
+ * chromosomes that its markers are on and the size of the population
+ * document in bytes.
+ *
+ * @param population_p The full population document.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the summary was saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SavePopulationSummary (const bson_t *population_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Read a population back from the database and write its summary. This
+ * is used after appending to a population since only the new markers
+ * and progeny are available at that point.
+ *
+ * @param id_p The id of the population.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if the summary was saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool RefreshPopulationSummary (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Write the summaries for all of the populations that are already in
+ * the database, such as those that were submitted before the summaries
+ * collection was added.
+ *
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the summaries were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool RebuildPopulationSummaries (ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the population summaries, sorted by population name.
+ *
+ * @param name_s If this is not <code>NULL</code> or empty, only the summaries
+ * for the population with this name or with this variety as one of its
+ * parents are returned.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array of the summaries or <code>NULL</code>
+ * upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetPopulationSummaries (const char *name_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_POPULATION_SUMMARIES_H_ */
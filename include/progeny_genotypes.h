@@ -0,0 +1,77 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * progeny_genotypes.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PROGENY_GENOTYPES_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PROGENY_GENOTYPES_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "search_deadline.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Write the genotypes of each progeny line in a population to the
+ * progeny collection.
+ *
+ * The population document stores the genotypes by marker and then by
+ * accession. This transposes them so that there is a document for each
+ * accession with its genotypes keyed by escaped marker name. The markers
+ * are merged into any existing document for the same population and
+ * accession, so this works for appends as well as new populations.
+ *
+ * @param id_p The id of the population.
+ * @param population_s The name of the population.
+ * @param doc_p The population document, or just the new markers
+ * and progeny when appending.
+ * @param data_p The configuration data for the service.
+ * @return <code>true</code> if all of the progeny were saved successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SaveProgenyGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, ParentalGenotypeServiceData *data_p);
+
+
+/**
+ * Get the genotypes for a progeny line.
+ *
+ * @param accession_s The accession of the progeny line.
+ * @param population_s If this is not <code>NULL</code> or empty, only the
+ * genotypes from the population with this name are returned.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the query.
+ * @return A newly-allocated JSON array with a document for each population
+ * that the line is in, or <code>NULL</code> upon error. The marker names
+ * in the genotypes are still escaped.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetProgenyGenotypes (const char *accession_s, const char *population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_PROGENY_GENOTYPES_H_ */
@@ -0,0 +1,70 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * recombination_matrix.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RECOMBINATION_MATRIX_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RECOMBINATION_MATRIX_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "compact_format.h"
+#include "search_deadline.h"
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Count the recombinants between every pair of markers on a chromosome.
+ *
+ * Each marker's progeny calls are encoded as two bitsets, one for the
+ * progeny with parent A's genotype and one for those with parent B's.
+ * For each pair of markers, the progeny that are informative are those
+ * with a parental genotype at both, and the recombinants are those whose
+ * parental genotype differs between them. Both are counted a word at a
+ * time with popcount. Large chromosomes have their rows split between
+ * several threads.
+ *
+ * The counts are returned as flattened upper triangles in map order, so
+ * the pair of markers i and j, where i < j, is at
+ * (i * (2n - i - 1) / 2) + (j - i - 1) for n markers. The recombination
+ * fraction for a pair is its recombinants divided by its informative
+ * progeny.
+ *
+ * @param population_s The name of the population.
+ * @param chromosome_s The chromosome.
+ * @param format If this is RF_COMPACT_GZIP, each matrix is compressed.
+ * @param data_p The configuration data for the service.
+ * @param deadline_p The deadline for the search.
+ * @return A newly-allocated JSON array with a matrix for each population
+ * with the given name, or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *GetRecombinationMatrices (const char *population_s, const char *chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RECOMBINATION_MATRIX_H_ */
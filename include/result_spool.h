@@ -0,0 +1,171 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * result_spool.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RESULT_SPOOL_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RESULT_SPOOL_H_
+
+#include <stdio.h>
+
+#include "parental_genotype_service_library.h"
+#include "jansson.h"
+#include "service_job.h"
+
+
+/**
+ * Keeps track of how much memory the results of a ServiceJob use
+ * and, once they go over budget, writes any further results to a
+ * temporary file rather than keeping them in memory.
+ */
+typedef struct ResultSpool
+{
+	/** The number of bytes of results to keep in memory, 0 means no limit. */
+	uint64 rs_budget;
+
+	/** The number of bytes of results kept in memory so far. */
+	uint64 rs_used;
+
+	/** The directory to write the file to. */
+	const char *rs_directory_s;
+
+	/** The number of seconds that an uncollected file is kept for, 0 means forever. */
+	uint32 rs_expiry_s;
+
+	/** The file that results are written to once over budget. */
+	FILE *rs_file_f;
+
+	/** The name of rs_file_f. */
+	char *rs_filename_s;
+
+	/** The number of results written to rs_file_f. */
+	uint32 rs_num_spooled;
+
+	/** The number of bytes written to rs_file_f. */
+	uint64 rs_spooled_bytes;
+} ResultSpool;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Initialise a ResultSpool.
+ *
+ * @param spool_p The ResultSpool to initialise.
+ * @param budget The number of bytes of results to keep in memory. If this is 0,
+ * there is no limit.
+ * @param directory_s The directory to write any oversized results to.
+ * @param expiry_s The number of seconds after which any spool files in
+ * directory_s that have not been collected are deleted. If this is 0,
+ * they are kept until they are collected.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void InitResultSpool (ResultSpool *spool_p, const uint64 budget, const char *directory_s, const uint32 expiry_s);
+
+
+/**
+ * Add a result to a ServiceJob if it fits within the budget, or write
+ * it to the spool file otherwise.
+ *
+ * @param spool_p The ResultSpool.
+ * @param job_p The ServiceJob.
+ * @param result_p The result. Upon success, the ResultSpool takes ownership of this.
+ * @return <code>true</code> if the result was added or spooled successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddResultToResultSpool (ResultSpool *spool_p, ServiceJob *job_p, json_t *result_p);
+
+
+/**
+ * Write a result to the spool file whatever the budget is, for results
+ * that should always be collected page by page.
+ *
+ * @param spool_p The ResultSpool.
+ * @param result_p The result. Upon success, the ResultSpool takes ownership of this.
+ * @return <code>true</code> if the result was spooled successfully,
+ * <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool SpoolResult (ResultSpool *spool_p, json_t *result_p);
+
+
+/**
+ * Close the spool file, if there is one, and add its details to the
+ * ServiceJob's metadata under "spooled". These include a "token" that
+ * can be passed to AddSpooledResultsToServiceJob () to collect the
+ * spooled results.
+ *
+ * @param spool_p The ResultSpool.
+ * @param job_p The ServiceJob.
+ * @return <code>true</code> if successful, <code>false</code> if the
+ * spooled results could not be added.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool FinishResultSpool (ResultSpool *spool_p, ServiceJob *job_p);
+
+
+/**
+ * Close and delete the spool file, if there is one, without adding
+ * its token to a ServiceJob, e.g. if the spooled results are no use
+ * because the job has failed.
+ *
+ * @param spool_p The ResultSpool.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void DiscardResultSpool (ResultSpool *spool_p);
+
+
+/**
+ * Add the next page of results from a spool file to a ServiceJob.
+ *
+ * If there are more results after this page, a new token for them is
+ * added to the ServiceJob's metadata under "spooled". Otherwise, the
+ * spool file is deleted.
+ *
+ * @param token_s The token from a previous ServiceJob's "spooled" metadata.
+ * @param budget The number of bytes of results to add. If this is 0, all
+ * of the remaining results are added.
+ * @param directory_s The directory that the spool files are written to.
+ * @param expiry_s The number of seconds after which any uncollected spool
+ * files are deleted, 0 means never.
+ * @param job_p The ServiceJob to add the results to.
+ * @return <code>true</code> if the results were added successfully,
+ * <code>false</code> if the token is invalid, the results have expired or
+ * they could not be read.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddSpooledResultsToServiceJob (const char *token_s, const uint64 budget, const char *directory_s, const uint32 expiry_s, ServiceJob *job_p);
+
+
+/**
+ * Check whether some of a ServiceJob's results were written to a
+ * spool file rather than added to the ServiceJob.
+ *
+ * @param job_p The ServiceJob.
+ * @return <code>true</code> if the ServiceJob has a "spooled" token,
+ * <code>false</code> if all of its results are in the ServiceJob.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool HasSpooledResults (const ServiceJob *job_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_RESULT_SPOOL_H_ */
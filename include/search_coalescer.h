@@ -0,0 +1,101 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * search_coalescer.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_COALESCER_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_COALESCER_H_
+
+#include "parental_genotype_service_library.h"
+#include "operation.h"
+#include "search_deadline.h"
+#include "jansson.h"
+
+
+/**
+ * A search that is currently being run. Any identical searches
+ * that arrive while it is running wait for its results rather than
+ * running their own.
+ */
+typedef struct InFlightSearch InFlightSearch;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Join the search for the given key, starting it if no identical
+ * search is currently running.
+ *
+ * Each successful call must be balanced by a call to LeaveInFlightSearch ().
+ *
+ * @param key_s The normalised search parameters.
+ * @param leader_flag_p This will be set to <code>true</code> if the caller
+ * started the search and so must run it and then call PublishInFlightSearch (),
+ * or <code>false</code> if it should call WaitForInFlightSearch ().
+ * @return The search or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL InFlightSearch *JoinInFlightSearch (const char *key_s, bool *leader_flag_p);
+
+
+/**
+ * Share the results of a search with any callers that are waiting for it.
+ * After this, any new callers with the same key will start a new search.
+ *
+ * @param search_p The search.
+ * @param results_p The results to share. These are copied so the caller
+ * keeps ownership. If this is <code>NULL</code>, the waiting callers will
+ * need to run the search themselves.
+ * @param status The status of the search. The results are only shared if
+ * this is OS_SUCCEEDED, otherwise the waiting callers run the search themselves.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void PublishInFlightSearch (InFlightSearch *search_p, const json_t *results_p, const OperationStatus status);
+
+
+/**
+ * Wait for the leader of a search to publish its results.
+ *
+ * @param search_p The search.
+ * @param deadline_p The time by which the caller needs the results. If this
+ * passes first, its sd_expired_flag will be set.
+ * @param status_p Upon success, this will be set to the status of the search.
+ * @return A newly-allocated copy of the results or <code>NULL</code> if they
+ * are not available.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL json_t *WaitForInFlightSearch (InFlightSearch *search_p, SearchDeadline *deadline_p, OperationStatus *status_p);
+
+
+/**
+ * Release a reference to a search. It is freed once all of its
+ * callers have left.
+ *
+ * @param search_p The search.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void LeaveInFlightSearch (InFlightSearch *search_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_COALESCER_H_ */
@@ -0,0 +1,105 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * search_deadline.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_DEADLINE_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_DEADLINE_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+#include "bson.h"
+
+
+/**
+ * The time by which a search must finish.
+ */
+typedef struct SearchDeadline
+{
+	/**
+	 * The monotonic time, in nanoseconds, when the search must stop
+	 * or 0 if there is no limit.
+	 */
+	uint64 sd_end_time;
+
+	/**
+	 * This is set once the deadline has been found to have passed.
+	 */
+	bool sd_expired_flag;
+} SearchDeadline;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Start the clock for a search.
+ *
+ * @param deadline_p The SearchDeadline to initialise.
+ * @param timeout_ms The number of milliseconds that the search can run for.
+ * If this is 0, there is no limit.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void InitSearchDeadline (SearchDeadline *deadline_p, const uint32 timeout_ms);
+
+
+/**
+ * Get the timeout to use for a search.
+ *
+ * @param requested_ms_p The timeout, in milliseconds, asked for by the request
+ * or <code>NULL</code> if it didn't give one. If this is 0 or more than
+ * configured_ms, configured_ms is used instead.
+ * @param configured_ms The service's configured timeout, in milliseconds, where
+ * 0 means no limit.
+ * @return The timeout in milliseconds, or 0 if there is no limit.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint32 GetSearchTimeout (const uint32 *requested_ms_p, const uint32 configured_ms);
+
+
+/**
+ * Check whether a search has run out of time.
+ *
+ * @param deadline_p The SearchDeadline to check. Once this has passed,
+ * its sd_expired_flag is set.
+ * @return <code>true</code> if the deadline has passed, <code>false</code>
+ * otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool HasSearchDeadlinePassed (SearchDeadline *deadline_p);
+
+
+/**
+ * Get the options to limit a database query to the time that
+ * a search has left.
+ *
+ * @param deadline_p The SearchDeadline to use.
+ * @return The newly-allocated options containing "maxTimeMS", which the
+ * caller must free with bson_destroy (), or <code>NULL</code> if there is
+ * no limit.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bson_t *GetSearchDeadlineQueryOptions (SearchDeadline *deadline_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SEARCH_DEADLINE_H_ */
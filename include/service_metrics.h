@@ -0,0 +1,158 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * service_metrics.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SERVICE_METRICS_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SERVICE_METRICS_H_
+
+#include "parental_genotype_service_library.h"
+#include "typedefs.h"
+
+
+/**
+ * The different types of search that are counted separately.
+ */
+typedef enum MetricsSearchMode
+{
+	/** A marker search that returns just the matching marker. */
+	MSM_MARKER,
+
+	/** A population search without a marker. */
+	MSM_POPULATION,
+
+	/** A search for a marker within a population. */
+	MSM_MARKER_AND_POPULATION,
+
+	/** A marker search that returns the full populations. */
+	MSM_FULL_RECORD,
+
+	/** The number of modes, this must be the last entry. */
+	MSM_NUM_MODES
+} MetricsSearchMode;
+
+
+/**
+ * The upper bounds, in milliseconds, of the latency histogram buckets.
+ * There is also an implicit final "+Inf" bucket.
+ */
+#define PGS_NUM_LATENCY_BUCKETS (12)
+
+
+/**
+ * A latency histogram whose counters can be updated from
+ * multiple threads without locking.
+ */
+typedef struct LatencyHistogram
+{
+	/** The number of observations in each bucket, these are not cumulative. */
+	uint64 lh_buckets [PGS_NUM_LATENCY_BUCKETS + 1];
+
+	/** The total number of observations. */
+	uint64 lh_count;
+
+	/** The sum of all observations in microseconds. */
+	uint64 lh_sum_us;
+} LatencyHistogram;
+
+
+/**
+ * The process-wide counters for the Parental Genotype services.
+ *
+ * All of the members are updated with atomic operations so
+ * no locks are needed.
+ */
+typedef struct ServiceMetrics
+{
+	/** The number of searches for each mode. */
+	uint64 sm_searches [MSM_NUM_MODES];
+
+	/** The number of searches for each mode that did not succeed. */
+	uint64 sm_failed_searches [MSM_NUM_MODES];
+
+	/** The latencies for each search mode. */
+	LatencyHistogram sm_search_latencies [MSM_NUM_MODES];
+
+	/** The number of queries sent to the database. */
+	uint64 sm_mongo_round_trips;
+
+	/** The number of documents returned by the database. */
+	uint64 sm_mongo_documents;
+
+	/** The number of lookups that were answered from an in-memory cache. */
+	uint64 sm_cache_hits;
+
+	/** The number of lookups that had to go to the database. */
+	uint64 sm_cache_misses;
+
+	/** The number of submissions. */
+	uint64 sm_submissions;
+
+	/** The number of submissions that did not succeed. */
+	uint64 sm_failed_submissions;
+
+	/** The number of table rows that have been submitted successfully. */
+	uint64 sm_submission_rows;
+
+	/** The latencies of the submissions. */
+	LatencyHistogram sm_submission_latencies;
+} ServiceMetrics;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Get the ServiceMetrics shared by all of the Parental Genotype services
+ * in this process.
+ *
+ * @return The ServiceMetrics.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL ServiceMetrics *GetServiceMetrics (void);
+
+
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddSearchToServiceMetrics (ServiceMetrics *metrics_p, const MetricsSearchMode mode, const bool success_flag, const uint64 duration_ns, const uint32 round_trips, const uint64 num_docs);
+
+
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddSubmissionToServiceMetrics (ServiceMetrics *metrics_p, const bool success_flag, const uint64 duration_ns, const size_t num_rows, const uint32 round_trips, const uint64 num_docs);
+
+
+PARENTAL_GENOTYPE_SERVICE_LOCAL void AddCacheLookupToServiceMetrics (ServiceMetrics *metrics_p, const bool hit_flag);
+
+
+/**
+ * Get the current values of the metrics in the Prometheus text
+ * exposition format.
+ *
+ * @param metrics_p The ServiceMetrics to get the values from.
+ * @return The newly-allocated text which should be freed with
+ * FreeCopiedString () or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL char *GetServiceMetricsAsText (const ServiceMetrics *metrics_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_SERVICE_METRICS_H_ */
@@ -0,0 +1,135 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * vcf_file.h
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_VCF_FILE_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_VCF_FILE_H_
+
+#include "parental_genotype_service_data.h"
+#include "parental_genotype_service_library.h"
+#include "job_arena.h"
+
+
+/**
+ * A VCF file of a parental cross that has been read into memory.
+ *
+ * Each variant becomes a marker and each sample column becomes either
+ * one of the parents or a progeny line.
+ */
+typedef struct VCFFile VCFFile;
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Check whether a file starts with a VCF header line. Files that are
+ * gzip or BGZF compressed are checked once they are decompressed.
+ *
+ * @param filename_s The full path to the file.
+ * @return <code>true</code> if the file is a VCF file, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool IsVCFFile (const char *filename_s);
+
+
+/**
+ * Open a VCF file.
+ *
+ * The file is mapped into memory and its header is read to get the samples.
+ * Files that are gzip or BGZF compressed, such as .vcf.gz files, are
+ * instead decompressed a buffer at a time, so only the header and the
+ * start of the variants are read here.
+ *
+ * @param filename_s The full path to the file.
+ * @param parent_a_s The sample to use as Parent A. If this is <code>NULL</code>
+ * or empty, the first sample is used.
+ * @param parent_b_s The sample to use as Parent B. If this is <code>NULL</code>
+ * or empty, the second sample is used.
+ * @param map_filename_s The full path to a genetic map with a marker, chromosome
+ * and mapping position on each line. If this is <code>NULL</code>, the CHROM and
+ * POS of each variant are used instead. If it is given, any variants that aren't
+ * on the map are skipped.
+ * @return The newly-allocated VCFFile or <code>NULL</code> upon error.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL VCFFile *OpenVCFFile (const char *filename_s, const char *parent_a_s, const char *parent_b_s, const char *map_filename_s);
+
+
+/**
+ * Get the number of rows that a submitted table of the same data would have.
+ *
+ * @param vcf_p The VCFFile.
+ * @return The number of samples plus the chromosome and mapping position rows.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL size_t GetVCFFileNumRows (const VCFFile *vcf_p);
+
+
+/**
+ * Get the number of cells that a submitted table of the same data would have.
+ *
+ * @param vcf_p The VCFFile.
+ * @return The estimated number of cells, based upon the number of lines in the file.
+ * For compressed files, the lines are counted in the part that has been decompressed
+ * and scaled up by how much of the compressed file that took.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL uint64 GetVCFFileNumCells (const VCFFile *vcf_p);
+
+
+/**
+ * Add the variants in a VCF file to a population document.
+ *
+ * The file is split into chunks of whole lines which are parsed in
+ * parallel, a batch at a time, and then added to the document in file
+ * order. For compressed files, each batch is decompressed into the same
+ * buffer and any partial line at its end is carried over to the next one.
+ * The marker of a variant is its ID or, if it doesn't have one,
+ * "CHROM:POS". Each call is its alleles, in allele order and separated
+ * by "/", with any missing calls stored as "-".
+ *
+ * @param vcf_p The VCFFile.
+ * @param doc_p The population document to add the markers to.
+ * @param parent_a_row_pp Where to store Parent A's row, which has the same
+ * keys as a row of a submitted table. This belongs to vcf_p.
+ * @param parent_b_row_pp Where to store Parent B's row, which belongs to vcf_p.
+ * @param data_p The configuration data for the service, whose name mappings
+ * are applied to the progeny accessions.
+ * @param arena_p The JobArena to use for each marker, which is reset after it.
+ * @return <code>true</code> if successful, <code>false</code> otherwise.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL bool AddVCFFileToPopulation (VCFFile *vcf_p, json_t *doc_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, const ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+
+/**
+ * Unmap or free the data of a VCFFile, close its decompressing stream
+ * if it has one and then free the VCFFile.
+ *
+ * @param vcf_p The VCFFile.
+ */
+PARENTAL_GENOTYPE_SERVICE_LOCAL void CloseVCFFile (VCFFile *vcf_p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_INCLUDE_VCF_FILE_H_ */
@@ -0,0 +1,385 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * admission_control.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <pthread.h>
+#include <time.h>
+
+#include "admission_control.h"
+#include "job_timings.h"
+
+#include "streams.h"
+#include "json_util.h"
+#include "string_utils.h"
+
+
+/**
+ * A request that is waiting for a slot. These live on the
+ * waiting caller's stack.
+ */
+typedef struct AdmissionWaiter
+{
+	struct AdmissionWaiter *aw_next_p;
+} AdmissionWaiter;
+
+
+typedef struct AdmissionQueue
+{
+	/** The number of requests that can run at once, 0 means no limit. */
+	uint32 aq_max_running;
+
+	/** The number of requests that can wait for a slot. */
+	uint32 aq_max_queued;
+
+	/** How long a request can wait for a slot, 0 means no limit. */
+	uint32 aq_max_wait_ms;
+
+	uint32 aq_num_running;
+
+	uint32 aq_num_queued;
+
+	/** The waiting requests, oldest first. */
+	AdmissionWaiter *aq_head_p;
+
+	AdmissionWaiter *aq_tail_p;
+
+	/** Signalled when a slot is freed or the queue changes. */
+	pthread_cond_t aq_cond;
+} AdmissionQueue;
+
+
+static const char * const S_CLASS_NAMES_SS [AC_NUM_CLASSES] = { "light", "heavy", "bulk" };
+
+
+/*
+ * All of the queues and s_bulk_threshold are protected by s_admission_lock.
+ */
+static AdmissionQueue s_queues [AC_NUM_CLASSES];
+
+static uint32 s_bulk_threshold = 100000;
+
+static pthread_mutex_t s_admission_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t s_init_once = PTHREAD_ONCE_INIT;
+
+
+static void InitAdmissionQueues (void);
+
+static void InitAdmissionQueue (AdmissionQueue *queue_p, const uint32 max_running, const uint32 max_queued, const uint32 max_wait_ms);
+
+static bool HasFreeSlot (const AdmissionQueue *queue_p);
+
+static uint64 GetWaitEndTime (const AdmissionQueue *queue_p, const uint64 end_time);
+
+static void RemoveAdmissionWaiter (AdmissionQueue *queue_p, AdmissionWaiter *waiter_p);
+
+
+
+void ConfigureAdmissionControl (const json_t *config_p)
+{
+	pthread_once (&s_init_once, InitAdmissionQueues);
+
+	if (config_p)
+		{
+			AdmissionClass ac;
+
+			pthread_mutex_lock (&s_admission_lock);
+
+			for (ac = AC_LIGHT; ac < AC_NUM_CLASSES; ++ ac)
+				{
+					const json_t *class_config_p = json_object_get (config_p, S_CLASS_NAMES_SS [ac]);
+
+					if (class_config_p)
+						{
+							AdmissionQueue *queue_p = & (s_queues [ac]);
+
+							GetJSONUnsignedInteger (class_config_p, "max_running", & (queue_p -> aq_max_running));
+							GetJSONUnsignedInteger (class_config_p, "max_queued", & (queue_p -> aq_max_queued));
+							GetJSONUnsignedInteger (class_config_p, "max_wait_ms", & (queue_p -> aq_max_wait_ms));
+
+							/*
+							 * The limits may have been raised so let any waiting requests check again
+							 */
+							pthread_cond_broadcast (& (queue_p -> aq_cond));
+						}
+				}
+
+			GetJSONUnsignedInteger (config_p, "bulk_threshold_cells", &s_bulk_threshold);
+
+			pthread_mutex_unlock (&s_admission_lock);
+		}
+}
+
+
+AdmissionClass GetSearchAdmissionClass (const char *marker_s, const char *population_s, const bool full_record_flag)
+{
+	/*
+	 * Population searches go through every cross for a parent and
+	 * full-record searches return whole populations, whereas a plain
+	 * marker lookup is a single indexed query.
+	 */
+	if (IsStringEmpty (marker_s) || (!IsStringEmpty (population_s)) || full_record_flag)
+		{
+			return AC_HEAVY;
+		}
+
+	return AC_LIGHT;
+}
+
+
+AdmissionClass GetSubmissionAdmissionClass (const json_t *data_json_p)
+{
+	AdmissionClass ac = AC_HEAVY;
+
+	if (json_is_array (data_json_p))
+		{
+			/*
+			 * Each row has a column per marker so the number of genotype
+			 * values is roughly the number of rows times the size of the first one.
+			 */
+			const json_t *row_p = json_array_get (data_json_p, 0);
+			const uint64 num_cells = ((uint64) json_array_size (data_json_p)) * ((uint64) (json_is_object (row_p) ? json_object_size (row_p) : 0));
+
+			ac = GetSubmissionAdmissionClassByCells (num_cells);
+		}
+
+	return ac;
+}
+
+
+AdmissionClass GetSubmissionAdmissionClassByCells (const uint64 num_cells)
+{
+	AdmissionClass ac = AC_HEAVY;
+	uint32 threshold;
+
+	pthread_once (&s_init_once, InitAdmissionQueues);
+
+	pthread_mutex_lock (&s_admission_lock);
+	threshold = s_bulk_threshold;
+	pthread_mutex_unlock (&s_admission_lock);
+
+	if (num_cells > threshold)
+		{
+			ac = AC_BULK;
+		}
+
+	return ac;
+}
+
+
+bool EnterAdmissionControl (const AdmissionClass ac, const uint64 end_time)
+{
+	bool admitted_flag = false;
+	AdmissionQueue *queue_p = & (s_queues [ac]);
+
+	pthread_once (&s_init_once, InitAdmissionQueues);
+
+	pthread_mutex_lock (&s_admission_lock);
+
+	if ((HasFreeSlot (queue_p)) && (queue_p -> aq_head_p == NULL))
+		{
+			admitted_flag = true;
+		}
+	else if (queue_p -> aq_num_queued < queue_p -> aq_max_queued)
+		{
+			AdmissionWaiter waiter;
+			const uint64 wait_end_time = GetWaitEndTime (queue_p, end_time);
+			int res = 0;
+
+			waiter.aw_next_p = NULL;
+
+			if (queue_p -> aq_tail_p)
+				{
+					queue_p -> aq_tail_p -> aw_next_p = &waiter;
+				}
+			else
+				{
+					queue_p -> aq_head_p = &waiter;
+				}
+
+			queue_p -> aq_tail_p = &waiter;
+			++ (queue_p -> aq_num_queued);
+
+			if (wait_end_time != 0)
+				{
+					/*
+					 * The condition variable uses the monotonic clock, the same
+					 * as the end time
+					 */
+					struct timespec wait_end;
+
+					wait_end.tv_sec = (time_t) (wait_end_time / 1000000000ULL);
+					wait_end.tv_nsec = (long) (wait_end_time % 1000000000ULL);
+
+					while ((! ((queue_p -> aq_head_p == &waiter) && (HasFreeSlot (queue_p)))) && (res == 0))
+						{
+							res = pthread_cond_timedwait (& (queue_p -> aq_cond), &s_admission_lock, &wait_end);
+						}
+				}
+			else
+				{
+					while (! ((queue_p -> aq_head_p == &waiter) && (HasFreeSlot (queue_p))))
+						{
+							pthread_cond_wait (& (queue_p -> aq_cond), &s_admission_lock);
+						}
+				}
+
+			admitted_flag = (queue_p -> aq_head_p == &waiter) && (HasFreeSlot (queue_p));
+
+			RemoveAdmissionWaiter (queue_p, &waiter);
+			-- (queue_p -> aq_num_queued);
+
+			/*
+			 * Whether we got in or gave up, there is a new head of the queue
+			 * which may be able to run now.
+			 */
+			pthread_cond_broadcast (& (queue_p -> aq_cond));
+		}
+
+	if (admitted_flag)
+		{
+			++ (queue_p -> aq_num_running);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Rejected %s request with " UINT32_FMT " running and " UINT32_FMT " queued", S_CLASS_NAMES_SS [ac], queue_p -> aq_num_running, queue_p -> aq_num_queued);
+		}
+
+	pthread_mutex_unlock (&s_admission_lock);
+
+	return admitted_flag;
+}
+
+
+void LeaveAdmissionControl (const AdmissionClass ac)
+{
+	AdmissionQueue *queue_p = & (s_queues [ac]);
+
+	pthread_mutex_lock (&s_admission_lock);
+
+	-- (queue_p -> aq_num_running);
+
+	if (queue_p -> aq_head_p)
+		{
+			pthread_cond_broadcast (& (queue_p -> aq_cond));
+		}
+
+	pthread_mutex_unlock (&s_admission_lock);
+}
+
+
+const char *GetAdmissionClassAsString (const AdmissionClass ac)
+{
+	return S_CLASS_NAMES_SS [ac];
+}
+
+
+/*
+ * The quick lookups get plenty of slots whereas only a few
+ * of the requests that fetch whole populations can run at once.
+ */
+static void InitAdmissionQueues (void)
+{
+	InitAdmissionQueue (& (s_queues [AC_LIGHT]), 32, 128, 5000);
+	InitAdmissionQueue (& (s_queues [AC_HEAVY]), 4, 16, 30000);
+	InitAdmissionQueue (& (s_queues [AC_BULK]), 1, 4, 60000);
+}
+
+
+static void InitAdmissionQueue (AdmissionQueue *queue_p, const uint32 max_running, const uint32 max_queued, const uint32 max_wait_ms)
+{
+	pthread_condattr_t attrs;
+
+	queue_p -> aq_max_running = max_running;
+	queue_p -> aq_max_queued = max_queued;
+	queue_p -> aq_max_wait_ms = max_wait_ms;
+	queue_p -> aq_num_running = 0;
+	queue_p -> aq_num_queued = 0;
+	queue_p -> aq_head_p = NULL;
+	queue_p -> aq_tail_p = NULL;
+
+	if (pthread_condattr_init (&attrs) == 0)
+		{
+			if (pthread_condattr_setclock (&attrs, CLOCK_MONOTONIC) != 0)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to set admission queue clock to monotonic");
+				}
+
+			pthread_cond_init (& (queue_p -> aq_cond), &attrs);
+			pthread_condattr_destroy (&attrs);
+		}
+	else
+		{
+			pthread_cond_init (& (queue_p -> aq_cond), NULL);
+		}
+}
+
+
+static bool HasFreeSlot (const AdmissionQueue *queue_p)
+{
+	return ((queue_p -> aq_max_running == 0) || (queue_p -> aq_num_running < queue_p -> aq_max_running));
+}
+
+
+/*
+ * Use whichever is sooner of the caller's end time and the
+ * class's maximum wait.
+ */
+static uint64 GetWaitEndTime (const AdmissionQueue *queue_p, const uint64 end_time)
+{
+	uint64 wait_end_time = end_time;
+
+	if (queue_p -> aq_max_wait_ms > 0)
+		{
+			const uint64 max_end_time = GetMonotonicTimeInNanoseconds () + (((uint64) (queue_p -> aq_max_wait_ms)) * 1000000ULL);
+
+			if ((wait_end_time == 0) || (max_end_time < wait_end_time))
+				{
+					wait_end_time = max_end_time;
+				}
+		}
+
+	return wait_end_time;
+}
+
+
+static void RemoveAdmissionWaiter (AdmissionQueue *queue_p, AdmissionWaiter *waiter_p)
+{
+	AdmissionWaiter **prev_pp = & (queue_p -> aq_head_p);
+	AdmissionWaiter *prev_p = NULL;
+
+	while (*prev_pp)
+		{
+			if (*prev_pp == waiter_p)
+				{
+					*prev_pp = waiter_p -> aw_next_p;
+
+					if (queue_p -> aq_tail_p == waiter_p)
+						{
+							queue_p -> aq_tail_p = prev_p;
+						}
+
+					return;
+				}
+
+			prev_p = *prev_pp;
+			prev_pp = & ((*prev_pp) -> aw_next_p);
+		}
+}
@@ -0,0 +1,968 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * arrow_export.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "arrow_export.h"
+#include "flatbuffer_builder.h"
+#include "parental_genotype_service.h"
+
+#include "byte_buffer.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "json_util.h"
+
+
+/*
+ * The FieldNode, Buffer and Block structs from the Arrow
+ * IPC schemas, laid out as they are in the FlatBuffers.
+ */
+typedef struct ArrowFieldNode
+{
+	int64 afn_length;
+
+	int64 afn_null_count;
+} ArrowFieldNode;
+
+
+typedef struct ArrowBuffer
+{
+	int64 ab_offset;
+
+	int64 ab_length;
+} ArrowBuffer;
+
+
+typedef struct ArrowBlock
+{
+	int64 ab_offset;
+
+	int32 ab_metadata_length;
+
+	int32 ab_padding;
+
+	int64 ab_body_length;
+} ArrowBlock;
+
+
+/*
+ * A buffer to write into a message's body.
+ */
+typedef struct ArrowBodyBuffer
+{
+	const void *abb_data_p;
+
+	int64 abb_length;
+} ArrowBodyBuffer;
+
+
+struct ArrowMatrixWriter
+{
+	FILE *amw_out_f;
+
+	/** The number of bytes written so far, which is where the next message starts. */
+	uint64 amw_offset;
+
+	const char **amw_accessions_ss;
+
+	uint32 amw_num_progeny;
+
+	const json_t *amw_call_indexes_p;
+
+	uint32 amw_num_calls;
+
+	/** The size in bytes of each dictionary index. */
+	uint32 amw_index_width;
+
+	FlatBufferBuilder amw_builder;
+
+	/** The number of rows in the current batch. */
+	uint32 amw_num_rows;
+
+	ByteBuffer *amw_markers_p;
+
+	int32 *amw_marker_offsets_p;
+
+	ByteBuffer *amw_chromosomes_p;
+
+	int32 *amw_chromosome_offsets_p;
+
+	uint8 *amw_chromosome_validity_p;
+
+	uint32 amw_num_null_chromosomes;
+
+	double64 *amw_positions_p;
+
+	uint8 *amw_position_validity_p;
+
+	uint32 amw_num_null_positions;
+
+	/** The dictionary indexes for each progeny line in turn. */
+	uint8 *amw_indexes_p;
+
+	/** The validity bitmap for each progeny line in turn. */
+	uint8 *amw_validity_p;
+
+	uint32 *amw_null_counts_p;
+
+	ArrowFieldNode *amw_nodes_p;
+
+	ArrowBodyBuffer *amw_buffers_p;
+
+	/** The dictionary's values, which are the same for every progeny line. */
+	ByteBuffer *amw_dictionary_p;
+
+	int32 *amw_dictionary_offsets_p;
+
+	ArrowBlock *amw_dictionary_blocks_p;
+
+	ArrowBlock *amw_batch_blocks_p;
+
+	uint32 amw_num_batches;
+
+	uint32 amw_max_batches;
+};
+
+
+/*
+ * The values from the Arrow IPC schemas, Schema.fbs, Message.fbs and File.fbs.
+ */
+enum
+{
+	ARROW_METADATA_V5 = 4,
+
+	ARROW_HEADER_SCHEMA = 1,
+	ARROW_HEADER_DICTIONARY_BATCH = 2,
+	ARROW_HEADER_RECORD_BATCH = 3,
+
+	ARROW_TYPE_INT = 2,
+	ARROW_TYPE_FLOATING_POINT = 3,
+	ARROW_TYPE_UTF8 = 5,
+
+	ARROW_PRECISION_DOUBLE = 2
+};
+
+
+/*
+ * The number of markers in each record batch.
+ */
+#define S_ROWS_PER_BATCH (4096)
+
+static const uint32 S_VALIDITY_BYTES = S_ROWS_PER_BATCH / 8;
+
+static const char S_MAGIC_S [] = "ARROW1";
+
+static const uint32 S_CONTINUATION = 0xFFFFFFFF;
+
+
+static bool AllocateArrowBatch (ArrowMatrixWriter *writer_p);
+
+static void ResetArrowBatch (ArrowMatrixWriter *writer_p);
+
+static bool SetArrowDictionary (ArrowMatrixWriter *writer_p);
+
+static uint32 AddArrowSchema (ArrowMatrixWriter *writer_p);
+
+static uint32 AddArrowField (FlatBufferBuilder *builder_p, const char *name_s, const bool nullable_flag, const uint8 type_type, const uint32 type, const uint32 dictionary, const uint32 children);
+
+static uint32 AddArrowRecordBatch (FlatBufferBuilder *builder_p, const int64 length, const ArrowFieldNode *nodes_p, const uint32 num_nodes, const ArrowBodyBuffer *buffers_p, const uint32 num_buffers);
+
+static uint32 AddArrowBlocks (FlatBufferBuilder *builder_p, const ArrowBlock *blocks_p, const uint32 num_blocks);
+
+static int64 GetArrowBodyLength (const ArrowBodyBuffer *buffers_p, const uint32 num_buffers);
+
+static bool WriteArrowSchema (ArrowMatrixWriter *writer_p);
+
+static bool WriteArrowDictionaries (ArrowMatrixWriter *writer_p);
+
+static bool WriteArrowRecordBatch (ArrowMatrixWriter *writer_p);
+
+static bool WriteArrowFooter (ArrowMatrixWriter *writer_p);
+
+static bool WriteArrowMessage (ArrowMatrixWriter *writer_p, const uint8 header_type, const uint32 header, const ArrowBodyBuffer *buffers_p, const uint32 num_buffers, ArrowBlock *block_p);
+
+static void WriteArrowPadding (ArrowMatrixWriter *writer_p, const size_t num_bytes);
+
+static void SetValidityBit (uint8 *validity_p, const uint32 row);
+
+static inline size_t GetArrowPadding (const size_t length);
+
+
+
+ArrowMatrixWriter *AllocateArrowMatrixWriter (FILE *out_f, const char **accessions_ss, const uint32 num_progeny, const json_t *call_indexes_p)
+{
+	ArrowMatrixWriter *writer_p = (ArrowMatrixWriter *) AllocMemory (sizeof (ArrowMatrixWriter));
+
+	if (writer_p)
+		{
+			memset (writer_p, 0, sizeof (ArrowMatrixWriter));
+
+			writer_p -> amw_out_f = out_f;
+			writer_p -> amw_accessions_ss = accessions_ss;
+			writer_p -> amw_num_progeny = num_progeny;
+			writer_p -> amw_call_indexes_p = call_indexes_p;
+			writer_p -> amw_num_calls = (uint32) json_object_size (call_indexes_p);
+
+			/*
+			 * The indexes are signed so use the smallest type that can hold them all
+			 */
+			writer_p -> amw_index_width = (writer_p -> amw_num_calls <= INT8_MAX) ? 1 : 2;
+
+			if (writer_p -> amw_num_calls <= INT16_MAX)
+				{
+					if (InitFlatBufferBuilder (& (writer_p -> amw_builder), 1024))
+						{
+							if ((AllocateArrowBatch (writer_p)) && (SetArrowDictionary (writer_p)))
+								{
+									const uint8 magic [8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+									fwrite (magic, 1, sizeof (magic), out_f);
+									writer_p -> amw_offset = sizeof (magic);
+
+									if ((WriteArrowSchema (writer_p)) && (WriteArrowDictionaries (writer_p)))
+										{
+											return writer_p;
+										}
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, UINT32_FMT " distinct calls are too many for an Arrow dictionary", writer_p -> amw_num_calls);
+				}
+
+			FreeArrowMatrixWriter (writer_p);
+		}		/* if (writer_p) */
+
+	return NULL;
+}
+
+
+bool AddArrowMatrixRow (ArrowMatrixWriter *writer_p, const char *marker_s, const char *chromosome_s, const double64 position, const char **row_ss)
+{
+	const uint32 row = writer_p -> amw_num_rows;
+	uint32 i;
+
+	if (!AppendToByteBuffer (writer_p -> amw_markers_p, marker_s, strlen (marker_s)))
+		{
+			return false;
+		}
+
+	writer_p -> amw_marker_offsets_p [row + 1] = (int32) GetByteBufferSize (writer_p -> amw_markers_p);
+
+	if ((chromosome_s != NULL) && (*chromosome_s != '\0'))
+		{
+			if (!AppendToByteBuffer (writer_p -> amw_chromosomes_p, chromosome_s, strlen (chromosome_s)))
+				{
+					return false;
+				}
+
+			SetValidityBit (writer_p -> amw_chromosome_validity_p, row);
+		}
+	else
+		{
+			++ (writer_p -> amw_num_null_chromosomes);
+		}
+
+	writer_p -> amw_chromosome_offsets_p [row + 1] = (int32) GetByteBufferSize (writer_p -> amw_chromosomes_p);
+
+	if (isinf (position))
+		{
+			writer_p -> amw_positions_p [row] = 0.0;
+			++ (writer_p -> amw_num_null_positions);
+		}
+	else
+		{
+			writer_p -> amw_positions_p [row] = position;
+			SetValidityBit (writer_p -> amw_position_validity_p, row);
+		}
+
+	for (i = 0; i < writer_p -> amw_num_progeny; ++ i)
+		{
+			const json_t *index_p = IsMissingGenotype (row_ss [i]) ? NULL : json_object_get (writer_p -> amw_call_indexes_p, row_ss [i]);
+
+			if (index_p)
+				{
+					const json_int_t index = json_integer_value (index_p);
+					uint8 *column_p = writer_p -> amw_indexes_p + ((size_t) i * S_ROWS_PER_BATCH * writer_p -> amw_index_width);
+
+					if (writer_p -> amw_index_width == 1)
+						{
+							((int8 *) column_p) [row] = (int8) index;
+						}
+					else
+						{
+							((int16 *) column_p) [row] = (int16) index;
+						}
+
+					SetValidityBit (writer_p -> amw_validity_p + ((size_t) i * S_VALIDITY_BYTES), row);
+				}
+			else
+				{
+					++ (writer_p -> amw_null_counts_p [i]);
+				}
+		}
+
+	++ (writer_p -> amw_num_rows);
+
+	if (writer_p -> amw_num_rows == S_ROWS_PER_BATCH)
+		{
+			return WriteArrowRecordBatch (writer_p);
+		}
+
+	return true;
+}
+
+
+bool FinishArrowMatrix (ArrowMatrixWriter *writer_p)
+{
+	if ((writer_p -> amw_num_rows == 0) || (WriteArrowRecordBatch (writer_p)))
+		{
+			/*
+			 * The end-of-stream marker
+			 */
+			const uint32 eos [2] = { S_CONTINUATION, 0 };
+
+			fwrite (eos, sizeof (uint32), 2, writer_p -> amw_out_f);
+			writer_p -> amw_offset += sizeof (eos);
+
+			if (WriteArrowFooter (writer_p))
+				{
+					if (!ferror (writer_p -> amw_out_f))
+						{
+							return true;
+						}
+				}
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to finish Arrow file");
+
+	return false;
+}
+
+
+void FreeArrowMatrixWriter (ArrowMatrixWriter *writer_p)
+{
+	void **arrays_pp [] =
+		{
+			(void **) & (writer_p -> amw_marker_offsets_p),
+			(void **) & (writer_p -> amw_chromosome_offsets_p),
+			(void **) & (writer_p -> amw_chromosome_validity_p),
+			(void **) & (writer_p -> amw_positions_p),
+			(void **) & (writer_p -> amw_position_validity_p),
+			(void **) & (writer_p -> amw_indexes_p),
+			(void **) & (writer_p -> amw_validity_p),
+			(void **) & (writer_p -> amw_null_counts_p),
+			(void **) & (writer_p -> amw_nodes_p),
+			(void **) & (writer_p -> amw_buffers_p),
+			(void **) & (writer_p -> amw_dictionary_offsets_p),
+			(void **) & (writer_p -> amw_dictionary_blocks_p),
+			(void **) & (writer_p -> amw_batch_blocks_p),
+			NULL
+		};
+	void ***array_ppp;
+
+	for (array_ppp = arrays_pp; *array_ppp; ++ array_ppp)
+		{
+			if (**array_ppp)
+				{
+					FreeMemory (**array_ppp);
+				}
+		}
+
+	if (writer_p -> amw_markers_p)
+		{
+			FreeByteBuffer (writer_p -> amw_markers_p);
+		}
+
+	if (writer_p -> amw_chromosomes_p)
+		{
+			FreeByteBuffer (writer_p -> amw_chromosomes_p);
+		}
+
+	if (writer_p -> amw_dictionary_p)
+		{
+			FreeByteBuffer (writer_p -> amw_dictionary_p);
+		}
+
+	ClearFlatBufferBuilder (& (writer_p -> amw_builder));
+
+	FreeMemory (writer_p);
+}
+
+
+static bool AllocateArrowBatch (ArrowMatrixWriter *writer_p)
+{
+	const size_t num_progeny = writer_p -> amw_num_progeny;
+
+	/*
+	 * Each row has nodes for the marker, chromosome and position columns
+	 * and then for each progeny line. The marker and chromosome columns
+	 * have three buffers and all of the others have two.
+	 */
+	const size_t num_nodes = 3 + num_progeny;
+	const size_t num_buffers = 8 + (2 * num_progeny);
+
+	if (((writer_p -> amw_markers_p = AllocateByteBuffer (64 * 1024)) != NULL) &&
+			((writer_p -> amw_chromosomes_p = AllocateByteBuffer (16 * 1024)) != NULL) &&
+			((writer_p -> amw_marker_offsets_p = (int32 *) AllocMemoryArray (S_ROWS_PER_BATCH + 1, sizeof (int32))) != NULL) &&
+			((writer_p -> amw_chromosome_offsets_p = (int32 *) AllocMemoryArray (S_ROWS_PER_BATCH + 1, sizeof (int32))) != NULL) &&
+			((writer_p -> amw_chromosome_validity_p = (uint8 *) AllocMemoryArray (S_VALIDITY_BYTES, sizeof (uint8))) != NULL) &&
+			((writer_p -> amw_positions_p = (double64 *) AllocMemoryArray (S_ROWS_PER_BATCH, sizeof (double64))) != NULL) &&
+			((writer_p -> amw_position_validity_p = (uint8 *) AllocMemoryArray (S_VALIDITY_BYTES, sizeof (uint8))) != NULL) &&
+			((writer_p -> amw_indexes_p = (uint8 *) AllocMemoryArray ((num_progeny * S_ROWS_PER_BATCH) + 1, writer_p -> amw_index_width)) != NULL) &&
+			((writer_p -> amw_validity_p = (uint8 *) AllocMemoryArray ((num_progeny * S_VALIDITY_BYTES) + 1, sizeof (uint8))) != NULL) &&
+			((writer_p -> amw_null_counts_p = (uint32 *) AllocMemoryArray (num_progeny + 1, sizeof (uint32))) != NULL) &&
+			((writer_p -> amw_nodes_p = (ArrowFieldNode *) AllocMemoryArray (num_nodes, sizeof (ArrowFieldNode))) != NULL) &&
+			((writer_p -> amw_buffers_p = (ArrowBodyBuffer *) AllocMemoryArray (num_buffers, sizeof (ArrowBodyBuffer))) != NULL) &&
+			((writer_p -> amw_dictionary_blocks_p = (ArrowBlock *) AllocMemoryArray (num_progeny + 1, sizeof (ArrowBlock))) != NULL))
+		{
+			ResetArrowBatch (writer_p);
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate Arrow record batch for " UINT32_FMT " progeny", writer_p -> amw_num_progeny);
+
+	return false;
+}
+
+
+static void ResetArrowBatch (ArrowMatrixWriter *writer_p)
+{
+	const size_t num_progeny = writer_p -> amw_num_progeny;
+
+	writer_p -> amw_num_rows = 0;
+
+	ResetByteBuffer (writer_p -> amw_markers_p);
+	ResetByteBuffer (writer_p -> amw_chromosomes_p);
+
+	writer_p -> amw_marker_offsets_p [0] = 0;
+	writer_p -> amw_chromosome_offsets_p [0] = 0;
+
+	memset (writer_p -> amw_chromosome_validity_p, 0, S_VALIDITY_BYTES);
+	memset (writer_p -> amw_position_validity_p, 0, S_VALIDITY_BYTES);
+	writer_p -> amw_num_null_chromosomes = 0;
+	writer_p -> amw_num_null_positions = 0;
+
+	/*
+	 * The null slots in the indexes must still be valid indexes
+	 */
+	memset (writer_p -> amw_indexes_p, 0, num_progeny * S_ROWS_PER_BATCH * writer_p -> amw_index_width);
+	memset (writer_p -> amw_validity_p, 0, num_progeny * S_VALIDITY_BYTES);
+	memset (writer_p -> amw_null_counts_p, 0, num_progeny * sizeof (uint32));
+}
+
+
+static bool SetArrowDictionary (ArrowMatrixWriter *writer_p)
+{
+	const uint32 num_calls = writer_p -> amw_num_calls;
+	const char **calls_ss = (const char **) AllocMemoryArray (num_calls + 1, sizeof (const char *));
+	bool success_flag = false;
+
+	if (calls_ss)
+		{
+			if (((writer_p -> amw_dictionary_offsets_p = (int32 *) AllocMemoryArray (num_calls + 1, sizeof (int32))) != NULL) &&
+					((writer_p -> amw_dictionary_p = AllocateByteBuffer (1024)) != NULL))
+				{
+					const char *call_s;
+					json_t *index_p;
+					uint32 i;
+
+					json_object_foreach ((json_t *) (writer_p -> amw_call_indexes_p), call_s, index_p)
+						{
+							calls_ss [json_integer_value (index_p)] = call_s;
+						}
+
+					success_flag = true;
+					writer_p -> amw_dictionary_offsets_p [0] = 0;
+
+					for (i = 0; (i < num_calls) && success_flag; ++ i)
+						{
+							if (AppendToByteBuffer (writer_p -> amw_dictionary_p, calls_ss [i], strlen (calls_ss [i])))
+								{
+									writer_p -> amw_dictionary_offsets_p [i + 1] = (int32) GetByteBufferSize (writer_p -> amw_dictionary_p);
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+				}
+
+			FreeMemory (calls_ss);
+		}		/* if (calls_ss) */
+
+	return success_flag;
+}
+
+
+static uint32 AddArrowSchema (ArrowMatrixWriter *writer_p)
+{
+	FlatBufferBuilder *builder_p = & (writer_p -> amw_builder);
+	uint32 *fields_p = (uint32 *) AllocMemoryArray (writer_p -> amw_num_progeny + 3, sizeof (uint32));
+	uint32 schema = 0;
+
+	if (fields_p)
+		{
+			uint32 utf8_type;
+			uint32 double_type;
+			uint32 index_type;
+			uint32 children;
+			uint32 num_fields = 0;
+			uint32 i;
+
+			/*
+			 * The types and the empty list of children are shared by all of the fields
+			 */
+			StartFlatBufferTable (builder_p);
+			utf8_type = EndFlatBufferTable (builder_p);
+
+			StartFlatBufferTable (builder_p);
+			AddFlatBufferInt16 (builder_p, 0, ARROW_PRECISION_DOUBLE);
+			double_type = EndFlatBufferTable (builder_p);
+
+			StartFlatBufferTable (builder_p);
+			AddFlatBufferInt32 (builder_p, 0, (int32) (8 * writer_p -> amw_index_width));
+			AddFlatBufferUInt8 (builder_p, 1, 1);
+			index_type = EndFlatBufferTable (builder_p);
+
+			StartFlatBufferVector (builder_p, sizeof (uint32), 0, sizeof (uint32));
+			children = EndFlatBufferVector (builder_p, 0);
+
+			fields_p [num_fields ++] = AddArrowField (builder_p, "marker", false, ARROW_TYPE_UTF8, utf8_type, 0, children);
+			fields_p [num_fields ++] = AddArrowField (builder_p, PGS_CHROMOSOME_S, true, ARROW_TYPE_UTF8, utf8_type, 0, children);
+			fields_p [num_fields ++] = AddArrowField (builder_p, PGS_MAPPING_POSITION_S, true, ARROW_TYPE_FLOATING_POINT, double_type, 0, children);
+
+			for (i = 0; i < writer_p -> amw_num_progeny; ++ i)
+				{
+					uint32 dictionary;
+
+					/*
+					 * Each progeny line has a dictionary of its own, with
+					 * the same id as its position in the list of lines
+					 */
+					StartFlatBufferTable (builder_p);
+					AddFlatBufferInt64 (builder_p, 0, (int64) i);
+					AddFlatBufferOffset (builder_p, 1, index_type);
+					AddFlatBufferUInt8 (builder_p, 2, 0);
+					dictionary = EndFlatBufferTable (builder_p);
+
+					fields_p [num_fields ++] = AddArrowField (builder_p, writer_p -> amw_accessions_ss [i], true, ARROW_TYPE_UTF8, utf8_type, dictionary, children);
+				}
+
+			StartFlatBufferVector (builder_p, sizeof (uint32), num_fields, sizeof (uint32));
+
+			for (i = num_fields; i > 0; -- i)
+				{
+					PushFlatBufferOffset (builder_p, fields_p [i - 1]);
+				}
+
+			i = EndFlatBufferVector (builder_p, num_fields);
+
+			StartFlatBufferTable (builder_p);
+			AddFlatBufferInt16 (builder_p, 0, 0);
+			AddFlatBufferOffset (builder_p, 1, i);
+			schema = EndFlatBufferTable (builder_p);
+
+			FreeMemory (fields_p);
+		}		/* if (fields_p) */
+
+	return schema;
+}
+
+
+static uint32 AddArrowField (FlatBufferBuilder *builder_p, const char *name_s, const bool nullable_flag, const uint8 type_type, const uint32 type, const uint32 dictionary, const uint32 children)
+{
+	const uint32 name = CreateFlatBufferString (builder_p, name_s);
+
+	StartFlatBufferTable (builder_p);
+	AddFlatBufferOffset (builder_p, 0, name);
+	AddFlatBufferUInt8 (builder_p, 1, nullable_flag ? 1 : 0);
+	AddFlatBufferUInt8 (builder_p, 2, type_type);
+	AddFlatBufferOffset (builder_p, 3, type);
+
+	if (dictionary)
+		{
+			AddFlatBufferOffset (builder_p, 4, dictionary);
+		}
+
+	AddFlatBufferOffset (builder_p, 5, children);
+
+	return EndFlatBufferTable (builder_p);
+}
+
+
+static uint32 AddArrowRecordBatch (FlatBufferBuilder *builder_p, const int64 length, const ArrowFieldNode *nodes_p, const uint32 num_nodes, const ArrowBodyBuffer *buffers_p, const uint32 num_buffers)
+{
+	uint32 nodes;
+	uint32 buffers;
+	int64 end = GetArrowBodyLength (buffers_p, num_buffers);
+	uint32 i;
+
+	StartFlatBufferVector (builder_p, sizeof (ArrowFieldNode), num_nodes, sizeof (int64));
+
+	for (i = num_nodes; i > 0; -- i)
+		{
+			PushFlatBufferStruct (builder_p, nodes_p + (i - 1), sizeof (ArrowFieldNode));
+		}
+
+	nodes = EndFlatBufferVector (builder_p, num_nodes);
+
+	/*
+	 * The buffers are pushed from the last to the first so work
+	 * out their offsets back from the end of the body
+	 */
+	StartFlatBufferVector (builder_p, sizeof (ArrowBuffer), num_buffers, sizeof (int64));
+
+	for (i = num_buffers; i > 0; -- i)
+		{
+			const ArrowBodyBuffer *body_buffer_p = buffers_p + (i - 1);
+			ArrowBuffer buffer;
+
+			end -= body_buffer_p -> abb_length + GetArrowPadding (body_buffer_p -> abb_length);
+
+			buffer.ab_offset = end;
+			buffer.ab_length = body_buffer_p -> abb_length;
+
+			PushFlatBufferStruct (builder_p, &buffer, sizeof (ArrowBuffer));
+		}
+
+	buffers = EndFlatBufferVector (builder_p, num_buffers);
+
+	StartFlatBufferTable (builder_p);
+	AddFlatBufferInt64 (builder_p, 0, length);
+	AddFlatBufferOffset (builder_p, 1, nodes);
+	AddFlatBufferOffset (builder_p, 2, buffers);
+
+	return EndFlatBufferTable (builder_p);
+}
+
+
+static uint32 AddArrowBlocks (FlatBufferBuilder *builder_p, const ArrowBlock *blocks_p, const uint32 num_blocks)
+{
+	uint32 i;
+
+	StartFlatBufferVector (builder_p, sizeof (ArrowBlock), num_blocks, sizeof (int64));
+
+	for (i = num_blocks; i > 0; -- i)
+		{
+			PushFlatBufferStruct (builder_p, blocks_p + (i - 1), sizeof (ArrowBlock));
+		}
+
+	return EndFlatBufferVector (builder_p, num_blocks);
+}
+
+
+static int64 GetArrowBodyLength (const ArrowBodyBuffer *buffers_p, const uint32 num_buffers)
+{
+	int64 length = 0;
+	uint32 i;
+
+	for (i = 0; i < num_buffers; ++ i)
+		{
+			length += buffers_p [i].abb_length + GetArrowPadding (buffers_p [i].abb_length);
+		}
+
+	return length;
+}
+
+
+static bool WriteArrowSchema (ArrowMatrixWriter *writer_p)
+{
+	uint32 schema;
+
+	ResetFlatBufferBuilder (& (writer_p -> amw_builder));
+
+	if ((schema = AddArrowSchema (writer_p)) != 0)
+		{
+			ArrowBlock block;
+
+			return WriteArrowMessage (writer_p, ARROW_HEADER_SCHEMA, schema, NULL, 0, &block);
+		}
+
+	return false;
+}
+
+
+static bool WriteArrowDictionaries (ArrowMatrixWriter *writer_p)
+{
+	ArrowFieldNode node;
+	ArrowBodyBuffer buffers [3];
+	uint32 i;
+
+	node.afn_length = writer_p -> amw_num_calls;
+	node.afn_null_count = 0;
+
+	/*
+	 * No validity bitmap is needed since there are no nulls
+	 */
+	buffers [0].abb_data_p = NULL;
+	buffers [0].abb_length = 0;
+	buffers [1].abb_data_p = writer_p -> amw_dictionary_offsets_p;
+	buffers [1].abb_length = (int64) ((writer_p -> amw_num_calls + 1) * sizeof (int32));
+	buffers [2].abb_data_p = GetByteBufferData (writer_p -> amw_dictionary_p);
+	buffers [2].abb_length = (int64) GetByteBufferSize (writer_p -> amw_dictionary_p);
+
+	for (i = 0; i < writer_p -> amw_num_progeny; ++ i)
+		{
+			FlatBufferBuilder *builder_p = & (writer_p -> amw_builder);
+			uint32 data;
+			uint32 batch;
+
+			ResetFlatBufferBuilder (builder_p);
+
+			data = AddArrowRecordBatch (builder_p, node.afn_length, &node, 1, buffers, 3);
+
+			StartFlatBufferTable (builder_p);
+			AddFlatBufferInt64 (builder_p, 0, (int64) i);
+			AddFlatBufferOffset (builder_p, 1, data);
+			AddFlatBufferUInt8 (builder_p, 2, 0);
+			batch = EndFlatBufferTable (builder_p);
+
+			if (!WriteArrowMessage (writer_p, ARROW_HEADER_DICTIONARY_BATCH, batch, buffers, 3, writer_p -> amw_dictionary_blocks_p + i))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+static bool WriteArrowRecordBatch (ArrowMatrixWriter *writer_p)
+{
+	const uint32 num_rows = writer_p -> amw_num_rows;
+	const int64 validity_length = (num_rows + 7) / 8;
+	ArrowFieldNode *node_p = writer_p -> amw_nodes_p;
+	ArrowBodyBuffer *buffer_p = writer_p -> amw_buffers_p;
+	uint32 i;
+
+	if (writer_p -> amw_num_batches == writer_p -> amw_max_batches)
+		{
+			const uint32 max_batches = (writer_p -> amw_max_batches > 0) ? (writer_p -> amw_max_batches << 1) : 16;
+			ArrowBlock *blocks_p = (ArrowBlock *) AllocMemoryArray (max_batches, sizeof (ArrowBlock));
+
+			if (!blocks_p)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " UINT32_FMT " Arrow blocks", max_batches);
+					return false;
+				}
+
+			if (writer_p -> amw_batch_blocks_p)
+				{
+					memcpy (blocks_p, writer_p -> amw_batch_blocks_p, writer_p -> amw_num_batches * sizeof (ArrowBlock));
+					FreeMemory (writer_p -> amw_batch_blocks_p);
+				}
+
+			writer_p -> amw_batch_blocks_p = blocks_p;
+			writer_p -> amw_max_batches = max_batches;
+		}
+
+	node_p -> afn_length = num_rows;
+	node_p -> afn_null_count = 0;
+	++ node_p;
+
+	buffer_p -> abb_data_p = NULL;
+	buffer_p -> abb_length = 0;
+	++ buffer_p;
+	buffer_p -> abb_data_p = writer_p -> amw_marker_offsets_p;
+	buffer_p -> abb_length = (int64) ((num_rows + 1) * sizeof (int32));
+	++ buffer_p;
+	buffer_p -> abb_data_p = GetByteBufferData (writer_p -> amw_markers_p);
+	buffer_p -> abb_length = (int64) GetByteBufferSize (writer_p -> amw_markers_p);
+	++ buffer_p;
+
+	node_p -> afn_length = num_rows;
+	node_p -> afn_null_count = writer_p -> amw_num_null_chromosomes;
+	++ node_p;
+
+	buffer_p -> abb_data_p = writer_p -> amw_chromosome_validity_p;
+	buffer_p -> abb_length = validity_length;
+	++ buffer_p;
+	buffer_p -> abb_data_p = writer_p -> amw_chromosome_offsets_p;
+	buffer_p -> abb_length = (int64) ((num_rows + 1) * sizeof (int32));
+	++ buffer_p;
+	buffer_p -> abb_data_p = GetByteBufferData (writer_p -> amw_chromosomes_p);
+	buffer_p -> abb_length = (int64) GetByteBufferSize (writer_p -> amw_chromosomes_p);
+	++ buffer_p;
+
+	node_p -> afn_length = num_rows;
+	node_p -> afn_null_count = writer_p -> amw_num_null_positions;
+	++ node_p;
+
+	buffer_p -> abb_data_p = writer_p -> amw_position_validity_p;
+	buffer_p -> abb_length = validity_length;
+	++ buffer_p;
+	buffer_p -> abb_data_p = writer_p -> amw_positions_p;
+	buffer_p -> abb_length = (int64) (num_rows * sizeof (double64));
+	++ buffer_p;
+
+	for (i = 0; i < writer_p -> amw_num_progeny; ++ i)
+		{
+			node_p -> afn_length = num_rows;
+			node_p -> afn_null_count = writer_p -> amw_null_counts_p [i];
+			++ node_p;
+
+			buffer_p -> abb_data_p = writer_p -> amw_validity_p + ((size_t) i * S_VALIDITY_BYTES);
+			buffer_p -> abb_length = validity_length;
+			++ buffer_p;
+			buffer_p -> abb_data_p = writer_p -> amw_indexes_p + ((size_t) i * S_ROWS_PER_BATCH * writer_p -> amw_index_width);
+			buffer_p -> abb_length = (int64) (num_rows * writer_p -> amw_index_width);
+			++ buffer_p;
+		}
+
+	ResetFlatBufferBuilder (& (writer_p -> amw_builder));
+
+	if (WriteArrowMessage (writer_p, ARROW_HEADER_RECORD_BATCH,
+			AddArrowRecordBatch (& (writer_p -> amw_builder), num_rows, writer_p -> amw_nodes_p, (uint32) (node_p - writer_p -> amw_nodes_p), writer_p -> amw_buffers_p, (uint32) (buffer_p - writer_p -> amw_buffers_p)),
+			writer_p -> amw_buffers_p, (uint32) (buffer_p - writer_p -> amw_buffers_p), writer_p -> amw_batch_blocks_p + writer_p -> amw_num_batches))
+		{
+			++ (writer_p -> amw_num_batches);
+			ResetArrowBatch (writer_p);
+
+			return true;
+		}
+
+	return false;
+}
+
+
+/*
+ * The footer repeats the schema and has the locations of all of the
+ * dictionaries and record batches so that readers can go straight to them.
+ */
+static bool WriteArrowFooter (ArrowMatrixWriter *writer_p)
+{
+	FlatBufferBuilder *builder_p = & (writer_p -> amw_builder);
+	uint32 schema;
+
+	ResetFlatBufferBuilder (builder_p);
+
+	if ((schema = AddArrowSchema (writer_p)) != 0)
+		{
+			const uint32 dictionaries = AddArrowBlocks (builder_p, writer_p -> amw_dictionary_blocks_p, writer_p -> amw_num_progeny);
+			const uint32 batches = AddArrowBlocks (builder_p, writer_p -> amw_batch_blocks_p, writer_p -> amw_num_batches);
+			uint32 footer;
+
+			StartFlatBufferTable (builder_p);
+			AddFlatBufferInt16 (builder_p, 0, ARROW_METADATA_V5);
+			AddFlatBufferOffset (builder_p, 1, schema);
+			AddFlatBufferOffset (builder_p, 2, dictionaries);
+			AddFlatBufferOffset (builder_p, 3, batches);
+			footer = EndFlatBufferTable (builder_p);
+
+			if (FinishFlatBuffer (builder_p, footer))
+				{
+					const int32 footer_size = (int32) GetFlatBufferSize (builder_p);
+
+					fwrite (GetFlatBufferData (builder_p), 1, footer_size, writer_p -> amw_out_f);
+					fwrite (&footer_size, sizeof (int32), 1, writer_p -> amw_out_f);
+					fwrite (S_MAGIC_S, 1, strlen (S_MAGIC_S), writer_p -> amw_out_f);
+
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+/*
+ * Each message is a continuation marker, the size of its metadata,
+ * the metadata padded to 8 bytes and then its body.
+ */
+static bool WriteArrowMessage (ArrowMatrixWriter *writer_p, const uint8 header_type, const uint32 header, const ArrowBodyBuffer *buffers_p, const uint32 num_buffers, ArrowBlock *block_p)
+{
+	FlatBufferBuilder *builder_p = & (writer_p -> amw_builder);
+	const int64 body_length = GetArrowBodyLength (buffers_p, num_buffers);
+	uint32 message;
+
+	StartFlatBufferTable (builder_p);
+	AddFlatBufferInt16 (builder_p, 0, ARROW_METADATA_V5);
+	AddFlatBufferUInt8 (builder_p, 1, header_type);
+	AddFlatBufferOffset (builder_p, 2, header);
+	AddFlatBufferInt64 (builder_p, 3, body_length);
+	message = EndFlatBufferTable (builder_p);
+
+	if ((header != 0) && (FinishFlatBuffer (builder_p, message)))
+		{
+			const size_t metadata_size = GetFlatBufferSize (builder_p);
+			const int32 padded_size = (int32) (metadata_size + GetArrowPadding (metadata_size + 8));
+			uint32 i;
+
+			fwrite (&S_CONTINUATION, sizeof (uint32), 1, writer_p -> amw_out_f);
+			fwrite (&padded_size, sizeof (int32), 1, writer_p -> amw_out_f);
+			fwrite (GetFlatBufferData (builder_p), 1, metadata_size, writer_p -> amw_out_f);
+			WriteArrowPadding (writer_p, padded_size - metadata_size);
+
+			for (i = 0; i < num_buffers; ++ i)
+				{
+					if (buffers_p [i].abb_length > 0)
+						{
+							fwrite (buffers_p [i].abb_data_p, 1, buffers_p [i].abb_length, writer_p -> amw_out_f);
+							WriteArrowPadding (writer_p, GetArrowPadding (buffers_p [i].abb_length));
+						}
+				}
+
+			block_p -> ab_offset = (int64) (writer_p -> amw_offset);
+			block_p -> ab_metadata_length = padded_size + 8;
+			block_p -> ab_padding = 0;
+			block_p -> ab_body_length = body_length;
+
+			writer_p -> amw_offset += 8 + padded_size + body_length;
+
+			if (!ferror (writer_p -> amw_out_f))
+				{
+					return true;
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write Arrow message");
+		}
+
+	return false;
+}
+
+
+static void WriteArrowPadding (ArrowMatrixWriter *writer_p, const size_t num_bytes)
+{
+	static const uint8 padding [8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+	if (num_bytes > 0)
+		{
+			fwrite (padding, 1, num_bytes, writer_p -> amw_out_f);
+		}
+}
+
+
+static void SetValidityBit (uint8 *validity_p, const uint32 row)
+{
+	validity_p [row >> 3] |= (uint8) (1 << (row & 7));
+}
+
+
+/*
+ * Everything in the file is aligned to 8 bytes.
+ */
+static inline size_t GetArrowPadding (const size_t length)
+{
+	return (8 - (length & 7)) & 7;
+}
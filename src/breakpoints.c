@@ -0,0 +1,619 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * breakpoints.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "breakpoints.h"
+#include "genetic_map.h"
+#include "parent_genotypes.h"
+#include "parental_genotype_service.h"
+#include "job_arena.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+static const char * const S_START_S = "start";
+
+static const char * const S_END_S = "end";
+
+static const char * const S_START_MARKER_S = "start_marker";
+
+static const char * const S_END_MARKER_S = "end_marker";
+
+static const char * const S_FROM_S = "from";
+
+static const char * const S_TO_S = "to";
+
+
+/*
+ * The calls either side of a breakpoint are stored as the usual
+ * ABH codes, indexed by GenotypeClass
+ */
+static const char * const S_CLASS_CODES_SS [GC_NUM_CLASSES] = { "A", "B", "H", "-" };
+
+
+/*
+ * Where a progeny line is up to as the markers are walked.
+ */
+typedef struct ProgenyState
+{
+	/**
+	 * The line's last call on the current chromosome, or GC_MISSING
+	 * if it hasn't had one yet.
+	 */
+	GenotypeClass ps_last_class;
+
+	/** The index of the marker that ps_last_class was called at. */
+	uint32 ps_last_marker;
+
+	/** The line's breakpoints. */
+	json_t *ps_breakpoints_p;
+} ProgenyState;
+
+
+static bool FindBreakpoints (const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, ProgenyState *states_p, const size_t num_progeny);
+
+static bool AddBreakpoint (ProgenyState *state_p, const MapMarker *start_p, const MapMarker *end_p, const GenotypeClass to_class, JobArena *arena_p);
+
+static bool SetMarkerDetails (json_t *breakpoint_p, const MapMarker *marker_p, const char *name_key_s, const char *position_key_s, JobArena *arena_p);
+
+static bool WriteBreakpoints (const bson_oid_t *id_p, const char *population_s, const json_t *accession_indexes_p, const ProgenyState *states_p, ParentalGenotypeServiceData *data_p);
+
+static bool AddBreakpointsUpdate (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *accession_s, json_t *breakpoints_p);
+
+static bool AddBreakpointsQuery (bson_t *query_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p);
+
+static bool AddIntervalBound (bson_t *match_p, const char *key_s, const char *op_s, const double64 *value_p);
+
+static bool FilterBreakpoints (json_t *results_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p);
+
+static bool IsBreakpointInRange (const json_t *breakpoint_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p);
+
+
+
+bool SaveBreakpoints (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	uint32 num_markers = 0;
+	MapMarker *markers_p = GetMarkersInMapOrder (population_p, NULL, false, &num_markers);
+
+	if (markers_p)
+		{
+			json_t *accession_indexes_p = GetAccessionIndexes (markers_p, num_markers);
+
+			if (accession_indexes_p)
+				{
+					const size_t num_progeny = json_object_size (accession_indexes_p);
+
+					if (num_progeny == 0)
+						{
+							success_flag = true;
+						}
+					else
+						{
+							ProgenyState *states_p = (ProgenyState *) AllocMemoryArray (num_progeny, sizeof (ProgenyState));
+
+							if (states_p)
+								{
+									size_t i;
+
+									if (FindBreakpoints (markers_p, num_markers, accession_indexes_p, parents_p, states_p, num_progeny))
+										{
+											success_flag = WriteBreakpoints (id_p, population_s, accession_indexes_p, states_p, data_p);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to find the breakpoints for \"%s\"", population_s);
+										}
+
+									for (i = 0; i < num_progeny; ++ i)
+										{
+											if (states_p [i].ps_breakpoints_p)
+												{
+													json_decref (states_p [i].ps_breakpoints_p);
+												}
+										}
+
+									FreeMemory (states_p);
+								}		/* if (states_p) */
+						}
+
+					json_decref (accession_indexes_p);
+				}		/* if (accession_indexes_p) */
+
+			FreeMemory (markers_p);
+		}		/* if (markers_p) */
+
+	return success_flag;
+}
+
+
+json_t *GetBreakpoints (const char *accession_s, const char *population_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s))
+		{
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					if (((IsStringEmpty (accession_s)) || (BSON_APPEND_UTF8 (query_p, PGS_ACCESSION_S, accession_s))) &&
+							((IsStringEmpty (population_s)) || (BSON_APPEND_UTF8 (query_p, PGS_POPULATION_S, population_s))) &&
+							(AddBreakpointsQuery (query_p, chromosome_s, start_p, end_p)))
+						{
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+							if (!opts_p)
+								{
+									opts_p = bson_new ();
+								}
+
+							if (opts_p)
+								{
+									bson_t *sort_p = BCON_NEW (PGS_POPULATION_S, BCON_INT32 (1), PGS_ACCESSION_S, BCON_INT32 (1));
+
+									if (sort_p)
+										{
+											/*
+											 * Leave out the genotypes since they are much bigger than the breakpoints
+											 */
+											bson_t *projection_p = BCON_NEW (MONGO_ID_S, BCON_BOOL (false), PGS_ACCESSION_S, BCON_BOOL (true), PGS_POPULATION_S, BCON_BOOL (true), PGS_BREAKPOINTS_S, BCON_BOOL (true));
+
+											if (projection_p)
+												{
+													if ((BSON_APPEND_DOCUMENT (opts_p, "sort", sort_p)) && (BSON_APPEND_DOCUMENT (opts_p, "projection", projection_p)))
+														{
+															results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+															/*
+															 * The query matches the lines with any breakpoint in range
+															 * so drop the rest of each line's breakpoints
+															 */
+															if (results_p)
+																{
+																	if (!FilterBreakpoints (results_p, chromosome_s, start_p, end_p))
+																		{
+																			json_decref (results_p);
+																			results_p = NULL;
+																		}
+																}
+														}
+
+													bson_destroy (projection_p);
+												}
+
+											bson_destroy (sort_p);
+										}
+
+									bson_destroy (opts_p);
+								}		/* if (opts_p) */
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s)) */
+
+	return results_p;
+}
+
+
+/*
+ * This is a single pass over the markers in map order, which keeps
+ * the last call for every line so that each call is only looked at once.
+ */
+static bool FindBreakpoints (const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, ProgenyState *states_p, const size_t num_progeny)
+{
+	bool success_flag = true;
+	const char *chromosome_s = NULL;
+	JobArena arena;
+	uint32 i;
+	size_t j;
+
+	for (j = 0; j < num_progeny; ++ j)
+		{
+			states_p [j].ps_last_class = GC_MISSING;
+			states_p [j].ps_last_marker = 0;
+
+			if ((states_p [j].ps_breakpoints_p = json_array ()) == NULL)
+				{
+					success_flag = false;
+				}
+		}
+
+	InitJobArena (&arena);
+
+	for (i = 0; (i < num_markers) && success_flag; ++ i)
+		{
+			const MapMarker *marker_p = markers_p + i;
+			const json_t *parent_genotypes_p = json_object_get (parents_p, marker_p -> mm_name_s);
+			const char *parent_a_s = json_string_value (json_array_get (parent_genotypes_p, 0));
+			const char *parent_b_s = json_string_value (json_array_get (parent_genotypes_p, 1));
+			const char *accession_s;
+			json_t *value_p;
+
+			/*
+			 * The markers are sorted by chromosome so a new one starts
+			 * every line off again
+			 */
+			if ((chromosome_s == NULL) || (strcmp (chromosome_s, marker_p -> mm_chromosome_s) != 0))
+				{
+					for (j = 0; j < num_progeny; ++ j)
+						{
+							states_p [j].ps_last_class = GC_MISSING;
+						}
+
+					chromosome_s = marker_p -> mm_chromosome_s;
+				}
+
+			ResolveParentGenotypes (&parent_a_s, &parent_b_s);
+
+			json_object_foreach ((json_t *) (marker_p -> mm_marker_p), accession_s, value_p)
+				{
+					if (success_flag && (json_is_string (value_p)) && (!IsMarkerMetadataKey (accession_s)))
+						{
+							const GenotypeClass gc = GetGenotypeClass (json_string_value (value_p), parent_a_s, parent_b_s);
+
+							if (gc != GC_MISSING)
+								{
+									ProgenyState *state_p = states_p + json_integer_value (json_object_get (accession_indexes_p, accession_s));
+
+									if ((state_p -> ps_last_class != GC_MISSING) && (state_p -> ps_last_class != gc))
+										{
+											success_flag = AddBreakpoint (state_p, markers_p + state_p -> ps_last_marker, marker_p, gc, &arena);
+										}
+
+									state_p -> ps_last_class = gc;
+									state_p -> ps_last_marker = i;
+								}
+						}
+				}
+
+			ResetJobArena (&arena);
+		}
+
+	ClearJobArena (&arena);
+
+	return success_flag;
+}
+
+
+static bool AddBreakpoint (ProgenyState *state_p, const MapMarker *start_p, const MapMarker *end_p, const GenotypeClass to_class, JobArena *arena_p)
+{
+	json_t *breakpoint_p = json_object ();
+
+	if (breakpoint_p)
+		{
+			if ((SetJSONString (breakpoint_p, PGS_CHROMOSOME_S, end_p -> mm_chromosome_s)) &&
+					(SetMarkerDetails (breakpoint_p, start_p, S_START_MARKER_S, S_START_S, arena_p)) &&
+					(SetMarkerDetails (breakpoint_p, end_p, S_END_MARKER_S, S_END_S, arena_p)) &&
+					(SetJSONString (breakpoint_p, S_FROM_S, S_CLASS_CODES_SS [state_p -> ps_last_class])) &&
+					(SetJSONString (breakpoint_p, S_TO_S, S_CLASS_CODES_SS [to_class])))
+				{
+					/*
+					 * json_array_append_new () takes breakpoint_p even if it fails
+					 */
+					return (json_array_append_new (state_p -> ps_breakpoints_p, breakpoint_p) == 0);
+				}
+
+			json_decref (breakpoint_p);
+		}
+
+	return false;
+}
+
+
+/*
+ * Markers without a numeric mapping position only have their name
+ * stored, so they won't match any interval queries.
+ */
+static bool SetMarkerDetails (json_t *breakpoint_p, const MapMarker *marker_p, const char *name_key_s, const char *position_key_s, JobArena *arena_p)
+{
+	const char *name_s = SearchAndReplaceInStringInJobArena (arena_p, marker_p -> mm_name_s, PGS_ESCAPED_DOT_S, ".");
+
+	if ((name_s) && (SetJSONString (breakpoint_p, name_key_s, name_s)))
+		{
+			return ((!isfinite (marker_p -> mm_position)) || (SetJSONReal (breakpoint_p, position_key_s, marker_p -> mm_position)));
+		}
+
+	return false;
+}
+
+
+static bool WriteBreakpoints (const bson_oid_t *id_p, const char *population_s, const json_t *accession_indexes_p, const ProgenyState *states_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s))
+		{
+			bson_t *opts_p = BCON_NEW ("ordered", BCON_BOOL (false));
+
+			if (opts_p)
+				{
+					mongoc_bulk_operation_t *bulk_p = mongoc_collection_create_bulk_operation_with_opts (data_p -> pgsd_mongo_p -> mt_collection_p, opts_p);
+
+					if (bulk_p)
+						{
+							const char *accession_s;
+							json_t *index_p;
+
+							success_flag = true;
+
+							/*
+							 * Every line is written, even those without any breakpoints,
+							 * so that appending progeny replaces any out of date ones
+							 */
+							json_object_foreach ((json_t *) accession_indexes_p, accession_s, index_p)
+								{
+									if (success_flag)
+										{
+											success_flag = AddBreakpointsUpdate (bulk_p, id_p, population_s, accession_s, states_p [json_integer_value (index_p)].ps_breakpoints_p);
+										}
+								}
+
+							if (success_flag)
+								{
+									bson_t reply;
+									bson_error_t error;
+
+									if (mongoc_bulk_operation_execute (bulk_p, &reply, &error) == 0)
+										{
+											PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, &reply, "Failed to save breakpoints for \"%s\" to \"%s\": %s", population_s, data_p -> pgsd_progeny_collection_s, error.message);
+											success_flag = false;
+										}
+
+									bson_destroy (&reply);
+								}
+
+							mongoc_bulk_operation_destroy (bulk_p);
+						}		/* if (bulk_p) */
+
+					bson_destroy (opts_p);
+				}		/* if (opts_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s)) */
+
+	return success_flag;
+}
+
+
+static bool AddBreakpointsUpdate (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *accession_s, json_t *breakpoints_p)
+{
+	bool success_flag = false;
+	json_t *fields_p = json_object ();
+
+	if (fields_p)
+		{
+			if ((SetJSONString (fields_p, PGS_POPULATION_S, population_s)) && (json_object_set (fields_p, PGS_BREAKPOINTS_S, breakpoints_p) == 0))
+				{
+					bson_t *fields_bson_p = ConvertJSONToBSON (fields_p);
+
+					if (fields_bson_p)
+						{
+							bson_t *update_p = BCON_NEW ("$set", BCON_DOCUMENT (fields_bson_p));
+
+							if (update_p)
+								{
+									bson_t *selector_p = BCON_NEW (PGS_POPULATION_ID_S, BCON_OID (id_p), PGS_ACCESSION_S, BCON_UTF8 (accession_s));
+
+									if (selector_p)
+										{
+											bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+											if (opts_p)
+												{
+													bson_error_t error;
+
+													if (mongoc_bulk_operation_update_one_with_opts (bulk_p, selector_p, update_p, opts_p, &error))
+														{
+															success_flag = true;
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add breakpoints for \"%s\" to bulk update: %s", accession_s, error.message);
+														}
+
+													bson_destroy (opts_p);
+												}
+
+											bson_destroy (selector_p);
+										}
+
+									bson_destroy (update_p);
+								}		/* if (update_p) */
+
+							bson_destroy (fields_bson_p);
+						}		/* if (fields_bson_p) */
+				}
+
+			json_decref (fields_p);
+		}		/* if (fields_p) */
+
+	return success_flag;
+}
+
+
+static bool AddBreakpointsQuery (bson_t *query_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p)
+{
+	bool success_flag = false;
+
+	if ((IsStringEmpty (chromosome_s)) && (!start_p) && (!end_p))
+		{
+			/*
+			 * Just the lines that have any breakpoints
+			 */
+			bson_t *exists_p = BCON_NEW ("$exists", BCON_BOOL (true));
+
+			if (exists_p)
+				{
+					success_flag = BSON_APPEND_DOCUMENT (query_p, "breakpoints.0", exists_p);
+					bson_destroy (exists_p);
+				}
+		}
+	else
+		{
+			bson_t *match_p = bson_new ();
+
+			if (match_p)
+				{
+					/*
+					 * A breakpoint overlaps the interval if it ends after the
+					 * interval starts and starts before the interval ends
+					 */
+					if (((IsStringEmpty (chromosome_s)) || (BSON_APPEND_UTF8 (match_p, PGS_CHROMOSOME_S, chromosome_s))) &&
+							(AddIntervalBound (match_p, S_END_S, "$gte", start_p)) &&
+							(AddIntervalBound (match_p, S_START_S, "$lte", end_p)))
+						{
+							bson_t *elem_match_p = BCON_NEW ("$elemMatch", BCON_DOCUMENT (match_p));
+
+							if (elem_match_p)
+								{
+									success_flag = BSON_APPEND_DOCUMENT (query_p, PGS_BREAKPOINTS_S, elem_match_p);
+									bson_destroy (elem_match_p);
+								}
+						}
+
+					bson_destroy (match_p);
+				}		/* if (match_p) */
+		}
+
+	return success_flag;
+}
+
+
+static bool AddIntervalBound (bson_t *match_p, const char *key_s, const char *op_s, const double64 *value_p)
+{
+	bool success_flag = true;
+
+	if (value_p)
+		{
+			bson_t *bound_p = BCON_NEW (op_s, BCON_DOUBLE (*value_p));
+
+			success_flag = false;
+
+			if (bound_p)
+				{
+					success_flag = BSON_APPEND_DOCUMENT (match_p, key_s, bound_p);
+					bson_destroy (bound_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool FilterBreakpoints (json_t *results_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p)
+{
+	bool success_flag = true;
+
+	if ((!IsStringEmpty (chromosome_s)) || (start_p) || (end_p))
+		{
+			size_t i;
+			json_t *result_p;
+
+			json_array_foreach (results_p, i, result_p)
+				{
+					if (success_flag)
+						{
+							const json_t *breakpoints_p = json_object_get (result_p, PGS_BREAKPOINTS_S);
+							json_t *matches_p = json_array ();
+
+							if (matches_p)
+								{
+									size_t j;
+									json_t *breakpoint_p;
+
+									json_array_foreach (breakpoints_p, j, breakpoint_p)
+										{
+											if (success_flag && (IsBreakpointInRange (breakpoint_p, chromosome_s, start_p, end_p)))
+												{
+													success_flag = (json_array_append (matches_p, breakpoint_p) == 0);
+												}
+										}
+
+									/*
+									 * json_object_set_new () takes matches_p even if it fails
+									 */
+									if (success_flag)
+										{
+											success_flag = (json_object_set_new (result_p, PGS_BREAKPOINTS_S, matches_p) == 0);
+										}
+									else
+										{
+											json_decref (matches_p);
+										}
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to filter breakpoints");
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool IsBreakpointInRange (const json_t *breakpoint_p, const char *chromosome_s, const double64 *start_p, const double64 *end_p)
+{
+	if (!IsStringEmpty (chromosome_s))
+		{
+			const char *breakpoint_chromosome_s = GetJSONString (breakpoint_p, PGS_CHROMOSOME_S);
+
+			if ((!breakpoint_chromosome_s) || (strcmp (breakpoint_chromosome_s, chromosome_s) != 0))
+				{
+					return false;
+				}
+		}
+
+	if (start_p)
+		{
+			double64 end = 0.0;
+
+			if ((!GetJSONReal (breakpoint_p, S_END_S, &end)) || (end < *start_p))
+				{
+					return false;
+				}
+		}
+
+	if (end_p)
+		{
+			double64 start = 0.0;
+
+			if ((!GetJSONReal (breakpoint_p, S_START_S, &start)) || (start > *end_p))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
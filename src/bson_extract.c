@@ -0,0 +1,138 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * bson_extract.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "bson_extract.h"
+
+#include "streams.h"
+
+
+static json_t *GetBSONContainerAsJSON (const bson_iter_t *iter_p, const bool array_flag);
+
+
+
+const char *GetBSONString (const bson_t *doc_p, const char *key_s)
+{
+	bson_iter_t iter;
+
+	if ((bson_iter_init_find (&iter, doc_p, key_s)) && (BSON_ITER_HOLDS_UTF8 (&iter)))
+		{
+			return bson_iter_utf8 (&iter, NULL);
+		}
+
+	return NULL;
+}
+
+
+json_t *GetBSONIterAsJSON (const bson_iter_t *iter_p)
+{
+	json_t *value_p = NULL;
+
+	switch (bson_iter_type (iter_p))
+		{
+			case BSON_TYPE_UTF8:
+				{
+					uint32_t length = 0;
+					const char *value_s = bson_iter_utf8 (iter_p, &length);
+
+					value_p = json_stringn (value_s, length);
+				}
+				break;
+
+			case BSON_TYPE_INT32:
+				value_p = json_integer (bson_iter_int32 (iter_p));
+				break;
+
+			case BSON_TYPE_INT64:
+				value_p = json_integer (bson_iter_int64 (iter_p));
+				break;
+
+			case BSON_TYPE_DOUBLE:
+				value_p = json_real (bson_iter_double (iter_p));
+				break;
+
+			case BSON_TYPE_BOOL:
+				value_p = json_boolean (bson_iter_bool (iter_p));
+				break;
+
+			case BSON_TYPE_NULL:
+				value_p = json_null ();
+				break;
+
+			case BSON_TYPE_DOCUMENT:
+				value_p = GetBSONContainerAsJSON (iter_p, false);
+				break;
+
+			case BSON_TYPE_ARRAY:
+				value_p = GetBSONContainerAsJSON (iter_p, true);
+				break;
+
+			default:
+				break;
+		}
+
+	return value_p;
+}
+
+
+static json_t *GetBSONContainerAsJSON (const bson_iter_t *iter_p, const bool array_flag)
+{
+	bson_iter_t child_iter;
+
+	if (bson_iter_recurse (iter_p, &child_iter))
+		{
+			json_t *container_p = array_flag ? json_array () : json_object ();
+
+			if (container_p)
+				{
+					bool success_flag = true;
+
+					while (success_flag && (bson_iter_next (&child_iter)))
+						{
+							json_t *child_p = GetBSONIterAsJSON (&child_iter);
+
+							/*
+							 * Any unsupported types are skipped
+							 */
+							if (child_p)
+								{
+									if (array_flag)
+										{
+											success_flag = (json_array_append_new (container_p, child_p) == 0);
+										}
+									else
+										{
+											success_flag = (json_object_set_new (container_p, bson_iter_key (&child_iter), child_p) == 0);
+										}
+								}
+						}
+
+					if (success_flag)
+						{
+							return container_p;
+						}
+
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to convert \"%s\" to JSON", bson_iter_key (iter_p));
+					json_decref (container_p);
+				}
+		}
+
+	return NULL;
+}
@@ -0,0 +1,418 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * collection_indexes.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <string.h>
+
+#include "collection_indexes.h"
+#include "parental_genotype_service.h"
+
+#include "streams.h"
+#include "string_utils.h"
+
+
+static bool CheckIndex (ParentalGenotypeServiceData *data_p, const char *collection_s, const char *key_0_s, const char *key_1_s, const bool unique_flag, const bool sparse_flag, const bool create_flag);
+
+static bool DoesIndexExist (mongoc_collection_t *collection_p, const bson_t *keys_p);
+
+static bool DoKeysMatch (const bson_t *index_p, const bson_t *keys_p);
+
+static bool CreateIndex (MongoTool *tool_p, const char *collection_s, const bson_t *keys_p, const char *key_0_s, const char *key_1_s, const bool unique_flag, const bool sparse_flag);
+
+static bool IsQueryIndexed (mongoc_collection_t *collection_p, const char *collection_s, const bson_t *keys_p);
+
+static bool HasStage (bson_iter_t *iter_p, const char *stage_s);
+
+
+
+bool CheckCollectionIndexes (ParentalGenotypeServiceData *data_p, const bool create_flag)
+{
+	bool success_flag = true;
+
+	/*
+	 * The varieties are looked up by name when searching for a population
+	 * and when each submission updates the parents.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_varieties_collection_s, PGS_POPULATION_NAME_S, NULL, true, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * Populations are found by name when appending to an existing one
+	 * and the parents index covers looking up all of the crosses
+	 * between a given pair of varieties.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_populations_collection_s, PGS_POPULATION_NAME_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * Appending claims the population's name so that concurrent appends
+	 * can't each create their own population. Populations from plain
+	 * submissions don't have a claim, so the index is sparse.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_populations_collection_s, PGS_CLAIMED_NAME_S, NULL, true, true, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_populations_collection_s, PGS_PARENT_A_S, PGS_PARENT_B_S, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * The populations that are only stored as haplotype blocks are
+	 * found by the marker searches through their lists of markers.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_populations_collection_s, PGS_MARKERS_S, NULL, false, true, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * The summaries are listed in name order and can be filtered
+	 * by the population name or either of the parents.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_summaries_collection_s, PGS_POPULATION_NAME_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_summaries_collection_s, PGS_PARENT_A_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_summaries_collection_s, PGS_PARENT_B_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * Each progeny line is written by population and accession
+	 * and is looked up by accession.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_progeny_collection_s, PGS_POPULATION_ID_S, PGS_ACCESSION_S, true, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_progeny_collection_s, PGS_ACCESSION_S, PGS_POPULATION_S, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * The breakpoints for a whole population are found by its name
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_progeny_collection_s, PGS_POPULATION_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_parent_genotypes_collection_s, PGS_POPULATION_NAME_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_haplotype_blocks_collection_s, PGS_POPULATION_NAME_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	/*
+	 * The marker statistics are written by population and marker
+	 * and are filtered by population or chromosome.
+	 */
+	if (!CheckIndex (data_p, data_p -> pgsd_marker_stats_collection_s, PGS_POPULATION_ID_S, PGS_MARKER_S, true, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_marker_stats_collection_s, PGS_POPULATION_S, PGS_CHROMOSOME_S, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	if (!CheckIndex (data_p, data_p -> pgsd_marker_stats_collection_s, PGS_CHROMOSOME_S, NULL, false, false, create_flag))
+		{
+			success_flag = false;
+		}
+
+	return success_flag;
+}
+
+
+static bool CheckIndex (ParentalGenotypeServiceData *data_p, const char *collection_s, const char *key_0_s, const char *key_1_s, const bool unique_flag, const bool sparse_flag, const bool create_flag)
+{
+	bool success_flag = false;
+	bson_t *keys_p = bson_new ();
+
+	if (keys_p)
+		{
+			if ((BSON_APPEND_INT32 (keys_p, key_0_s, 1)) && ((key_1_s == NULL) || (BSON_APPEND_INT32 (keys_p, key_1_s, 1))))
+				{
+					if (SetMongoToolCollection (data_p -> pgsd_mongo_p, collection_s))
+						{
+							mongoc_collection_t *collection_p = data_p -> pgsd_mongo_p -> mt_collection_p;
+							bool exists_flag = DoesIndexExist (collection_p, keys_p);
+
+							if ((!exists_flag) && create_flag)
+								{
+									PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Creating index on \"%s\"%s%s in \"%s\"", key_0_s, key_1_s ? ", " : "", key_1_s ? key_1_s : "", collection_s);
+
+									exists_flag = CreateIndex (data_p -> pgsd_mongo_p, collection_s, keys_p, key_0_s, key_1_s, unique_flag, sparse_flag);
+								}
+
+							if (exists_flag)
+								{
+									PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Expecting queries on \"%s\" by \"%s\"%s%s to use an index scan", collection_s, key_0_s, key_1_s ? ", " : "", key_1_s ? key_1_s : "");
+
+									if (IsQueryIndexed (collection_p, collection_s, keys_p))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Queries on \"%s\" by \"%s\"%s%s will use a collection scan", collection_s, key_0_s, key_1_s ? ", " : "", key_1_s ? key_1_s : "");
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "There is no index on \"%s\"%s%s in \"%s\" so queries will use a collection scan", key_0_s, key_1_s ? ", " : "", key_1_s ? key_1_s : "", collection_s);
+								}
+
+						}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, collection_s)) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set collection to \"%s\"", collection_s);
+						}
+
+				}
+
+			bson_destroy (keys_p);
+		}		/* if (keys_p) */
+
+	return success_flag;
+}
+
+
+static bool DoesIndexExist (mongoc_collection_t *collection_p, const bson_t *keys_p)
+{
+	bool exists_flag = false;
+	mongoc_cursor_t *cursor_p = mongoc_collection_find_indexes_with_opts (collection_p, NULL);
+
+	if (cursor_p)
+		{
+			const bson_t *index_p;
+			bson_error_t error;
+
+			while ((!exists_flag) && (mongoc_cursor_next (cursor_p, &index_p)))
+				{
+					exists_flag = DoKeysMatch (index_p, keys_p);
+				}
+
+			if (mongoc_cursor_error (cursor_p, &error))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to list indexes: %s", error.message);
+				}
+
+			mongoc_cursor_destroy (cursor_p);
+		}		/* if (cursor_p) */
+
+	return exists_flag;
+}
+
+
+/*
+ * An index matches if its keys are the same fields, in the same order,
+ * and are all ascending.
+ */
+static bool DoKeysMatch (const bson_t *index_p, const bson_t *keys_p)
+{
+	bson_iter_t index_iter;
+
+	if ((bson_iter_init_find (&index_iter, index_p, "key")) && (BSON_ITER_HOLDS_DOCUMENT (&index_iter)))
+		{
+			bson_iter_t index_keys_iter;
+			bson_iter_t keys_iter;
+
+			if ((bson_iter_recurse (&index_iter, &index_keys_iter)) && (bson_iter_init (&keys_iter, keys_p)))
+				{
+					bool index_next_flag = bson_iter_next (&index_keys_iter);
+					bool keys_next_flag = bson_iter_next (&keys_iter);
+
+					while (index_next_flag && keys_next_flag)
+						{
+							if ((strcmp (bson_iter_key (&index_keys_iter), bson_iter_key (&keys_iter)) != 0) || (bson_iter_as_int64 (&index_keys_iter) != 1))
+								{
+									return false;
+								}
+
+							index_next_flag = bson_iter_next (&index_keys_iter);
+							keys_next_flag = bson_iter_next (&keys_iter);
+						}
+
+					return ((!index_next_flag) && (!keys_next_flag));
+				}
+		}
+
+	return false;
+}
+
+
+static bool CreateIndex (MongoTool *tool_p, const char *collection_s, const bson_t *keys_p, const char *key_0_s, const char *key_1_s, const bool unique_flag, const bool sparse_flag)
+{
+	bool success_flag = false;
+
+	/*
+	 * Use the same name that the server would give the index by default
+	 */
+	char *name_s = key_1_s ? ConcatenateVarargsStrings (key_0_s, "_1_", key_1_s, "_1", NULL) : ConcatenateStrings (key_0_s, "_1");
+
+	if (name_s)
+		{
+			bson_t *command_p = BCON_NEW ("createIndexes", BCON_UTF8 (collection_s),
+																		"indexes", "[", "{", "key", BCON_DOCUMENT (keys_p), "name", BCON_UTF8 (name_s), "unique", BCON_BOOL (unique_flag), "sparse", BCON_BOOL (sparse_flag), "}", "]");
+
+			if (command_p)
+				{
+					bson_t reply;
+					bson_error_t error;
+
+					if (mongoc_database_write_command_with_opts (tool_p -> mt_database_p, command_p, NULL, &reply, &error))
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, keys_p, "Failed to create index \"%s\" in \"%s\": %s", name_s, collection_s, error.message);
+						}
+
+					bson_destroy (&reply);
+					bson_destroy (command_p);
+				}		/* if (command_p) */
+
+			FreeCopiedString (name_s);
+		}		/* if (name_s) */
+
+	return success_flag;
+}
+
+
+/*
+ * Ask the server how it would run a query on the given keys and
+ * check that it wouldn't need to scan the whole collection.
+ */
+static bool IsQueryIndexed (mongoc_collection_t *collection_p, const char *collection_s, const bson_t *keys_p)
+{
+	bool indexed_flag = false;
+	bson_t *filter_p = bson_new ();
+
+	if (filter_p)
+		{
+			bson_iter_t keys_iter;
+			bool success_flag = bson_iter_init (&keys_iter, keys_p);
+
+			while (success_flag && (bson_iter_next (&keys_iter)))
+				{
+					success_flag = BSON_APPEND_UTF8 (filter_p, bson_iter_key (&keys_iter), "");
+				}
+
+			if (success_flag)
+				{
+					bson_t *command_p = BCON_NEW ("explain", "{", "find", BCON_UTF8 (collection_s), "filter", BCON_DOCUMENT (filter_p), "}",
+																				"verbosity", BCON_UTF8 ("queryPlanner"));
+
+					if (command_p)
+						{
+							bson_t reply;
+							bson_error_t error;
+
+							if (mongoc_collection_read_command_with_opts (collection_p, command_p, NULL, NULL, &reply, &error))
+								{
+									bson_iter_t reply_iter;
+
+									if ((bson_iter_init_find (&reply_iter, &reply, "queryPlanner")) && (BSON_ITER_HOLDS_DOCUMENT (&reply_iter)))
+										{
+											bson_iter_t plan_iter;
+
+											if ((bson_iter_recurse (&reply_iter, &plan_iter)) && (bson_iter_find (&plan_iter, "winningPlan")))
+												{
+													indexed_flag = !HasStage (&plan_iter, "COLLSCAN");
+												}
+										}
+
+									if (!indexed_flag)
+										{
+											PrintBSONToLog (STM_LEVEL_INFO, __FILE__, __LINE__, &reply, "Query plan for \"%s\"", collection_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get the query plan for \"%s\": %s", collection_s, error.message);
+								}
+
+							bson_destroy (&reply);
+							bson_destroy (command_p);
+						}		/* if (command_p) */
+				}
+
+			bson_destroy (filter_p);
+		}		/* if (filter_p) */
+
+	return indexed_flag;
+}
+
+
+/*
+ * Plans are nested through "inputStage" and "inputStages" so
+ * search the whole of the given value.
+ */
+static bool HasStage (bson_iter_t *iter_p, const char *stage_s)
+{
+	if ((BSON_ITER_HOLDS_DOCUMENT (iter_p)) || (BSON_ITER_HOLDS_ARRAY (iter_p)))
+		{
+			bson_iter_t child_iter;
+
+			if (bson_iter_recurse (iter_p, &child_iter))
+				{
+					while (bson_iter_next (&child_iter))
+						{
+							if ((strcmp (bson_iter_key (&child_iter), "stage") == 0) && (BSON_ITER_HOLDS_UTF8 (&child_iter)))
+								{
+									if (strcmp (bson_iter_utf8 (&child_iter, NULL), stage_s) == 0)
+										{
+											return true;
+										}
+								}
+							else if (HasStage (&child_iter, stage_s))
+								{
+									return true;
+								}
+						}
+				}
+		}
+
+	return false;
+}
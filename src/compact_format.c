@@ -0,0 +1,407 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * compact_format.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "compact_format.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+static const char * const S_ACCESSIONS_S = "accessions";
+static const char * const S_MARKERS_S = "markers";
+static const char * const S_GENOTYPES_S = "genotypes";
+static const char * const S_ENCODING_S = "encoding";
+static const char * const S_DATA_S = "data";
+
+
+static bool CopyStringIfPresent (const json_t *src_p, json_t *dest_p, const char *key_s);
+
+static json_t *GetCompactMarker (const json_t *src_marker_p, json_t *accession_indexes_p, json_t *accessions_p);
+
+static bool PadGenotypes (json_t *markers_p, const size_t num_accessions);
+
+static char *GetGzippedData (const char *data_s, const size_t data_length, size_t *compressed_length_p);
+
+
+
+json_t *GetPopulationInCompactFormat (const json_t *src_p, const ResponseFormat format, JobArena *arena_p)
+{
+	json_t *dest_p = json_object ();
+
+	if (dest_p)
+		{
+			if ((CopyStringIfPresent (src_p, dest_p, PGS_POPULATION_NAME_S)) &&
+					(CopyStringIfPresent (src_p, dest_p, PGS_PARENT_A_S)) &&
+					(CopyStringIfPresent (src_p, dest_p, PGS_PARENT_B_S)))
+				{
+					json_t *accessions_p = json_array ();
+
+					if (accessions_p)
+						{
+							if (json_object_set_new (dest_p, S_ACCESSIONS_S, accessions_p) == 0)
+								{
+									json_t *markers_p = json_object ();
+
+									if (markers_p)
+										{
+											if (json_object_set_new (dest_p, S_MARKERS_S, markers_p) == 0)
+												{
+													/*
+													 * A map of accession name to its index in accessions_p
+													 */
+													json_t *accession_indexes_p = json_object ();
+
+													if (accession_indexes_p)
+														{
+															bool success_flag = true;
+															const char *key_s;
+															json_t *value_p;
+
+															json_object_foreach ((json_t *) src_p, key_s, value_p)
+																{
+																	if (success_flag && IsMarkerEntry (key_s, value_p))
+																		{
+																			json_t *marker_p = GetCompactMarker (value_p, accession_indexes_p, accessions_p);
+
+																			success_flag = false;
+
+																			if (marker_p)
+																				{
+																					const char *unescaped_key_s = SearchAndReplaceInStringInJobArena (arena_p, key_s, PGS_ESCAPED_DOT_S, ".");
+
+																					if (unescaped_key_s)
+																						{
+																							if (json_object_set_new (markers_p, unescaped_key_s, marker_p) == 0)
+																								{
+																									success_flag = true;
+																								}
+																						}
+
+																					if (!success_flag)
+																						{
+																							json_decref (marker_p);
+																						}
+																				}
+																		}
+																}
+
+															json_decref (accession_indexes_p);
+															ResetJobArena (arena_p);
+
+															if (success_flag)
+																{
+																	if (PadGenotypes (markers_p, json_array_size (accessions_p)))
+																		{
+																			if (format == RF_COMPACT_GZIP)
+																				{
+																					json_t *compressed_p = GetCompressedDocument (dest_p);
+
+																					json_decref (dest_p);
+																					return compressed_p;
+																				}
+
+																			return dest_p;
+																		}
+																}
+
+														}		/* if (accession_indexes_p) */
+
+												}		/* if (json_object_set_new (dest_p, S_MARKERS_S, markers_p) == 0) */
+											else
+												{
+													json_decref (markers_p);
+												}
+
+										}		/* if (markers_p) */
+
+								}		/* if (json_object_set_new (dest_p, S_ACCESSIONS_S, accessions_p) == 0) */
+							else
+								{
+									json_decref (accessions_p);
+								}
+
+						}		/* if (accessions_p) */
+
+				}
+
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, src_p, "Failed to convert population to compact format");
+			json_decref (dest_p);
+		}		/* if (dest_p) */
+
+	return NULL;
+}
+
+
+json_t *GetCompressedDocument (const json_t *compact_p)
+{
+	json_t *compressed_p = NULL;
+	char *dump_s = json_dumps (compact_p, JSON_COMPACT);
+
+	if (dump_s)
+		{
+			size_t compressed_length = 0;
+			char *compressed_data_p = GetGzippedData (dump_s, strlen (dump_s), &compressed_length);
+
+			if (compressed_data_p)
+				{
+					char *encoded_s = GetAsBase64 ((const unsigned char *) compressed_data_p, compressed_length);
+
+					if (encoded_s)
+						{
+							compressed_p = json_object ();
+
+							if (compressed_p)
+								{
+									if (!((CopyStringIfPresent (compact_p, compressed_p, PGS_POPULATION_NAME_S)) &&
+											(SetJSONString (compressed_p, S_ENCODING_S, "gzip+base64")) &&
+											(SetJSONString (compressed_p, S_DATA_S, encoded_s))))
+										{
+											json_decref (compressed_p);
+											compressed_p = NULL;
+										}
+								}
+
+							FreeMemory (encoded_s);
+						}
+
+					FreeMemory (compressed_data_p);
+				}		/* if (compressed_data_p) */
+
+			free (dump_s);
+		}		/* if (dump_s) */
+
+	return compressed_p;
+}
+
+
+char *GetAsBase64 (const unsigned char *data_p, const size_t length)
+{
+	static const char S_ALPHABET_S [] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *encoded_s = (char *) AllocMemory (((length + 2) / 3) * 4 + 1);
+
+	if (encoded_s)
+		{
+			char *dest_p = encoded_s;
+			size_t i = 0;
+
+			while (i + 2 < length)
+				{
+					const uint32 v = (((uint32) data_p [i]) << 16) | (((uint32) data_p [i + 1]) << 8) | ((uint32) data_p [i + 2]);
+
+					*dest_p ++ = S_ALPHABET_S [(v >> 18) & 0x3F];
+					*dest_p ++ = S_ALPHABET_S [(v >> 12) & 0x3F];
+					*dest_p ++ = S_ALPHABET_S [(v >> 6) & 0x3F];
+					*dest_p ++ = S_ALPHABET_S [v & 0x3F];
+
+					i += 3;
+				}
+
+			if (i < length)
+				{
+					uint32 v = ((uint32) data_p [i]) << 16;
+
+					if (i + 1 < length)
+						{
+							v |= ((uint32) data_p [i + 1]) << 8;
+						}
+
+					*dest_p ++ = S_ALPHABET_S [(v >> 18) & 0x3F];
+					*dest_p ++ = S_ALPHABET_S [(v >> 12) & 0x3F];
+					*dest_p ++ = (i + 1 < length) ? S_ALPHABET_S [(v >> 6) & 0x3F] : '=';
+					*dest_p ++ = '=';
+				}
+
+			*dest_p = '\0';
+		}
+
+	return encoded_s;
+}
+
+
+static bool CopyStringIfPresent (const json_t *src_p, json_t *dest_p, const char *key_s)
+{
+	const char *value_s = GetJSONString (src_p, key_s);
+
+	return value_s ? SetJSONString (dest_p, key_s, value_s) : true;
+}
+
+
+static json_t *GetCompactMarker (const json_t *src_marker_p, json_t *accession_indexes_p, json_t *accessions_p)
+{
+	json_t *marker_p = json_object ();
+
+	if (marker_p)
+		{
+			if ((CopyStringIfPresent (src_marker_p, marker_p, PGS_CHROMOSOME_S)) &&
+					(CopyStringIfPresent (src_marker_p, marker_p, PGS_MAPPING_POSITION_S)))
+				{
+					json_t *genotypes_p = json_array ();
+
+					if (genotypes_p)
+						{
+							if (json_object_set_new (marker_p, S_GENOTYPES_S, genotypes_p) == 0)
+								{
+									bool success_flag = true;
+									const char *accession_s;
+									json_t *genotype_p;
+
+									json_object_foreach ((json_t *) src_marker_p, accession_s, genotype_p)
+										{
+											if (success_flag && (!IsMarkerMetadataKey (accession_s)))
+												{
+													const json_t *index_p = json_object_get (accession_indexes_p, accession_s);
+													size_t index;
+
+													success_flag = false;
+
+													if (index_p)
+														{
+															index = (size_t) json_integer_value (index_p);
+															success_flag = true;
+														}
+													else
+														{
+															index = json_array_size (accessions_p);
+
+															if (json_array_append_new (accessions_p, json_string (accession_s)) == 0)
+																{
+																	if (json_object_set_new (accession_indexes_p, accession_s, json_integer (index)) == 0)
+																		{
+																			success_flag = true;
+																		}
+																}
+														}
+
+													/*
+													 * Fill in any accessions that this marker doesn't have a value for
+													 */
+													while (success_flag && (json_array_size (genotypes_p) < index))
+														{
+															success_flag = (json_array_append_new (genotypes_p, json_null ()) == 0);
+														}
+
+													if (success_flag)
+														{
+															if (json_array_size (genotypes_p) == index)
+																{
+																	success_flag = (json_array_append (genotypes_p, genotype_p) == 0);
+																}
+															else
+																{
+																	success_flag = (json_array_set (genotypes_p, index, genotype_p) == 0);
+																}
+														}
+												}
+										}
+
+									if (success_flag)
+										{
+											return marker_p;
+										}
+								}
+							else
+								{
+									json_decref (genotypes_p);
+								}
+						}
+				}
+
+			json_decref (marker_p);
+		}		/* if (marker_p) */
+
+	return NULL;
+}
+
+
+/*
+ * Make sure that every marker has a value, even if it is null,
+ * for each accession.
+ */
+static bool PadGenotypes (json_t *markers_p, const size_t num_accessions)
+{
+	const char *key_s;
+	json_t *marker_p;
+
+	json_object_foreach (markers_p, key_s, marker_p)
+		{
+			json_t *genotypes_p = json_object_get (marker_p, S_GENOTYPES_S);
+
+			while (json_array_size (genotypes_p) < num_accessions)
+				{
+					if (json_array_append_new (genotypes_p, json_null ()) != 0)
+						{
+							return false;
+						}
+				}
+		}
+
+	return true;
+}
+
+
+static char *GetGzippedData (const char *data_s, const size_t data_length, size_t *compressed_length_p)
+{
+	z_stream stream;
+
+	memset (&stream, 0, sizeof (z_stream));
+
+	/*
+	 * Adding 16 to the window bits gives a gzip header and trailer
+	 * rather than a zlib one.
+	 */
+	if (deflateInit2 (&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+		{
+			const uLong bound = deflateBound (&stream, (uLong) data_length);
+			char *compressed_data_p = (char *) AllocMemory (bound);
+
+			if (compressed_data_p)
+				{
+					stream.next_in = (Bytef *) data_s;
+					stream.avail_in = (uInt) data_length;
+					stream.next_out = (Bytef *) compressed_data_p;
+					stream.avail_out = (uInt) bound;
+
+					if (deflate (&stream, Z_FINISH) == Z_STREAM_END)
+						{
+							*compressed_length_p = stream.total_out;
+							deflateEnd (&stream);
+
+							return compressed_data_p;
+						}
+
+					FreeMemory (compressed_data_p);
+				}
+
+			deflateEnd (&stream);
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to compress " SIZET_FMT " bytes", data_length);
+
+	return NULL;
+}
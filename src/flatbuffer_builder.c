@@ -0,0 +1,356 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * flatbuffer_builder.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <string.h>
+
+#include "flatbuffer_builder.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+
+
+static void PrepareFlatBuffer (FlatBufferBuilder *builder_p, const size_t alignment, const size_t additional_bytes);
+
+static bool ReserveFlatBufferSpace (FlatBufferBuilder *builder_p, const size_t num_bytes);
+
+static void PushFlatBufferBytes (FlatBufferBuilder *builder_p, const void *data_p, const size_t num_bytes);
+
+static void PushFlatBufferPadding (FlatBufferBuilder *builder_p, const size_t num_bytes);
+
+static void AddFlatBufferScalar (FlatBufferBuilder *builder_p, const uint16 field, const void *value_p, const size_t size);
+
+static uint32 GetFlatBufferReference (FlatBufferBuilder *builder_p, const uint32 offset);
+
+
+
+bool InitFlatBufferBuilder (FlatBufferBuilder *builder_p, const size_t capacity)
+{
+	memset (builder_p, 0, sizeof (FlatBufferBuilder));
+
+	if ((builder_p -> fbb_buffer_p = (uint8 *) AllocMemory (capacity)) != NULL)
+		{
+			builder_p -> fbb_capacity = capacity;
+			builder_p -> fbb_min_align = 1;
+
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " bytes for FlatBufferBuilder", capacity);
+
+	return false;
+}
+
+
+void ClearFlatBufferBuilder (FlatBufferBuilder *builder_p)
+{
+	if (builder_p -> fbb_buffer_p)
+		{
+			FreeMemory (builder_p -> fbb_buffer_p);
+		}
+
+	memset (builder_p, 0, sizeof (FlatBufferBuilder));
+}
+
+
+void ResetFlatBufferBuilder (FlatBufferBuilder *builder_p)
+{
+	builder_p -> fbb_size = 0;
+	builder_p -> fbb_min_align = 1;
+	builder_p -> fbb_table_start = 0;
+	builder_p -> fbb_num_fields = 0;
+	builder_p -> fbb_failed_flag = false;
+}
+
+
+uint32 CreateFlatBufferString (FlatBufferBuilder *builder_p, const char *value_s)
+{
+	const size_t length = strlen (value_s);
+	const uint32 l = (uint32) length;
+
+	/*
+	 * The length comes first, then the characters and a terminating 0
+	 */
+	PrepareFlatBuffer (builder_p, sizeof (uint32), length + 1);
+	PushFlatBufferPadding (builder_p, 1);
+	PushFlatBufferBytes (builder_p, value_s, length);
+	PushFlatBufferBytes (builder_p, &l, sizeof (uint32));
+
+	return (uint32) (builder_p -> fbb_size);
+}
+
+
+void StartFlatBufferTable (FlatBufferBuilder *builder_p)
+{
+	memset (builder_p -> fbb_fields, 0, sizeof (builder_p -> fbb_fields));
+	builder_p -> fbb_num_fields = 0;
+	builder_p -> fbb_table_start = builder_p -> fbb_size;
+}
+
+
+void AddFlatBufferUInt8 (FlatBufferBuilder *builder_p, const uint16 field, const uint8 value)
+{
+	AddFlatBufferScalar (builder_p, field, &value, sizeof (uint8));
+}
+
+
+void AddFlatBufferInt16 (FlatBufferBuilder *builder_p, const uint16 field, const int16 value)
+{
+	AddFlatBufferScalar (builder_p, field, &value, sizeof (int16));
+}
+
+
+void AddFlatBufferInt32 (FlatBufferBuilder *builder_p, const uint16 field, const int32 value)
+{
+	AddFlatBufferScalar (builder_p, field, &value, sizeof (int32));
+}
+
+
+void AddFlatBufferInt64 (FlatBufferBuilder *builder_p, const uint16 field, const int64 value)
+{
+	AddFlatBufferScalar (builder_p, field, &value, sizeof (int64));
+}
+
+
+void AddFlatBufferOffset (FlatBufferBuilder *builder_p, const uint16 field, const uint32 offset)
+{
+	const uint32 reference = GetFlatBufferReference (builder_p, offset);
+
+	AddFlatBufferScalar (builder_p, field, &reference, sizeof (uint32));
+}
+
+
+/*
+ * The table starts with the signed offset back to its vtable, which is
+ * written just before it. The vtable holds its own size, the table's size
+ * and then the offset of each field from the start of the table.
+ */
+uint32 EndFlatBufferTable (FlatBufferBuilder *builder_p)
+{
+	const int32 placeholder = 0;
+	uint32 table_offset;
+	uint16 value;
+	int32 vtable_offset;
+	int i;
+
+	PrepareFlatBuffer (builder_p, sizeof (int32), 0);
+	PushFlatBufferBytes (builder_p, &placeholder, sizeof (int32));
+
+	table_offset = (uint32) (builder_p -> fbb_size);
+
+	for (i = ((int) (builder_p -> fbb_num_fields)) - 1; i >= 0; -- i)
+		{
+			value = (builder_p -> fbb_fields [i] != 0) ? (uint16) (table_offset - builder_p -> fbb_fields [i]) : 0;
+			PushFlatBufferBytes (builder_p, &value, sizeof (uint16));
+		}
+
+	value = (uint16) (table_offset - builder_p -> fbb_table_start);
+	PushFlatBufferBytes (builder_p, &value, sizeof (uint16));
+
+	value = (uint16) ((builder_p -> fbb_num_fields + 2) * sizeof (uint16));
+	PushFlatBufferBytes (builder_p, &value, sizeof (uint16));
+
+	if (! (builder_p -> fbb_failed_flag))
+		{
+			vtable_offset = (int32) (builder_p -> fbb_size - table_offset);
+			memcpy (builder_p -> fbb_buffer_p + builder_p -> fbb_capacity - table_offset, &vtable_offset, sizeof (int32));
+		}
+
+	builder_p -> fbb_num_fields = 0;
+
+	return table_offset;
+}
+
+
+void StartFlatBufferVector (FlatBufferBuilder *builder_p, const size_t element_size, const size_t num_elements, const size_t alignment)
+{
+	PrepareFlatBuffer (builder_p, sizeof (uint32), element_size * num_elements);
+	PrepareFlatBuffer (builder_p, alignment, element_size * num_elements);
+}
+
+
+void PushFlatBufferOffset (FlatBufferBuilder *builder_p, const uint32 offset)
+{
+	const uint32 reference = GetFlatBufferReference (builder_p, offset);
+
+	PushFlatBufferBytes (builder_p, &reference, sizeof (uint32));
+}
+
+
+void PushFlatBufferStruct (FlatBufferBuilder *builder_p, const void *struct_p, const size_t size)
+{
+	PushFlatBufferBytes (builder_p, struct_p, size);
+}
+
+
+uint32 EndFlatBufferVector (FlatBufferBuilder *builder_p, const size_t num_elements)
+{
+	const uint32 n = (uint32) num_elements;
+
+	PrepareFlatBuffer (builder_p, sizeof (uint32), 0);
+	PushFlatBufferBytes (builder_p, &n, sizeof (uint32));
+
+	return (uint32) (builder_p -> fbb_size);
+}
+
+
+bool FinishFlatBuffer (FlatBufferBuilder *builder_p, const uint32 root)
+{
+	uint32 reference;
+
+	/*
+	 * Pad the front so that the buffer's size is a multiple of its
+	 * largest alignment
+	 */
+	PrepareFlatBuffer (builder_p, builder_p -> fbb_min_align, sizeof (uint32));
+
+	reference = GetFlatBufferReference (builder_p, root);
+	PushFlatBufferBytes (builder_p, &reference, sizeof (uint32));
+
+	if (builder_p -> fbb_failed_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build FlatBuffer");
+			return false;
+		}
+
+	return true;
+}
+
+
+const uint8 *GetFlatBufferData (const FlatBufferBuilder *builder_p)
+{
+	return (builder_p -> fbb_buffer_p + builder_p -> fbb_capacity - builder_p -> fbb_size);
+}
+
+
+size_t GetFlatBufferSize (const FlatBufferBuilder *builder_p)
+{
+	return builder_p -> fbb_size;
+}
+
+
+/*
+ * Add enough padding so that once additional_bytes have been written,
+ * the data is aligned to the given alignment.
+ */
+static void PrepareFlatBuffer (FlatBufferBuilder *builder_p, const size_t alignment, const size_t additional_bytes)
+{
+	if (alignment > builder_p -> fbb_min_align)
+		{
+			builder_p -> fbb_min_align = alignment;
+		}
+
+	PushFlatBufferPadding (builder_p, (~(builder_p -> fbb_size + additional_bytes) + 1) & (alignment - 1));
+}
+
+
+static bool ReserveFlatBufferSpace (FlatBufferBuilder *builder_p, const size_t num_bytes)
+{
+	if (builder_p -> fbb_failed_flag)
+		{
+			return false;
+		}
+
+	if (builder_p -> fbb_size + num_bytes > builder_p -> fbb_capacity)
+		{
+			size_t capacity = builder_p -> fbb_capacity;
+			uint8 *buffer_p;
+
+			while (builder_p -> fbb_size + num_bytes > capacity)
+				{
+					capacity <<= 1;
+				}
+
+			/*
+			 * The data is at the end of the buffer so keep it there
+			 */
+			if ((buffer_p = (uint8 *) AllocMemory (capacity)) != NULL)
+				{
+					memcpy (buffer_p + capacity - builder_p -> fbb_size, builder_p -> fbb_buffer_p + builder_p -> fbb_capacity - builder_p -> fbb_size, builder_p -> fbb_size);
+
+					FreeMemory (builder_p -> fbb_buffer_p);
+					builder_p -> fbb_buffer_p = buffer_p;
+					builder_p -> fbb_capacity = capacity;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to grow FlatBufferBuilder to " SIZET_FMT " bytes", capacity);
+					builder_p -> fbb_failed_flag = true;
+
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+static void PushFlatBufferBytes (FlatBufferBuilder *builder_p, const void *data_p, const size_t num_bytes)
+{
+	if (ReserveFlatBufferSpace (builder_p, num_bytes))
+		{
+			builder_p -> fbb_size += num_bytes;
+			memcpy (builder_p -> fbb_buffer_p + builder_p -> fbb_capacity - builder_p -> fbb_size, data_p, num_bytes);
+		}
+}
+
+
+static void PushFlatBufferPadding (FlatBufferBuilder *builder_p, const size_t num_bytes)
+{
+	if ((num_bytes > 0) && (ReserveFlatBufferSpace (builder_p, num_bytes)))
+		{
+			builder_p -> fbb_size += num_bytes;
+			memset (builder_p -> fbb_buffer_p + builder_p -> fbb_capacity - builder_p -> fbb_size, 0, num_bytes);
+		}
+}
+
+
+static void AddFlatBufferScalar (FlatBufferBuilder *builder_p, const uint16 field, const void *value_p, const size_t size)
+{
+	if (field < FBB_MAX_FIELDS)
+		{
+			PrepareFlatBuffer (builder_p, size, 0);
+			PushFlatBufferBytes (builder_p, value_p, size);
+
+			builder_p -> fbb_fields [field] = (uint32) (builder_p -> fbb_size);
+
+			if (field >= builder_p -> fbb_num_fields)
+				{
+					builder_p -> fbb_num_fields = field + 1;
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "FlatBuffer field %u is out of range", (unsigned int) field);
+			builder_p -> fbb_failed_flag = true;
+		}
+}
+
+
+/*
+ * References are unsigned offsets forward from where they are stored
+ * to the object that they refer to.
+ */
+static uint32 GetFlatBufferReference (FlatBufferBuilder *builder_p, const uint32 offset)
+{
+	PrepareFlatBuffer (builder_p, sizeof (uint32), 0);
+
+	return (uint32) (builder_p -> fbb_size - offset + sizeof (uint32));
+}
@@ -0,0 +1,155 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * genetic_map.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "genetic_map.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "json_util.h"
+
+
+static int CompareMapMarkers (const void *v0_p, const void *v1_p);
+
+
+
+MapMarker *GetMarkersInMapOrder (const json_t *population_p, const char *chromosome_s, const bool unmapped_flag, uint32 *num_markers_p)
+{
+	MapMarker *markers_p = (MapMarker *) AllocMemoryArray (json_object_size (population_p) + 1, sizeof (MapMarker));
+
+	if (markers_p)
+		{
+			uint32 num_markers = 0;
+			const char *key_s;
+			json_t *value_p;
+
+			json_object_foreach ((json_t *) population_p, key_s, value_p)
+				{
+					if (IsMarkerEntry (key_s, value_p))
+						{
+							const char *marker_chromosome_s = GetJSONString (value_p, PGS_CHROMOSOME_S);
+
+							if ((!marker_chromosome_s) && (unmapped_flag))
+								{
+									marker_chromosome_s = "";
+								}
+
+							if ((marker_chromosome_s) && ((chromosome_s == NULL) || (strcmp (marker_chromosome_s, chromosome_s) == 0)))
+								{
+									MapMarker *marker_p = markers_p + num_markers;
+
+									marker_p -> mm_name_s = key_s;
+									marker_p -> mm_chromosome_s = marker_chromosome_s;
+									marker_p -> mm_position_s = GetJSONString (value_p, PGS_MAPPING_POSITION_S);
+									marker_p -> mm_marker_p = value_p;
+
+									/*
+									 * Put any markers without a position at the end
+									 */
+									marker_p -> mm_position = HUGE_VAL;
+
+									if (marker_p -> mm_position_s)
+										{
+											char *end_s = NULL;
+											const double64 position = strtod (marker_p -> mm_position_s, &end_s);
+
+											if (end_s != marker_p -> mm_position_s)
+												{
+													marker_p -> mm_position = position;
+												}
+										}
+
+									++ num_markers;
+								}
+						}
+				}
+
+			qsort (markers_p, num_markers, sizeof (MapMarker), CompareMapMarkers);
+
+			*num_markers_p = num_markers;
+		}		/* if (markers_p) */
+
+	return markers_p;
+}
+
+
+json_t *GetAccessionIndexes (const MapMarker *markers_p, const uint32 num_markers)
+{
+	json_t *accession_indexes_p = json_object ();
+
+	if (accession_indexes_p)
+		{
+			bool success_flag = true;
+			uint32 i;
+
+			for (i = 0; (i < num_markers) && success_flag; ++ i)
+				{
+					const char *accession_s;
+					json_t *value_p;
+
+					json_object_foreach ((json_t *) (markers_p [i].mm_marker_p), accession_s, value_p)
+						{
+							if (success_flag && (json_is_string (value_p)) && (!IsMarkerMetadataKey (accession_s)) && (!json_object_get (accession_indexes_p, accession_s)))
+								{
+									success_flag = (json_object_set_new (accession_indexes_p, accession_s, json_integer (json_object_size (accession_indexes_p))) == 0);
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					return accession_indexes_p;
+				}
+
+			json_decref (accession_indexes_p);
+		}
+
+	return NULL;
+}
+
+
+static int CompareMapMarkers (const void *v0_p, const void *v1_p)
+{
+	const MapMarker *marker_0_p = (const MapMarker *) v0_p;
+	const MapMarker *marker_1_p = (const MapMarker *) v1_p;
+	int res = strcmp (marker_0_p -> mm_chromosome_s, marker_1_p -> mm_chromosome_s);
+
+	if (res == 0)
+		{
+			if (marker_0_p -> mm_position < marker_1_p -> mm_position)
+				{
+					res = -1;
+				}
+			else if (marker_0_p -> mm_position > marker_1_p -> mm_position)
+				{
+					res = 1;
+				}
+			else
+				{
+					res = strcmp (marker_0_p -> mm_name_s, marker_1_p -> mm_name_s);
+				}
+		}
+
+	return res;
+}
@@ -0,0 +1,844 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * genotype_table_file.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "genotype_table_file.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+struct GenotypeTableFile
+{
+	char *gtf_filename_s;
+
+	/** The mapped file. */
+	const char *gtf_data_s;
+
+	size_t gtf_size;
+
+	char gtf_delimiter;
+
+	/** The number of columns in the row of marker names. */
+	uint32 gtf_num_columns;
+
+	/** The number of non-blank rows, including the row of marker names. */
+	size_t gtf_num_rows;
+
+	json_t *gtf_parent_a_row_p;
+
+	json_t *gtf_parent_b_row_p;
+};
+
+
+/*
+ * A field in a row, which points into the mapped file.
+ */
+typedef struct TableField
+{
+	const char *tf_value_s;
+
+	size_t tf_length;
+
+	/** Does the value have any doubled quotes in it that need unescaping? */
+	bool tf_escaped_flag;
+} TableField;
+
+
+/*
+ * Finds the delimiters, quotes and line endings in the file a block
+ * at a time. Each block is checked with a few vector comparisons and
+ * the positions of any matches are kept as a bitmask, so most fields
+ * are found without looking at their characters one by one.
+ */
+typedef struct DelimiterScanner
+{
+	/** The start of the current block. */
+	const char *ds_block_s;
+
+	const char *ds_end_s;
+
+	/** The matches in the current block that haven't been returned yet. */
+	uint32 ds_mask;
+
+	char ds_delimiter;
+
+#ifdef __SSE2__
+	__m128i ds_delimiter_v;
+
+	__m128i ds_quote_v;
+
+	__m128i ds_newline_v;
+
+	__m128i ds_return_v;
+#endif
+} DelimiterScanner;
+
+
+/*
+ * The rows before the progeny, in the same order as a submitted table.
+ */
+typedef enum TableRow
+{
+	TR_MARKERS,
+
+	TR_CHROMOSOMES,
+
+	TR_MAPPING_POSITIONS,
+
+	TR_PARENT_A,
+
+	TR_PARENT_B,
+
+	TR_FIRST_PROGENY
+} TableRow;
+
+
+#define S_BLOCK_SIZE (16)
+
+/*
+ * The key that the first column of each row of a submitted table has.
+ */
+static const char * const S_ID_S = "id";
+
+
+static bool CountTableRows (GenotypeTableFile *file_p);
+
+static void InitDelimiterScanner (DelimiterScanner *scanner_p, const GenotypeTableFile *file_p);
+
+static void SetDelimiterScannerPosition (DelimiterScanner *scanner_p, const char *position_s);
+
+static uint32 GetSpecialCharactersMask (const DelimiterScanner *scanner_p, const char *block_s);
+
+static const char *GetNextSpecialCharacter (DelimiterScanner *scanner_p);
+
+static const char *ScanRow (DelimiterScanner *scanner_p, const char *row_s, TableField *fields_p, const uint32 max_fields, uint32 *num_fields_p);
+
+static const char *FindClosingQuote (const char *value_s, const char *end_s, bool *escaped_flag_p);
+
+static bool IsBlankRow (const TableField *fields_p, const uint32 num_fields);
+
+static bool AddTableRow (GenotypeTableFile *file_p, const size_t row_index, const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char **names_ss, json_t *doc_p, const ParentalGenotypeServiceData *data_p, JobArena *names_arena_p, JobArena *arena_p);
+
+static bool AddTableMarkers (const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char **names_ss, json_t *doc_p, JobArena *names_arena_p);
+
+static bool SetTableMarkerValues (const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char *key_s, JobArena *arena_p);
+
+static json_t *GetTableParentRow (const TableField *fields_p, const uint32 num_fields, const char **names_ss, JobArena *arena_p);
+
+static const char *GetTableFieldAsString (const TableField *field_p, JobArena *arena_p);
+
+static json_t *GetTableFieldAsJSON (const TableField *field_p, JobArena *arena_p);
+
+
+
+GenotypeTableFile *OpenGenotypeTableFile (const char *filename_s)
+{
+	int fd = open (filename_s, O_RDONLY);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size > 0))
+				{
+					const size_t size = (size_t) st.st_size;
+					void *data_p = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+					if (data_p != MAP_FAILED)
+						{
+							GenotypeTableFile *file_p = (GenotypeTableFile *) AllocMemory (sizeof (GenotypeTableFile));
+
+							/*
+							 * The file is read from start to end, twice
+							 */
+							madvise (data_p, size, MADV_SEQUENTIAL);
+
+							if (file_p)
+								{
+									file_p -> gtf_data_s = (const char *) data_p;
+									file_p -> gtf_size = size;
+									file_p -> gtf_delimiter = '\t';
+									file_p -> gtf_num_columns = 0;
+									file_p -> gtf_num_rows = 0;
+									file_p -> gtf_parent_a_row_p = NULL;
+									file_p -> gtf_parent_b_row_p = NULL;
+
+									if ((file_p -> gtf_filename_s = EasyCopyToNewString (filename_s)) != NULL)
+										{
+											if (CountTableRows (file_p))
+												{
+													/*
+													 * The mapping stays valid without the descriptor
+													 */
+													close (fd);
+
+													return file_p;
+												}
+
+											FreeCopiedString (file_p -> gtf_filename_s);
+										}
+
+									FreeMemory (file_p);
+								}		/* if (file_p) */
+
+							munmap (data_p, size);
+						}		/* if (data_p != MAP_FAILED) */
+
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is empty", filename_s);
+				}
+
+			close (fd);
+		}		/* if (fd != -1) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open genotype table \"%s\"", filename_s);
+
+	return NULL;
+}
+
+
+size_t GetGenotypeTableFileNumRows (const GenotypeTableFile *file_p)
+{
+	return file_p -> gtf_num_rows - 1;
+}
+
+
+uint64 GetGenotypeTableFileNumCells (const GenotypeTableFile *file_p)
+{
+	return ((uint64) (file_p -> gtf_num_rows)) * ((uint64) (file_p -> gtf_num_columns));
+}
+
+
+bool AddGenotypeTableFileToPopulation (GenotypeTableFile *file_p, json_t *doc_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, const ParentalGenotypeServiceData *data_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	const uint32 num_columns = file_p -> gtf_num_columns;
+	TableField *fields_p = (TableField *) AllocMemoryArray (num_columns, sizeof (TableField));
+
+	if (fields_p)
+		{
+			/*
+			 * The marker in doc_p for each column, so that the fields can be
+			 * added without looking up their markers by name
+			 */
+			json_t **markers_pp = (json_t **) AllocMemoryArray (num_columns, sizeof (json_t *));
+
+			if (markers_pp)
+				{
+					/*
+					 * The marker names as they were submitted, which are the keys of the parent rows
+					 */
+					const char **names_ss = (const char **) AllocMemoryArray (num_columns, sizeof (const char *));
+
+					if (names_ss)
+						{
+							const char *row_s = file_p -> gtf_data_s;
+							const char *end_s = row_s + file_p -> gtf_size;
+							size_t row_index = 0;
+							DelimiterScanner scanner;
+							JobArena names_arena;
+
+							InitJobArena (&names_arena);
+							InitDelimiterScanner (&scanner, file_p);
+
+							success_flag = true;
+
+							while ((row_s < end_s) && success_flag)
+								{
+									uint32 num_fields = 0;
+
+									if ((row_s = ScanRow (&scanner, row_s, fields_p, num_columns, &num_fields)) != NULL)
+										{
+											if (!IsBlankRow (fields_p, num_fields))
+												{
+													/*
+													 * The rows were checked when the file was opened
+													 */
+													if (num_fields > num_columns)
+														{
+															num_fields = num_columns;
+														}
+
+													success_flag = AddTableRow (file_p, row_index, fields_p, num_fields, markers_pp, names_ss, doc_p, data_p, &names_arena, arena_p);
+
+													if (!success_flag)
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add row " SIZET_FMT " of \"%s\"", row_index + 1, file_p -> gtf_filename_s);
+														}
+
+													++ row_index;
+
+													/*
+													 * The fields for this row have all been copied
+													 * into doc_p so the arena can be reused for the next one
+													 */
+													ResetJobArena (arena_p);
+												}
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+
+							if (success_flag)
+								{
+									if ((file_p -> gtf_parent_a_row_p) && (file_p -> gtf_parent_b_row_p))
+										{
+											*parent_a_row_pp = file_p -> gtf_parent_a_row_p;
+											*parent_b_row_pp = file_p -> gtf_parent_b_row_p;
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+
+							ClearJobArena (&names_arena);
+							FreeMemory (names_ss);
+						}		/* if (names_ss) */
+
+					FreeMemory (markers_pp);
+				}		/* if (markers_pp) */
+
+			FreeMemory (fields_p);
+		}		/* if (fields_p) */
+
+	return success_flag;
+}
+
+
+void CloseGenotypeTableFile (GenotypeTableFile *file_p)
+{
+	if (file_p -> gtf_parent_a_row_p)
+		{
+			json_decref (file_p -> gtf_parent_a_row_p);
+		}
+
+	if (file_p -> gtf_parent_b_row_p)
+		{
+			json_decref (file_p -> gtf_parent_b_row_p);
+		}
+
+	munmap ((void *) (file_p -> gtf_data_s), file_p -> gtf_size);
+
+	FreeCopiedString (file_p -> gtf_filename_s);
+	FreeMemory (file_p);
+}
+
+
+/*
+ * Scan the whole file once so that the cost of the submission is known
+ * and any ragged rows are found before anything is added.
+ */
+static bool CountTableRows (GenotypeTableFile *file_p)
+{
+	const char *row_s = file_p -> gtf_data_s;
+	const char *end_s = row_s + file_p -> gtf_size;
+	const char *line_end_s = (const char *) memchr (row_s, '\n', file_p -> gtf_size);
+	DelimiterScanner scanner;
+
+	if (memchr (row_s, ',', (line_end_s ? line_end_s : end_s) - row_s) && (!memchr (row_s, '\t', (line_end_s ? line_end_s : end_s) - row_s)))
+		{
+			file_p -> gtf_delimiter = ',';
+		}
+
+	InitDelimiterScanner (&scanner, file_p);
+
+	while (row_s < end_s)
+		{
+			TableField first_field;
+			uint32 num_fields = 0;
+
+			if ((row_s = ScanRow (&scanner, row_s, &first_field, 1, &num_fields)) == NULL)
+				{
+					return false;
+				}
+
+			if (!IsBlankRow (&first_field, num_fields))
+				{
+					if (file_p -> gtf_num_rows == TR_MARKERS)
+						{
+							file_p -> gtf_num_columns = num_fields;
+						}
+					else if (num_fields != file_p -> gtf_num_columns)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Row " SIZET_FMT " of \"%s\" has " UINT32_FMT " columns but there are " UINT32_FMT " in its first row",
+													 file_p -> gtf_num_rows + 1, file_p -> gtf_filename_s, num_fields, file_p -> gtf_num_columns);
+							return false;
+						}
+
+					++ (file_p -> gtf_num_rows);
+				}
+		}
+
+	if ((file_p -> gtf_num_rows >= TR_FIRST_PROGENY) && (file_p -> gtf_num_columns > 1))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" needs rows for the markers, chromosomes, mapping positions and both parents", file_p -> gtf_filename_s);
+
+	return false;
+}
+
+
+static void InitDelimiterScanner (DelimiterScanner *scanner_p, const GenotypeTableFile *file_p)
+{
+	scanner_p -> ds_end_s = file_p -> gtf_data_s + file_p -> gtf_size;
+	scanner_p -> ds_delimiter = file_p -> gtf_delimiter;
+
+#ifdef __SSE2__
+	scanner_p -> ds_delimiter_v = _mm_set1_epi8 (file_p -> gtf_delimiter);
+	scanner_p -> ds_quote_v = _mm_set1_epi8 ('"');
+	scanner_p -> ds_newline_v = _mm_set1_epi8 ('\n');
+	scanner_p -> ds_return_v = _mm_set1_epi8 ('\r');
+#endif
+
+	SetDelimiterScannerPosition (scanner_p, file_p -> gtf_data_s);
+}
+
+
+static void SetDelimiterScannerPosition (DelimiterScanner *scanner_p, const char *position_s)
+{
+	scanner_p -> ds_block_s = position_s;
+	scanner_p -> ds_mask = (position_s < scanner_p -> ds_end_s) ? GetSpecialCharactersMask (scanner_p, position_s) : 0;
+}
+
+
+static uint32 GetSpecialCharactersMask (const DelimiterScanner *scanner_p, const char *block_s)
+{
+	const size_t remaining = scanner_p -> ds_end_s - block_s;
+	uint32 mask = 0;
+
+#ifdef __SSE2__
+	if (remaining >= S_BLOCK_SIZE)
+		{
+			const __m128i block_v = _mm_loadu_si128 ((const __m128i *) block_s);
+			const __m128i field_ends_v = _mm_or_si128 (_mm_cmpeq_epi8 (block_v, scanner_p -> ds_delimiter_v), _mm_cmpeq_epi8 (block_v, scanner_p -> ds_quote_v));
+			const __m128i line_ends_v = _mm_or_si128 (_mm_cmpeq_epi8 (block_v, scanner_p -> ds_newline_v), _mm_cmpeq_epi8 (block_v, scanner_p -> ds_return_v));
+
+			mask = (uint32) _mm_movemask_epi8 (_mm_or_si128 (field_ends_v, line_ends_v));
+		}
+	else
+#endif
+		{
+			const size_t length = (remaining < S_BLOCK_SIZE) ? remaining : S_BLOCK_SIZE;
+			size_t i;
+
+			for (i = 0; i < length; ++ i)
+				{
+					const char c = block_s [i];
+
+					if ((c == scanner_p -> ds_delimiter) || (c == '"') || (c == '\n') || (c == '\r'))
+						{
+							mask |= (1U << i);
+						}
+				}
+		}
+
+	return mask;
+}
+
+
+/*
+ * Get the next delimiter, quote or line ending, or the end of the file
+ * if there aren't any more.
+ */
+static const char *GetNextSpecialCharacter (DelimiterScanner *scanner_p)
+{
+	const char *c_p;
+
+	while (scanner_p -> ds_mask == 0)
+		{
+			if ((size_t) (scanner_p -> ds_end_s - scanner_p -> ds_block_s) <= S_BLOCK_SIZE)
+				{
+					scanner_p -> ds_block_s = scanner_p -> ds_end_s;
+					return scanner_p -> ds_end_s;
+				}
+
+			scanner_p -> ds_block_s += S_BLOCK_SIZE;
+			scanner_p -> ds_mask = GetSpecialCharactersMask (scanner_p, scanner_p -> ds_block_s);
+		}
+
+	c_p = scanner_p -> ds_block_s + __builtin_ctz (scanner_p -> ds_mask);
+
+	/*
+	 * Clear the lowest bit
+	 */
+	scanner_p -> ds_mask &= scanner_p -> ds_mask - 1;
+
+	return c_p;
+}
+
+
+/*
+ * Split a row into its fields and return the start of the next row.
+ * If there are more than max_fields fields, the rest are counted but
+ * not stored.
+ */
+static const char *ScanRow (DelimiterScanner *scanner_p, const char *row_s, TableField *fields_p, const uint32 max_fields, uint32 *num_fields_p)
+{
+	const char *field_s = row_s;
+	const char *closing_quote_s = NULL;
+	bool escaped_flag = false;
+	uint32 num_fields = 0;
+
+	for (;;)
+		{
+			const char *c_p = GetNextSpecialCharacter (scanner_p);
+
+			if ((c_p < scanner_p -> ds_end_s) && (*c_p == '"'))
+				{
+					/*
+					 * Only a quote at the start of a field begins a quoted
+					 * value, any others are just part of the value
+					 */
+					if ((c_p == field_s) && (closing_quote_s == NULL))
+						{
+							if ((closing_quote_s = FindClosingQuote (c_p + 1, scanner_p -> ds_end_s, &escaped_flag)) != NULL)
+								{
+									SetDelimiterScannerPosition (scanner_p, closing_quote_s + 1);
+								}
+							else
+								{
+									return NULL;
+								}
+						}
+				}
+			else
+				{
+					if (num_fields < max_fields)
+						{
+							TableField *field_p = fields_p + num_fields;
+
+							if (closing_quote_s)
+								{
+									field_p -> tf_value_s = field_s + 1;
+									field_p -> tf_length = closing_quote_s - field_s - 1;
+								}
+							else
+								{
+									field_p -> tf_value_s = field_s;
+									field_p -> tf_length = c_p - field_s;
+								}
+
+							field_p -> tf_escaped_flag = escaped_flag;
+						}
+
+					++ num_fields;
+					closing_quote_s = NULL;
+					escaped_flag = false;
+
+					if (c_p == scanner_p -> ds_end_s)
+						{
+							*num_fields_p = num_fields;
+							return c_p;
+						}
+					else if (*c_p == scanner_p -> ds_delimiter)
+						{
+							field_s = c_p + 1;
+						}
+					else
+						{
+							/*
+							 * Treat \r\n as a single line ending
+							 */
+							if ((*c_p == '\r') && (c_p + 1 < scanner_p -> ds_end_s) && (c_p [1] == '\n'))
+								{
+									c_p = GetNextSpecialCharacter (scanner_p);
+								}
+
+							*num_fields_p = num_fields;
+							return c_p + 1;
+						}
+				}
+		}
+}
+
+
+static const char *FindClosingQuote (const char *value_s, const char *end_s, bool *escaped_flag_p)
+{
+	while (value_s < end_s)
+		{
+			const char *quote_s = (const char *) memchr (value_s, '"', end_s - value_s);
+
+			if (quote_s)
+				{
+					if ((quote_s + 1 < end_s) && (quote_s [1] == '"'))
+						{
+							*escaped_flag_p = true;
+							value_s = quote_s + 2;
+						}
+					else
+						{
+							return quote_s;
+						}
+				}
+			else
+				{
+					value_s = end_s;
+				}
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Quoted value has no closing quote");
+
+	return NULL;
+}
+
+
+static bool IsBlankRow (const TableField *fields_p, const uint32 num_fields)
+{
+	return ((num_fields == 1) && (fields_p -> tf_length == 0));
+}
+
+
+static bool AddTableRow (GenotypeTableFile *file_p, const size_t row_index, const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char **names_ss, json_t *doc_p, const ParentalGenotypeServiceData *data_p, JobArena *names_arena_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+
+	switch (row_index)
+		{
+			case TR_MARKERS:
+				success_flag = AddTableMarkers (fields_p, num_fields, markers_pp, names_ss, doc_p, names_arena_p);
+				break;
+
+			case TR_CHROMOSOMES:
+				success_flag = SetTableMarkerValues (fields_p, num_fields, markers_pp, PGS_CHROMOSOME_S, arena_p);
+				break;
+
+			case TR_MAPPING_POSITIONS:
+				success_flag = SetTableMarkerValues (fields_p, num_fields, markers_pp, PGS_MAPPING_POSITION_S, arena_p);
+				break;
+
+			case TR_PARENT_A:
+				success_flag = ((file_p -> gtf_parent_a_row_p = GetTableParentRow (fields_p, num_fields, names_ss, arena_p)) != NULL);
+				break;
+
+			case TR_PARENT_B:
+				success_flag = ((file_p -> gtf_parent_b_row_p = GetTableParentRow (fields_p, num_fields, names_ss, arena_p)) != NULL);
+				break;
+
+			default:
+				{
+					const char *accession_s = GetTableFieldAsString (fields_p, arena_p);
+
+					if (accession_s)
+						{
+							if ((accession_s = GetMappedAccession (accession_s, data_p, arena_p)) != NULL)
+								{
+									success_flag = SetTableMarkerValues (fields_p, num_fields, markers_pp, accession_s, arena_p);
+								}
+						}
+				}
+				break;
+		}
+
+	return success_flag;
+}
+
+
+static bool AddTableMarkers (const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char **names_ss, json_t *doc_p, JobArena *names_arena_p)
+{
+	uint32 i;
+
+	/*
+	 * The first column is the heading for the rows' names
+	 */
+	for (i = 1; i < num_fields; ++ i)
+		{
+			const char *marker_s = GetTableFieldAsString (fields_p + i, names_arena_p);
+
+			if (marker_s && (*marker_s != '\0'))
+				{
+					/*
+					 * The marker name may contain full stops and although MongoDB 3.6+
+					 * allows these, the current version of the mongo-c driver (1.13)
+					 * does not, so we need to do the escaping ourselves
+					 */
+					const char *escaped_marker_s = SearchAndReplaceInStringInJobArena (names_arena_p, marker_s, ".", PGS_ESCAPED_DOT_S);
+
+					if (escaped_marker_s)
+						{
+							if (!json_object_get (doc_p, escaped_marker_s))
+								{
+									json_t *marker_p = json_object ();
+
+									if (marker_p)
+										{
+											if (json_object_set_new (doc_p, escaped_marker_s, marker_p) == 0)
+												{
+													markers_pp [i] = marker_p;
+													names_ss [i] = marker_s;
+												}
+											else
+												{
+													return false;
+												}
+										}
+									else
+										{
+											return false;
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Marker \"%s\" is in more than one column", marker_s);
+									return false;
+								}
+						}
+					else
+						{
+							return false;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Column " UINT32_FMT " has no marker name", i + 1);
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+static bool SetTableMarkerValues (const TableField *fields_p, const uint32 num_fields, json_t **markers_pp, const char *key_s, JobArena *arena_p)
+{
+	uint32 i;
+
+	for (i = 1; i < num_fields; ++ i)
+		{
+			json_t *value_p = GetTableFieldAsJSON (fields_p + i, arena_p);
+
+			if ((value_p == NULL) || (json_object_set_new (markers_pp [i], key_s, value_p) != 0))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set \"%s\" in column " UINT32_FMT, key_s, i + 1);
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * The parent rows are kept in the same form as the rows of a submitted
+ * table since that is what SaveParentGenotypes () expects.
+ */
+static json_t *GetTableParentRow (const TableField *fields_p, const uint32 num_fields, const char **names_ss, JobArena *arena_p)
+{
+	json_t *row_p = json_object ();
+
+	if (row_p)
+		{
+			const char *parent_s = GetTableFieldAsString (fields_p, arena_p);
+
+			if ((parent_s) && (SetJSONString (row_p, S_ID_S, parent_s)))
+				{
+					bool success_flag = true;
+					uint32 i;
+
+					for (i = 1; (i < num_fields) && success_flag; ++ i)
+						{
+							json_t *value_p = GetTableFieldAsJSON (fields_p + i, arena_p);
+
+							success_flag = ((value_p != NULL) && (json_object_set_new (row_p, names_ss [i], value_p) == 0));
+						}
+
+					if (success_flag)
+						{
+							return row_p;
+						}
+				}
+
+			json_decref (row_p);
+		}
+
+	return NULL;
+}
+
+
+static const char *GetTableFieldAsString (const TableField *field_p, JobArena *arena_p)
+{
+	char *value_s = (char *) AllocFromJobArena (arena_p, field_p -> tf_length + 1);
+
+	if (value_s)
+		{
+			if (field_p -> tf_escaped_flag)
+				{
+					const char *src_p = field_p -> tf_value_s;
+					const char *end_p = src_p + field_p -> tf_length;
+					char *dest_p = value_s;
+
+					while (src_p < end_p)
+						{
+							*dest_p = *src_p;
+							++ dest_p;
+
+							/*
+							 * Skip the second quote of each pair
+							 */
+							src_p += (*src_p == '"') ? 2 : 1;
+						}
+
+					*dest_p = '\0';
+				}
+			else
+				{
+					memcpy (value_s, field_p -> tf_value_s, field_p -> tf_length);
+					value_s [field_p -> tf_length] = '\0';
+				}
+		}
+
+	return value_s;
+}
+
+
+static json_t *GetTableFieldAsJSON (const TableField *field_p, JobArena *arena_p)
+{
+	if (field_p -> tf_escaped_flag)
+		{
+			const char *value_s = GetTableFieldAsString (field_p, arena_p);
+
+			return value_s ? json_string (value_s) : NULL;
+		}
+
+	/*
+	 * Most values can be copied straight from the mapped file
+	 */
+	return json_stringn (field_p -> tf_value_s, field_p -> tf_length);
+}
@@ -0,0 +1,1566 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * haplotype_blocks.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "haplotype_blocks.h"
+#include "genetic_map.h"
+#include "parent_genotypes.h"
+#include "parental_genotype_service.h"
+#include "bson_extract.h"
+#include "job_arena.h"
+
+#include "byte_buffer.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+/*
+ * The codes that the runs are stored with. A call that is neither
+ * parent's genotype is coded as HC_OTHER plus its index in the
+ * population's table of other calls.
+ */
+typedef enum HaplotypeCode
+{
+	HC_PARENT_A,
+
+	HC_PARENT_B,
+
+	HC_NO_CALL,
+
+	HC_OTHER
+} HaplotypeCode;
+
+
+/*
+ * The run that a progeny line is currently in while encoding.
+ */
+typedef struct ProgenyRuns
+{
+	ByteBuffer *pr_runs_p;
+
+	/* The offset of the start of each chromosome's runs in pr_runs_p */
+	uint32 *pr_skip_p;
+
+	uint32 pr_code;
+
+	uint32 pr_length;
+} ProgenyRuns;
+
+
+typedef struct HaplotypeSearch
+{
+	const char *hs_accession_s;
+
+	const char *hs_marker_s;
+
+	const char *hs_chromosome_s;
+
+	const double64 *hs_start_p;
+
+	const double64 *hs_end_p;
+
+	json_t *hs_results_p;
+} HaplotypeSearch;
+
+
+/*
+ * The population document that a population's haplotype blocks
+ * are being decoded back into.
+ */
+typedef struct HaplotypeMarkers
+{
+	json_t *hm_population_p;
+
+	/* If this is set, only this marker is decoded */
+	const char *hm_marker_s;
+
+	uint32 hm_num_docs;
+} HaplotypeMarkers;
+
+
+/*
+ * The runs for a single progeny line along with everything
+ * needed to turn them back into calls.
+ */
+typedef struct HaplotypeDecoder
+{
+	const uint8_t *hd_runs_p;
+
+	uint32_t hd_runs_length;
+
+	uint32 *hd_skip_p;
+
+	const char **hd_other_calls_ss;
+
+	uint32 hd_num_other_calls;
+
+	uint32 hd_num_chromosomes;
+} HaplotypeDecoder;
+
+
+static const char * const S_CHROMOSOMES_S = "chromosomes";
+
+static const char * const S_MARKERS_S = "markers";
+
+static const char * const S_MAPPING_POSITIONS_S = "mapping_positions";
+
+static const char * const S_PARENT_A_GENOTYPES_S = "parent_a_genotypes";
+
+static const char * const S_PARENT_B_GENOTYPES_S = "parent_b_genotypes";
+
+static const char * const S_OTHER_CALLS_S = "other_calls";
+
+static const char * const S_PROGENY_S = "progeny";
+
+static const char * const S_RUNS_S = "runs";
+
+static const char * const S_SKIP_S = "skip";
+
+static const char * const S_NUM_RUNS_S = "num_runs";
+
+
+static bson_t *EncodeHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p);
+
+static uint32 CountChromosomes (const MapMarker *markers_p, const uint32 num_markers);
+
+static bool EncodeRuns (const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, ProgenyRuns *progeny_p, const size_t num_progeny, json_t *other_calls_p, uint64 *num_runs_p);
+
+static bool GetHaplotypeCode (const char *call_s, const char *parent_a_s, const char *parent_b_s, json_t *other_calls_p, uint32 *code_p);
+
+static bool FinishRun (ProgenyRuns *progeny_p, uint64 *num_runs_p);
+
+static size_t EncodeVarint (uint8 *dest_p, uint32 value);
+
+static bool DecodeVarint (const uint8_t **data_pp, const uint8_t *end_p, uint32 *value_p);
+
+static bson_t *GetHaplotypeBlocksAsBSON (const bson_oid_t *id_p, const char *population_s, const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, const ProgenyRuns *progeny_p, const json_t *other_calls_p, const uint64 num_runs, JobArena *arena_p);
+
+static bool AppendChromosomes (bson_t *doc_p, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, JobArena *arena_p);
+
+static bool AppendChromosome (bson_t *chromosomes_p, const uint32 chromosome_index, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, JobArena *arena_p);
+
+static bool AppendParentGenotypes (bson_t *chromosome_p, const char *key_s, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, const uint32 parent_index);
+
+static bool AppendOtherCalls (bson_t *doc_p, const json_t *other_calls_p);
+
+static bool AppendProgeny (bson_t *doc_p, const json_t *accession_indexes_p, const ProgenyRuns *progeny_p, const uint32 num_chromosomes);
+
+static bool WriteHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const bson_t *doc_p, ParentalGenotypeServiceData *data_p);
+
+static bool AddBSONHaplotypeGenotypes (const bson_t *doc_p, void *data_p);
+
+static bool AddBSONHaplotypeMarkers (const bson_t *doc_p, void *data_p);
+
+static bool AddHaplotypeMarkerObjects (const bson_t *doc_p, const HaplotypeMarkers *markers_p, json_t *marker_objects_p);
+
+static bool AddProgenyCallsToMarkers (const bson_t *doc_p, const HaplotypeDecoder *decoder_p, const char *accession_s, const HaplotypeMarkers *markers_p, json_t *marker_objects_p, json_t *genotypes_p);
+
+static bool FindProgenyRuns (const bson_t *doc_p, const char *accession_s, HaplotypeDecoder *decoder_p);
+
+static bool GetProgenyRuns (const bson_iter_t *progeny_iter_p, HaplotypeDecoder *decoder_p);
+
+static const char **GetBSONStringArray (const bson_t *doc_p, const char *key_s, uint32 *num_values_p);
+
+static bool DecodeChromosome (const HaplotypeDecoder *decoder_p, const uint32 chromosome_index, const bson_t *chromosome_p, const HaplotypeSearch *search_p, json_t *genotypes_p);
+
+static bool IsPositionInInterval (const char *position_s, const double64 *start_p, const double64 *end_p);
+
+
+
+bool SaveHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	bson_t *doc_p = EncodeHaplotypeBlocks (id_p, population_s, population_p, parents_p);
+
+	if (doc_p)
+		{
+			success_flag = WriteHaplotypeBlocks (id_p, population_s, doc_p, data_p);
+			bson_destroy (doc_p);
+		}
+
+	return success_flag;
+}
+
+
+json_t *GetHaplotypeBlockGenotypes (const char *population_s, const char *accession_s, const char *marker_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_haplotype_blocks_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_UTF8 (population_s));
+
+			if (query_p)
+				{
+					bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+					if (!opts_p)
+						{
+							opts_p = bson_new ();
+						}
+
+					if (opts_p)
+						{
+							/*
+							 * Only fetch the runs for the requested line rather than every line in the population
+							 */
+							bson_t *projection_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_BOOL (true),
+																							 S_CHROMOSOMES_S, BCON_BOOL (true),
+																							 S_OTHER_CALLS_S, BCON_BOOL (true),
+																							 S_PROGENY_S, "{", "$elemMatch", "{", PGS_ACCESSION_S, BCON_UTF8 (accession_s), "}", "}");
+
+							if (projection_p)
+								{
+									if ((BSON_APPEND_DOCUMENT (opts_p, "projection", projection_p)) && (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p)))
+										{
+											HaplotypeSearch search;
+
+											search.hs_accession_s = accession_s;
+											search.hs_marker_s = IsStringEmpty (marker_s) ? NULL : marker_s;
+											search.hs_chromosome_s = IsStringEmpty (chromosome_s) ? NULL : chromosome_s;
+											search.hs_start_p = start_p;
+											search.hs_end_p = end_p;
+
+											if ((search.hs_results_p = json_array ()) != NULL)
+												{
+													if (IterateOverMongoResults (data_p -> pgsd_mongo_p, AddBSONHaplotypeGenotypes, &search) >= 0)
+														{
+															results_p = search.hs_results_p;
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to decode the haplotype blocks of \"%s\" in \"%s\"", accession_s, population_s);
+															json_decref (search.hs_results_p);
+														}
+												}
+										}
+
+									bson_destroy (projection_p);
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_haplotype_blocks_collection_s)) */
+
+	return results_p;
+}
+
+
+bool IsHaplotypeBlocksOnlyPopulation (const json_t *population_p)
+{
+	bool blocks_only_flag = false;
+
+	GetJSONBoolean (population_p, PGS_HAPLOTYPE_BLOCKS_ONLY_S, &blocks_only_flag);
+
+	return blocks_only_flag;
+}
+
+
+bool AddHaplotypeBlockMarkers (json_t *population_p, const char *marker_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	bool success_flag = false;
+	bson_oid_t id;
+
+	if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), &id))
+		{
+			if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_haplotype_blocks_collection_s))
+				{
+					bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (&id));
+
+					if (query_p)
+						{
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+							if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p))
+								{
+									HaplotypeMarkers markers;
+
+									markers.hm_population_p = population_p;
+									markers.hm_marker_s = IsStringEmpty (marker_s) ? NULL : marker_s;
+									markers.hm_num_docs = 0;
+
+									if ((IterateOverMongoResults (data_p -> pgsd_mongo_p, AddBSONHaplotypeMarkers, &markers) >= 0) && (markers.hm_num_docs == 1))
+										{
+											/*
+											 * The population now has its markers so it no longer needs
+											 * the list of their names or to be flagged
+											 */
+											json_object_del (population_p, PGS_MARKERS_S);
+											json_object_del (population_p, PGS_HAPLOTYPE_BLOCKS_ONLY_S);
+
+											success_flag = true;
+										}
+									else
+										{
+											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, json_object_get (population_p, MONGO_ID_S), "Failed to decode the haplotype blocks of \"%s\"", GetJSONString (population_p, PGS_POPULATION_NAME_S));
+										}
+								}
+
+							if (opts_p)
+								{
+									bson_destroy (opts_p);
+								}
+
+							bson_destroy (query_p);
+						}		/* if (query_p) */
+
+				}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_haplotype_blocks_collection_s)) */
+
+		}		/* if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), &id)) */
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, population_p, "Failed to get the id of the population");
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Encode each progeny line's calls as runs along the map and
+ * put them, along with everything needed to decode them, into
+ * the document that is stored in the haplotype blocks collection.
+ */
+static bson_t *EncodeHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p)
+{
+	bson_t *doc_p = NULL;
+	uint32 num_markers = 0;
+	MapMarker *markers_p = GetMarkersInMapOrder (population_p, NULL, true, &num_markers);
+
+	if (markers_p)
+		{
+			json_t *accession_indexes_p = GetAccessionIndexes (markers_p, num_markers);
+
+			if (accession_indexes_p)
+				{
+					const size_t num_progeny = json_object_size (accession_indexes_p);
+					const uint32 num_chromosomes = CountChromosomes (markers_p, num_markers);
+					ProgenyRuns *progeny_p = (ProgenyRuns *) AllocMemoryArray (num_progeny + 1, sizeof (ProgenyRuns));
+
+					if (progeny_p)
+						{
+							json_t *other_calls_p = json_object ();
+							size_t i;
+
+							if (other_calls_p)
+								{
+									bool success_flag = true;
+
+									for (i = 0; (i < num_progeny) && success_flag; ++ i)
+										{
+											progeny_p [i].pr_runs_p = AllocateByteBuffer (1024);
+											progeny_p [i].pr_skip_p = (uint32 *) AllocMemoryArray (num_chromosomes + 1, sizeof (uint32));
+											progeny_p [i].pr_code = HC_NO_CALL;
+											progeny_p [i].pr_length = 0;
+
+											success_flag = (progeny_p [i].pr_runs_p != NULL) && (progeny_p [i].pr_skip_p != NULL);
+										}
+
+									if (success_flag)
+										{
+											uint64 num_runs = 0;
+
+											if (EncodeRuns (markers_p, num_markers, accession_indexes_p, parents_p, progeny_p, num_progeny, other_calls_p, &num_runs))
+												{
+													JobArena arena;
+
+													InitJobArena (&arena);
+
+													doc_p = GetHaplotypeBlocksAsBSON (id_p, population_s, markers_p, num_markers, accession_indexes_p, parents_p, progeny_p, other_calls_p, num_runs, &arena);
+
+													if (doc_p)
+														{
+															PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Encoded " SIZET_FMT " progeny of \"%s\" as " UINT64_FMT " runs in " UINT32_FMT " bytes", num_progeny, population_s, num_runs, doc_p -> len);
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build the haplotype blocks for \"%s\"", population_s);
+														}
+
+													ClearJobArena (&arena);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to encode the haplotype blocks for \"%s\"", population_s);
+												}
+										}
+
+									json_decref (other_calls_p);
+								}		/* if (other_calls_p) */
+
+							for (i = 0; i < num_progeny; ++ i)
+								{
+									if (progeny_p [i].pr_runs_p)
+										{
+											FreeByteBuffer (progeny_p [i].pr_runs_p);
+										}
+
+									if (progeny_p [i].pr_skip_p)
+										{
+											FreeMemory (progeny_p [i].pr_skip_p);
+										}
+								}
+
+							FreeMemory (progeny_p);
+						}		/* if (progeny_p) */
+
+					json_decref (accession_indexes_p);
+				}		/* if (accession_indexes_p) */
+
+			FreeMemory (markers_p);
+		}		/* if (markers_p) */
+
+	return doc_p;
+}
+
+
+static uint32 CountChromosomes (const MapMarker *markers_p, const uint32 num_markers)
+{
+	uint32 num_chromosomes = 0;
+	uint32 i;
+
+	for (i = 0; i < num_markers; ++ i)
+		{
+			if ((i == 0) || (strcmp (markers_p [i].mm_chromosome_s, markers_p [i - 1].mm_chromosome_s) != 0))
+				{
+					++ num_chromosomes;
+				}
+		}
+
+	return num_chromosomes;
+}
+
+
+/*
+ * This is a single pass over the markers in map order. The calls at
+ * each marker are coded first, with any lines that weren't called
+ * there left as HC_NO_CALL, and then each line's current run is
+ * either extended or finished.
+ */
+static bool EncodeRuns (const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, ProgenyRuns *progeny_p, const size_t num_progeny, json_t *other_calls_p, uint64 *num_runs_p)
+{
+	bool success_flag = false;
+	uint32 *codes_p = (uint32 *) AllocMemoryArray (num_progeny + 1, sizeof (uint32));
+
+	if (codes_p)
+		{
+			uint32 chromosome_index = 0;
+			uint32 i;
+			size_t j;
+
+			success_flag = true;
+
+			for (i = 0; (i < num_markers) && success_flag; ++ i)
+				{
+					const MapMarker *marker_p = markers_p + i;
+					const json_t *parent_genotypes_p = json_object_get (parents_p, marker_p -> mm_name_s);
+					const char *parent_a_s = json_string_value (json_array_get (parent_genotypes_p, 0));
+					const char *parent_b_s = json_string_value (json_array_get (parent_genotypes_p, 1));
+					const char *accession_s;
+					json_t *value_p;
+
+					/*
+					 * Runs never cross chromosomes, so each one starts
+					 * a new entry in the skip index
+					 */
+					if ((i == 0) || (strcmp (marker_p -> mm_chromosome_s, markers_p [i - 1].mm_chromosome_s) != 0))
+						{
+							if (i > 0)
+								{
+									++ chromosome_index;
+								}
+
+							for (j = 0; (j < num_progeny) && success_flag; ++ j)
+								{
+									success_flag = FinishRun (progeny_p + j, num_runs_p);
+									progeny_p [j].pr_skip_p [chromosome_index] = (uint32) GetByteBufferSize (progeny_p [j].pr_runs_p);
+								}
+						}
+
+					ResolveParentGenotypes (&parent_a_s, &parent_b_s);
+
+					for (j = 0; j < num_progeny; ++ j)
+						{
+							codes_p [j] = HC_NO_CALL;
+						}
+
+					json_object_foreach ((json_t *) (marker_p -> mm_marker_p), accession_s, value_p)
+						{
+							if (success_flag && (json_is_string (value_p)) && (!IsMarkerMetadataKey (accession_s)))
+								{
+									const json_int_t index = json_integer_value (json_object_get (accession_indexes_p, accession_s));
+
+									success_flag = GetHaplotypeCode (json_string_value (value_p), parent_a_s, parent_b_s, other_calls_p, codes_p + index);
+								}
+						}
+
+					for (j = 0; (j < num_progeny) && success_flag; ++ j)
+						{
+							ProgenyRuns *runs_p = progeny_p + j;
+
+							if ((runs_p -> pr_length > 0) && (runs_p -> pr_code == codes_p [j]))
+								{
+									++ (runs_p -> pr_length);
+								}
+							else
+								{
+									success_flag = FinishRun (runs_p, num_runs_p);
+									runs_p -> pr_code = codes_p [j];
+									runs_p -> pr_length = 1;
+								}
+						}
+				}
+
+			for (j = 0; (j < num_progeny) && success_flag; ++ j)
+				{
+					success_flag = FinishRun (progeny_p + j, num_runs_p);
+				}
+
+			FreeMemory (codes_p);
+		}		/* if (codes_p) */
+
+	return success_flag;
+}
+
+
+static bool GetHaplotypeCode (const char *call_s, const char *parent_a_s, const char *parent_b_s, json_t *other_calls_p, uint32 *code_p)
+{
+	if (strcmp (call_s, parent_a_s) == 0)
+		{
+			*code_p = HC_PARENT_A;
+		}
+	else if (strcmp (call_s, parent_b_s) == 0)
+		{
+			*code_p = HC_PARENT_B;
+		}
+	else
+		{
+			json_t *index_p = json_object_get (other_calls_p, call_s);
+
+			if (!index_p)
+				{
+					index_p = json_integer (json_object_size (other_calls_p));
+
+					if (index_p)
+						{
+							if (json_object_set_new (other_calls_p, call_s, index_p) != 0)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add \"%s\" to the other calls", call_s);
+									return false;
+								}
+						}
+					else
+						{
+							return false;
+						}
+				}
+
+			*code_p = HC_OTHER + (uint32) json_integer_value (index_p);
+		}
+
+	return true;
+}
+
+
+/*
+ * Each run is stored as its code followed by its length, both as
+ * varints, so the usual runs of a parent's call take just 2 bytes.
+ */
+static bool FinishRun (ProgenyRuns *progeny_p, uint64 *num_runs_p)
+{
+	bool success_flag = true;
+
+	if (progeny_p -> pr_length > 0)
+		{
+			uint8 run [10];
+			size_t run_length = EncodeVarint (run, progeny_p -> pr_code);
+
+			run_length += EncodeVarint (run + run_length, progeny_p -> pr_length);
+
+			success_flag = AppendToByteBuffer (progeny_p -> pr_runs_p, run, run_length);
+
+			progeny_p -> pr_length = 0;
+			++ (*num_runs_p);
+		}
+
+	return success_flag;
+}
+
+
+static size_t EncodeVarint (uint8 *dest_p, uint32 value)
+{
+	size_t length = 0;
+
+	while (value >= 0x80)
+		{
+			dest_p [length ++] = (uint8) ((value & 0x7F) | 0x80);
+			value >>= 7;
+		}
+
+	dest_p [length ++] = (uint8) value;
+
+	return length;
+}
+
+
+static bool DecodeVarint (const uint8_t **data_pp, const uint8_t *end_p, uint32 *value_p)
+{
+	const uint8_t *data_p = *data_pp;
+	uint32 value = 0;
+	uint32 shift = 0;
+
+	while ((data_p < end_p) && (shift < 32))
+		{
+			const uint8_t b = *data_p;
+
+			++ data_p;
+			value |= ((uint32) (b & 0x7F)) << shift;
+
+			if (! (b & 0x80))
+				{
+					*value_p = value;
+					*data_pp = data_p;
+
+					return true;
+				}
+
+			shift += 7;
+		}
+
+	return false;
+}
+
+
+static bson_t *GetHaplotypeBlocksAsBSON (const bson_oid_t *id_p, const char *population_s, const MapMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const json_t *parents_p, const ProgenyRuns *progeny_p, const json_t *other_calls_p, const uint64 num_runs, JobArena *arena_p)
+{
+	bson_t *doc_p = bson_new ();
+
+	if (doc_p)
+		{
+			if ((BSON_APPEND_OID (doc_p, MONGO_ID_S, id_p)) &&
+					(BSON_APPEND_UTF8 (doc_p, PGS_POPULATION_NAME_S, population_s)) &&
+					(AppendChromosomes (doc_p, markers_p, num_markers, parents_p, arena_p)) &&
+					(AppendOtherCalls (doc_p, other_calls_p)) &&
+					(AppendProgeny (doc_p, accession_indexes_p, progeny_p, CountChromosomes (markers_p, num_markers))) &&
+					(BSON_APPEND_INT64 (doc_p, S_NUM_RUNS_S, (int64_t) num_runs)))
+				{
+					return doc_p;
+				}
+
+			bson_destroy (doc_p);
+		}
+
+	return NULL;
+}
+
+
+static bool AppendChromosomes (bson_t *doc_p, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	bson_t chromosomes;
+
+	if (BSON_APPEND_ARRAY_BEGIN (doc_p, S_CHROMOSOMES_S, &chromosomes))
+		{
+			uint32 chromosome_index = 0;
+			uint32 start = 0;
+			uint32 i;
+
+			success_flag = true;
+
+			for (i = 1; (i <= num_markers) && success_flag; ++ i)
+				{
+					if ((i == num_markers) || (strcmp (markers_p [i].mm_chromosome_s, markers_p [start].mm_chromosome_s) != 0))
+						{
+							success_flag = AppendChromosome (&chromosomes, chromosome_index, markers_p + start, i - start, parents_p, arena_p);
+
+							++ chromosome_index;
+							start = i;
+						}
+				}
+
+			if (!bson_append_array_end (doc_p, &chromosomes))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The parents' genotypes are stored after ResolveParentGenotypes () has
+ * been applied so that decoding a parent's code gives back the exact call.
+ */
+static bool AppendChromosome (bson_t *chromosomes_p, const uint32 chromosome_index, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	char key_s [32];
+	bson_t chromosome;
+
+	sprintf (key_s, UINT32_FMT, chromosome_index);
+
+	if (BSON_APPEND_DOCUMENT_BEGIN (chromosomes_p, key_s, &chromosome))
+		{
+			bson_t markers;
+			bson_t positions;
+
+			if ((BSON_APPEND_UTF8 (&chromosome, PGS_CHROMOSOME_S, markers_p -> mm_chromosome_s)) &&
+					(BSON_APPEND_ARRAY_BEGIN (&chromosome, S_MARKERS_S, &markers)))
+				{
+					uint32 i;
+
+					success_flag = true;
+
+					for (i = 0; (i < num_markers) && success_flag; ++ i)
+						{
+							const char *marker_s = SearchAndReplaceInStringInJobArena (arena_p, markers_p [i].mm_name_s, PGS_ESCAPED_DOT_S, ".");
+
+							sprintf (key_s, UINT32_FMT, i);
+							success_flag = (marker_s != NULL) && (BSON_APPEND_UTF8 (&markers, key_s, marker_s));
+						}
+
+					ResetJobArena (arena_p);
+
+					if (!bson_append_array_end (&chromosome, &markers))
+						{
+							success_flag = false;
+						}
+
+					if (success_flag)
+						{
+							success_flag = false;
+
+							if (BSON_APPEND_ARRAY_BEGIN (&chromosome, S_MAPPING_POSITIONS_S, &positions))
+								{
+									success_flag = true;
+
+									for (i = 0; (i < num_markers) && success_flag; ++ i)
+										{
+											sprintf (key_s, UINT32_FMT, i);
+											success_flag = BSON_APPEND_UTF8 (&positions, key_s, markers_p [i].mm_position_s ? markers_p [i].mm_position_s : "");
+										}
+
+									if (!bson_append_array_end (&chromosome, &positions))
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = (AppendParentGenotypes (&chromosome, S_PARENT_A_GENOTYPES_S, markers_p, num_markers, parents_p, 0)) &&
+								(AppendParentGenotypes (&chromosome, S_PARENT_B_GENOTYPES_S, markers_p, num_markers, parents_p, 1));
+						}
+				}
+
+			if (!bson_append_document_end (chromosomes_p, &chromosome))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendParentGenotypes (bson_t *chromosome_p, const char *key_s, const MapMarker *markers_p, const uint32 num_markers, const json_t *parents_p, const uint32 parent_index)
+{
+	bool success_flag = false;
+	bson_t genotypes;
+
+	if (BSON_APPEND_ARRAY_BEGIN (chromosome_p, key_s, &genotypes))
+		{
+			uint32 i;
+
+			success_flag = true;
+
+			for (i = 0; (i < num_markers) && success_flag; ++ i)
+				{
+					const json_t *parent_genotypes_p = json_object_get (parents_p, markers_p [i].mm_name_s);
+					const char *parents_ss [2];
+					char index_s [32];
+
+					parents_ss [0] = json_string_value (json_array_get (parent_genotypes_p, 0));
+					parents_ss [1] = json_string_value (json_array_get (parent_genotypes_p, 1));
+
+					ResolveParentGenotypes (parents_ss, parents_ss + 1);
+
+					sprintf (index_s, UINT32_FMT, i);
+					success_flag = BSON_APPEND_UTF8 (&genotypes, index_s, parents_ss [parent_index]);
+				}
+
+			if (!bson_append_array_end (chromosome_p, &genotypes))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendOtherCalls (bson_t *doc_p, const json_t *other_calls_p)
+{
+	bool success_flag = false;
+	const size_t num_calls = json_object_size (other_calls_p);
+	const char **calls_ss = (const char **) AllocMemoryArray (num_calls + 1, sizeof (const char *));
+
+	if (calls_ss)
+		{
+			bson_t calls;
+			const char *call_s;
+			json_t *index_p;
+
+			/*
+			 * Put the calls in the order of the codes that refer to them
+			 */
+			json_object_foreach ((json_t *) other_calls_p, call_s, index_p)
+				{
+					calls_ss [json_integer_value (index_p)] = call_s;
+				}
+
+			if (BSON_APPEND_ARRAY_BEGIN (doc_p, S_OTHER_CALLS_S, &calls))
+				{
+					size_t i;
+
+					success_flag = true;
+
+					for (i = 0; (i < num_calls) && success_flag; ++ i)
+						{
+							char key_s [32];
+
+							sprintf (key_s, SIZET_FMT, i);
+							success_flag = BSON_APPEND_UTF8 (&calls, key_s, calls_ss [i]);
+						}
+
+					if (!bson_append_array_end (doc_p, &calls))
+						{
+							success_flag = false;
+						}
+				}
+
+			FreeMemory (calls_ss);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The skip index is stored as varints too since the offsets
+ * are usually small.
+ */
+static bool AppendProgeny (bson_t *doc_p, const json_t *accession_indexes_p, const ProgenyRuns *progeny_p, const uint32 num_chromosomes)
+{
+	bool success_flag = false;
+	uint8 *skip_p = (uint8 *) AllocMemoryArray ((size_t) num_chromosomes * 5 + 1, sizeof (uint8));
+
+	if (skip_p)
+		{
+			bson_t progeny;
+
+			if (BSON_APPEND_ARRAY_BEGIN (doc_p, S_PROGENY_S, &progeny))
+				{
+					const char *accession_s;
+					json_t *index_p;
+					size_t i = 0;
+
+					success_flag = true;
+
+					json_object_foreach ((json_t *) accession_indexes_p, accession_s, index_p)
+						{
+							if (success_flag)
+								{
+									const ProgenyRuns *runs_p = progeny_p + json_integer_value (index_p);
+									size_t skip_length = 0;
+									char key_s [32];
+									bson_t line;
+									uint32 j;
+
+									for (j = 0; j < num_chromosomes; ++ j)
+										{
+											skip_length += EncodeVarint (skip_p + skip_length, runs_p -> pr_skip_p [j]);
+										}
+
+									sprintf (key_s, SIZET_FMT, i);
+									success_flag = false;
+
+									if (BSON_APPEND_DOCUMENT_BEGIN (&progeny, key_s, &line))
+										{
+											success_flag = (BSON_APPEND_UTF8 (&line, PGS_ACCESSION_S, accession_s)) &&
+												(BSON_APPEND_BINARY (&line, S_RUNS_S, BSON_SUBTYPE_BINARY, (const uint8_t *) GetByteBufferData (runs_p -> pr_runs_p), (uint32) GetByteBufferSize (runs_p -> pr_runs_p))) &&
+												(BSON_APPEND_BINARY (&line, S_SKIP_S, BSON_SUBTYPE_BINARY, skip_p, (uint32) skip_length));
+
+											if (!bson_append_document_end (&progeny, &line))
+												{
+													success_flag = false;
+												}
+										}
+
+									++ i;
+								}
+						}
+
+					if (!bson_append_array_end (doc_p, &progeny))
+						{
+							success_flag = false;
+						}
+				}
+
+			FreeMemory (skip_p);
+		}
+
+	return success_flag;
+}
+
+
+static bool WriteHaplotypeBlocks (const bson_oid_t *id_p, const char *population_s, const bson_t *doc_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (doc_p -> len < BSON_MAX_SIZE)
+		{
+			if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_haplotype_blocks_collection_s))
+				{
+					bson_t *selector_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+					if (selector_p)
+						{
+							bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+							if (opts_p)
+								{
+									bson_error_t error;
+
+									if (mongoc_collection_replace_one (data_p -> pgsd_mongo_p -> mt_collection_p, selector_p, doc_p, opts_p, NULL, &error))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save haplotype blocks for \"%s\" to \"%s\": %s", population_s, data_p -> pgsd_haplotype_blocks_collection_s, error.message);
+										}
+
+									bson_destroy (opts_p);
+								}
+
+							bson_destroy (selector_p);
+						}
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The haplotype blocks for \"%s\" are too large to save, " UINT32_FMT " bytes", population_s, doc_p -> len);
+		}
+
+	return success_flag;
+}
+
+
+static bool AddBSONHaplotypeGenotypes (const bson_t *doc_p, void *data_p)
+{
+	HaplotypeSearch *search_p = (HaplotypeSearch *) data_p;
+	HaplotypeDecoder decoder;
+	bool success_flag = true;
+
+	memset (&decoder, 0, sizeof (HaplotypeDecoder));
+
+	/*
+	 * Skip any populations with this name that don't have the line
+	 */
+	if (FindProgenyRuns (doc_p, search_p -> hs_accession_s, &decoder))
+		{
+			bson_iter_t iter;
+			bson_iter_t chromosomes_iter;
+
+			success_flag = false;
+
+			if ((bson_iter_init_find (&iter, doc_p, S_CHROMOSOMES_S)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &chromosomes_iter)))
+				{
+					decoder.hd_other_calls_ss = GetBSONStringArray (doc_p, S_OTHER_CALLS_S, & (decoder.hd_num_other_calls));
+
+					if (decoder.hd_other_calls_ss)
+						{
+							json_t *result_p = json_object ();
+
+							if (result_p)
+								{
+									json_t *genotypes_p = json_object ();
+
+									if (genotypes_p)
+										{
+											if (json_object_set_new (result_p, PGS_GENOTYPES_S, genotypes_p) == 0)
+												{
+													uint32 i = 0;
+
+													success_flag = (SetJSONString (result_p, PGS_POPULATION_NAME_S, GetBSONString (doc_p, PGS_POPULATION_NAME_S))) &&
+														(SetJSONString (result_p, PGS_ACCESSION_S, search_p -> hs_accession_s));
+
+													while (success_flag && (bson_iter_next (&chromosomes_iter)))
+														{
+															if (BSON_ITER_HOLDS_DOCUMENT (&chromosomes_iter))
+																{
+																	const uint8_t *chromosome_data_p = NULL;
+																	uint32_t chromosome_length = 0;
+																	bson_t chromosome;
+
+																	bson_iter_document (&chromosomes_iter, &chromosome_length, &chromosome_data_p);
+
+																	if (bson_init_static (&chromosome, chromosome_data_p, chromosome_length))
+																		{
+																			success_flag = DecodeChromosome (&decoder, i, &chromosome, search_p, genotypes_p);
+																		}
+																}
+
+															++ i;
+														}
+
+													if (success_flag)
+														{
+															success_flag = (json_array_append (search_p -> hs_results_p, result_p) == 0);
+														}
+												}
+											else
+												{
+													json_decref (genotypes_p);
+												}
+										}
+
+									json_decref (result_p);
+								}		/* if (result_p) */
+
+							FreeMemory (decoder.hd_other_calls_ss);
+						}		/* if (decoder.hd_other_calls_ss) */
+				}
+
+			FreeMemory (decoder.hd_skip_p);
+		}		/* if (FindProgenyRuns (doc_p, search_p -> hs_accession_s, &decoder)) */
+
+	return success_flag;
+}
+
+
+/*
+ * Add a marker object for each of the decoded markers to the population
+ * and then fill them in a progeny line at a time. The marker objects are
+ * also kept by their unescaped names, as the blocks store them, so each
+ * decoded call can be put straight into its marker.
+ */
+static bool AddBSONHaplotypeMarkers (const bson_t *doc_p, void *data_p)
+{
+	HaplotypeMarkers *markers_p = (HaplotypeMarkers *) data_p;
+	bool success_flag = false;
+	json_t *marker_objects_p = json_object ();
+
+	++ (markers_p -> hm_num_docs);
+
+	if (marker_objects_p)
+		{
+			json_t *genotypes_p = json_object ();
+
+			if (genotypes_p)
+				{
+					HaplotypeDecoder decoder;
+
+					memset (&decoder, 0, sizeof (HaplotypeDecoder));
+
+					if ((decoder.hd_other_calls_ss = GetBSONStringArray (doc_p, S_OTHER_CALLS_S, & (decoder.hd_num_other_calls))) != NULL)
+						{
+							if (AddHaplotypeMarkerObjects (doc_p, markers_p, marker_objects_p))
+								{
+									bson_iter_t iter;
+									bson_iter_t progeny_iter;
+
+									if ((bson_iter_init_find (&iter, doc_p, S_PROGENY_S)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &progeny_iter)))
+										{
+											success_flag = true;
+
+											while (success_flag && (bson_iter_next (&progeny_iter)))
+												{
+													bson_iter_t line_iter;
+
+													success_flag = false;
+
+													if ((BSON_ITER_HOLDS_DOCUMENT (&progeny_iter)) && (bson_iter_recurse (&progeny_iter, &line_iter)) &&
+															(bson_iter_find (&line_iter, PGS_ACCESSION_S)) && (BSON_ITER_HOLDS_UTF8 (&line_iter)))
+														{
+															const char *accession_s = bson_iter_utf8 (&line_iter, NULL);
+
+															if (GetProgenyRuns (&progeny_iter, &decoder))
+																{
+																	success_flag = AddProgenyCallsToMarkers (doc_p, &decoder, accession_s, markers_p, marker_objects_p, genotypes_p);
+
+																	FreeMemory (decoder.hd_skip_p);
+																	decoder.hd_skip_p = NULL;
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the runs for \"%s\"", accession_s);
+																}
+														}
+												}
+										}
+								}
+
+							FreeMemory (decoder.hd_other_calls_ss);
+						}		/* if (decoder.hd_other_calls_ss) */
+
+					json_decref (genotypes_p);
+				}		/* if (genotypes_p) */
+
+			json_decref (marker_objects_p);
+		}		/* if (marker_objects_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Markers that weren't on the map are stored on the unnamed chromosome,
+ * "", and markers without a mapping position have an empty one, so
+ * neither of these is added back.
+ */
+static bool AddHaplotypeMarkerObjects (const bson_t *doc_p, const HaplotypeMarkers *markers_p, json_t *marker_objects_p)
+{
+	bool success_flag = false;
+	bson_iter_t iter;
+	bson_iter_t chromosomes_iter;
+
+	if ((bson_iter_init_find (&iter, doc_p, S_CHROMOSOMES_S)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &chromosomes_iter)))
+		{
+			success_flag = true;
+
+			while (success_flag && (bson_iter_next (&chromosomes_iter)))
+				{
+					const uint8_t *chromosome_data_p = NULL;
+					uint32_t chromosome_length = 0;
+					bson_t chromosome;
+
+					success_flag = false;
+
+					if (BSON_ITER_HOLDS_DOCUMENT (&chromosomes_iter))
+						{
+							bson_iter_document (&chromosomes_iter, &chromosome_length, &chromosome_data_p);
+
+							if (bson_init_static (&chromosome, chromosome_data_p, chromosome_length))
+								{
+									const char *chromosome_s = GetBSONString (&chromosome, PGS_CHROMOSOME_S);
+									uint32 num_markers = 0;
+									const char **markers_ss = GetBSONStringArray (&chromosome, S_MARKERS_S, &num_markers);
+
+									if (markers_ss)
+										{
+											uint32 num_positions = 0;
+											const char **positions_ss = GetBSONStringArray (&chromosome, S_MAPPING_POSITIONS_S, &num_positions);
+
+											if (positions_ss)
+												{
+													uint32 i;
+
+													success_flag = (chromosome_s != NULL) && (num_positions == num_markers);
+
+													for (i = 0; (i < num_markers) && success_flag; ++ i)
+														{
+															if ((markers_p -> hm_marker_s == NULL) || (strcmp (markers_ss [i], markers_p -> hm_marker_s) == 0))
+																{
+																	json_t *marker_p = json_object ();
+
+																	success_flag = false;
+
+																	if (marker_p)
+																		{
+																			char *escaped_marker_s = NULL;
+
+																			if (((*chromosome_s == '\0') || (SetJSONString (marker_p, PGS_CHROMOSOME_S, chromosome_s))) &&
+																					((* (positions_ss [i]) == '\0') || (SetJSONString (marker_p, PGS_MAPPING_POSITION_S, positions_ss [i]))) &&
+																					(json_object_set (marker_objects_p, markers_ss [i], marker_p) == 0) &&
+																					(SearchAndReplaceInString (markers_ss [i], &escaped_marker_s, ".", PGS_ESCAPED_DOT_S)))
+																				{
+																					if (json_object_set (markers_p -> hm_population_p, escaped_marker_s ? escaped_marker_s : markers_ss [i], marker_p) == 0)
+																						{
+																							success_flag = true;
+																						}
+
+																					if (escaped_marker_s)
+																						{
+																							FreeCopiedString (escaped_marker_s);
+																						}
+																				}
+
+																			json_decref (marker_p);
+																		}
+																}
+														}
+
+													FreeMemory (positions_ss);
+												}		/* if (positions_ss) */
+
+											FreeMemory (markers_ss);
+										}		/* if (markers_ss) */
+								}
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Decode a progeny line's calls, on every chromosome, and put each of
+ * them into the marker object that it belongs to.
+ */
+static bool AddProgenyCallsToMarkers (const bson_t *doc_p, const HaplotypeDecoder *decoder_p, const char *accession_s, const HaplotypeMarkers *markers_p, json_t *marker_objects_p, json_t *genotypes_p)
+{
+	bool success_flag = false;
+	bson_iter_t iter;
+	bson_iter_t chromosomes_iter;
+
+	json_object_clear (genotypes_p);
+
+	if ((bson_iter_init_find (&iter, doc_p, S_CHROMOSOMES_S)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &chromosomes_iter)))
+		{
+			HaplotypeSearch search;
+			uint32 i = 0;
+
+			memset (&search, 0, sizeof (HaplotypeSearch));
+			search.hs_accession_s = accession_s;
+			search.hs_marker_s = markers_p -> hm_marker_s;
+
+			success_flag = true;
+
+			while (success_flag && (bson_iter_next (&chromosomes_iter)))
+				{
+					if (BSON_ITER_HOLDS_DOCUMENT (&chromosomes_iter))
+						{
+							const uint8_t *chromosome_data_p = NULL;
+							uint32_t chromosome_length = 0;
+							bson_t chromosome;
+
+							bson_iter_document (&chromosomes_iter, &chromosome_length, &chromosome_data_p);
+
+							if (bson_init_static (&chromosome, chromosome_data_p, chromosome_length))
+								{
+									success_flag = DecodeChromosome (decoder_p, i, &chromosome, &search, genotypes_p);
+								}
+						}
+
+					++ i;
+				}
+
+			if (success_flag)
+				{
+					const char *marker_s;
+					json_t *call_p;
+
+					json_object_foreach (genotypes_p, marker_s, call_p)
+						{
+							if (success_flag)
+								{
+									json_t *marker_p = json_object_get (marker_objects_p, marker_s);
+
+									if (marker_p)
+										{
+											success_flag = (json_object_set (marker_p, accession_s, call_p) == 0);
+										}
+								}
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool FindProgenyRuns (const bson_t *doc_p, const char *accession_s, HaplotypeDecoder *decoder_p)
+{
+	bson_iter_t iter;
+	bson_iter_t progeny_iter;
+
+	if ((bson_iter_init_find (&iter, doc_p, S_PROGENY_S)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &progeny_iter)))
+		{
+			while (bson_iter_next (&progeny_iter))
+				{
+					bson_iter_t line_iter;
+
+					if ((BSON_ITER_HOLDS_DOCUMENT (&progeny_iter)) && (bson_iter_recurse (&progeny_iter, &line_iter)) &&
+							(bson_iter_find (&line_iter, PGS_ACCESSION_S)) && (BSON_ITER_HOLDS_UTF8 (&line_iter)) &&
+							(strcmp (bson_iter_utf8 (&line_iter, NULL), accession_s) == 0))
+						{
+							if (GetProgenyRuns (&progeny_iter, decoder_p))
+								{
+									return true;
+								}
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the runs for \"%s\"", accession_s);
+							return false;
+						}
+				}
+		}
+
+	return false;
+}
+
+
+/*
+ * Get the runs and the skip index of the progeny line that
+ * progeny_iter_p is on.
+ */
+static bool GetProgenyRuns (const bson_iter_t *progeny_iter_p, HaplotypeDecoder *decoder_p)
+{
+	bson_iter_t runs_iter;
+	bson_iter_t skip_iter;
+
+	if ((bson_iter_recurse (progeny_iter_p, &runs_iter)) && (bson_iter_find (&runs_iter, S_RUNS_S)) && (BSON_ITER_HOLDS_BINARY (&runs_iter)) &&
+			(bson_iter_recurse (progeny_iter_p, &skip_iter)) && (bson_iter_find (&skip_iter, S_SKIP_S)) && (BSON_ITER_HOLDS_BINARY (&skip_iter)))
+		{
+			const uint8_t *skip_data_p = NULL;
+			uint32_t skip_length = 0;
+			bson_subtype_t subtype;
+
+			bson_iter_binary (&runs_iter, &subtype, & (decoder_p -> hd_runs_length), & (decoder_p -> hd_runs_p));
+			bson_iter_binary (&skip_iter, &subtype, &skip_length, &skip_data_p);
+
+			decoder_p -> hd_num_chromosomes = 0;
+
+			/*
+			 * There is a varint for each chromosome and each one is at least a byte
+			 */
+			if ((decoder_p -> hd_skip_p = (uint32 *) AllocMemoryArray (skip_length + 1, sizeof (uint32))) != NULL)
+				{
+					const uint8_t *skip_end_p = skip_data_p + skip_length;
+
+					while ((skip_data_p < skip_end_p) && (DecodeVarint (&skip_data_p, skip_end_p, decoder_p -> hd_skip_p + decoder_p -> hd_num_chromosomes)))
+						{
+							++ (decoder_p -> hd_num_chromosomes);
+						}
+
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static const char **GetBSONStringArray (const bson_t *doc_p, const char *key_s, uint32 *num_values_p)
+{
+	bson_iter_t iter;
+	bson_iter_t values_iter;
+
+	if ((bson_iter_init_find (&iter, doc_p, key_s)) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, &values_iter)))
+		{
+			bson_iter_t count_iter = values_iter;
+			uint32 num_values = 0;
+			const char **values_ss;
+
+			while (bson_iter_next (&count_iter))
+				{
+					++ num_values;
+				}
+
+			values_ss = (const char **) AllocMemoryArray (num_values + 1, sizeof (const char *));
+
+			if (values_ss)
+				{
+					uint32 i = 0;
+
+					while ((i < num_values) && (bson_iter_next (&values_iter)))
+						{
+							values_ss [i ++] = BSON_ITER_HOLDS_UTF8 (&values_iter) ? bson_iter_utf8 (&values_iter, NULL) : "";
+						}
+
+					*num_values_p = num_values;
+					return values_ss;
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * The markers are in map order, so the ones to decode are a contiguous
+ * range. The runs before that range are skipped over by their lengths
+ * without looking at the markers that they cover.
+ */
+static bool DecodeChromosome (const HaplotypeDecoder *decoder_p, const uint32 chromosome_index, const bson_t *chromosome_p, const HaplotypeSearch *search_p, json_t *genotypes_p)
+{
+	bool success_flag = true;
+
+	const char *chromosome_s = GetBSONString (chromosome_p, PGS_CHROMOSOME_S);
+
+	if ((chromosome_s) && (chromosome_index < decoder_p -> hd_num_chromosomes) &&
+			((search_p -> hs_chromosome_s == NULL) || (strcmp (search_p -> hs_chromosome_s, chromosome_s) == 0)))
+		{
+			uint32 num_markers = 0;
+			const char **markers_ss = GetBSONStringArray (chromosome_p, S_MARKERS_S, &num_markers);
+
+			success_flag = false;
+
+			if (markers_ss)
+				{
+					uint32 num_positions = 0;
+					const char **positions_ss = GetBSONStringArray (chromosome_p, S_MAPPING_POSITIONS_S, &num_positions);
+
+					if (positions_ss)
+						{
+							uint32 num_parent_a = 0;
+							const char **parent_a_ss = GetBSONStringArray (chromosome_p, S_PARENT_A_GENOTYPES_S, &num_parent_a);
+
+							if (parent_a_ss)
+								{
+									uint32 num_parent_b = 0;
+									const char **parent_b_ss = GetBSONStringArray (chromosome_p, S_PARENT_B_GENOTYPES_S, &num_parent_b);
+
+									if (parent_b_ss)
+										{
+											uint32 first = num_markers;
+											uint32 last = 0;
+											uint32 i;
+
+											success_flag = (num_positions == num_markers) && (num_parent_a == num_markers) && (num_parent_b == num_markers);
+
+											for (i = 0; (i < num_markers) && success_flag; ++ i)
+												{
+													const bool wanted_flag = (search_p -> hs_marker_s) ?
+														(strcmp (markers_ss [i], search_p -> hs_marker_s) == 0) :
+														(IsPositionInInterval (positions_ss [i], search_p -> hs_start_p, search_p -> hs_end_p));
+
+													if (wanted_flag)
+														{
+															if (first == num_markers)
+																{
+																	first = i;
+																}
+
+															last = i;
+														}
+												}
+
+											if (success_flag && (first < num_markers))
+												{
+													const uint8_t *runs_p = decoder_p -> hd_runs_p + decoder_p -> hd_skip_p [chromosome_index];
+													const uint8_t *runs_end_p = decoder_p -> hd_runs_p + ((chromosome_index + 1 < decoder_p -> hd_num_chromosomes) ? decoder_p -> hd_skip_p [chromosome_index + 1] : decoder_p -> hd_runs_length);
+													uint32 run_start = 0;
+
+													while (success_flag && (run_start <= last) && (runs_p < runs_end_p))
+														{
+															uint32 code;
+															uint32 length;
+
+															if ((DecodeVarint (&runs_p, runs_end_p, &code)) && (DecodeVarint (&runs_p, runs_end_p, &length)))
+																{
+																	if ((code != HC_NO_CALL) && (run_start + length > first))
+																		{
+																			const uint32 end = (run_start + length - 1 < last) ? run_start + length - 1 : last;
+
+																			for (i = (run_start > first) ? run_start : first; (i <= end) && success_flag; ++ i)
+																				{
+																					if ((search_p -> hs_marker_s) || (IsPositionInInterval (positions_ss [i], search_p -> hs_start_p, search_p -> hs_end_p)))
+																						{
+																							const char *call_s = NULL;
+
+																							if (code == HC_PARENT_A)
+																								{
+																									call_s = parent_a_ss [i];
+																								}
+																							else if (code == HC_PARENT_B)
+																								{
+																									call_s = parent_b_ss [i];
+																								}
+																							else if (code - HC_OTHER < decoder_p -> hd_num_other_calls)
+																								{
+																									call_s = decoder_p -> hd_other_calls_ss [code - HC_OTHER];
+																								}
+
+																							success_flag = (call_s != NULL) && (SetJSONString (genotypes_p, markers_ss [i], call_s));
+																						}
+																				}
+																		}
+
+																	run_start += length;
+																}
+															else
+																{
+																	success_flag = false;
+																}
+														}
+												}
+
+											if (!success_flag)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to decode the haplotype blocks on \"%s\"", chromosome_s);
+												}
+
+											FreeMemory (parent_b_ss);
+										}		/* if (parent_b_ss) */
+
+									FreeMemory (parent_a_ss);
+								}		/* if (parent_a_ss) */
+
+							FreeMemory (positions_ss);
+						}		/* if (positions_ss) */
+
+					FreeMemory (markers_ss);
+				}		/* if (markers_ss) */
+		}
+
+	return success_flag;
+}
+
+
+static bool IsPositionInInterval (const char *position_s, const double64 *start_p, const double64 *end_p)
+{
+	if ((start_p) || (end_p))
+		{
+			char *end_s = NULL;
+			const double64 position = strtod (position_s, &end_s);
+
+			if (end_s == position_s)
+				{
+					return false;
+				}
+
+			if ((start_p) && (position < *start_p))
+				{
+					return false;
+				}
+
+			if ((end_p) && (position > *end_p))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
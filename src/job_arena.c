@@ -0,0 +1,307 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * job_arena.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "job_arena.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "json_util.h"
+
+
+struct JobArenaChunk
+{
+	/** The next, older, chunk. */
+	struct JobArenaChunk *jac_next_p;
+
+	/** The number of bytes available in jac_data. */
+	size_t jac_size;
+
+	/** The number of bytes of jac_data that have been handed out. */
+	size_t jac_used;
+
+	char jac_data [];
+};
+
+
+/*
+ * Most jobs only need the one chunk. Anything bigger than a quarter of
+ * this gets a chunk of its own so that it doesn't waste the rest of the
+ * current one.
+ */
+static const size_t S_CHUNK_SIZE = 64 * 1024;
+
+static const size_t S_ALIGNMENT = sizeof (void *);
+
+
+static JobArenaChunk *AllocateJobArenaChunk (const size_t size);
+
+
+
+void InitJobArena (JobArena *arena_p)
+{
+	arena_p -> ja_chunks_p = NULL;
+	arena_p -> ja_num_allocations = 0;
+	arena_p -> ja_num_bytes = 0;
+	arena_p -> ja_num_chunks = 0;
+	arena_p -> ja_num_resets = 0;
+}
+
+
+void *AllocFromJobArena (JobArena *arena_p, const size_t size)
+{
+	const size_t aligned_size = (size + S_ALIGNMENT - 1) & ~(S_ALIGNMENT - 1);
+	JobArenaChunk *chunk_p = arena_p -> ja_chunks_p;
+
+	if ((chunk_p == NULL) || (chunk_p -> jac_size - chunk_p -> jac_used < aligned_size))
+		{
+			if (aligned_size > (S_CHUNK_SIZE / 4))
+				{
+					chunk_p = AllocateJobArenaChunk (aligned_size);
+
+					if (chunk_p)
+						{
+							/*
+							 * Keep allocating from the current chunk afterwards
+							 */
+							if (arena_p -> ja_chunks_p)
+								{
+									chunk_p -> jac_next_p = arena_p -> ja_chunks_p -> jac_next_p;
+									arena_p -> ja_chunks_p -> jac_next_p = chunk_p;
+								}
+							else
+								{
+									arena_p -> ja_chunks_p = chunk_p;
+								}
+						}
+				}
+			else
+				{
+					chunk_p = AllocateJobArenaChunk (S_CHUNK_SIZE);
+
+					if (chunk_p)
+						{
+							chunk_p -> jac_next_p = arena_p -> ja_chunks_p;
+							arena_p -> ja_chunks_p = chunk_p;
+						}
+				}
+
+			if (!chunk_p)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate arena chunk for " SIZET_FMT " bytes", size);
+					return NULL;
+				}
+
+			++ (arena_p -> ja_num_chunks);
+		}
+
+	chunk_p -> jac_used += aligned_size;
+
+	++ (arena_p -> ja_num_allocations);
+	arena_p -> ja_num_bytes += size;
+
+	return (chunk_p -> jac_data + chunk_p -> jac_used - aligned_size);
+}
+
+
+char *ConcatenateVarargsStringsInJobArena (JobArena *arena_p, ...)
+{
+	char *result_s = NULL;
+	size_t length = 0;
+	const char *value_s;
+	va_list args;
+
+	va_start (args, arena_p);
+
+	while ((value_s = va_arg (args, const char *)) != NULL)
+		{
+			length += strlen (value_s);
+		}
+
+	va_end (args);
+
+	if ((result_s = (char *) AllocFromJobArena (arena_p, length + 1)) != NULL)
+		{
+			char *dest_s = result_s;
+
+			va_start (args, arena_p);
+
+			while ((value_s = va_arg (args, const char *)) != NULL)
+				{
+					const size_t l = strlen (value_s);
+
+					memcpy (dest_s, value_s, l);
+					dest_s += l;
+				}
+
+			va_end (args);
+
+			*dest_s = '\0';
+		}
+
+	return result_s;
+}
+
+
+const char *SearchAndReplaceInStringInJobArena (JobArena *arena_p, const char *src_s, const char *to_find_s, const char *replacement_s)
+{
+	const char *match_s = strstr (src_s, to_find_s);
+
+	if (match_s)
+		{
+			const size_t find_length = strlen (to_find_s);
+			const size_t replacement_length = strlen (replacement_s);
+			size_t num_matches = 0;
+			char *result_s;
+
+			while (match_s)
+				{
+					++ num_matches;
+					match_s = strstr (match_s + find_length, to_find_s);
+				}
+
+			result_s = (char *) AllocFromJobArena (arena_p, strlen (src_s) + (num_matches * replacement_length) - (num_matches * find_length) + 1);
+
+			if (result_s)
+				{
+					char *dest_s = result_s;
+
+					while ((match_s = strstr (src_s, to_find_s)) != NULL)
+						{
+							const size_t l = match_s - src_s;
+
+							memcpy (dest_s, src_s, l);
+							dest_s += l;
+
+							memcpy (dest_s, replacement_s, replacement_length);
+							dest_s += replacement_length;
+
+							src_s = match_s + find_length;
+						}
+
+					strcpy (dest_s, src_s);
+				}
+
+			return result_s;
+		}
+
+	return src_s;
+}
+
+
+void ResetJobArena (JobArena *arena_p)
+{
+	JobArenaChunk *chunk_p = arena_p -> ja_chunks_p;
+	JobArenaChunk *kept_p = NULL;
+
+	while (chunk_p)
+		{
+			JobArenaChunk *next_p = chunk_p -> jac_next_p;
+
+			if ((kept_p == NULL) && (chunk_p -> jac_size == S_CHUNK_SIZE))
+				{
+					kept_p = chunk_p;
+					kept_p -> jac_used = 0;
+					kept_p -> jac_next_p = NULL;
+				}
+			else
+				{
+					FreeMemory (chunk_p);
+				}
+
+			chunk_p = next_p;
+		}
+
+	arena_p -> ja_chunks_p = kept_p;
+	++ (arena_p -> ja_num_resets);
+}
+
+
+void ClearJobArena (JobArena *arena_p)
+{
+	JobArenaChunk *chunk_p = arena_p -> ja_chunks_p;
+
+	while (chunk_p)
+		{
+			JobArenaChunk *next_p = chunk_p -> jac_next_p;
+
+			FreeMemory (chunk_p);
+			chunk_p = next_p;
+		}
+
+	arena_p -> ja_chunks_p = NULL;
+}
+
+
+bool AddJobArenaToServiceJob (const JobArena *arena_p, ServiceJob *job_p)
+{
+	json_t *arena_json_p = json_object ();
+
+	if (arena_json_p)
+		{
+			/*
+			 * Without the arena, each of the allocations would have been
+			 * a separate malloc and free, so comparing the allocations
+			 * with the chunks shows how many heap calls were saved.
+			 */
+			if ((SetJSONInteger (arena_json_p, "allocations", (json_int_t) (arena_p -> ja_num_allocations))) &&
+					(SetJSONInteger (arena_json_p, "bytes", (json_int_t) (arena_p -> ja_num_bytes))) &&
+					(SetJSONInteger (arena_json_p, "heap_chunks", arena_p -> ja_num_chunks)) &&
+					(SetJSONInteger (arena_json_p, "resets", arena_p -> ja_num_resets)))
+				{
+					if (! (job_p -> sj_metadata_p))
+						{
+							job_p -> sj_metadata_p = json_object ();
+						}
+
+					if (job_p -> sj_metadata_p)
+						{
+							if (json_object_set_new (job_p -> sj_metadata_p, "arena", arena_json_p) == 0)
+								{
+									return true;
+								}
+						}
+				}
+
+			json_decref (arena_json_p);
+		}
+
+	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add arena counts to job metadata");
+
+	return false;
+}
+
+
+static JobArenaChunk *AllocateJobArenaChunk (const size_t size)
+{
+	JobArenaChunk *chunk_p = (JobArenaChunk *) AllocMemory (sizeof (JobArenaChunk) + size);
+
+	if (chunk_p)
+		{
+			chunk_p -> jac_next_p = NULL;
+			chunk_p -> jac_size = size;
+			chunk_p -> jac_used = 0;
+		}
+
+	return chunk_p;
+}
@@ -0,0 +1,216 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * job_timings.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "job_timings.h"
+
+#include "streams.h"
+#include "json_util.h"
+
+
+static const char * const S_STAGE_NAMES_SS [JTS_NUM_STAGES] =
+{
+	"varieties_lookup",
+	"population_fetch",
+	"marker_fetch",
+	"amalgamation",
+	"unescape_keys",
+	"result_wrapping",
+	"build_markers",
+	"save_markers",
+	"save_varieties",
+	"save_progeny",
+	"save_marker_stats",
+	"save_breakpoints",
+	"save_haplotype_blocks"
+};
+
+
+
+void InitJobTimings (JobTimings *timings_p, const bool enabled_flag)
+{
+	memset (timings_p, 0, sizeof (JobTimings));
+	timings_p -> jt_enabled_flag = enabled_flag;
+}
+
+
+uint64 StartJobTimer (const JobTimings *timings_p)
+{
+	return (timings_p -> jt_enabled_flag) ? GetMonotonicTimeInNanoseconds () : 0;
+}
+
+
+void StopJobTimer (JobTimings *timings_p, const JobTimingStage stage, const uint64 start_time)
+{
+	if (timings_p -> jt_enabled_flag)
+		{
+			timings_p -> jt_stage_times [stage] += GetMonotonicTimeInNanoseconds () - start_time;
+			++ (timings_p -> jt_stage_calls [stage]);
+		}
+}
+
+
+void AddMongoFetchToJobTimings (JobTimings *timings_p, const json_t *results_p)
+{
+	/*
+	 * The round trip and document counts are cheap enough to always
+	 * keep since they are also used for the process-wide metrics.
+	 */
+	++ (timings_p -> jt_round_trips);
+
+	if (results_p)
+		{
+			timings_p -> jt_docs_fetched += json_array_size (results_p);
+
+			if (timings_p -> jt_enabled_flag)
+				{
+					/*
+					 * We don't have access to the raw BSON sizes here, so use the
+					 * size of the compact JSON as an approximation. Passing a NULL
+					 * buffer just calculates the size without writing anything.
+					 */
+					timings_p -> jt_bytes_fetched += json_dumpb (results_p, NULL, 0, JSON_COMPACT);
+				}
+		}
+}
+
+
+void AddBSONFetchToJobTimings (JobTimings *timings_p, const uint64 num_docs, const uint64 num_bytes)
+{
+	++ (timings_p -> jt_round_trips);
+
+	timings_p -> jt_docs_fetched += num_docs;
+
+	if (timings_p -> jt_enabled_flag)
+		{
+			timings_p -> jt_bytes_fetched += num_bytes;
+		}
+}
+
+
+bool AddJobTimingsToServiceJob (const JobTimings *timings_p, ServiceJob *job_p)
+{
+	bool success_flag = true;
+
+	if (timings_p -> jt_enabled_flag)
+		{
+			json_t *timings_json_p = json_object ();
+
+			success_flag = false;
+
+			if (timings_json_p)
+				{
+					json_t *stages_p = json_object ();
+
+					if (stages_p)
+						{
+							if (json_object_set_new (timings_json_p, "stages", stages_p) == 0)
+								{
+									JobTimingStage stage = 0;
+									bool loop_flag = true;
+
+									while ((stage < JTS_NUM_STAGES) && loop_flag)
+										{
+											if (timings_p -> jt_stage_calls [stage] > 0)
+												{
+													json_t *stage_p = json_object ();
+
+													loop_flag = false;
+
+													if (stage_p)
+														{
+															if (json_object_set_new (stages_p, S_STAGE_NAMES_SS [stage], stage_p) == 0)
+																{
+																	if (SetJSONReal (stage_p, "ms", ((double) (timings_p -> jt_stage_times [stage])) / 1000000.0))
+																		{
+																			if (SetJSONInteger (stage_p, "calls", timings_p -> jt_stage_calls [stage]))
+																				{
+																					loop_flag = true;
+																				}
+																		}
+																}
+															else
+																{
+																	json_decref (stage_p);
+																}
+														}		/* if (stage_p) */
+
+												}		/* if (timings_p -> jt_stage_calls [stage] > 0) */
+
+											++ stage;
+										}		/* while ((stage < JTS_NUM_STAGES) && loop_flag) */
+
+									if (loop_flag)
+										{
+											if (SetJSONInteger (timings_json_p, "round_trips", timings_p -> jt_round_trips))
+												{
+													if (SetJSONInteger (timings_json_p, "documents_fetched", timings_p -> jt_docs_fetched))
+														{
+															if (SetJSONInteger (timings_json_p, "bytes_fetched", timings_p -> jt_bytes_fetched))
+																{
+																	if (! (job_p -> sj_metadata_p))
+																		{
+																			job_p -> sj_metadata_p = json_object ();
+																		}
+
+																	if (job_p -> sj_metadata_p)
+																		{
+																			if (json_object_set_new (job_p -> sj_metadata_p, "timings", timings_json_p) == 0)
+																				{
+																					return true;
+																				}
+																		}
+																}
+														}
+												}
+										}		/* if (loop_flag) */
+
+								}		/* if (json_object_set_new (timings_json_p, "stages", stages_p) == 0) */
+							else
+								{
+									json_decref (stages_p);
+								}
+
+						}		/* if (stages_p) */
+
+					PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, timings_json_p, "Failed to add timings to job metadata");
+					json_decref (timings_json_p);
+				}		/* if (timings_json_p) */
+
+		}		/* if (timings_p -> jt_enabled_flag) */
+
+	return success_flag;
+}
+
+
+uint64 GetMonotonicTimeInNanoseconds (void)
+{
+	struct timespec t;
+
+	if (clock_gettime (CLOCK_MONOTONIC, &t) == 0)
+		{
+			return (((uint64) t.tv_sec) * 1000000000ULL) + ((uint64) t.tv_nsec);
+		}
+
+	return 0;
+}
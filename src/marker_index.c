@@ -0,0 +1,837 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * marker_index.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "marker_index.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * A marker name along with the indexes of the populations, in
+ * MarkerIndex's mi_populations_p, that contain it.
+ */
+typedef struct MarkerIndexEntry
+{
+	char *mie_marker_s;
+
+	uint32 *mie_populations_p;
+
+	uint32 mie_num_populations;
+} MarkerIndexEntry;
+
+
+typedef struct MarkerIndexPopulation
+{
+	bson_oid_t mip_id;
+
+	char *mip_name_s;
+} MarkerIndexPopulation;
+
+
+/*
+ * The entries are kept sorted by marker name so that prefix
+ * searches are a binary search followed by a linear scan over
+ * just the matching entries.
+ */
+typedef struct MarkerIndex
+{
+	MarkerIndexEntry *mi_entries_p;
+
+	size_t mi_num_entries;
+
+	MarkerIndexPopulation *mi_populations_p;
+
+	uint32 mi_num_populations;
+
+	uint32 mi_num_refs;
+
+	bool mi_loaded_flag;
+} MarkerIndex;
+
+
+/*
+ * A growable list of unescaped marker names for a single population.
+ */
+typedef struct MarkerNames
+{
+	char **mn_names_ss;
+
+	size_t mn_num_names;
+
+	size_t mn_capacity;
+} MarkerNames;
+
+
+static MarkerIndex s_index = { NULL, 0, NULL, 0, 0, false };
+
+static pthread_rwlock_t s_index_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+
+static bool AddBSONPopulationToMarkerIndex (const bson_t *doc_p, void *data_p);
+
+static bool AddMarkersToIndex (MarkerIndex *index_p, const bson_oid_t *id_p, const char *name_s, MarkerNames *names_p);
+
+static uint32 GetPopulationIndex (MarkerIndex *index_p, const bson_oid_t *id_p, const char *name_s);
+
+static bool AddMarkerName (MarkerNames *names_p, const char *escaped_marker_s);
+
+static void ClearMarkerNames (MarkerNames *names_p);
+
+static size_t FindMarkerIndexEntry (const MarkerIndex *index_p, const char *marker_s, const size_t marker_length);
+
+static json_t *GetMarkerIndexEntryAsJSON (const MarkerIndex *index_p, const MarkerIndexEntry *entry_p);
+
+static void ClearMarkerIndex (MarkerIndex *index_p);
+
+static int CompareStrings (const void *v0_p, const void *v1_p);
+
+
+
+bool LoadMarkerIndex (ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	pthread_rwlock_wrlock (&s_index_lock);
+
+	if (s_index.mi_loaded_flag)
+		{
+			success_flag = true;
+		}
+	else
+		{
+			if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+				{
+					bson_t *query_p = bson_new ();
+
+					if (query_p)
+						{
+							if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, NULL))
+								{
+									if (IterateOverMongoResults (data_p -> pgsd_mongo_p, AddBSONPopulationToMarkerIndex, &s_index) >= 0)
+										{
+											PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Loaded " SIZET_FMT " markers from " UINT32_FMT " populations into the marker index", s_index.mi_num_entries, s_index.mi_num_populations);
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load marker index from \"%s\"", data_p -> pgsd_populations_collection_s);
+										}
+								}
+
+							bson_destroy (query_p);
+						}		/* if (query_p) */
+
+				}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+			if (success_flag)
+				{
+					s_index.mi_loaded_flag = true;
+				}
+			else
+				{
+					ClearMarkerIndex (&s_index);
+				}
+		}
+
+	if (success_flag)
+		{
+			++ (s_index.mi_num_refs);
+		}
+
+	pthread_rwlock_unlock (&s_index_lock);
+
+	return success_flag;
+}
+
+
+void ReleaseMarkerIndex (void)
+{
+	pthread_rwlock_wrlock (&s_index_lock);
+
+	if (s_index.mi_num_refs > 0)
+		{
+			-- (s_index.mi_num_refs);
+
+			if (s_index.mi_num_refs == 0)
+				{
+					ClearMarkerIndex (&s_index);
+				}
+		}
+
+	pthread_rwlock_unlock (&s_index_lock);
+}
+
+
+bool AddPopulationToMarkerIndex (const bson_oid_t *id_p, const char *name_s, const json_t *doc_p)
+{
+	bool success_flag = true;
+
+	pthread_rwlock_wrlock (&s_index_lock);
+
+	if (s_index.mi_loaded_flag)
+		{
+			MarkerNames names = { NULL, 0, 0 };
+			const char *key_s;
+			json_t *value_p;
+
+			json_object_foreach ((json_t *) doc_p, key_s, value_p)
+				{
+					if (success_flag && IsMarkerEntry (key_s, value_p))
+						{
+							success_flag = AddMarkerName (&names, key_s);
+						}
+				}
+
+			if (success_flag)
+				{
+					success_flag = AddMarkersToIndex (&s_index, id_p, name_s, &names);
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add markers for \"%s\" to the marker index", name_s);
+				}
+
+			ClearMarkerNames (&names);
+		}
+
+	pthread_rwlock_unlock (&s_index_lock);
+
+	return success_flag;
+}
+
+
+json_t *SearchMarkerIndex (const char *pattern_s, const size_t max_results, size_t *num_matches_p)
+{
+	json_t *results_p = NULL;
+
+	pthread_rwlock_rdlock (&s_index_lock);
+
+	if (s_index.mi_loaded_flag)
+		{
+			results_p = json_array ();
+
+			if (results_p)
+				{
+					/*
+					 * Everything up to the first wildcard character is a literal
+					 * prefix, so we only need to look at the entries that start
+					 * with it.
+					 */
+					const size_t prefix_length = strcspn (pattern_s, "*?[");
+					const bool wildcard_flag = (* (pattern_s + prefix_length) != '\0');
+					size_t i = FindMarkerIndexEntry (&s_index, pattern_s, prefix_length);
+					size_t num_matches = 0;
+					bool success_flag = true;
+
+					while ((i < s_index.mi_num_entries) && success_flag && (strncmp (s_index.mi_entries_p [i].mie_marker_s, pattern_s, prefix_length) == 0))
+						{
+							const MarkerIndexEntry *entry_p = s_index.mi_entries_p + i;
+
+							if ((!wildcard_flag) || (fnmatch (pattern_s, entry_p -> mie_marker_s, 0) == 0))
+								{
+									if (num_matches < max_results)
+										{
+											json_t *entry_json_p = GetMarkerIndexEntryAsJSON (&s_index, entry_p);
+
+											success_flag = false;
+
+											if (entry_json_p)
+												{
+													if (json_array_append_new (results_p, entry_json_p) == 0)
+														{
+															success_flag = true;
+														}
+													else
+														{
+															json_decref (entry_json_p);
+														}
+												}
+										}
+
+									++ num_matches;
+								}
+
+							++ i;
+						}
+
+					if (success_flag)
+						{
+							if (num_matches_p)
+								{
+									*num_matches_p = num_matches;
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get marker index results for \"%s\"", pattern_s);
+							json_decref (results_p);
+							results_p = NULL;
+						}
+
+				}		/* if (results_p) */
+
+		}		/* if (s_index.mi_loaded_flag) */
+
+	pthread_rwlock_unlock (&s_index_lock);
+
+	return results_p;
+}
+
+
+static bool AddBSONPopulationToMarkerIndex (const bson_t *doc_p, void *data_p)
+{
+	MarkerIndex *index_p = (MarkerIndex *) data_p;
+	bool success_flag = true;
+	const bson_oid_t *id_p = NULL;
+	const char *name_s = NULL;
+	MarkerNames names = { NULL, 0, 0 };
+	bson_iter_t iter;
+
+	if (bson_iter_init (&iter, doc_p))
+		{
+			while (success_flag && bson_iter_next (&iter))
+				{
+					const char *key_s = bson_iter_key (&iter);
+
+					if (BSON_ITER_HOLDS_DOCUMENT (&iter))
+						{
+							success_flag = AddMarkerName (&names, key_s);
+						}
+					else if ((BSON_ITER_HOLDS_ARRAY (&iter)) && (strcmp (key_s, PGS_MARKERS_S) == 0))
+						{
+							/*
+							 * A population that is only stored as haplotype
+							 * blocks lists its markers instead
+							 */
+							bson_iter_t markers_iter;
+
+							if (bson_iter_recurse (&iter, &markers_iter))
+								{
+									while (success_flag && bson_iter_next (&markers_iter))
+										{
+											if (BSON_ITER_HOLDS_UTF8 (&markers_iter))
+												{
+													success_flag = AddMarkerName (&names, bson_iter_utf8 (&markers_iter, NULL));
+												}
+										}
+								}
+						}
+					else if ((BSON_ITER_HOLDS_OID (&iter)) && (strcmp (key_s, MONGO_ID_S) == 0))
+						{
+							id_p = bson_iter_oid (&iter);
+						}
+					else if ((BSON_ITER_HOLDS_UTF8 (&iter)) && (strcmp (key_s, PGS_POPULATION_NAME_S) == 0))
+						{
+							name_s = bson_iter_utf8 (&iter, NULL);
+						}
+				}
+
+			if (success_flag && id_p && name_s)
+				{
+					success_flag = AddMarkersToIndex (index_p, id_p, name_s, &names);
+				}
+		}
+
+	ClearMarkerNames (&names);
+
+	return success_flag;
+}
+
+
+static bool AddMarkersToIndex (MarkerIndex *index_p, const bson_oid_t *id_p, const char *name_s, MarkerNames *names_p)
+{
+	bool success_flag = false;
+	const uint32 population_index = GetPopulationIndex (index_p, id_p, name_s);
+
+	if (population_index < index_p -> mi_num_populations)
+		{
+			size_t *matches_p = NULL;
+			size_t num_names = names_p -> mn_num_names;
+
+			if (num_names == 0)
+				{
+					return true;
+				}
+
+			/*
+			 * Sort the new names and remove any duplicates
+			 */
+			qsort (names_p -> mn_names_ss, num_names, sizeof (char *), CompareStrings);
+
+			if (num_names > 1)
+				{
+					size_t i;
+					size_t j = 0;
+
+					for (i = 1; i < num_names; ++ i)
+						{
+							if (strcmp (* (names_p -> mn_names_ss + i), * (names_p -> mn_names_ss + j)) == 0)
+								{
+									FreeCopiedString (* (names_p -> mn_names_ss + i));
+								}
+							else
+								{
+									* (names_p -> mn_names_ss + (++ j)) = * (names_p -> mn_names_ss + i);
+								}
+						}
+
+					num_names = j + 1;
+					names_p -> mn_num_names = num_names;
+				}
+
+			/*
+			 * Find which of the names are already in the index. Since both
+			 * lists are sorted, we can do this in a single pass.
+			 */
+			matches_p = (size_t *) AllocMemoryArray (num_names, sizeof (size_t));
+
+			if (matches_p)
+				{
+					size_t i = 0;
+					size_t j = 0;
+					size_t num_new = 0;
+
+					while (j < num_names)
+						{
+							int res = -1;
+
+							while ((i < index_p -> mi_num_entries) && ((res = strcmp (index_p -> mi_entries_p [i].mie_marker_s, * (names_p -> mn_names_ss + j))) < 0))
+								{
+									++ i;
+								}
+
+							if ((i < index_p -> mi_num_entries) && (res == 0))
+								{
+									* (matches_p + j) = i;
+								}
+							else
+								{
+									* (matches_p + j) = SIZE_MAX;
+									++ num_new;
+								}
+
+							++ j;
+						}
+
+					/*
+					 * Make room for the new population in the existing entries. If any of
+					 * these fail, the index is still consistent since the number of
+					 * populations in each entry is not updated until later.
+					 */
+					success_flag = true;
+
+					for (j = 0; (j < num_names) && success_flag; ++ j)
+						{
+							const size_t k = * (matches_p + j);
+
+							if (k != SIZE_MAX)
+								{
+									MarkerIndexEntry *entry_p = index_p -> mi_entries_p + k;
+									uint32 *populations_p = (uint32 *) ReallocMemory (entry_p -> mie_populations_p, (entry_p -> mie_num_populations + 1) * sizeof (uint32), entry_p -> mie_num_populations * sizeof (uint32));
+
+									if (populations_p)
+										{
+											entry_p -> mie_populations_p = populations_p;
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (success_flag && (num_new > 0))
+						{
+							/*
+							 * Allocate everything that the new entries need before changing
+							 * the index so that a failure leaves it untouched.
+							 */
+							MarkerIndexEntry *entries_p = (MarkerIndexEntry *) AllocMemoryArray (index_p -> mi_num_entries + num_new, sizeof (MarkerIndexEntry));
+							uint32 **populations_pp = (uint32 **) AllocMemoryArray (num_new, sizeof (uint32 *));
+							size_t k = 0;
+
+							success_flag = false;
+
+							if (entries_p && populations_pp)
+								{
+									while ((k < num_new) && ((* (populations_pp + k) = (uint32 *) AllocMemory (sizeof (uint32))) != NULL))
+										{
+											++ k;
+										}
+
+									success_flag = (k == num_new);
+								}
+
+							if (success_flag)
+								{
+									/*
+									 * Merge the existing entries with the new ones. The new entries take
+									 * ownership of the marker names.
+									 */
+									MarkerIndexEntry *dest_p = entries_p;
+
+									i = 0;
+									k = 0;
+
+									for (j = 0; j < num_names; ++ j)
+										{
+											if (* (matches_p + j) == SIZE_MAX)
+												{
+													char *marker_s = * (names_p -> mn_names_ss + j);
+
+													while ((i < index_p -> mi_num_entries) && (strcmp (index_p -> mi_entries_p [i].mie_marker_s, marker_s) < 0))
+														{
+															*dest_p = index_p -> mi_entries_p [i];
+															++ dest_p;
+															++ i;
+														}
+
+													dest_p -> mie_marker_s = marker_s;
+													dest_p -> mie_populations_p = * (populations_pp + k);
+													* (dest_p -> mie_populations_p) = population_index;
+													dest_p -> mie_num_populations = 1;
+
+													* (names_p -> mn_names_ss + j) = NULL;
+													++ dest_p;
+													++ k;
+												}
+										}
+
+									while (i < index_p -> mi_num_entries)
+										{
+											*dest_p = index_p -> mi_entries_p [i];
+											++ dest_p;
+											++ i;
+										}
+
+									if (index_p -> mi_entries_p)
+										{
+											FreeMemory (index_p -> mi_entries_p);
+										}
+
+									index_p -> mi_entries_p = entries_p;
+									index_p -> mi_num_entries += num_new;
+								}
+							else
+								{
+									while (k > 0)
+										{
+											-- k;
+											FreeMemory (* (populations_pp + k));
+										}
+
+									if (entries_p)
+										{
+											FreeMemory (entries_p);
+										}
+								}
+
+							if (populations_pp)
+								{
+									FreeMemory (populations_pp);
+								}
+
+						}		/* if (success_flag && (num_new > 0)) */
+
+					if (success_flag)
+						{
+							/*
+							 * Now record the population against the names that were already
+							 * in the index. Their positions may have changed during the merge
+							 * so look them up again.
+							 */
+							for (j = 0; j < num_names; ++ j)
+								{
+									const char *marker_s = * (names_p -> mn_names_ss + j);
+
+									if (marker_s)
+										{
+											const size_t k = FindMarkerIndexEntry (index_p, marker_s, strlen (marker_s) + 1);
+
+											if (k < index_p -> mi_num_entries)
+												{
+													MarkerIndexEntry *entry_p = index_p -> mi_entries_p + k;
+													uint32 l = 0;
+
+													while ((l < entry_p -> mie_num_populations) && (* (entry_p -> mie_populations_p + l) != population_index))
+														{
+															++ l;
+														}
+
+													if (l == entry_p -> mie_num_populations)
+														{
+															* (entry_p -> mie_populations_p + l) = population_index;
+															++ (entry_p -> mie_num_populations);
+														}
+												}
+										}
+								}
+						}
+
+					FreeMemory (matches_p);
+				}		/* if (matches_p) */
+
+		}		/* if (population_index < index_p -> mi_num_populations) */
+
+	return success_flag;
+}
+
+
+static uint32 GetPopulationIndex (MarkerIndex *index_p, const bson_oid_t *id_p, const char *name_s)
+{
+	uint32 i;
+	MarkerIndexPopulation *populations_p;
+
+	for (i = 0; i < index_p -> mi_num_populations; ++ i)
+		{
+			if (bson_oid_equal (& (index_p -> mi_populations_p [i].mip_id), id_p))
+				{
+					return i;
+				}
+		}
+
+	populations_p = (MarkerIndexPopulation *) ReallocMemory (index_p -> mi_populations_p, (index_p -> mi_num_populations + 1) * sizeof (MarkerIndexPopulation), index_p -> mi_num_populations * sizeof (MarkerIndexPopulation));
+
+	if (populations_p)
+		{
+			MarkerIndexPopulation *population_p = populations_p + index_p -> mi_num_populations;
+
+			index_p -> mi_populations_p = populations_p;
+
+			if ((population_p -> mip_name_s = EasyCopyToNewString (name_s)) != NULL)
+				{
+					bson_oid_copy (id_p, & (population_p -> mip_id));
+					return (index_p -> mi_num_populations) ++;
+				}
+		}
+
+	/* An out of range value signals an error */
+	return UINT32_MAX;
+}
+
+
+static bool AddMarkerName (MarkerNames *names_p, const char *escaped_marker_s)
+{
+	char *marker_s = NULL;
+
+	if (strstr (escaped_marker_s, PGS_ESCAPED_DOT_S))
+		{
+			if (!SearchAndReplaceInString (escaped_marker_s, &marker_s, PGS_ESCAPED_DOT_S, "."))
+				{
+					return false;
+				}
+		}
+	else
+		{
+			marker_s = EasyCopyToNewString (escaped_marker_s);
+		}
+
+	if (marker_s)
+		{
+			if (names_p -> mn_num_names == names_p -> mn_capacity)
+				{
+					const size_t new_capacity = (names_p -> mn_capacity > 0) ? (names_p -> mn_capacity) << 1 : 1024;
+					char **names_ss = (char **) ReallocMemory (names_p -> mn_names_ss, new_capacity * sizeof (char *), names_p -> mn_capacity * sizeof (char *));
+
+					if (names_ss)
+						{
+							names_p -> mn_names_ss = names_ss;
+							names_p -> mn_capacity = new_capacity;
+						}
+					else
+						{
+							FreeCopiedString (marker_s);
+							return false;
+						}
+				}
+
+			* (names_p -> mn_names_ss + names_p -> mn_num_names) = marker_s;
+			++ (names_p -> mn_num_names);
+
+			return true;
+		}
+
+	return false;
+}
+
+
+static void ClearMarkerNames (MarkerNames *names_p)
+{
+	if (names_p -> mn_names_ss)
+		{
+			size_t i;
+
+			for (i = 0; i < names_p -> mn_num_names; ++ i)
+				{
+					char *name_s = * (names_p -> mn_names_ss + i);
+
+					if (name_s)
+						{
+							FreeCopiedString (name_s);
+						}
+				}
+
+			FreeMemory (names_p -> mn_names_ss);
+		}
+
+	names_p -> mn_names_ss = NULL;
+	names_p -> mn_num_names = 0;
+	names_p -> mn_capacity = 0;
+}
+
+
+/*
+ * Get the index of the first entry whose first marker_length characters
+ * are not less than those of marker_s. Using a length that includes the
+ * terminating '\0' gives an exact match.
+ */
+static size_t FindMarkerIndexEntry (const MarkerIndex *index_p, const char *marker_s, const size_t marker_length)
+{
+	size_t lo = 0;
+	size_t hi = index_p -> mi_num_entries;
+
+	while (lo < hi)
+		{
+			const size_t mid = lo + ((hi - lo) >> 1);
+
+			if (strncmp (index_p -> mi_entries_p [mid].mie_marker_s, marker_s, marker_length) < 0)
+				{
+					lo = mid + 1;
+				}
+			else
+				{
+					hi = mid;
+				}
+		}
+
+	return lo;
+}
+
+
+static json_t *GetMarkerIndexEntryAsJSON (const MarkerIndex *index_p, const MarkerIndexEntry *entry_p)
+{
+	json_t *entry_json_p = json_object ();
+
+	if (entry_json_p)
+		{
+			if (SetJSONString (entry_json_p, "marker", entry_p -> mie_marker_s))
+				{
+					json_t *populations_p = json_array ();
+
+					if (populations_p)
+						{
+							if (json_object_set_new (entry_json_p, "populations", populations_p) == 0)
+								{
+									uint32 i = 0;
+									bool success_flag = true;
+
+									while ((i < entry_p -> mie_num_populations) && success_flag)
+										{
+											const MarkerIndexPopulation *population_p = index_p -> mi_populations_p + (* (entry_p -> mie_populations_p + i));
+
+											if (json_array_append_new (populations_p, json_string (population_p -> mip_name_s)) == 0)
+												{
+													++ i;
+												}
+											else
+												{
+													success_flag = false;
+												}
+										}
+
+									if (success_flag)
+										{
+											return entry_json_p;
+										}
+								}
+							else
+								{
+									json_decref (populations_p);
+								}
+						}
+				}
+
+			json_decref (entry_json_p);
+		}
+
+	return NULL;
+}
+
+
+static void ClearMarkerIndex (MarkerIndex *index_p)
+{
+	if (index_p -> mi_entries_p)
+		{
+			size_t i;
+
+			for (i = 0; i < index_p -> mi_num_entries; ++ i)
+				{
+					MarkerIndexEntry *entry_p = index_p -> mi_entries_p + i;
+
+					FreeCopiedString (entry_p -> mie_marker_s);
+
+					if (entry_p -> mie_populations_p)
+						{
+							FreeMemory (entry_p -> mie_populations_p);
+						}
+				}
+
+			FreeMemory (index_p -> mi_entries_p);
+			index_p -> mi_entries_p = NULL;
+		}
+
+	if (index_p -> mi_populations_p)
+		{
+			uint32 i;
+
+			for (i = 0; i < index_p -> mi_num_populations; ++ i)
+				{
+					FreeCopiedString (index_p -> mi_populations_p [i].mip_name_s);
+				}
+
+			FreeMemory (index_p -> mi_populations_p);
+			index_p -> mi_populations_p = NULL;
+		}
+
+	index_p -> mi_num_entries = 0;
+	index_p -> mi_num_populations = 0;
+	index_p -> mi_loaded_flag = false;
+}
+
+
+static int CompareStrings (const void *v0_p, const void *v1_p)
+{
+	const char *s0 = * ((const char * const *) v0_p);
+	const char *s1 = * ((const char * const *) v1_p);
+
+	return strcmp (s0, s1);
+}
@@ -0,0 +1,407 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * marker_stats.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "marker_stats.h"
+#include "parent_genotypes.h"
+#include "parental_genotype_service.h"
+#include "job_arena.h"
+
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+static const char * const S_NUM_PARENT_A_S = "num_parent_a";
+
+static const char * const S_NUM_PARENT_B_S = "num_parent_b";
+
+static const char * const S_NUM_HETEROZYGOUS_S = "num_heterozygous";
+
+static const char * const S_NUM_MISSING_S = "num_missing";
+
+static const char * const S_HETEROZYGOSITY_S = "heterozygosity";
+
+static const char * const S_MISSING_RATE_S = "missing_rate";
+
+static const char * const S_CHI_SQUARE_S = "chi_square";
+
+static const char * const S_P_VALUE_S = "p_value";
+
+
+/**
+ * A marker's calls packed into a bitset for each GenotypeClass, with a
+ * bit for each progeny, so that the classes can be counted with popcount.
+ * The buffer is reused for every marker in the population.
+ */
+typedef struct GenotypeBitsets
+{
+	/** The bitsets for each class, one after another. */
+	uint64 *gb_bits_p;
+
+	/** The number of 64-bit words in each class's bitset. */
+	size_t gb_num_words;
+
+	/** The number of 64-bit words that gb_bits_p has room for. */
+	size_t gb_capacity;
+} GenotypeBitsets;
+
+
+static bool AddMarkerStats (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *escaped_marker_s, const json_t *marker_p, const json_t *parents_p, GenotypeBitsets *bitsets_p, JobArena *arena_p);
+
+static bool PackGenotypeClasses (const json_t *marker_p, const char *parent_a_s, const char *parent_b_s, GenotypeBitsets *bitsets_p);
+
+static void CountGenotypeClasses (const GenotypeBitsets *bitsets_p, uint32 counts [GC_NUM_CLASSES]);
+
+static bool AddFilterBound (bson_t *query_p, const char *key_s, const char *op_s, const double64 *value_p);
+
+
+
+bool SaveMarkerStats (const bson_oid_t *id_p, const char *population_s, const json_t *population_p, const json_t *parents_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_marker_stats_collection_s))
+		{
+			bson_t *opts_p = BCON_NEW ("ordered", BCON_BOOL (false));
+
+			if (opts_p)
+				{
+					mongoc_bulk_operation_t *bulk_p = mongoc_collection_create_bulk_operation_with_opts (data_p -> pgsd_mongo_p -> mt_collection_p, opts_p);
+
+					if (bulk_p)
+						{
+							const char *marker_s;
+							json_t *marker_p;
+							uint32 num_markers = 0;
+							GenotypeBitsets bitsets;
+							JobArena arena;
+
+							memset (&bitsets, 0, sizeof (GenotypeBitsets));
+							InitJobArena (&arena);
+							success_flag = true;
+
+							json_object_foreach ((json_t *) population_p, marker_s, marker_p)
+								{
+									if (success_flag && IsMarkerEntry (marker_s, marker_p))
+										{
+											success_flag = AddMarkerStats (bulk_p, id_p, population_s, marker_s, marker_p, parents_p, &bitsets, &arena);
+											ResetJobArena (&arena);
+											++ num_markers;
+										}
+								}
+
+							ClearJobArena (&arena);
+
+							if (bitsets.gb_bits_p)
+								{
+									FreeMemory (bitsets.gb_bits_p);
+								}
+
+							if (success_flag && (num_markers > 0))
+								{
+									bson_t reply;
+									bson_error_t error;
+
+									if (mongoc_bulk_operation_execute (bulk_p, &reply, &error) == 0)
+										{
+											PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, &reply, "Failed to save marker statistics for \"%s\" to \"%s\": %s", population_s, data_p -> pgsd_marker_stats_collection_s, error.message);
+											success_flag = false;
+										}
+
+									bson_destroy (&reply);
+								}
+
+							mongoc_bulk_operation_destroy (bulk_p);
+						}		/* if (bulk_p) */
+
+					bson_destroy (opts_p);
+				}		/* if (opts_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_marker_stats_collection_s)) */
+
+	return success_flag;
+}
+
+
+json_t *GetMarkerStats (const MarkerStatsFilter *filter_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_marker_stats_collection_s))
+		{
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					if (((IsStringEmpty (filter_p -> msf_population_s)) || (BSON_APPEND_UTF8 (query_p, PGS_POPULATION_S, filter_p -> msf_population_s))) &&
+							((IsStringEmpty (filter_p -> msf_chromosome_s)) || (BSON_APPEND_UTF8 (query_p, PGS_CHROMOSOME_S, filter_p -> msf_chromosome_s))) &&
+							(AddFilterBound (query_p, S_MISSING_RATE_S, "$lte", filter_p -> msf_max_missing_rate_p)) &&
+							(AddFilterBound (query_p, S_HETEROZYGOSITY_S, "$lte", filter_p -> msf_max_heterozygosity_p)) &&
+							(AddFilterBound (query_p, S_P_VALUE_S, "$gte", filter_p -> msf_min_p_value_p)))
+						{
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+							if (!opts_p)
+								{
+									opts_p = bson_new ();
+								}
+
+							if (opts_p)
+								{
+									bson_t *sort_p = BCON_NEW (PGS_POPULATION_S, BCON_INT32 (1), PGS_CHROMOSOME_S, BCON_INT32 (1), PGS_MARKER_S, BCON_INT32 (1));
+
+									if (sort_p)
+										{
+											bson_t *projection_p = BCON_NEW (MONGO_ID_S, BCON_BOOL (false), PGS_POPULATION_ID_S, BCON_BOOL (false));
+
+											if (projection_p)
+												{
+													if ((BSON_APPEND_DOCUMENT (opts_p, "sort", sort_p)) && (BSON_APPEND_DOCUMENT (opts_p, "projection", projection_p)))
+														{
+															results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+														}
+
+													bson_destroy (projection_p);
+												}
+
+											bson_destroy (sort_p);
+										}
+
+									bson_destroy (opts_p);
+								}		/* if (opts_p) */
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_marker_stats_collection_s)) */
+
+	return results_p;
+}
+
+
+static bool AddMarkerStats (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *escaped_marker_s, const json_t *marker_p, const json_t *parents_p, GenotypeBitsets *bitsets_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+
+	const char *marker_s = SearchAndReplaceInStringInJobArena (arena_p, escaped_marker_s, PGS_ESCAPED_DOT_S, ".");
+
+	if (marker_s)
+		{
+			uint32 counts [GC_NUM_CLASSES] = { 0 };
+			const json_t *parent_genotypes_p = json_object_get (parents_p, escaped_marker_s);
+			const char *parent_a_s = json_string_value (json_array_get (parent_genotypes_p, 0));
+			const char *parent_b_s = json_string_value (json_array_get (parent_genotypes_p, 1));
+			const char *chromosome_s = GetJSONString (marker_p, PGS_CHROMOSOME_S);
+			const char *position_s = GetJSONString (marker_p, PGS_MAPPING_POSITION_S);
+			uint32 num_calls;
+			uint32 num_homozygous;
+			double64 heterozygosity = 0.0;
+			double64 missing_rate = 0.0;
+			double64 chi_square = 0.0;
+			double64 p_value = 1.0;
+			bson_t *selector_p;
+
+			ResolveParentGenotypes (&parent_a_s, &parent_b_s);
+
+			if (PackGenotypeClasses (marker_p, parent_a_s, parent_b_s, bitsets_p))
+				{
+					CountGenotypeClasses (bitsets_p, counts);
+
+					num_homozygous = counts [GC_PARENT_A] + counts [GC_PARENT_B];
+					num_calls = num_homozygous + counts [GC_HETEROZYGOUS];
+
+					if (num_calls + counts [GC_MISSING] > 0)
+						{
+							missing_rate = (double64) counts [GC_MISSING] / (double64) (num_calls + counts [GC_MISSING]);
+						}
+
+					if (num_calls > 0)
+						{
+							heterozygosity = (double64) counts [GC_HETEROZYGOUS] / (double64) num_calls;
+						}
+
+					/*
+					 * Without distortion the two parental classes are expected
+					 * 1:1, so this is a chi-square test with one degree of freedom
+					 */
+					if (num_homozygous > 0)
+						{
+							const double64 diff = (double64) counts [GC_PARENT_A] - (double64) counts [GC_PARENT_B];
+
+							chi_square = (diff * diff) / (double64) num_homozygous;
+							p_value = erfc (sqrt (chi_square / 2.0));
+						}
+
+					selector_p = BCON_NEW (PGS_POPULATION_ID_S, BCON_OID (id_p), PGS_MARKER_S, BCON_UTF8 (marker_s));
+
+					if (selector_p)
+						{
+							bson_t *stats_p = BCON_NEW (PGS_POPULATION_ID_S, BCON_OID (id_p),
+																					PGS_POPULATION_S, BCON_UTF8 (population_s),
+																					PGS_MARKER_S, BCON_UTF8 (marker_s),
+																					PGS_CHROMOSOME_S, BCON_UTF8 (chromosome_s ? chromosome_s : ""),
+																					PGS_MAPPING_POSITION_S, BCON_UTF8 (position_s ? position_s : ""),
+																					S_NUM_PARENT_A_S, BCON_INT32 ((int32) counts [GC_PARENT_A]),
+																					S_NUM_PARENT_B_S, BCON_INT32 ((int32) counts [GC_PARENT_B]),
+																					S_NUM_HETEROZYGOUS_S, BCON_INT32 ((int32) counts [GC_HETEROZYGOUS]),
+																					S_NUM_MISSING_S, BCON_INT32 ((int32) counts [GC_MISSING]),
+																					S_HETEROZYGOSITY_S, BCON_DOUBLE (heterozygosity),
+																					S_MISSING_RATE_S, BCON_DOUBLE (missing_rate),
+																					S_CHI_SQUARE_S, BCON_DOUBLE (chi_square),
+																					S_P_VALUE_S, BCON_DOUBLE (p_value));
+
+							if (stats_p)
+								{
+									bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+									if (opts_p)
+										{
+											bson_error_t error;
+
+											if (mongoc_bulk_operation_replace_one_with_opts (bulk_p, selector_p, stats_p, opts_p, &error))
+												{
+													success_flag = true;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add statistics for \"%s\" in \"%s\": %s", marker_s, population_s, error.message);
+												}
+
+											bson_destroy (opts_p);
+										}
+
+									bson_destroy (stats_p);
+								}
+
+							bson_destroy (selector_p);
+						}		/* if (selector_p) */
+
+				}		/* if (PackGenotypeClasses (marker_p, parent_a_s, parent_b_s, bitsets_p)) */
+
+		}		/* if (marker_s) */
+
+	return success_flag;
+}
+
+
+/*
+ * Set each progeny's bit in the bitset for the class of its call. The
+ * class is used directly as the index of the bitset so there is no
+ * branching on the result.
+ */
+static bool PackGenotypeClasses (const json_t *marker_p, const char *parent_a_s, const char *parent_b_s, GenotypeBitsets *bitsets_p)
+{
+	const size_t num_words = (json_object_size (marker_p) + 63) / 64;
+	const char *key_s;
+	json_t *value_p;
+	size_t index = 0;
+
+	if (num_words * GC_NUM_CLASSES > bitsets_p -> gb_capacity)
+		{
+			const size_t capacity = num_words * GC_NUM_CLASSES;
+			uint64 *bits_p = (uint64 *) AllocMemoryArray (capacity, sizeof (uint64));
+
+			if (!bits_p)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " words for the genotype bitsets", capacity);
+					return false;
+				}
+
+			if (bitsets_p -> gb_bits_p)
+				{
+					FreeMemory (bitsets_p -> gb_bits_p);
+				}
+
+			bitsets_p -> gb_bits_p = bits_p;
+			bitsets_p -> gb_capacity = capacity;
+		}
+
+	bitsets_p -> gb_num_words = num_words;
+	memset (bitsets_p -> gb_bits_p, 0, num_words * GC_NUM_CLASSES * sizeof (uint64));
+
+	json_object_foreach ((json_t *) marker_p, key_s, value_p)
+		{
+			if (json_is_string (value_p) && (!IsMarkerMetadataKey (key_s)))
+				{
+					const GenotypeClass gc = GetGenotypeClass (json_string_value (value_p), parent_a_s, parent_b_s);
+
+					bitsets_p -> gb_bits_p [(gc * num_words) + (index >> 6)] |= 1ULL << (index & 63);
+					++ index;
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * This is the hot loop, run over every word of every marker's bitsets.
+ * All of the classes are counted in the same pass over the words.
+ */
+static void CountGenotypeClasses (const GenotypeBitsets *bitsets_p, uint32 counts [GC_NUM_CLASSES])
+{
+	const size_t num_words = bitsets_p -> gb_num_words;
+	const uint64 *parent_a_p = bitsets_p -> gb_bits_p;
+	const uint64 *parent_b_p = parent_a_p + num_words;
+	const uint64 *heterozygous_p = parent_b_p + num_words;
+	const uint64 *missing_p = heterozygous_p + num_words;
+	size_t i;
+
+	for (i = 0; i < num_words; ++ i)
+		{
+			counts [GC_PARENT_A] += (uint32) __builtin_popcountll (parent_a_p [i]);
+			counts [GC_PARENT_B] += (uint32) __builtin_popcountll (parent_b_p [i]);
+			counts [GC_HETEROZYGOUS] += (uint32) __builtin_popcountll (heterozygous_p [i]);
+			counts [GC_MISSING] += (uint32) __builtin_popcountll (missing_p [i]);
+		}
+}
+
+
+static bool AddFilterBound (bson_t *query_p, const char *key_s, const char *op_s, const double64 *value_p)
+{
+	bool success_flag = true;
+
+	if (value_p)
+		{
+			bson_t bound;
+
+			success_flag = false;
+
+			if (BSON_APPEND_DOCUMENT_BEGIN (query_p, key_s, &bound))
+				{
+					if (BSON_APPEND_DOUBLE (&bound, op_s, *value_p))
+						{
+							success_flag = true;
+						}
+
+					if (!bson_append_document_end (query_p, &bound))
+						{
+							success_flag = false;
+						}
+				}
+		}
+
+	return success_flag;
+}
@@ -0,0 +1,1235 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * matrix_export.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+/*
+ * For fopencookie () and memrchr ()
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matrix_export.h"
+#include "arrow_export.h"
+#include "compact_format.h"
+#include "parental_genotype_service.h"
+#include "parent_genotypes.h"
+#include "bson_extract.h"
+#include "job_arena.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+/*
+ * A marker in a population document, which is read straight from the BSON.
+ */
+typedef struct ExportMarker
+{
+	/** The escaped name of the marker, which points into the population document. */
+	const char *em_name_s;
+
+	/** The chromosome, which is empty if the marker doesn't have one. */
+	const char *em_chromosome_s;
+
+	const char *em_position_s;
+
+	/**
+	 * The mapping position used for sorting. This is HUGE_VAL if the
+	 * marker doesn't have a numeric position.
+	 */
+	double64 em_position;
+
+	/** An iterator that is on the marker's document. */
+	bson_iter_t em_iter;
+} ExportMarker;
+
+
+/*
+ * The state passed to WritePopulationMatrix () for each population.
+ */
+typedef struct MatrixExport
+{
+	/** The escaped names of the markers to export, or NULL for all of them. */
+	const char **me_markers_ss;
+
+	uint32 me_num_markers;
+
+	const char *me_chromosome_s;
+
+	const double64 *me_start_p;
+
+	const double64 *me_end_p;
+
+	ExportFormat me_format;
+
+	/** The parents' genotypes by marker for EF_ABH, which is NULL otherwise. */
+	const json_t *me_parents_p;
+
+	ParentalGenotypeServiceData *me_data_p;
+
+	SearchDeadline *me_deadline_p;
+
+	/** The arena for the unescaped marker names, which is reset after each row. */
+	JobArena me_arena;
+
+	/** The spool that each part of the matrices is written to. */
+	ResultSpool *me_spool_p;
+
+	/** The population that is being written. */
+	const char *me_population_s;
+
+	/** The part of the population's matrix that hasn't been spooled yet. */
+	char *me_part_s;
+
+	size_t me_part_length;
+
+	/** The number of parts of the population's matrix that have been spooled. */
+	uint32 me_num_parts;
+
+	/** A summary of each exported population. */
+	json_t *me_results_p;
+
+	bool me_success_flag;
+} MatrixExport;
+
+
+static const char * const S_MARKER_SEPARATORS_S = ", \t\r\n";
+
+static const char * const S_DATA_S = "data";
+
+static const char * const S_ENCODING_S = "encoding";
+
+static const char * const S_NUM_MARKERS_S = "num_markers";
+
+static const char * const S_NUM_PROGENY_S = "num_progeny";
+
+static const char * const S_PART_S = "part";
+
+static const char * const S_NUM_PARTS_S = "num_parts";
+
+
+/*
+ * The size of each part of a matrix that is spooled. This is a
+ * multiple of 3 so that the base64-encoded parts of an Arrow file
+ * don't need any padding and can be joined back together as they are.
+ */
+static const size_t S_EXPORT_PART_SIZE = 3 * 16384;
+
+
+/*
+ * How many rows to write between checking the deadline.
+ */
+static const uint32 S_DEADLINE_CHECK_INTERVAL = 256;
+
+
+static const char **ParseMarkerNames (const char *markers_s, JobArena *arena_p, uint32 *num_markers_p);
+
+static bool IsRepeatedMarker (const MatrixExport *export_p, const uint32 index);
+
+static bson_t *GetExportQuery (const char *population_s, const MatrixExport *export_p);
+
+static bson_t *GetExportQueryOptions (const MatrixExport *export_p, const bool ids_only_flag);
+
+static bool ExportPopulation (const json_t *population_p, MatrixExport *export_p);
+
+static bool WritePopulationMatrix (const bson_t *doc_p, void *data_p);
+
+static ExportMarker *GetExportMarkers (const bson_t *doc_p, const MatrixExport *export_p, uint32 *num_markers_p);
+
+static bool IsPositionInInterval (const MatrixExport *export_p, const double64 position);
+
+static int CompareExportMarkers (const void *v0_p, const void *v1_p);
+
+static json_t *GetBSONAccessionIndexes (const ExportMarker *markers_p, const uint32 num_markers);
+
+static json_t *GetBSONCallIndexes (const ExportMarker *markers_p, const uint32 num_markers);
+
+static bool WriteMatrix (FILE *out_f, MatrixExport *export_p, const ExportMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const char **accessions_ss, const char **row_ss, const uint32 num_progeny);
+
+static bool WriteArrowMatrix (FILE *out_f, MatrixExport *export_p, const ExportMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const char **accessions_ss, const char **row_ss, const uint32 num_progeny);
+
+static void FillMatrixRow (const ExportMarker *marker_p, const json_t *accession_indexes_p, const char **row_ss, const uint32 num_progeny);
+
+static void WriteField (FILE *out_f, const char *value_s, const char delimiter, const bool first_flag);
+
+static const char *GetABHCode (const GenotypeClass gc);
+
+static ssize_t WriteExportPart (void *cookie_p, const char *buffer_s, size_t size);
+
+static bool SpoolExportPart (MatrixExport *export_p, const bool last_flag);
+
+static size_t GetExportPartLength (const MatrixExport *export_p, const bool last_flag);
+
+static bool AddExportResult (MatrixExport *export_p, const char *population_s, const uint32 num_markers, const uint32 num_progeny);
+
+
+
+json_t *ExportPopulationMatrices (const char *population_s, const char *markers_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, const ExportFormat format, ResultSpool *spool_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+	MatrixExport export_data;
+
+	memset (&export_data, 0, sizeof (MatrixExport));
+	InitJobArena (& (export_data.me_arena));
+
+	export_data.me_chromosome_s = IsStringEmpty (chromosome_s) ? NULL : chromosome_s;
+	export_data.me_start_p = start_p;
+	export_data.me_end_p = end_p;
+	export_data.me_format = format;
+	export_data.me_data_p = data_p;
+	export_data.me_deadline_p = deadline_p;
+	export_data.me_spool_p = spool_p;
+
+	if ((export_data.me_part_s = (char *) AllocMemory (S_EXPORT_PART_SIZE)) == NULL)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " bytes for the export", S_EXPORT_PART_SIZE);
+		}
+	else if ((IsStringEmpty (markers_s)) || ((export_data.me_markers_ss = ParseMarkerNames (markers_s, & (export_data.me_arena), & (export_data.me_num_markers))) != NULL))
+		{
+			if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+				{
+					bson_t *query_p = GetExportQuery (population_s, &export_data);
+
+					if (query_p)
+						{
+							bson_t *opts_p = GetExportQueryOptions (&export_data, true);
+
+							if (opts_p)
+								{
+									/*
+									 * Just get the ids first since each population is then
+									 * streamed from a cursor of its own
+									 */
+									json_t *populations_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+									if (populations_p)
+										{
+											if ((export_data.me_results_p = json_array ()) != NULL)
+												{
+													const size_t num_populations = json_array_size (populations_p);
+													bool success_flag = true;
+													size_t i;
+
+													for (i = 0; (i < num_populations) && success_flag; ++ i)
+														{
+															if (HasSearchDeadlinePassed (deadline_p))
+																{
+																	success_flag = false;
+																}
+															else
+																{
+																	success_flag = ExportPopulation (json_array_get (populations_p, i), &export_data);
+																}
+														}
+
+													if (success_flag)
+														{
+															results_p = export_data.me_results_p;
+														}
+													else
+														{
+															json_decref (export_data.me_results_p);
+														}
+												}
+
+											json_decref (populations_p);
+										}		/* if (populations_p) */
+
+									bson_destroy (opts_p);
+								}		/* if (opts_p) */
+
+							bson_destroy (query_p);
+						}		/* if (query_p) */
+
+				}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse markers \"%s\"", markers_s);
+		}
+
+	if (export_data.me_part_s)
+		{
+			FreeMemory (export_data.me_part_s);
+		}
+
+	ClearJobArena (& (export_data.me_arena));
+
+	return results_p;
+}
+
+
+static const char **ParseMarkerNames (const char *markers_s, JobArena *arena_p, uint32 *num_markers_p)
+{
+	const size_t length = strlen (markers_s);
+	char *copy_s = (char *) AllocFromJobArena (arena_p, length + 1);
+
+	/*
+	 * There can't be more names than half of the characters
+	 */
+	const char **markers_ss = (const char **) AllocFromJobArena (arena_p, ((length / 2) + 1) * sizeof (const char *));
+
+	if (copy_s && markers_ss)
+		{
+			uint32 num_markers = 0;
+			char *save_s = NULL;
+			char *marker_s;
+
+			memcpy (copy_s, markers_s, length + 1);
+
+			for (marker_s = strtok_r (copy_s, S_MARKER_SEPARATORS_S, &save_s); marker_s; marker_s = strtok_r (NULL, S_MARKER_SEPARATORS_S, &save_s))
+				{
+					if ((markers_ss [num_markers] = SearchAndReplaceInStringInJobArena (arena_p, marker_s, ".", PGS_ESCAPED_DOT_S)) != NULL)
+						{
+							++ num_markers;
+						}
+					else
+						{
+							return NULL;
+						}
+				}
+
+			if (num_markers > 0)
+				{
+					*num_markers_p = num_markers;
+					return markers_ss;
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * A marker can be given more than once, but MongoDB rejects
+ * repeated fields in projections.
+ */
+static bool IsRepeatedMarker (const MatrixExport *export_p, const uint32 index)
+{
+	uint32 i;
+
+	for (i = 0; i < index; ++ i)
+		{
+			if (strcmp (export_p -> me_markers_ss [i], export_p -> me_markers_ss [index]) == 0)
+				{
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static bson_t *GetExportQuery (const char *population_s, const MatrixExport *export_p)
+{
+	bson_t *query_p = IsStringEmpty (population_s) ? bson_new () : BCON_NEW (PGS_POPULATION_NAME_S, BCON_UTF8 (population_s));
+
+	if (query_p)
+		{
+			bool success_flag = true;
+
+			if (export_p -> me_num_markers > 0)
+				{
+					bson_t markers;
+
+					success_flag = false;
+
+					/*
+					 * Any population with at least one of the markers
+					 */
+					if (BSON_APPEND_ARRAY_BEGIN (query_p, "$or", &markers))
+						{
+							uint32 i;
+
+							success_flag = true;
+
+							for (i = 0; (i < export_p -> me_num_markers) && success_flag; ++ i)
+								{
+									bson_t *clause_p = BCON_NEW (export_p -> me_markers_ss [i], "{", "$exists", BCON_BOOL (true), "}");
+
+									success_flag = false;
+
+									if (clause_p)
+										{
+											char key_s [16];
+
+											sprintf (key_s, UINT32_FMT, i);
+											success_flag = BSON_APPEND_DOCUMENT (&markers, key_s, clause_p);
+
+											bson_destroy (clause_p);
+										}
+								}
+
+							if (!bson_append_array_end (query_p, &markers))
+								{
+									success_flag = false;
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					return query_p;
+				}
+
+			bson_destroy (query_p);
+		}		/* if (query_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create export query");
+
+	return NULL;
+}
+
+
+static bson_t *GetExportQueryOptions (const MatrixExport *export_p, const bool ids_only_flag)
+{
+	bson_t *opts_p = GetSearchDeadlineQueryOptions (export_p -> me_deadline_p);
+
+	if (!opts_p)
+		{
+			opts_p = bson_new ();
+		}
+
+	if (opts_p)
+		{
+			bool success_flag = true;
+
+			if ((ids_only_flag) || (export_p -> me_num_markers > 0))
+				{
+					bson_t projection;
+
+					success_flag = false;
+
+					if (BSON_APPEND_DOCUMENT_BEGIN (opts_p, "projection", &projection))
+						{
+							uint32 i;
+
+							success_flag = BSON_APPEND_INT32 (&projection, PGS_POPULATION_NAME_S, 1);
+
+							for (i = 0; (i < export_p -> me_num_markers) && success_flag && (!ids_only_flag); ++ i)
+								{
+									if (!IsRepeatedMarker (export_p, i))
+										{
+											success_flag = BSON_APPEND_INT32 (&projection, export_p -> me_markers_ss [i], 1);
+										}
+								}
+
+							if (!bson_append_document_end (opts_p, &projection))
+								{
+									success_flag = false;
+								}
+						}
+				}
+
+			if (success_flag && ids_only_flag)
+				{
+					bson_t *sort_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_INT32 (1));
+
+					success_flag = false;
+
+					if (sort_p)
+						{
+							success_flag = BSON_APPEND_DOCUMENT (opts_p, "sort", sort_p);
+							bson_destroy (sort_p);
+						}
+				}
+
+			if (success_flag)
+				{
+					return opts_p;
+				}
+
+			bson_destroy (opts_p);
+		}		/* if (opts_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create export query options");
+
+	return NULL;
+}
+
+
+static bool ExportPopulation (const json_t *population_p, MatrixExport *export_p)
+{
+	bool success_flag = false;
+	const char *population_s = GetJSONString (population_p, PGS_POPULATION_NAME_S);
+	ParentalGenotypeServiceData *data_p = export_p -> me_data_p;
+	json_t *parents_p = NULL;
+	bson_oid_t id;
+
+	if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), &id))
+		{
+			/*
+			 * Get the parents before opening the population's cursor
+			 * since they use the same connection
+			 */
+			if ((export_p -> me_format != EF_ABH) || ((parents_p = GetParentGenotypesByMarker (&id, data_p)) != NULL))
+				{
+					if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+						{
+							bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (&id));
+
+							if (query_p)
+								{
+									bson_t *opts_p = GetExportQueryOptions (export_p, false);
+
+									if (opts_p)
+										{
+											export_p -> me_parents_p = parents_p;
+											export_p -> me_success_flag = false;
+
+											if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p))
+												{
+													if (IterateOverMongoResults (data_p -> pgsd_mongo_p, WritePopulationMatrix, export_p) >= 0)
+														{
+															success_flag = export_p -> me_success_flag;
+														}
+												}
+
+											export_p -> me_parents_p = NULL;
+
+											bson_destroy (opts_p);
+										}
+
+									bson_destroy (query_p);
+								}		/* if (query_p) */
+
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get parent genotypes for \"%s\"", population_s);
+				}
+
+			if (parents_p)
+				{
+					json_decref (parents_p);
+				}
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to export \"%s\"", population_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Only the markers' positions are held in memory, the genotypes are
+ * written out one row at a time straight from the BSON. The matrix
+ * is written through a stream that spools each part of it as soon as
+ * it is full, so no more than one part of it is held in memory and
+ * nothing is left on the server once it has been collected.
+ */
+static bool WritePopulationMatrix (const bson_t *doc_p, void *data_p)
+{
+	MatrixExport *export_p = (MatrixExport *) data_p;
+	const char *population_s = GetBSONString (doc_p, PGS_POPULATION_NAME_S);
+	uint32 num_markers = 0;
+	ExportMarker *markers_p = GetExportMarkers (doc_p, export_p, &num_markers);
+	bool success_flag = false;
+
+	if (markers_p)
+		{
+			json_t *accession_indexes_p = GetBSONAccessionIndexes (markers_p, num_markers);
+
+			if (accession_indexes_p)
+				{
+					const uint32 num_progeny = (uint32) json_object_size (accession_indexes_p);
+					const char **accessions_ss = (const char **) AllocMemoryArray (num_progeny + 1, sizeof (const char *));
+
+					if (accessions_ss)
+						{
+							const char **row_ss = (const char **) AllocMemoryArray (num_progeny + 1, sizeof (const char *));
+
+							if (row_ss)
+								{
+									cookie_io_functions_t functions = { NULL, WriteExportPart, NULL, NULL };
+									FILE *out_f;
+
+									export_p -> me_population_s = population_s ? population_s : "";
+									export_p -> me_part_length = 0;
+									export_p -> me_num_parts = 0;
+
+									if ((out_f = fopencookie (export_p, "w", functions)) != NULL)
+										{
+											const char *accession_s;
+											json_t *index_p;
+
+											json_object_foreach (accession_indexes_p, accession_s, index_p)
+												{
+													accessions_ss [json_integer_value (index_p)] = accession_s;
+												}
+
+											if (export_p -> me_format == EF_ARROW)
+												{
+													success_flag = WriteArrowMatrix (out_f, export_p, markers_p, num_markers, accession_indexes_p, accessions_ss, row_ss, num_progeny);
+												}
+											else
+												{
+													success_flag = WriteMatrix (out_f, export_p, markers_p, num_markers, accession_indexes_p, accessions_ss, row_ss, num_progeny);
+												}
+
+											if (fclose (out_f) != 0)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to close the export of \"%s\"", export_p -> me_population_s);
+													success_flag = false;
+												}
+
+											if (success_flag)
+												{
+													/*
+													 * Spool whatever is left, unless the last part was full
+													 */
+													if ((export_p -> me_part_length > 0) || (export_p -> me_num_parts == 0))
+														{
+															success_flag = SpoolExportPart (export_p, true);
+														}
+
+													if (success_flag)
+														{
+															success_flag = AddExportResult (export_p, export_p -> me_population_s, num_markers, num_progeny);
+														}
+												}
+
+										}		/* if (out_f) */
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open the export of \"%s\"", export_p -> me_population_s);
+										}
+
+									export_p -> me_population_s = NULL;
+
+									FreeMemory (row_ss);
+								}		/* if (row_ss) */
+
+							FreeMemory (accessions_ss);
+						}		/* if (accessions_ss) */
+
+					json_decref (accession_indexes_p);
+				}		/* if (accession_indexes_p) */
+
+			FreeMemory (markers_p);
+		}		/* if (markers_p) */
+
+	export_p -> me_success_flag = success_flag;
+
+	return success_flag;
+}
+
+
+static ExportMarker *GetExportMarkers (const bson_t *doc_p, const MatrixExport *export_p, uint32 *num_markers_p)
+{
+	ExportMarker *markers_p = (ExportMarker *) AllocMemoryArray (bson_count_keys (doc_p) + 1, sizeof (ExportMarker));
+
+	if (markers_p)
+		{
+			uint32 num_markers = 0;
+			bson_iter_t iter;
+
+			if (bson_iter_init (&iter, doc_p))
+				{
+					while (bson_iter_next (&iter))
+						{
+							bson_iter_t child_iter;
+
+							if ((BSON_ITER_HOLDS_DOCUMENT (&iter)) && (bson_iter_recurse (&iter, &child_iter)))
+								{
+									ExportMarker *marker_p = markers_p + num_markers;
+
+									marker_p -> em_name_s = bson_iter_key (&iter);
+									marker_p -> em_chromosome_s = "";
+									marker_p -> em_position_s = NULL;
+									marker_p -> em_position = HUGE_VAL;
+									marker_p -> em_iter = iter;
+
+									while (bson_iter_next (&child_iter))
+										{
+											if (BSON_ITER_HOLDS_UTF8 (&child_iter))
+												{
+													const char *key_s = bson_iter_key (&child_iter);
+
+													if (strcmp (key_s, PGS_CHROMOSOME_S) == 0)
+														{
+															marker_p -> em_chromosome_s = bson_iter_utf8 (&child_iter, NULL);
+														}
+													else if (strcmp (key_s, PGS_MAPPING_POSITION_S) == 0)
+														{
+															marker_p -> em_position_s = bson_iter_utf8 (&child_iter, NULL);
+														}
+												}
+										}
+
+									if (marker_p -> em_position_s)
+										{
+											char *end_s = NULL;
+											const double64 position = strtod (marker_p -> em_position_s, &end_s);
+
+											if (end_s != marker_p -> em_position_s)
+												{
+													marker_p -> em_position = position;
+												}
+										}
+
+									if (((export_p -> me_chromosome_s == NULL) || (strcmp (marker_p -> em_chromosome_s, export_p -> me_chromosome_s) == 0)) &&
+											(IsPositionInInterval (export_p, marker_p -> em_position)))
+										{
+											++ num_markers;
+										}
+								}
+						}
+				}
+
+			qsort (markers_p, num_markers, sizeof (ExportMarker), CompareExportMarkers);
+
+			*num_markers_p = num_markers;
+		}		/* if (markers_p) */
+
+	return markers_p;
+}
+
+
+static bool IsPositionInInterval (const MatrixExport *export_p, const double64 position)
+{
+	if (export_p -> me_start_p || export_p -> me_end_p)
+		{
+			if ((isinf (position)) ||
+					((export_p -> me_start_p) && (position < * (export_p -> me_start_p))) ||
+					((export_p -> me_end_p) && (position > * (export_p -> me_end_p))))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * The same order as GetMarkersInMapOrder () except that the markers
+ * without a chromosome go at the end rather than being skipped.
+ */
+static int CompareExportMarkers (const void *v0_p, const void *v1_p)
+{
+	const ExportMarker *marker_0_p = (const ExportMarker *) v0_p;
+	const ExportMarker *marker_1_p = (const ExportMarker *) v1_p;
+	int res;
+
+	if (* (marker_0_p -> em_chromosome_s) == '\0')
+		{
+			res = (* (marker_1_p -> em_chromosome_s) == '\0') ? 0 : 1;
+		}
+	else if (* (marker_1_p -> em_chromosome_s) == '\0')
+		{
+			res = -1;
+		}
+	else
+		{
+			res = strcmp (marker_0_p -> em_chromosome_s, marker_1_p -> em_chromosome_s);
+		}
+
+	if (res == 0)
+		{
+			if (marker_0_p -> em_position < marker_1_p -> em_position)
+				{
+					res = -1;
+				}
+			else if (marker_0_p -> em_position > marker_1_p -> em_position)
+				{
+					res = 1;
+				}
+			else
+				{
+					res = strcmp (marker_0_p -> em_name_s, marker_1_p -> em_name_s);
+				}
+		}
+
+	return res;
+}
+
+
+static json_t *GetBSONAccessionIndexes (const ExportMarker *markers_p, const uint32 num_markers)
+{
+	json_t *accession_indexes_p = json_object ();
+
+	if (accession_indexes_p)
+		{
+			bool success_flag = true;
+			uint32 i;
+
+			for (i = 0; (i < num_markers) && success_flag; ++ i)
+				{
+					bson_iter_t child_iter;
+
+					if (bson_iter_recurse (& (markers_p [i].em_iter), &child_iter))
+						{
+							while (success_flag && (bson_iter_next (&child_iter)))
+								{
+									const char *accession_s = bson_iter_key (&child_iter);
+
+									if ((BSON_ITER_HOLDS_UTF8 (&child_iter)) && (!IsMarkerMetadataKey (accession_s)) && (!json_object_get (accession_indexes_p, accession_s)))
+										{
+											success_flag = (json_object_set_new (accession_indexes_p, accession_s, json_integer (json_object_size (accession_indexes_p))) == 0);
+										}
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					return accession_indexes_p;
+				}
+
+			json_decref (accession_indexes_p);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * The values of each progeny column in an Arrow file are indexes into
+ * a dictionary of all of the distinct calls in the population.
+ */
+static json_t *GetBSONCallIndexes (const ExportMarker *markers_p, const uint32 num_markers)
+{
+	json_t *call_indexes_p = json_object ();
+
+	if (call_indexes_p)
+		{
+			bool success_flag = true;
+			uint32 i;
+
+			for (i = 0; (i < num_markers) && success_flag; ++ i)
+				{
+					bson_iter_t child_iter;
+
+					if (bson_iter_recurse (& (markers_p [i].em_iter), &child_iter))
+						{
+							while (success_flag && (bson_iter_next (&child_iter)))
+								{
+									if ((BSON_ITER_HOLDS_UTF8 (&child_iter)) && (!IsMarkerMetadataKey (bson_iter_key (&child_iter))))
+										{
+											const char *call_s = bson_iter_utf8 (&child_iter, NULL);
+
+											if ((!IsMissingGenotype (call_s)) && (!json_object_get (call_indexes_p, call_s)))
+												{
+													success_flag = (json_object_set_new (call_indexes_p, call_s, json_integer (json_object_size (call_indexes_p))) == 0);
+												}
+										}
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					return call_indexes_p;
+				}
+
+			json_decref (call_indexes_p);
+		}
+
+	return NULL;
+}
+
+
+static bool WriteMatrix (FILE *out_f, MatrixExport *export_p, const ExportMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const char **accessions_ss, const char **row_ss, const uint32 num_progeny)
+{
+	const char delimiter = (export_p -> me_format == EF_TSV) ? '\t' : ',';
+	uint32 i;
+	uint32 j;
+
+	WriteField (out_f, "marker", delimiter, true);
+	WriteField (out_f, PGS_CHROMOSOME_S, delimiter, false);
+	WriteField (out_f, PGS_MAPPING_POSITION_S, delimiter, false);
+
+	for (j = 0; j < num_progeny; ++ j)
+		{
+			WriteField (out_f, accessions_ss [j], delimiter, false);
+		}
+
+	fputc ('\n', out_f);
+
+	for (i = 0; i < num_markers; ++ i)
+		{
+			const ExportMarker *marker_p = markers_p + i;
+			const char *marker_s;
+
+			if (((i % S_DEADLINE_CHECK_INTERVAL) == 0) && (HasSearchDeadlinePassed (export_p -> me_deadline_p)))
+				{
+					return false;
+				}
+
+			FillMatrixRow (marker_p, accession_indexes_p, row_ss, num_progeny);
+
+			if ((marker_s = SearchAndReplaceInStringInJobArena (& (export_p -> me_arena), marker_p -> em_name_s, PGS_ESCAPED_DOT_S, ".")) == NULL)
+				{
+					return false;
+				}
+
+			WriteField (out_f, marker_s, delimiter, true);
+			WriteField (out_f, marker_p -> em_chromosome_s, delimiter, false);
+			WriteField (out_f, marker_p -> em_position_s ? marker_p -> em_position_s : "", delimiter, false);
+
+			if (export_p -> me_format == EF_ABH)
+				{
+					const json_t *genotypes_p = json_object_get (export_p -> me_parents_p, marker_p -> em_name_s);
+					const char *parent_a_s = json_string_value (json_array_get (genotypes_p, 0));
+					const char *parent_b_s = json_string_value (json_array_get (genotypes_p, 1));
+
+					ResolveParentGenotypes (&parent_a_s, &parent_b_s);
+
+					for (j = 0; j < num_progeny; ++ j)
+						{
+							WriteField (out_f, GetABHCode (GetGenotypeClass (row_ss [j], parent_a_s, parent_b_s)), delimiter, false);
+						}
+				}
+			else
+				{
+					for (j = 0; j < num_progeny; ++ j)
+						{
+							WriteField (out_f, row_ss [j] ? row_ss [j] : "", delimiter, false);
+						}
+				}
+
+			fputc ('\n', out_f);
+
+			ResetJobArena (& (export_p -> me_arena));
+		}
+
+	/*
+	 * The writes are buffered so check for any errors once at the end
+	 */
+	if (ferror (out_f))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write the export");
+			return false;
+		}
+
+	return true;
+}
+
+
+/*
+ * The ArrowMatrixWriter buffers the rows into record batches so, like
+ * the text formats, only one marker's calls are gathered at a time.
+ */
+static bool WriteArrowMatrix (FILE *out_f, MatrixExport *export_p, const ExportMarker *markers_p, const uint32 num_markers, const json_t *accession_indexes_p, const char **accessions_ss, const char **row_ss, const uint32 num_progeny)
+{
+	bool success_flag = false;
+	json_t *call_indexes_p = GetBSONCallIndexes (markers_p, num_markers);
+
+	if (call_indexes_p)
+		{
+			ArrowMatrixWriter *writer_p = AllocateArrowMatrixWriter (out_f, accessions_ss, num_progeny, call_indexes_p);
+
+			if (writer_p)
+				{
+					uint32 i;
+
+					success_flag = true;
+
+					for (i = 0; (i < num_markers) && success_flag; ++ i)
+						{
+							const ExportMarker *marker_p = markers_p + i;
+							const char *marker_s;
+
+							if (((i % S_DEADLINE_CHECK_INTERVAL) == 0) && (HasSearchDeadlinePassed (export_p -> me_deadline_p)))
+								{
+									success_flag = false;
+								}
+							else if ((marker_s = SearchAndReplaceInStringInJobArena (& (export_p -> me_arena), marker_p -> em_name_s, PGS_ESCAPED_DOT_S, ".")) != NULL)
+								{
+									FillMatrixRow (marker_p, accession_indexes_p, row_ss, num_progeny);
+
+									success_flag = AddArrowMatrixRow (writer_p, marker_s, marker_p -> em_chromosome_s, marker_p -> em_position, row_ss);
+
+									ResetJobArena (& (export_p -> me_arena));
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = FinishArrowMatrix (writer_p);
+						}
+
+					FreeArrowMatrixWriter (writer_p);
+				}		/* if (writer_p) */
+
+			json_decref (call_indexes_p);
+		}		/* if (call_indexes_p) */
+
+	return success_flag;
+}
+
+
+static void FillMatrixRow (const ExportMarker *marker_p, const json_t *accession_indexes_p, const char **row_ss, const uint32 num_progeny)
+{
+	bson_iter_t child_iter;
+
+	memset (row_ss, 0, num_progeny * sizeof (const char *));
+
+	if (bson_iter_recurse (& (marker_p -> em_iter), &child_iter))
+		{
+			while (bson_iter_next (&child_iter))
+				{
+					if (BSON_ITER_HOLDS_UTF8 (&child_iter))
+						{
+							const json_t *index_p = json_object_get (accession_indexes_p, bson_iter_key (&child_iter));
+
+							if (index_p)
+								{
+									row_ss [json_integer_value (index_p)] = bson_iter_utf8 (&child_iter, NULL);
+								}
+						}
+				}
+		}
+}
+
+
+static void WriteField (FILE *out_f, const char *value_s, const char delimiter, const bool first_flag)
+{
+	if (!first_flag)
+		{
+			fputc (delimiter, out_f);
+		}
+
+	if ((strchr (value_s, delimiter)) || (strpbrk (value_s, "\"\r\n")))
+		{
+			const char *c_p;
+
+			fputc ('"', out_f);
+
+			for (c_p = value_s; *c_p != '\0'; ++ c_p)
+				{
+					if (*c_p == '"')
+						{
+							fputc ('"', out_f);
+						}
+
+					fputc (*c_p, out_f);
+				}
+
+			fputc ('"', out_f);
+		}
+	else
+		{
+			fputs (value_s, out_f);
+		}
+}
+
+
+static const char *GetABHCode (const GenotypeClass gc)
+{
+	switch (gc)
+		{
+			case GC_PARENT_A:
+				return "A";
+
+			case GC_PARENT_B:
+				return "B";
+
+			case GC_HETEROZYGOUS:
+				return "H";
+
+			default:
+				break;
+		}
+
+	return "-";
+}
+
+
+/*
+ * The stream's buffer is copied into the current part and each part
+ * is spooled once it is full.
+ */
+static ssize_t WriteExportPart (void *cookie_p, const char *buffer_s, size_t size)
+{
+	MatrixExport *export_p = (MatrixExport *) cookie_p;
+	size_t remaining = size;
+
+	while (remaining > 0)
+		{
+			size_t length = S_EXPORT_PART_SIZE - (export_p -> me_part_length);
+
+			if (length > remaining)
+				{
+					length = remaining;
+				}
+
+			memcpy (export_p -> me_part_s + export_p -> me_part_length, buffer_s, length);
+			export_p -> me_part_length += length;
+			buffer_s += length;
+			remaining -= length;
+
+			if (export_p -> me_part_length == S_EXPORT_PART_SIZE)
+				{
+					if (!SpoolExportPart (export_p, false))
+						{
+							return -1;
+						}
+				}
+		}
+
+	return (ssize_t) size;
+}
+
+
+/*
+ * The text formats are sent back as they are but an Arrow file is
+ * binary so each part of it is base64-encoded first. Any of the part
+ * that isn't sent is kept for the start of the next one.
+ */
+static bool SpoolExportPart (MatrixExport *export_p, const bool last_flag)
+{
+	const size_t length = GetExportPartLength (export_p, last_flag);
+	json_t *result_p = json_object ();
+
+	if (result_p)
+		{
+			bool success_flag = false;
+
+			if (export_p -> me_format == EF_ARROW)
+				{
+					char *encoded_s = GetAsBase64 ((const unsigned char *) export_p -> me_part_s, length);
+
+					if (encoded_s)
+						{
+							success_flag = (SetJSONString (result_p, S_ENCODING_S, "base64")) && (SetJSONString (result_p, S_DATA_S, encoded_s));
+							FreeMemory (encoded_s);
+						}
+				}
+			else
+				{
+					success_flag = (json_object_set_new (result_p, S_DATA_S, json_stringn (export_p -> me_part_s, length)) == 0);
+				}
+
+			if (success_flag &&
+					(SetJSONString (result_p, PGS_POPULATION_NAME_S, export_p -> me_population_s)) &&
+					(SetJSONInteger (result_p, S_PART_S, export_p -> me_num_parts)))
+				{
+					if (SpoolResult (export_p -> me_spool_p, result_p))
+						{
+							++ (export_p -> me_num_parts);
+							export_p -> me_part_length -= length;
+
+							if (export_p -> me_part_length > 0)
+								{
+									memmove (export_p -> me_part_s, export_p -> me_part_s + length, export_p -> me_part_length);
+								}
+
+							return true;
+						}
+				}
+
+			json_decref (result_p);
+		}		/* if (result_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to spool part " UINT32_FMT " of the export of \"%s\"", export_p -> me_num_parts, export_p -> me_population_s);
+
+	return false;
+}
+
+
+/*
+ * A text part ends at the last complete row where possible, so that
+ * each part can be parsed on its own, and otherwise at the end of the
+ * last complete UTF-8 character since each part has to be a valid
+ * JSON string.
+ */
+static size_t GetExportPartLength (const MatrixExport *export_p, const bool last_flag)
+{
+	size_t length = export_p -> me_part_length;
+
+	if ((!last_flag) && (export_p -> me_format != EF_ARROW) && (length > 0))
+		{
+			const char *end_s = (const char *) memrchr (export_p -> me_part_s, '\n', length);
+
+			if (end_s)
+				{
+					length = (size_t) (end_s - export_p -> me_part_s) + 1;
+				}
+			else
+				{
+					const unsigned char *part_p = (const unsigned char *) export_p -> me_part_s;
+					size_t i = length - 1;
+
+					while ((i > 0) && ((part_p [i] & 0xC0) == 0x80))
+						{
+							-- i;
+						}
+
+					if (part_p [i] >= 0x80)
+						{
+							const size_t char_length = (part_p [i] >= 0xF0) ? 4 : ((part_p [i] >= 0xE0) ? 3 : 2);
+
+							if (i + char_length > length)
+								{
+									length = i;
+								}
+						}
+				}
+		}
+
+	return length;
+}
+
+
+static bool AddExportResult (MatrixExport *export_p, const char *population_s, const uint32 num_markers, const uint32 num_progeny)
+{
+	json_t *result_p = json_object ();
+
+	if (result_p)
+		{
+			if ((SetJSONString (result_p, PGS_POPULATION_NAME_S, population_s)) &&
+					(SetJSONInteger (result_p, S_NUM_MARKERS_S, num_markers)) &&
+					(SetJSONInteger (result_p, S_NUM_PROGENY_S, num_progeny)) &&
+					(SetJSONInteger (result_p, S_NUM_PARTS_S, export_p -> me_num_parts)))
+				{
+					if (json_array_append_new (export_p -> me_results_p, result_p) == 0)
+						{
+							return true;
+						}
+				}
+			else
+				{
+					json_decref (result_p);
+				}
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add export result for \"%s\"", population_s);
+
+	return false;
+}
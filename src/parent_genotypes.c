@@ -0,0 +1,733 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * parent_genotypes.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parent_genotypes.h"
+#include "parental_genotype_service.h"
+#include "bson_extract.h"
+#include "job_arena.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+/*
+ * The parallel arrays that are stored for each population
+ */
+typedef enum ParentGenotypesColumn
+{
+	PGC_MARKER,
+
+	PGC_CHROMOSOME,
+
+	PGC_MAPPING_POSITION,
+
+	PGC_PARENT_A,
+
+	PGC_PARENT_B,
+
+	PGC_NUM_COLUMNS
+} ParentGenotypesColumn;
+
+
+typedef struct PolymorphicSearch
+{
+	const char *ps_chromosome_s;
+
+	const double64 *ps_start_p;
+
+	const double64 *ps_end_p;
+
+	json_t *ps_results_p;
+
+	JobArena *ps_arena_p;
+} PolymorphicSearch;
+
+
+static const char * const S_COLUMN_KEYS_SS [PGC_NUM_COLUMNS] =
+{
+	"markers",
+	"chromosomes",
+	"mapping_positions",
+	"parent_a_genotypes",
+	"parent_b_genotypes"
+};
+
+static const char * const S_POLYMORPHIC_S = "polymorphic";
+
+static const char * const S_NUM_POLYMORPHIC_S = "num_polymorphic";
+
+
+static bool AddExistingParentGenotypes (const bson_oid_t *id_p, json_t *rows_p, json_t *index_p, ParentalGenotypeServiceData *data_p);
+
+static bool AddNewParentGenotypes (const json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, json_t *rows_p, json_t *index_p);
+
+static bool SetParentGenotypesRow (json_t *rows_p, json_t *index_p, const char *values_ss [PGC_NUM_COLUMNS]);
+
+static bool WriteParentGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, const json_t *rows_p, ParentalGenotypeServiceData *data_p);
+
+static bool IsPolymorphic (const char *parent_a_s, const char *parent_b_s);
+
+static bool AddBSONPolymorphicMarkers (const bson_t *doc_p, void *data_p);
+
+static bool IsMarkerInInterval (const PolymorphicSearch *search_p, const char *chromosome_s, const char *position_s);
+
+static json_t *GetParentGenotypesDocument (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p);
+
+
+
+bool SaveParentGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, const bool append_flag, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *rows_p = json_array ();
+
+	if (rows_p)
+		{
+			/*
+			 * The position of each marker in rows_p, keyed by escaped name
+			 */
+			json_t *index_p = json_object ();
+
+			if (index_p)
+				{
+					success_flag = true;
+
+					if (append_flag)
+						{
+							success_flag = AddExistingParentGenotypes (id_p, rows_p, index_p, data_p);
+						}
+
+					if (success_flag)
+						{
+							success_flag = AddNewParentGenotypes (doc_p, parent_a_row_p, parent_b_row_p, rows_p, index_p);
+
+							if (success_flag)
+								{
+									success_flag = WriteParentGenotypes (id_p, population_s, doc_p, rows_p, data_p);
+								}
+						}
+
+					json_decref (index_p);
+				}		/* if (index_p) */
+
+			json_decref (rows_p);
+		}		/* if (rows_p) */
+
+	return success_flag;
+}
+
+
+json_t *GetPolymorphicMarkers (const char *population_s, const char *chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_parent_genotypes_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_UTF8 (population_s));
+
+			if (query_p)
+				{
+					bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+					if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p))
+						{
+							PolymorphicSearch search;
+							JobArena arena;
+
+							InitJobArena (&arena);
+
+							search.ps_chromosome_s = IsStringEmpty (chromosome_s) ? NULL : chromosome_s;
+							search.ps_start_p = start_p;
+							search.ps_end_p = end_p;
+							search.ps_arena_p = &arena;
+
+							if ((search.ps_results_p = json_array ()) != NULL)
+								{
+									if (IterateOverMongoResults (data_p -> pgsd_mongo_p, AddBSONPolymorphicMarkers, &search) >= 0)
+										{
+											results_p = search.ps_results_p;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the polymorphic markers for \"%s\"", population_s);
+											json_decref (search.ps_results_p);
+										}
+								}
+
+							ClearJobArena (&arena);
+						}
+
+					if (opts_p)
+						{
+							bson_destroy (opts_p);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_parent_genotypes_collection_s)) */
+
+	return results_p;
+}
+
+
+json_t *GetParentGenotypesByMarker (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p)
+{
+	json_t *parents_p = NULL;
+	json_t *results_p = GetParentGenotypesDocument (id_p, data_p);
+
+	if (results_p)
+		{
+			if ((parents_p = json_object ()) != NULL)
+				{
+					const json_t *doc_p = json_array_get (results_p, 0);
+
+					if (doc_p)
+						{
+							const json_t *markers_p = json_object_get (doc_p, S_COLUMN_KEYS_SS [PGC_MARKER]);
+							const json_t *parent_a_p = json_object_get (doc_p, S_COLUMN_KEYS_SS [PGC_PARENT_A]);
+							const json_t *parent_b_p = json_object_get (doc_p, S_COLUMN_KEYS_SS [PGC_PARENT_B]);
+							const size_t num_markers = json_array_size (markers_p);
+							bool success_flag = true;
+							size_t i;
+
+							for (i = 0; (i < num_markers) && success_flag; ++ i)
+								{
+									const char *marker_s = json_string_value (json_array_get (markers_p, i));
+
+									success_flag = false;
+
+									if (marker_s)
+										{
+											json_t *genotypes_p = json_array ();
+
+											if (genotypes_p)
+												{
+													const char *parent_a_s = json_string_value (json_array_get (parent_a_p, i));
+													const char *parent_b_s = json_string_value (json_array_get (parent_b_p, i));
+
+													if ((json_array_append_new (genotypes_p, json_string (parent_a_s ? parent_a_s : "")) == 0) &&
+															(json_array_append_new (genotypes_p, json_string (parent_b_s ? parent_b_s : "")) == 0))
+														{
+															success_flag = (json_object_set_new (parents_p, marker_s, genotypes_p) == 0);
+														}
+													else
+														{
+															json_decref (genotypes_p);
+														}
+												}
+										}
+								}
+
+							if (!success_flag)
+								{
+									json_decref (parents_p);
+									parents_p = NULL;
+								}
+						}
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+
+	return parents_p;
+}
+
+
+void ResolveParentGenotypes (const char **parent_a_ss, const char **parent_b_ss)
+{
+	if ((IsMissingGenotype (*parent_a_ss)) || (IsMissingGenotype (*parent_b_ss)) || (strcmp (*parent_a_ss, *parent_b_ss) == 0))
+		{
+			*parent_a_ss = "A";
+			*parent_b_ss = "B";
+		}
+}
+
+
+GenotypeClass GetGenotypeClass (const char *genotype_s, const char *parent_a_s, const char *parent_b_s)
+{
+	if (IsMissingGenotype (genotype_s))
+		{
+			return GC_MISSING;
+		}
+	else if (strcmp (genotype_s, parent_a_s) == 0)
+		{
+			return GC_PARENT_A;
+		}
+	else if (strcmp (genotype_s, parent_b_s) == 0)
+		{
+			return GC_PARENT_B;
+		}
+
+	return GC_HETEROZYGOUS;
+}
+
+
+/*
+ * When appending, start with the markers that the population already has
+ * so that any that are submitted again are updated in place.
+ */
+static bool AddExistingParentGenotypes (const bson_oid_t *id_p, json_t *rows_p, json_t *index_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *results_p = GetParentGenotypesDocument (id_p, data_p);
+
+	if (results_p)
+		{
+			const json_t *existing_p = json_array_get (results_p, 0);
+
+			success_flag = true;
+
+			if (existing_p)
+				{
+					const json_t *columns_pp [PGC_NUM_COLUMNS];
+					size_t num_markers = 0;
+					uint32 i;
+
+					for (i = 0; i < PGC_NUM_COLUMNS; ++ i)
+						{
+							columns_pp [i] = json_object_get (existing_p, S_COLUMN_KEYS_SS [i]);
+						}
+
+					num_markers = json_array_size (columns_pp [PGC_MARKER]);
+
+					for (i = 0; (i < num_markers) && success_flag; ++ i)
+						{
+							const char *values_ss [PGC_NUM_COLUMNS];
+							uint32 j;
+
+							for (j = 0; j < PGC_NUM_COLUMNS; ++ j)
+								{
+									values_ss [j] = json_string_value (json_array_get (columns_pp [j], i));
+								}
+
+							success_flag = SetParentGenotypesRow (rows_p, index_p, values_ss);
+						}
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Get the stored document for a population as a JSON array
+ * that is empty if there isn't one.
+ */
+static json_t *GetParentGenotypesDocument (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_parent_genotypes_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+			if (query_p)
+				{
+					results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, NULL);
+					bson_destroy (query_p);
+				}
+		}
+
+	return results_p;
+}
+
+
+static bool AddNewParentGenotypes (const json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, json_t *rows_p, json_t *index_p)
+{
+	bool success_flag = true;
+	const char *escaped_marker_s;
+	json_t *marker_p;
+	JobArena arena;
+
+	InitJobArena (&arena);
+
+	json_object_foreach ((json_t *) doc_p, escaped_marker_s, marker_p)
+		{
+			if (success_flag && IsMarkerEntry (escaped_marker_s, marker_p))
+				{
+					/*
+					 * The parent rows use the marker names as they were submitted
+					 */
+					const char *marker_s = SearchAndReplaceInStringInJobArena (&arena, escaped_marker_s, PGS_ESCAPED_DOT_S, ".");
+
+					if (marker_s)
+						{
+							const char *values_ss [PGC_NUM_COLUMNS];
+
+							values_ss [PGC_MARKER] = escaped_marker_s;
+							values_ss [PGC_CHROMOSOME] = GetJSONString (marker_p, PGS_CHROMOSOME_S);
+							values_ss [PGC_MAPPING_POSITION] = GetJSONString (marker_p, PGS_MAPPING_POSITION_S);
+							values_ss [PGC_PARENT_A] = GetJSONString (parent_a_row_p, marker_s);
+							values_ss [PGC_PARENT_B] = GetJSONString (parent_b_row_p, marker_s);
+
+							success_flag = SetParentGenotypesRow (rows_p, index_p, values_ss);
+						}
+					else
+						{
+							success_flag = false;
+						}
+
+					ResetJobArena (&arena);
+				}
+		}
+
+	ClearJobArena (&arena);
+
+	return success_flag;
+}
+
+
+/*
+ * Any missing values are stored as empty strings so that the
+ * arrays stay the same length.
+ */
+static bool SetParentGenotypesRow (json_t *rows_p, json_t *index_p, const char *values_ss [PGC_NUM_COLUMNS])
+{
+	json_t *row_p;
+
+	if (!values_ss [PGC_MARKER])
+		{
+			return false;
+		}
+
+	if ((row_p = json_array ()) != NULL)
+		{
+			bool success_flag = true;
+			uint32 i;
+
+			for (i = 0; (i < PGC_NUM_COLUMNS) && success_flag; ++ i)
+				{
+					success_flag = (json_array_append_new (row_p, json_string (values_ss [i] ? values_ss [i] : "")) == 0);
+				}
+
+			if (success_flag)
+				{
+					const json_t *position_p = json_object_get (index_p, values_ss [PGC_MARKER]);
+
+					if (position_p)
+						{
+							if (json_array_set_new (rows_p, (size_t) json_integer_value (position_p), row_p) == 0)
+								{
+									return true;
+								}
+						}
+					else if (json_object_set_new (index_p, values_ss [PGC_MARKER], json_integer (json_array_size (rows_p))) == 0)
+						{
+							if (json_array_append_new (rows_p, row_p) == 0)
+								{
+									return true;
+								}
+						}
+				}
+
+			json_decref (row_p);
+		}
+
+	return false;
+}
+
+
+static bool WriteParentGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, const json_t *rows_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	const size_t num_markers = json_array_size (rows_p);
+	const size_t num_bytes = (num_markers + 7) / 8;
+	uint8 *bits_p = (uint8 *) AllocMemoryArray (num_bytes > 0 ? num_bytes : 1, sizeof (uint8));
+
+	if (bits_p)
+		{
+			bson_t *parents_p = bson_new ();
+
+			if (parents_p)
+				{
+					const char *parent_a_s = GetJSONString (doc_p, PGS_PARENT_A_S);
+					const char *parent_b_s = GetJSONString (doc_p, PGS_PARENT_B_S);
+					int32 num_polymorphic = 0;
+					size_t i;
+					uint32 j;
+
+					for (i = 0; i < num_markers; ++ i)
+						{
+							const json_t *row_p = json_array_get (rows_p, i);
+
+							if (IsPolymorphic (json_string_value (json_array_get (row_p, PGC_PARENT_A)), json_string_value (json_array_get (row_p, PGC_PARENT_B))))
+								{
+									bits_p [i >> 3] |= (uint8) (1 << (i & 7));
+									++ num_polymorphic;
+								}
+						}
+
+					success_flag = (BSON_APPEND_OID (parents_p, MONGO_ID_S, id_p)) &&
+						(BSON_APPEND_UTF8 (parents_p, PGS_POPULATION_NAME_S, population_s)) &&
+						((parent_a_s == NULL) || (BSON_APPEND_UTF8 (parents_p, PGS_PARENT_A_S, parent_a_s))) &&
+						((parent_b_s == NULL) || (BSON_APPEND_UTF8 (parents_p, PGS_PARENT_B_S, parent_b_s)));
+
+					for (j = 0; (j < PGC_NUM_COLUMNS) && success_flag; ++ j)
+						{
+							bson_t column;
+
+							if (BSON_APPEND_ARRAY_BEGIN (parents_p, S_COLUMN_KEYS_SS [j], &column))
+								{
+									for (i = 0; (i < num_markers) && success_flag; ++ i)
+										{
+											char key_s [32];
+
+											sprintf (key_s, SIZET_FMT, i);
+											success_flag = BSON_APPEND_UTF8 (&column, key_s, json_string_value (json_array_get (json_array_get (rows_p, i), j)));
+										}
+
+									if (!bson_append_array_end (parents_p, &column))
+										{
+											success_flag = false;
+										}
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = (BSON_APPEND_BINARY (parents_p, S_POLYMORPHIC_S, BSON_SUBTYPE_BINARY, bits_p, (uint32) num_bytes)) &&
+								(BSON_APPEND_INT32 (parents_p, S_NUM_POLYMORPHIC_S, num_polymorphic));
+						}
+
+					if (success_flag)
+						{
+							success_flag = false;
+
+							if (parents_p -> len < BSON_MAX_SIZE)
+								{
+									if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_parent_genotypes_collection_s))
+										{
+											bson_t *selector_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+											if (selector_p)
+												{
+													bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+													if (opts_p)
+														{
+															bson_error_t error;
+
+															if (mongoc_collection_replace_one (data_p -> pgsd_mongo_p -> mt_collection_p, selector_p, parents_p, opts_p, NULL, &error))
+																{
+																	success_flag = true;
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save parent genotypes for \"%s\" to \"%s\": %s", population_s, data_p -> pgsd_parent_genotypes_collection_s, error.message);
+																}
+
+															bson_destroy (opts_p);
+														}
+
+													bson_destroy (selector_p);
+												}
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The parent genotypes for \"%s\" are too large to save, " UINT32_FMT " bytes", population_s, parents_p -> len);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build the parent genotypes for \"%s\"", population_s);
+						}
+
+					bson_destroy (parents_p);
+				}		/* if (parents_p) */
+
+			FreeMemory (bits_p);
+		}		/* if (bits_p) */
+
+	return success_flag;
+}
+
+
+static bool IsPolymorphic (const char *parent_a_s, const char *parent_b_s)
+{
+	return ((!IsMissingGenotype (parent_a_s)) && (!IsMissingGenotype (parent_b_s)) && (strcmp (parent_a_s, parent_b_s) != 0));
+}
+
+
+/*
+ * Walk the parallel arrays together and add each marker whose bit is set.
+ */
+static bool AddBSONPolymorphicMarkers (const bson_t *doc_p, void *data_p)
+{
+	PolymorphicSearch *search_p = (PolymorphicSearch *) data_p;
+	bson_iter_t columns [PGC_NUM_COLUMNS];
+	bson_iter_t iter;
+	const uint8_t *bits_p = NULL;
+	uint32_t num_bytes = 0;
+	bool success_flag = true;
+	uint32 i;
+
+	for (i = 0; (i < PGC_NUM_COLUMNS) && success_flag; ++ i)
+		{
+			success_flag = (bson_iter_init_find (&iter, doc_p, S_COLUMN_KEYS_SS [i])) && (BSON_ITER_HOLDS_ARRAY (&iter)) && (bson_iter_recurse (&iter, columns + i));
+		}
+
+	if (success_flag && (bson_iter_init_find (&iter, doc_p, S_POLYMORPHIC_S)) && (BSON_ITER_HOLDS_BINARY (&iter)))
+		{
+			bson_subtype_t subtype;
+
+			bson_iter_binary (&iter, &subtype, &num_bytes, &bits_p);
+		}
+
+	if (success_flag)
+		{
+			json_t *result_p = json_object ();
+
+			success_flag = false;
+
+			if (result_p)
+				{
+					json_t *markers_p = json_array ();
+
+					if (markers_p)
+						{
+							if (json_object_set_new (result_p, "markers", markers_p) == 0)
+								{
+									const char *parent_a_s = GetBSONString (doc_p, PGS_PARENT_A_S);
+									const char *parent_b_s = GetBSONString (doc_p, PGS_PARENT_B_S);
+									uint32 marker_index = 0;
+									bool next_flag = true;
+
+									success_flag = (SetJSONString (result_p, PGS_POPULATION_NAME_S, GetBSONString (doc_p, PGS_POPULATION_NAME_S))) &&
+										((parent_a_s == NULL) || (SetJSONString (result_p, PGS_PARENT_A_S, parent_a_s))) &&
+										((parent_b_s == NULL) || (SetJSONString (result_p, PGS_PARENT_B_S, parent_b_s)));
+
+									while (success_flag && next_flag)
+										{
+											const char *values_ss [PGC_NUM_COLUMNS];
+
+											for (i = 0; (i < PGC_NUM_COLUMNS) && next_flag; ++ i)
+												{
+													next_flag = bson_iter_next (columns + i);
+
+													if (next_flag)
+														{
+															values_ss [i] = BSON_ITER_HOLDS_UTF8 (columns + i) ? bson_iter_utf8 (columns + i, NULL) : "";
+														}
+												}
+
+											if (next_flag)
+												{
+													const uint32 byte_index = marker_index >> 3;
+
+													if ((byte_index < num_bytes) && (bits_p [byte_index] & (1 << (marker_index & 7))) &&
+															(IsMarkerInInterval (search_p, values_ss [PGC_CHROMOSOME], values_ss [PGC_MAPPING_POSITION])))
+														{
+															json_t *marker_p = json_object ();
+
+															success_flag = false;
+
+															if (marker_p)
+																{
+																	if (json_array_append_new (markers_p, marker_p) == 0)
+																		{
+																			const char *marker_s = SearchAndReplaceInStringInJobArena (search_p -> ps_arena_p, values_ss [PGC_MARKER], PGS_ESCAPED_DOT_S, ".");
+
+																			success_flag = (marker_s != NULL) &&
+																				(SetJSONString (marker_p, PGS_MARKER_S, marker_s)) &&
+																				(SetJSONString (marker_p, PGS_CHROMOSOME_S, values_ss [PGC_CHROMOSOME])) &&
+																				(SetJSONString (marker_p, PGS_MAPPING_POSITION_S, values_ss [PGC_MAPPING_POSITION])) &&
+																				(SetJSONString (marker_p, PGS_PARENT_A_S, values_ss [PGC_PARENT_A])) &&
+																				(SetJSONString (marker_p, PGS_PARENT_B_S, values_ss [PGC_PARENT_B]));
+
+																			ResetJobArena (search_p -> ps_arena_p);
+																		}
+																	else
+																		{
+																			json_decref (marker_p);
+																		}
+																}
+														}
+
+													++ marker_index;
+												}
+										}
+
+									if (success_flag)
+										{
+											success_flag = (SetJSONInteger (result_p, S_NUM_POLYMORPHIC_S, json_array_size (markers_p))) &&
+												(json_array_append (search_p -> ps_results_p, result_p) == 0);
+										}
+								}
+							else
+								{
+									json_decref (markers_p);
+								}
+						}
+
+					json_decref (result_p);
+				}		/* if (result_p) */
+		}
+
+	return success_flag;
+}
+
+
+static bool IsMarkerInInterval (const PolymorphicSearch *search_p, const char *chromosome_s, const char *position_s)
+{
+	if ((search_p -> ps_chromosome_s) && (strcmp (search_p -> ps_chromosome_s, chromosome_s) != 0))
+		{
+			return false;
+		}
+
+	if ((search_p -> ps_start_p) || (search_p -> ps_end_p))
+		{
+			char *end_s = NULL;
+			const double64 position = strtod (position_s, &end_s);
+
+			/*
+			 * Markers without a mapping position can't be in the interval
+			 */
+			if (end_s == position_s)
+				{
+					return false;
+				}
+
+			if ((search_p -> ps_start_p) && (position < * (search_p -> ps_start_p)))
+				{
+					return false;
+				}
+
+			if ((search_p -> ps_end_p) && (position > * (search_p -> ps_end_p)))
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
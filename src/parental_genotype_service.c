@@ -118,3 +118,21 @@ void ReleaseServices (ServicesArray *services_p)
 	FreeServicesArray (services_p);
 }
 
+
+bool IsMarkerMetadataKey (const char *key_s)
+{
+	return ((strcmp (key_s, PGS_CHROMOSOME_S) == 0) || (strcmp (key_s, PGS_MAPPING_POSITION_S) == 0));
+}
+
+
+bool IsMarkerEntry (const char *key_s, const json_t *value_p)
+{
+	return ((json_is_object (value_p)) && (strcmp (key_s, MONGO_ID_S) != 0));
+}
+
+
+bool IsMissingGenotype (const char *genotype_s)
+{
+	return ((genotype_s == NULL) || (*genotype_s == '\0') || (strcmp (genotype_s, "-") == 0) || (strcmp (genotype_s, "NA") == 0));
+}
+
@@ -20,11 +20,31 @@
  *      Author: billy
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #define ALLOCATE_PARENTAL_GENOTYPE_SERVICE_TAGS (1)
 #include "parental_genotype_service_data.h"
+#include "marker_index.h"
+#include "population_filters.h"
+#include "population_summaries.h"
+#include "collection_indexes.h"
+#include "admission_control.h"
 
 #include "streams.h"
 #include "string_utils.h"
+#include "json_util.h"
+
+
+static void ConfigureMarkerIndex (ParentalGenotypeServiceData *data_p, const json_t *service_config_p);
+
+static void ConfigurePopulationFilters (ParentalGenotypeServiceData *data_p, const json_t *service_config_p);
+
+static void ConfigurePopulationSummaries (ParentalGenotypeServiceData *data_p, const json_t *service_config_p);
+
+static bool ConfigureCollectionIndexes (ParentalGenotypeServiceData *data_p, const json_t *service_config_p);
+
+static void ConfigureResultBudget (ParentalGenotypeServiceData *data_p, const json_t *service_config_p);
 
 
 ParentalGenotypeServiceData *AllocateParentalGenotypeServiceData  (void)
@@ -38,6 +58,26 @@ ParentalGenotypeServiceData *AllocateParentalGenotypeServiceData  (void)
 			data_p -> pgsd_populations_collection_s = NULL;
 			data_p -> pgsd_varieties_collection_s = NULL;
 			data_p -> pgsd_name_mappings_p = NULL;
+			data_p -> pgsd_timings_flag = false;
+			data_p -> pgsd_metrics_p = GetServiceMetrics ();
+			data_p -> pgsd_marker_index_flag = false;
+			data_p -> pgsd_marker_index_max_results = 100;
+			data_p -> pgsd_population_filters_flag = false;
+			data_p -> pgsd_coalesce_searches_flag = true;
+			data_p -> pgsd_search_timeout_ms = 0;
+			data_p -> pgsd_result_budget = 0;
+			data_p -> pgsd_spool_directory_s = "/tmp";
+			data_p -> pgsd_spool_expiry_s = 3600;
+			data_p -> pgsd_summaries_collection_s = "population_summaries";
+			data_p -> pgsd_progeny_collection_s = "progeny";
+			data_p -> pgsd_parent_genotypes_collection_s = "parent_genotypes";
+			data_p -> pgsd_marker_stats_collection_s = "marker_stats";
+			data_p -> pgsd_haplotype_blocks_collection_s = "haplotype_blocks";
+			data_p -> pgsd_recombination_threads = 4;
+			data_p -> pgsd_recombination_max_markers = 5000;
+			data_p -> pgsd_pattern_threads = 4;
+			data_p -> pgsd_import_directory_s = NULL;
+			data_p -> pgsd_import_threads = 4;
 
 			return data_p;
 		}
@@ -48,6 +88,16 @@ ParentalGenotypeServiceData *AllocateParentalGenotypeServiceData  (void)
 
 void FreeParentalGenotypeServiceData (ParentalGenotypeServiceData *data_p)
 {
+	if (data_p -> pgsd_marker_index_flag)
+		{
+			ReleaseMarkerIndex ();
+		}
+
+	if (data_p -> pgsd_population_filters_flag)
+		{
+			ReleasePopulationFilters ();
+		}
+
 	if (data_p -> pgsd_mongo_p)
 		{
 			FreeMongoTool (data_p -> pgsd_mongo_p);
@@ -61,6 +111,7 @@ bool ConfigureParentalGenotypeService (ParentalGenotypeServiceData *data_p, Gras
 {
 	bool success_flag = false;
 	const json_t *service_config_p = data_p -> pgsd_base_data.sd_config_p;
+	const char *collection_s = NULL;
 
 	data_p -> pgsd_database_s = GetJSONString (service_config_p, "database");
 
@@ -76,7 +127,75 @@ bool ConfigureParentalGenotypeService (ParentalGenotypeServiceData *data_p, Gras
 										{
 											data_p -> pgsd_name_mappings_p = json_object_get (service_config_p, "name_mappings");
 
-											success_flag = true;
+											/*
+											 * The summaries, progeny, parent genotypes and marker statistics collections are optional in the config
+											 */
+											if ((collection_s = GetJSONString (service_config_p, "summaries_collection")) != NULL)
+												{
+													data_p -> pgsd_summaries_collection_s = collection_s;
+												}
+
+											if ((collection_s = GetJSONString (service_config_p, "progeny_collection")) != NULL)
+												{
+													data_p -> pgsd_progeny_collection_s = collection_s;
+												}
+
+											if ((collection_s = GetJSONString (service_config_p, "parent_genotypes_collection")) != NULL)
+												{
+													data_p -> pgsd_parent_genotypes_collection_s = collection_s;
+												}
+
+											if ((collection_s = GetJSONString (service_config_p, "marker_stats_collection")) != NULL)
+												{
+													data_p -> pgsd_marker_stats_collection_s = collection_s;
+												}
+
+											if ((collection_s = GetJSONString (service_config_p, "haplotype_blocks_collection")) != NULL)
+												{
+													data_p -> pgsd_haplotype_blocks_collection_s = collection_s;
+												}
+
+											/*
+											 * Timing each stage of a job is off by default
+											 */
+											GetJSONBoolean (service_config_p, "timings", & (data_p -> pgsd_timings_flag));
+
+											/*
+											 * Sharing the results of identical concurrent searches is on by default
+											 */
+											GetJSONBoolean (service_config_p, "coalesce_searches", & (data_p -> pgsd_coalesce_searches_flag));
+
+											/*
+											 * Searches have no time limit by default
+											 */
+											GetJSONUnsignedInteger (service_config_p, "search_timeout_ms", & (data_p -> pgsd_search_timeout_ms));
+
+											GetJSONUnsignedInteger (service_config_p, "recombination_threads", & (data_p -> pgsd_recombination_threads));
+											GetJSONUnsignedInteger (service_config_p, "recombination_max_markers", & (data_p -> pgsd_recombination_max_markers));
+											GetJSONUnsignedInteger (service_config_p, "pattern_threads", & (data_p -> pgsd_pattern_threads));
+											GetJSONUnsignedInteger (service_config_p, "import_threads", & (data_p -> pgsd_import_threads));
+
+											/*
+											 * Submitting files from the server is off unless a directory is given
+											 */
+											data_p -> pgsd_import_directory_s = GetJSONString (service_config_p, "import_directory");
+
+											/*
+											 * The limits are shared by both services so whichever
+											 * is configured last sets any that are given
+											 */
+											ConfigureAdmissionControl (json_object_get (service_config_p, "admission_control"));
+
+											ConfigureResultBudget (data_p, service_config_p);
+
+											if (ConfigureCollectionIndexes (data_p, service_config_p))
+												{
+													ConfigureMarkerIndex (data_p, service_config_p);
+													ConfigurePopulationFilters (data_p, service_config_p);
+													ConfigurePopulationSummaries (data_p, service_config_p);
+
+													success_flag = true;
+												}
 										}
 									else
 										{
@@ -99,3 +218,260 @@ bool ConfigureParentalGenotypeService (ParentalGenotypeServiceData *data_p, Gras
 }
 
 
+/*
+ * Paragon x Watkins 1190[0-9][0-9][0-9]" to "ParW[0-9][0-9][0-9]"
+ */
+const char *GetMappedAccession (const char *accession_s, const ParentalGenotypeServiceData *data_p, JobArena *arena_p)
+{
+	const char *parents_s = NULL;
+	bool success_flag = true;
+
+	if (data_p -> pgsd_name_mappings_p)
+		{
+			void *iterator_p = json_object_iter (data_p -> pgsd_name_mappings_p);
+
+			while (iterator_p && success_flag)
+				{
+					const char *key_s = json_object_iter_key (iterator_p);
+					const size_t key_length = strlen (key_s);
+
+					if (strncmp (accession_s, key_s, key_length) == 0)
+						{
+							json_t *value_p = json_object_iter_value (iterator_p);
+
+							if (json_is_string (value_p))
+								{
+									const char *value_s = json_string_value (value_p);
+
+									accession_s += key_length;
+									parents_s = ConcatenateVarargsStringsInJobArena (arena_p, value_s, accession_s, NULL);
+
+									if (!parents_s)
+										{
+											success_flag = false;
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to concatenate \"%s\" and \"%s\"", value_s, accession_s);
+										}		/* if (!parents_s) */
+
+								}		/* if (json_is_string (value_p)) */
+							else
+								{
+									success_flag  = false;
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, data_p -> pgsd_name_mappings_p, "Value for \"%s\" is not a string", key_s);
+								}
+
+						}		/* if (strncmp (accession_s, key_s, key_length) == 0) */
+
+					if (success_flag)
+						{
+							iterator_p = json_object_iter_next (data_p -> pgsd_name_mappings_p, iterator_p);
+						}
+
+				}		/* while (iterator_p && success_flag) */
+
+		}		/* if (data_p -> pgsd_name_mappings_p) */
+
+	/*
+	 * If there is no mapping, the accession can be used as it is
+	 * since SetJSONString () takes its own copy of the key
+	 */
+	if (success_flag && (parents_s == NULL))
+		{
+			parents_s = accession_s;
+		}
+
+	return parents_s;
+}
+
+
+char *GetImportFilePath (const char *filename_s, const ParentalGenotypeServiceData *data_p)
+{
+	const char *directory_s = data_p -> pgsd_import_directory_s;
+
+	if (directory_s)
+		{
+			char *path_s = (*filename_s == '/') ? EasyCopyToNewString (filename_s) : ConcatenateVarargsStrings (directory_s, "/", filename_s, NULL);
+
+			if (path_s)
+				{
+					/*
+					 * Resolve any links and ".." components before checking
+					 * where the file actually is
+					 */
+					char *real_directory_s = realpath (directory_s, NULL);
+					char *real_path_s = realpath (path_s, NULL);
+					char *import_path_s = NULL;
+
+					if (real_directory_s && real_path_s)
+						{
+							const size_t l = strlen (real_directory_s);
+
+							if ((strncmp (real_path_s, real_directory_s, l) == 0) && ((real_path_s [l] == '/') || (real_directory_s [l - 1] == '/')))
+								{
+									import_path_s = EasyCopyToNewString (real_path_s);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is not in the import directory \"%s\"", filename_s, directory_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to resolve \"%s\" in \"%s\"", filename_s, directory_s);
+						}
+
+					/*
+					 * realpath () allocates its results with malloc ()
+					 */
+					if (real_path_s)
+						{
+							free (real_path_s);
+						}
+
+					if (real_directory_s)
+						{
+							free (real_directory_s);
+						}
+
+					FreeCopiedString (path_s);
+
+					return import_path_s;
+				}		/* if (path_s) */
+
+		}		/* if (directory_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't import \"%s\" since no \"import_directory\" is set", filename_s);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * By default there is no budget so all of the results are kept in
+ * memory and nothing is spooled. Any spooled results that haven't
+ * been collected after an hour are deleted.
+ */
+static void ConfigureResultBudget (ParentalGenotypeServiceData *data_p, const json_t *service_config_p)
+{
+	uint32 budget_mb = (uint32) (data_p -> pgsd_result_budget / (1024 * 1024));
+	const char *directory_s = GetJSONString (service_config_p, "spool_directory");
+
+	if (GetJSONUnsignedInteger (service_config_p, "result_budget_mb", &budget_mb))
+		{
+			data_p -> pgsd_result_budget = ((uint64) budget_mb) * 1024 * 1024;
+		}
+
+	if (directory_s)
+		{
+			data_p -> pgsd_spool_directory_s = directory_s;
+		}
+
+	GetJSONUnsignedInteger (service_config_p, "spool_expiry_s", & (data_p -> pgsd_spool_expiry_s));
+}
+
+
+/*
+ * The in-memory marker dictionary is on by default. If it can't be
+ * loaded, prefix searches are unavailable but everything else still works.
+ */
+static void ConfigureMarkerIndex (ParentalGenotypeServiceData *data_p, const json_t *service_config_p)
+{
+	bool marker_index_flag = true;
+
+	GetJSONBoolean (service_config_p, "marker_index", &marker_index_flag);
+	GetJSONUnsignedInteger (service_config_p, "marker_index_max_results", & (data_p -> pgsd_marker_index_max_results));
+
+	if (marker_index_flag)
+		{
+			data_p -> pgsd_marker_index_flag = LoadMarkerIndex (data_p);
+
+			if (! (data_p -> pgsd_marker_index_flag))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load the marker index, marker prefix searches will be unavailable");
+				}
+		}
+}
+
+
+/*
+ * The per-population marker filters are on by default. If they can't be
+ * loaded, searches just fetch every candidate population as before.
+ */
+static void ConfigurePopulationFilters (ParentalGenotypeServiceData *data_p, const json_t *service_config_p)
+{
+	bool population_filters_flag = true;
+
+	GetJSONBoolean (service_config_p, "population_filters", &population_filters_flag);
+
+	if (population_filters_flag)
+		{
+			data_p -> pgsd_population_filters_flag = LoadPopulationFilters (data_p);
+
+			if (! (data_p -> pgsd_population_filters_flag))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to load the population filters, every population will be fetched when searching");
+				}
+		}
+}
+
+
+/*
+ * Summaries are written for each population as it is submitted. Any
+ * populations that were added before then only get one if
+ * "rebuild_summaries" is set.
+ */
+static void ConfigurePopulationSummaries (ParentalGenotypeServiceData *data_p, const json_t *service_config_p)
+{
+	bool rebuild_flag = false;
+
+	GetJSONBoolean (service_config_p, "rebuild_summaries", &rebuild_flag);
+
+	if (rebuild_flag)
+		{
+			if (!RebuildPopulationSummaries (data_p))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to rebuild all of the population summaries in \"%s\"", data_p -> pgsd_summaries_collection_s);
+				}
+		}
+}
+
+
+/*
+ * The indexes are checked by default but are only created if the
+ * config asks for it. Missing indexes are logged and, if
+ * "require_indexes" is set, stop the service from starting.
+ */
+static bool ConfigureCollectionIndexes (ParentalGenotypeServiceData *data_p, const json_t *service_config_p)
+{
+	bool success_flag = true;
+	bool check_flag = true;
+
+	GetJSONBoolean (service_config_p, "check_indexes", &check_flag);
+
+	if (check_flag)
+		{
+			bool create_flag = false;
+
+			GetJSONBoolean (service_config_p, "create_indexes", &create_flag);
+
+			if (!CheckCollectionIndexes (data_p, create_flag))
+				{
+					bool require_flag = false;
+
+					GetJSONBoolean (service_config_p, "require_indexes", &require_flag);
+
+					if (require_flag)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Required indexes are missing from \"%s\"", data_p -> pgsd_database_s);
+							success_flag = false;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Indexes are missing from \"%s\", set \"create_indexes\" to add them", data_p -> pgsd_database_s);
+						}
+				}
+		}
+
+	return success_flag;
+}
@@ -0,0 +1,866 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * pattern_search.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <ctype.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "pattern_search.h"
+#include "parental_genotype_service.h"
+#include "population_filters.h"
+#include "genetic_map.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+/*
+ * The state for matching the pattern against a single population.
+ */
+typedef struct PopulationMatch
+{
+	/** The population document with just the pattern's markers. */
+	const json_t *pm_population_p;
+
+	/** The parents' genotypes by marker, which pm_parent_genotypes_ss points into. */
+	json_t *pm_parents_p;
+
+	/**
+	 * Parent A's and parent B's resolved genotypes for each term of the
+	 * pattern in turn.
+	 */
+	const char **pm_parent_genotypes_ss;
+
+	/** The accessions of the population's lines, indexed by their bit. */
+	const char **pm_accessions_ss;
+
+	json_t *pm_accession_indexes_p;
+
+	uint32 pm_num_progeny;
+
+	/** The bitset of the lines that match every term of the pattern. */
+	uint64 *pm_matches_p;
+
+	uint32 pm_num_matches;
+
+	bool pm_matched_flag;
+} PopulationMatch;
+
+
+typedef struct PatternWorker
+{
+	const GenotypePattern *pw_pattern_p;
+
+	PopulationMatch *pw_matches_p;
+
+	uint32 pw_num_populations;
+
+	/** The first population for this worker, each worker takes every pw_stride-th one. */
+	uint32 pw_first_population;
+
+	uint32 pw_stride;
+
+	/**
+	 * Each worker has its own copy since checking a SearchDeadline
+	 * updates it.
+	 */
+	SearchDeadline pw_deadline;
+
+	pthread_t pw_thread;
+
+	bool pw_started_flag;
+} PatternWorker;
+
+
+/*
+ * Below this many populations per thread, the cost of starting
+ * the threads outweighs the time that they save.
+ */
+static const uint32 S_MIN_POPULATIONS_PER_THREAD = 8;
+
+static const char * const S_TERM_SEPARATORS_S = ",;\n";
+
+static const char * const S_NUM_PROGENY_S = "num_progeny";
+
+static const char * const S_NUM_MATCHES_S = "num_matches";
+
+static const char * const S_PROGENY_S = "progeny";
+
+
+static bool AddPatternTerm (GenotypePattern *pattern_p, char *term_s);
+
+static char *TrimWhitespace (char *value_s);
+
+static bool IsRepeatedTerm (const GenotypePattern *pattern_p, const uint32 index);
+
+static bson_t *GetPatternQuery (const GenotypePattern *pattern_p, const char *population_s, const bool filters_flag);
+
+static bson_t *GetPatternQueryOptions (const GenotypePattern *pattern_p, SearchDeadline *deadline_p);
+
+static bool PreparePopulationMatch (PopulationMatch *match_p, const json_t *population_p, const GenotypePattern *pattern_p, ParentalGenotypeServiceData *data_p);
+
+static void ClearPopulationMatch (PopulationMatch *match_p);
+
+static bool MatchPopulations (const GenotypePattern *pattern_p, PopulationMatch *matches_p, const uint32 num_populations, const uint32 max_threads, SearchDeadline *deadline_p);
+
+static void *RunPatternWorker (void *data_p);
+
+static void MatchPopulation (const GenotypePattern *pattern_p, PopulationMatch *match_p);
+
+static void SetTermBits (const PatternTerm *term_p, const json_t *marker_p, const char *parent_a_s, const char *parent_b_s, const PopulationMatch *match_p, uint64 *bits_p);
+
+static uint64 AndBitsets (uint64 *dest_p, const uint64 *src_p, const uint32 num_words);
+
+static json_t *GetPopulationMatchAsJSON (const PopulationMatch *match_p);
+
+
+
+GenotypePattern *ParseGenotypePattern (const char *pattern_s)
+{
+	GenotypePattern *pattern_p = NULL;
+
+	if (!IsStringEmpty (pattern_s))
+		{
+			pattern_p = (GenotypePattern *) AllocMemory (sizeof (GenotypePattern));
+
+			if (pattern_p)
+				{
+					const size_t length = strlen (pattern_s);
+					uint32 max_terms = 1;
+					const char *c_p;
+					char *copy_s;
+
+					/*
+					 * Each term has an =, so this is an upper bound
+					 */
+					for (c_p = pattern_s; *c_p != '\0'; ++ c_p)
+						{
+							if (*c_p == '=')
+								{
+									++ max_terms;
+								}
+						}
+
+					InitJobArena (& (pattern_p -> gp_arena));
+					pattern_p -> gp_num_terms = 0;
+
+					pattern_p -> gp_terms_p = (PatternTerm *) AllocFromJobArena (& (pattern_p -> gp_arena), max_terms * sizeof (PatternTerm));
+					copy_s = (char *) AllocFromJobArena (& (pattern_p -> gp_arena), length + 1);
+
+					if ((pattern_p -> gp_terms_p) && copy_s)
+						{
+							bool success_flag = true;
+							char *save_s = NULL;
+							char *term_s;
+
+							memcpy (copy_s, pattern_s, length + 1);
+
+							for (term_s = strtok_r (copy_s, S_TERM_SEPARATORS_S, &save_s); term_s && success_flag; term_s = strtok_r (NULL, S_TERM_SEPARATORS_S, &save_s))
+								{
+									/*
+									 * Allow a trailing separator
+									 */
+									if (*TrimWhitespace (term_s) != '\0')
+										{
+											success_flag = AddPatternTerm (pattern_p, term_s);
+										}
+								}
+
+							if (success_flag && (pattern_p -> gp_num_terms > 0))
+								{
+									return pattern_p;
+								}
+						}
+
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid genotype pattern \"%s\"", pattern_s);
+					FreeGenotypePattern (pattern_p);
+					pattern_p = NULL;
+				}		/* if (pattern_p) */
+
+		}		/* if (!IsStringEmpty (pattern_s)) */
+
+	return pattern_p;
+}
+
+
+void FreeGenotypePattern (GenotypePattern *pattern_p)
+{
+	ClearJobArena (& (pattern_p -> gp_arena));
+	FreeMemory (pattern_p);
+}
+
+
+json_t *GetProgenyMatchingPattern (const GenotypePattern *pattern_p, const char *population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = GetPatternQuery (pattern_p, population_s, data_p -> pgsd_population_filters_flag);
+
+			if (query_p)
+				{
+					bson_t *opts_p = GetPatternQueryOptions (pattern_p, deadline_p);
+
+					if (opts_p)
+						{
+							json_t *populations_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+							if (populations_p)
+								{
+									const uint32 num_populations = (uint32) json_array_size (populations_p);
+									PopulationMatch *matches_p = (PopulationMatch *) AllocMemoryArray (num_populations + 1, sizeof (PopulationMatch));
+
+									if (matches_p)
+										{
+											bool success_flag = true;
+											uint32 i;
+
+											/*
+											 * The parents' genotypes come from the database so they
+											 * are all fetched on this thread before matching
+											 */
+											for (i = 0; (i < num_populations) && success_flag; ++ i)
+												{
+													if (HasSearchDeadlinePassed (deadline_p))
+														{
+															success_flag = false;
+														}
+													else
+														{
+															success_flag = PreparePopulationMatch (matches_p + i, json_array_get (populations_p, i), pattern_p, data_p);
+														}
+												}
+
+											if (success_flag)
+												{
+													success_flag = MatchPopulations (pattern_p, matches_p, num_populations, data_p -> pgsd_pattern_threads, deadline_p);
+												}
+
+											if (success_flag)
+												{
+													if ((results_p = json_array ()) != NULL)
+														{
+															for (i = 0; (i < num_populations) && results_p; ++ i)
+																{
+																	const PopulationMatch *match_p = matches_p + i;
+
+																	if (match_p -> pm_num_matches > 0)
+																		{
+																			json_t *result_p = GetPopulationMatchAsJSON (match_p);
+
+																			if ((!result_p) || (json_array_append_new (results_p, result_p) != 0))
+																				{
+																					json_decref (results_p);
+																					results_p = NULL;
+																				}
+																		}
+																	else if (! (match_p -> pm_matched_flag))
+																		{
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to match pattern against \"%s\"", GetJSONString (match_p -> pm_population_p, PGS_POPULATION_NAME_S));
+																		}
+																}
+														}
+												}
+
+											for (i = 0; i < num_populations; ++ i)
+												{
+													ClearPopulationMatch (matches_p + i);
+												}
+
+											FreeMemory (matches_p);
+										}		/* if (matches_p) */
+
+									json_decref (populations_p);
+								}		/* if (populations_p) */
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return results_p;
+}
+
+
+static bool AddPatternTerm (GenotypePattern *pattern_p, char *term_s)
+{
+	char *separator_s = strchr (term_s, '=');
+
+	if (separator_s)
+		{
+			const char *marker_s;
+			const char *genotype_s;
+
+			*separator_s = '\0';
+
+			marker_s = TrimWhitespace (term_s);
+			genotype_s = TrimWhitespace (separator_s + 1);
+
+			if ((*marker_s != '\0') && (*genotype_s != '\0'))
+				{
+					PatternTerm *pattern_term_p = pattern_p -> gp_terms_p + pattern_p -> gp_num_terms;
+
+					if ((pattern_term_p -> pt_marker_s = SearchAndReplaceInStringInJobArena (& (pattern_p -> gp_arena), marker_s, ".", PGS_ESCAPED_DOT_S)) != NULL)
+						{
+							pattern_term_p -> pt_genotype_s = genotype_s;
+
+							if (strcmp (genotype_s, "A") == 0)
+								{
+									pattern_term_p -> pt_class = GC_PARENT_A;
+								}
+							else if (strcmp (genotype_s, "B") == 0)
+								{
+									pattern_term_p -> pt_class = GC_PARENT_B;
+								}
+							else if (strcmp (genotype_s, "H") == 0)
+								{
+									pattern_term_p -> pt_class = GC_HETEROZYGOUS;
+								}
+							else if (IsMissingGenotype (genotype_s))
+								{
+									pattern_term_p -> pt_class = GC_MISSING;
+								}
+							else
+								{
+									pattern_term_p -> pt_class = GC_NUM_CLASSES;
+								}
+
+							++ (pattern_p -> gp_num_terms);
+
+							return true;
+						}
+				}
+		}
+
+	return false;
+}
+
+
+static char *TrimWhitespace (char *value_s)
+{
+	char *end_s;
+
+	while (isspace ((unsigned char) *value_s))
+		{
+			++ value_s;
+		}
+
+	end_s = value_s + strlen (value_s);
+
+	while ((end_s > value_s) && (isspace ((unsigned char) * (end_s - 1))))
+		{
+			-- end_s;
+		}
+
+	*end_s = '\0';
+
+	return value_s;
+}
+
+
+/*
+ * A marker can be given more than once, but MongoDB rejects
+ * repeated fields in projections.
+ */
+static bool IsRepeatedTerm (const GenotypePattern *pattern_p, const uint32 index)
+{
+	uint32 i;
+
+	for (i = 0; i < index; ++ i)
+		{
+			if (strcmp (pattern_p -> gp_terms_p [i].pt_marker_s, pattern_p -> gp_terms_p [index].pt_marker_s) == 0)
+				{
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static bson_t *GetPatternQuery (const GenotypePattern *pattern_p, const char *population_s, const bool filters_flag)
+{
+	bson_t *query_p = IsStringEmpty (population_s) ? bson_new () :
+		BCON_NEW ("$or", "[",
+								"{", PGS_POPULATION_NAME_S, BCON_UTF8 (population_s), "}",
+								"{", PGS_PARENT_A_S, BCON_UTF8 (population_s), "}",
+								"{", PGS_PARENT_B_S, BCON_UTF8 (population_s), "}",
+							"]");
+
+	if (query_p)
+		{
+			bool success_flag = true;
+			uint32 i;
+
+			for (i = 0; (i < pattern_p -> gp_num_terms) && success_flag; ++ i)
+				{
+					if (!IsRepeatedTerm (pattern_p, i))
+						{
+							bson_t *exists_p = BCON_NEW ("$exists", BCON_BOOL (true));
+
+							success_flag = false;
+
+							if (exists_p)
+								{
+									success_flag = BSON_APPEND_DOCUMENT (query_p, pattern_p -> gp_terms_p [i].pt_marker_s, exists_p);
+									bson_destroy (exists_p);
+								}
+						}
+				}
+
+			if (success_flag && filters_flag)
+				{
+					/*
+					 * Every population has to have all of the markers so
+					 * skipping those known to lack the first one is enough
+					 */
+					success_flag = (AddPopulationFiltersToQuery (query_p, pattern_p -> gp_terms_p -> pt_marker_s) >= 0);
+				}
+
+			if (success_flag)
+				{
+					return query_p;
+				}
+
+			bson_destroy (query_p);
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create genotype pattern query");
+
+	return NULL;
+}
+
+
+static bson_t *GetPatternQueryOptions (const GenotypePattern *pattern_p, SearchDeadline *deadline_p)
+{
+	bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+	if (!opts_p)
+		{
+			opts_p = bson_new ();
+		}
+
+	if (opts_p)
+		{
+			bson_t projection;
+
+			/*
+			 * Only fetch the pattern's markers rather than the whole of
+			 * each population
+			 */
+			if (BSON_APPEND_DOCUMENT_BEGIN (opts_p, "projection", &projection))
+				{
+					bool success_flag = (BSON_APPEND_INT32 (&projection, PGS_POPULATION_NAME_S, 1)) &&
+						(BSON_APPEND_INT32 (&projection, PGS_PARENT_A_S, 1)) &&
+						(BSON_APPEND_INT32 (&projection, PGS_PARENT_B_S, 1));
+					uint32 i;
+
+					for (i = 0; (i < pattern_p -> gp_num_terms) && success_flag; ++ i)
+						{
+							if (!IsRepeatedTerm (pattern_p, i))
+								{
+									success_flag = BSON_APPEND_INT32 (&projection, pattern_p -> gp_terms_p [i].pt_marker_s, 1);
+								}
+						}
+
+					if ((bson_append_document_end (opts_p, &projection)) && success_flag)
+						{
+							bson_t *sort_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_INT32 (1));
+
+							if (sort_p)
+								{
+									success_flag = BSON_APPEND_DOCUMENT (opts_p, "sort", sort_p);
+									bson_destroy (sort_p);
+
+									if (success_flag)
+										{
+											return opts_p;
+										}
+								}
+						}
+				}
+
+			bson_destroy (opts_p);
+		}		/* if (opts_p) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create genotype pattern query options");
+
+	return NULL;
+}
+
+
+static bool PreparePopulationMatch (PopulationMatch *match_p, const json_t *population_p, const GenotypePattern *pattern_p, ParentalGenotypeServiceData *data_p)
+{
+	const char *population_s = GetJSONString (population_p, PGS_POPULATION_NAME_S);
+	const uint32 num_terms = pattern_p -> gp_num_terms;
+	MapMarker *markers_p = (MapMarker *) AllocMemoryArray (num_terms, sizeof (MapMarker));
+	bool success_flag = false;
+
+	memset (match_p, 0, sizeof (PopulationMatch));
+	match_p -> pm_population_p = population_p;
+
+	if (markers_p)
+		{
+			bson_oid_t id;
+			uint32 i;
+
+			for (i = 0; i < num_terms; ++ i)
+				{
+					markers_p [i].mm_name_s = pattern_p -> gp_terms_p [i].pt_marker_s;
+					markers_p [i].mm_marker_p = json_object_get (population_p, markers_p [i].mm_name_s);
+				}
+
+			if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), &id))
+				{
+					match_p -> pm_parents_p = GetParentGenotypesByMarker (&id, data_p);
+				}
+
+			if ((match_p -> pm_parents_p) && ((match_p -> pm_accession_indexes_p = GetAccessionIndexes (markers_p, num_terms)) != NULL))
+				{
+					match_p -> pm_num_progeny = (uint32) json_object_size (match_p -> pm_accession_indexes_p);
+
+					match_p -> pm_accessions_ss = (const char **) AllocMemoryArray (match_p -> pm_num_progeny + 1, sizeof (const char *));
+					match_p -> pm_parent_genotypes_ss = (const char **) AllocMemoryArray (2 * num_terms, sizeof (const char *));
+
+					if ((match_p -> pm_accessions_ss) && (match_p -> pm_parent_genotypes_ss))
+						{
+							const char *accession_s;
+							json_t *index_p;
+
+							json_object_foreach (match_p -> pm_accession_indexes_p, accession_s, index_p)
+								{
+									match_p -> pm_accessions_ss [json_integer_value (index_p)] = accession_s;
+								}
+
+							for (i = 0; i < num_terms; ++ i)
+								{
+									const json_t *genotypes_p = json_object_get (match_p -> pm_parents_p, pattern_p -> gp_terms_p [i].pt_marker_s);
+									const char **parent_a_ss = match_p -> pm_parent_genotypes_ss + (2 * i);
+									const char **parent_b_ss = parent_a_ss + 1;
+
+									*parent_a_ss = json_string_value (json_array_get (genotypes_p, 0));
+									*parent_b_ss = json_string_value (json_array_get (genotypes_p, 1));
+
+									ResolveParentGenotypes (parent_a_ss, parent_b_ss);
+								}
+
+							success_flag = true;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get parent genotypes and progeny for \"%s\"", population_s);
+				}
+
+			FreeMemory (markers_p);
+		}		/* if (markers_p) */
+
+	return success_flag;
+}
+
+
+static void ClearPopulationMatch (PopulationMatch *match_p)
+{
+	if (match_p -> pm_parents_p)
+		{
+			json_decref (match_p -> pm_parents_p);
+		}
+
+	if (match_p -> pm_accession_indexes_p)
+		{
+			json_decref (match_p -> pm_accession_indexes_p);
+		}
+
+	if (match_p -> pm_parent_genotypes_ss)
+		{
+			FreeMemory (match_p -> pm_parent_genotypes_ss);
+		}
+
+	if (match_p -> pm_accessions_ss)
+		{
+			FreeMemory (match_p -> pm_accessions_ss);
+		}
+
+	if (match_p -> pm_matches_p)
+		{
+			FreeMemory (match_p -> pm_matches_p);
+		}
+
+	memset (match_p, 0, sizeof (PopulationMatch));
+}
+
+
+static bool MatchPopulations (const GenotypePattern *pattern_p, PopulationMatch *matches_p, const uint32 num_populations, const uint32 max_threads, SearchDeadline *deadline_p)
+{
+	bool success_flag = true;
+	uint32 num_threads = num_populations / S_MIN_POPULATIONS_PER_THREAD;
+
+	if (num_threads > max_threads)
+		{
+			num_threads = max_threads;
+		}
+
+	if (num_threads <= 1)
+		{
+			uint32 i;
+
+			for (i = 0; (i < num_populations) && success_flag; ++ i)
+				{
+					if (HasSearchDeadlinePassed (deadline_p))
+						{
+							success_flag = false;
+						}
+					else
+						{
+							MatchPopulation (pattern_p, matches_p + i);
+						}
+				}
+		}
+	else
+		{
+			PatternWorker *workers_p = (PatternWorker *) AllocMemoryArray (num_threads, sizeof (PatternWorker));
+
+			success_flag = false;
+
+			if (workers_p)
+				{
+					uint32 i;
+
+					/*
+					 * The populations are sorted by name so interleave them to
+					 * spread any runs of large ones between the threads
+					 */
+					for (i = 0; i < num_threads; ++ i)
+						{
+							PatternWorker *worker_p = workers_p + i;
+
+							worker_p -> pw_pattern_p = pattern_p;
+							worker_p -> pw_matches_p = matches_p;
+							worker_p -> pw_num_populations = num_populations;
+							worker_p -> pw_first_population = i;
+							worker_p -> pw_stride = num_threads;
+							worker_p -> pw_deadline = *deadline_p;
+
+							worker_p -> pw_started_flag = (pthread_create (& (worker_p -> pw_thread), NULL, RunPatternWorker, worker_p) == 0);
+
+							if (! (worker_p -> pw_started_flag))
+								{
+									/*
+									 * Do this worker's populations on this thread instead
+									 */
+									RunPatternWorker (worker_p);
+								}
+						}
+
+					success_flag = true;
+
+					for (i = 0; i < num_threads; ++ i)
+						{
+							if (workers_p [i].pw_started_flag)
+								{
+									pthread_join (workers_p [i].pw_thread, NULL);
+								}
+
+							if (workers_p [i].pw_deadline.sd_expired_flag)
+								{
+									success_flag = false;
+								}
+						}
+
+					FreeMemory (workers_p);
+				}		/* if (workers_p) */
+
+			if (!success_flag)
+				{
+					HasSearchDeadlinePassed (deadline_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static void *RunPatternWorker (void *data_p)
+{
+	PatternWorker *worker_p = (PatternWorker *) data_p;
+	uint32 i;
+
+	for (i = worker_p -> pw_first_population; i < worker_p -> pw_num_populations; i += worker_p -> pw_stride)
+		{
+			if (HasSearchDeadlinePassed (& (worker_p -> pw_deadline)))
+				{
+					break;
+				}
+
+			MatchPopulation (worker_p -> pw_pattern_p, worker_p -> pw_matches_p + i);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * This only reads from the population and its parents' genotypes
+ * so the populations can be matched in parallel without locking.
+ */
+static void MatchPopulation (const GenotypePattern *pattern_p, PopulationMatch *match_p)
+{
+	const uint32 num_words = (match_p -> pm_num_progeny + 63) / 64;
+	uint64 *term_bits_p = (uint64 *) AllocMemoryArray (num_words + 1, sizeof (uint64));
+
+	if (term_bits_p)
+		{
+			if ((match_p -> pm_matches_p = (uint64 *) AllocMemoryArray (num_words + 1, sizeof (uint64))) != NULL)
+				{
+					const PatternTerm *term_p = pattern_p -> gp_terms_p;
+					const char **parent_genotypes_ss = match_p -> pm_parent_genotypes_ss;
+					uint64 remaining = 1;
+					uint32 i;
+					uint32 k;
+
+					SetTermBits (term_p, json_object_get (match_p -> pm_population_p, term_p -> pt_marker_s), *parent_genotypes_ss, * (parent_genotypes_ss + 1), match_p, match_p -> pm_matches_p);
+
+					/*
+					 * Stop as soon as no lines are left since nothing
+					 * further can match
+					 */
+					for (i = 1, ++ term_p, parent_genotypes_ss += 2; (i < pattern_p -> gp_num_terms) && (remaining != 0); ++ i, ++ term_p, parent_genotypes_ss += 2)
+						{
+							SetTermBits (term_p, json_object_get (match_p -> pm_population_p, term_p -> pt_marker_s), *parent_genotypes_ss, * (parent_genotypes_ss + 1), match_p, term_bits_p);
+							remaining = AndBitsets (match_p -> pm_matches_p, term_bits_p, num_words);
+						}
+
+					for (k = 0; k < num_words; ++ k)
+						{
+							match_p -> pm_num_matches += (uint32) __builtin_popcountll (match_p -> pm_matches_p [k]);
+						}
+
+					match_p -> pm_matched_flag = true;
+				}
+
+			FreeMemory (term_bits_p);
+		}
+}
+
+
+static void SetTermBits (const PatternTerm *term_p, const json_t *marker_p, const char *parent_a_s, const char *parent_b_s, const PopulationMatch *match_p, uint64 *bits_p)
+{
+	uint32 j;
+
+	memset (bits_p, 0, ((match_p -> pm_num_progeny + 63) / 64) * sizeof (uint64));
+
+	for (j = 0; j < match_p -> pm_num_progeny; ++ j)
+		{
+			const char *genotype_s = GetJSONString (marker_p, match_p -> pm_accessions_ss [j]);
+			bool match_flag;
+
+			if (term_p -> pt_class == GC_NUM_CLASSES)
+				{
+					match_flag = (genotype_s != NULL) && (strcmp (genotype_s, term_p -> pt_genotype_s) == 0);
+				}
+			else
+				{
+					match_flag = (GetGenotypeClass (genotype_s, parent_a_s, parent_b_s) == term_p -> pt_class);
+				}
+
+			if (match_flag)
+				{
+					bits_p [j >> 6] |= ((uint64) 1) << (j & 63);
+				}
+		}
+}
+
+
+/*
+ * A plain loop over whole words so that the compiler can vectorise it.
+ * The return value is non-zero if any bits are still set.
+ */
+static uint64 AndBitsets (uint64 *dest_p, const uint64 *src_p, const uint32 num_words)
+{
+	uint64 remaining = 0;
+	uint32 k;
+
+	for (k = 0; k < num_words; ++ k)
+		{
+			dest_p [k] &= src_p [k];
+			remaining |= dest_p [k];
+		}
+
+	return remaining;
+}
+
+
+static json_t *GetPopulationMatchAsJSON (const PopulationMatch *match_p)
+{
+	json_t *result_p = json_object ();
+
+	if (result_p)
+		{
+			const json_t *population_p = match_p -> pm_population_p;
+			const char *parent_a_s = GetJSONString (population_p, PGS_PARENT_A_S);
+			const char *parent_b_s = GetJSONString (population_p, PGS_PARENT_B_S);
+
+			if ((SetJSONString (result_p, PGS_POPULATION_NAME_S, GetJSONString (population_p, PGS_POPULATION_NAME_S))) &&
+					((parent_a_s == NULL) || (SetJSONString (result_p, PGS_PARENT_A_S, parent_a_s))) &&
+					((parent_b_s == NULL) || (SetJSONString (result_p, PGS_PARENT_B_S, parent_b_s))) &&
+					(SetJSONInteger (result_p, S_NUM_PROGENY_S, match_p -> pm_num_progeny)) &&
+					(SetJSONInteger (result_p, S_NUM_MATCHES_S, match_p -> pm_num_matches)))
+				{
+					json_t *progeny_p = json_array ();
+
+					if (progeny_p)
+						{
+							if (json_object_set_new (result_p, S_PROGENY_S, progeny_p) == 0)
+								{
+									bool success_flag = true;
+									uint32 j;
+
+									for (j = 0; (j < match_p -> pm_num_progeny) && success_flag; ++ j)
+										{
+											if (match_p -> pm_matches_p [j >> 6] & (((uint64) 1) << (j & 63)))
+												{
+													success_flag = (json_array_append_new (progeny_p, json_string (match_p -> pm_accessions_ss [j])) == 0);
+												}
+										}
+
+									if (success_flag)
+										{
+											return result_p;
+										}
+								}
+							else
+								{
+									json_decref (progeny_p);
+								}
+						}
+				}
+
+			json_decref (result_p);
+		}		/* if (result_p) */
+
+	return NULL;
+}
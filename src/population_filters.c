@@ -0,0 +1,726 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * population_filters.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "population_filters.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * A Bloom filter over the escaped marker names of a single population.
+ */
+typedef struct PopulationFilter
+{
+	bson_oid_t pf_id;
+
+	uint64 *pf_bits_p;
+
+	uint32 pf_num_bits;
+
+	/*
+	 * The population's revision when the filter was built, or
+	 * -1 if it may have been changed by another process since.
+	 */
+	int64 pf_revision;
+} PopulationFilter;
+
+
+/*
+ * The filters are kept sorted by population id so that they
+ * can be found with a binary search.
+ */
+typedef struct PopulationFilters
+{
+	PopulationFilter *pfs_filters_p;
+
+	uint32 pfs_num_filters;
+
+	uint32 pfs_capacity;
+
+	uint32 pfs_num_refs;
+
+	bool pfs_loaded_flag;
+} PopulationFilters;
+
+
+/*
+ * 10 bits and 7 hashes per marker gives a false positive
+ * rate of just under 1%.
+ */
+static const uint32 S_BITS_PER_MARKER = 10;
+
+static const uint32 S_NUM_HASHES = 7;
+
+static const uint32 S_MIN_NUM_BITS = 64;
+
+static const char * const S_MARKERS_S = "markers";
+
+
+static PopulationFilters s_filters = { NULL, 0, 0, 0, false };
+
+static pthread_rwlock_t s_filters_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+
+
+static bool AddBSONPopulationToFilters (const bson_t *doc_p, void *data_p);
+
+static PopulationFilter *AddPopulationFilter (PopulationFilters *filters_p, const bson_oid_t *id_p, const uint32 num_markers, const int64 revision, const bool sorted_flag);
+
+static PopulationFilter *FindPopulationFilter (const PopulationFilters *filters_p, const bson_oid_t *id_p);
+
+static void AddMarkerToPopulationFilter (PopulationFilter *filter_p, const char *escaped_marker_s);
+
+static bool DoesPopulationFilterHaveMarker (const PopulationFilter *filter_p, const char *escaped_marker_s);
+
+static bool CanPopulationFilterExcludeMarker (const PopulationFilter *filter_p, const char *escaped_marker_s);
+
+static bool AppendUnchangedPopulationToArray (bson_t *array_p, const uint32 index, const PopulationFilter *filter_p);
+
+static uint64 GetMarkerHash (const char *escaped_marker_s);
+
+static void ClearPopulationFilters (PopulationFilters *filters_p);
+
+static int ComparePopulationFilters (const void *v0_p, const void *v1_p);
+
+
+
+bool LoadPopulationFilters (ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	pthread_rwlock_wrlock (&s_filters_lock);
+
+	if (s_filters.pfs_loaded_flag)
+		{
+			success_flag = true;
+		}
+	else
+		{
+			char *blocks_only_path_s = ConcatenateStrings ("$", PGS_HAPLOTYPE_BLOCKS_ONLY_S);
+			char *markers_path_s = ConcatenateStrings ("$", PGS_MARKERS_S);
+
+			if (blocks_only_path_s && markers_path_s && (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)))
+				{
+					/*
+					 * Only the marker names are needed, not their calls, so get the
+					 * server to reduce each population to the keys of its child objects,
+					 * or to its list of markers if it is only stored as haplotype blocks
+					 */
+					bson_t *pipeline_p = BCON_NEW ("pipeline", "[",
+																					"{", "$project", "{",
+																						MONGO_ID_S, BCON_INT32 (1),
+																						PGS_REVISION_S, BCON_INT32 (1),
+																						S_MARKERS_S, "{", "$cond", "[",
+																							"{", "$eq", "[", BCON_UTF8 (blocks_only_path_s), BCON_BOOL (true), "]", "}",
+																							BCON_UTF8 (markers_path_s),
+																							"{", "$map", "{",
+																								"input", "{", "$filter", "{",
+																									"input", "{", "$objectToArray", BCON_UTF8 ("$$ROOT"), "}",
+																									"as", BCON_UTF8 ("field"),
+																									"cond", "{", "$eq", "[", "{", "$type", BCON_UTF8 ("$$field.v"), "}", BCON_UTF8 ("object"), "]", "}",
+																								"}", "}",
+																								"as", BCON_UTF8 ("marker"),
+																								"in", BCON_UTF8 ("$$marker.k"),
+																							"}", "}",
+																						"]", "}",
+																					"}", "}",
+																				"]");
+
+					if (pipeline_p)
+						{
+							mongoc_cursor_t *cursor_p = mongoc_collection_aggregate (data_p -> pgsd_mongo_p -> mt_collection_p, MONGOC_QUERY_NONE, pipeline_p, NULL, NULL);
+
+							if (cursor_p)
+								{
+									const bson_t *doc_p;
+									bson_error_t error;
+
+									success_flag = true;
+
+									while (success_flag && (mongoc_cursor_next (cursor_p, &doc_p)))
+										{
+											success_flag = AddBSONPopulationToFilters (doc_p, &s_filters);
+										}
+
+									if (mongoc_cursor_error (cursor_p, &error))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read populations from \"%s\": %s", data_p -> pgsd_populations_collection_s, error.message);
+											success_flag = false;
+										}
+
+									mongoc_cursor_destroy (cursor_p);
+								}		/* if (cursor_p) */
+
+							if (success_flag)
+								{
+									/*
+									 * The filters were added in the order that they were
+									 * read so sort them once now they are all in.
+									 */
+									if (s_filters.pfs_num_filters > 1)
+										{
+											qsort (s_filters.pfs_filters_p, s_filters.pfs_num_filters, sizeof (PopulationFilter), ComparePopulationFilters);
+										}
+
+									PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Loaded marker filters for " UINT32_FMT " populations", s_filters.pfs_num_filters);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load population filters from \"%s\"", data_p -> pgsd_populations_collection_s);
+								}
+
+							bson_destroy (pipeline_p);
+						}		/* if (pipeline_p) */
+
+				}		/* if (blocks_only_path_s && markers_path_s && (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))) */
+
+			if (markers_path_s)
+				{
+					FreeCopiedString (markers_path_s);
+				}
+
+			if (blocks_only_path_s)
+				{
+					FreeCopiedString (blocks_only_path_s);
+				}
+
+			if (success_flag)
+				{
+					s_filters.pfs_loaded_flag = true;
+				}
+			else
+				{
+					ClearPopulationFilters (&s_filters);
+				}
+		}
+
+	if (success_flag)
+		{
+			++ (s_filters.pfs_num_refs);
+		}
+
+	pthread_rwlock_unlock (&s_filters_lock);
+
+	return success_flag;
+}
+
+
+void ReleasePopulationFilters (void)
+{
+	pthread_rwlock_wrlock (&s_filters_lock);
+
+	if (s_filters.pfs_num_refs > 0)
+		{
+			-- (s_filters.pfs_num_refs);
+
+			if (s_filters.pfs_num_refs == 0)
+				{
+					ClearPopulationFilters (&s_filters);
+				}
+		}
+
+	pthread_rwlock_unlock (&s_filters_lock);
+}
+
+
+bool AddPopulationToFilters (const bson_oid_t *id_p, const json_t *doc_p, const int64 revision)
+{
+	bool success_flag = true;
+
+	pthread_rwlock_wrlock (&s_filters_lock);
+
+	if (s_filters.pfs_loaded_flag)
+		{
+			PopulationFilter *filter_p = FindPopulationFilter (&s_filters, id_p);
+
+			if (filter_p)
+				{
+					/*
+					 * When appending to an existing population, the new markers go
+					 * into its current filter. This raises its false positive rate
+					 * but never causes a population to be skipped wrongly. If another
+					 * process has also changed the population since the filter was
+					 * built, its markers are missing so the filter can no longer
+					 * be used to skip the population.
+					 */
+					if ((filter_p -> pf_revision >= 0) && (revision == filter_p -> pf_revision + 1))
+						{
+							filter_p -> pf_revision = revision;
+						}
+					else
+						{
+							filter_p -> pf_revision = -1;
+						}
+				}
+			else
+				{
+					uint32 num_markers = 0;
+					const char *key_s;
+					json_t *value_p;
+
+					json_object_foreach ((json_t *) doc_p, key_s, value_p)
+						{
+							if (IsMarkerEntry (key_s, value_p))
+								{
+									++ num_markers;
+								}
+						}
+
+					filter_p = AddPopulationFilter (&s_filters, id_p, num_markers, revision, true);
+				}
+
+			if (filter_p)
+				{
+					const char *key_s;
+					json_t *value_p;
+
+					json_object_foreach ((json_t *) doc_p, key_s, value_p)
+						{
+							if (IsMarkerEntry (key_s, value_p))
+								{
+									AddMarkerToPopulationFilter (filter_p, key_s);
+								}
+						}
+				}
+			else
+				{
+					char id_s [25];
+
+					bson_oid_to_string (id_p, id_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add marker filter for population \"%s\"", id_s);
+
+					success_flag = false;
+				}
+		}
+
+	pthread_rwlock_unlock (&s_filters_lock);
+
+	return success_flag;
+}
+
+
+int32 AddPopulationFilterToQuery (bson_t *query_p, const bson_oid_t *id_p, const char *escaped_marker_s)
+{
+	int32 num_excluded = 0;
+
+	pthread_rwlock_rdlock (&s_filters_lock);
+
+	if (s_filters.pfs_loaded_flag)
+		{
+			const PopulationFilter *filter_p = FindPopulationFilter (&s_filters, id_p);
+
+			if ((filter_p) && (CanPopulationFilterExcludeMarker (filter_p, escaped_marker_s)))
+				{
+					bson_t populations;
+
+					num_excluded = -1;
+
+					if (BSON_APPEND_ARRAY_BEGIN (query_p, "$nor", &populations))
+						{
+							const bool appended_flag = AppendUnchangedPopulationToArray (&populations, 0, filter_p);
+
+							if ((bson_append_array_end (query_p, &populations)) && appended_flag)
+								{
+									num_excluded = 1;
+								}
+						}
+				}
+		}
+
+	pthread_rwlock_unlock (&s_filters_lock);
+
+	return num_excluded;
+}
+
+
+int32 AddPopulationFiltersToQuery (bson_t *query_p, const char *escaped_marker_s)
+{
+	int32 num_excluded = 0;
+
+	pthread_rwlock_rdlock (&s_filters_lock);
+
+	if (s_filters.pfs_loaded_flag)
+		{
+			uint32 i;
+			uint32 num_lacking = 0;
+
+			for (i = 0; i < s_filters.pfs_num_filters; ++ i)
+				{
+					if (CanPopulationFilterExcludeMarker (s_filters.pfs_filters_p + i, escaped_marker_s))
+						{
+							++ num_lacking;
+						}
+				}
+
+			if (num_lacking > 0)
+				{
+					bson_t populations;
+
+					num_excluded = -1;
+
+					if (BSON_APPEND_ARRAY_BEGIN (query_p, "$nor", &populations))
+						{
+							uint32 j = 0;
+							bool success_flag = true;
+
+							for (i = 0; (i < s_filters.pfs_num_filters) && success_flag; ++ i)
+								{
+									const PopulationFilter *filter_p = s_filters.pfs_filters_p + i;
+
+									if (CanPopulationFilterExcludeMarker (filter_p, escaped_marker_s))
+										{
+											success_flag = AppendUnchangedPopulationToArray (&populations, j, filter_p);
+											++ j;
+										}
+								}
+
+							if ((bson_append_array_end (query_p, &populations)) && success_flag)
+								{
+									num_excluded = (int32) num_lacking;
+								}
+						}
+
+					if (num_excluded == -1)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to exclude " UINT32_FMT " populations without \"%s\" from query", num_lacking, escaped_marker_s);
+						}
+				}
+
+		}		/* if (s_filters.pfs_loaded_flag) */
+
+	pthread_rwlock_unlock (&s_filters_lock);
+
+	return num_excluded;
+}
+
+
+/*
+ * Each document that the server returns from the aggregation in
+ * LoadPopulationFilters () has the population's id, its revision if
+ * it has ever been appended to, and an array of its marker names.
+ */
+static bool AddBSONPopulationToFilters (const bson_t *doc_p, void *data_p)
+{
+	PopulationFilters *filters_p = (PopulationFilters *) data_p;
+	bool success_flag = true;
+	bson_iter_t iter;
+
+	if (bson_iter_init (&iter, doc_p))
+		{
+			const bson_oid_t *id_p = NULL;
+			int64 revision = 0;
+			bson_iter_t markers_iter;
+			bool markers_flag = false;
+			uint32 num_markers = 0;
+
+			while (bson_iter_next (&iter))
+				{
+					const char *key_s = bson_iter_key (&iter);
+
+					if ((BSON_ITER_HOLDS_ARRAY (&iter)) && (strcmp (key_s, S_MARKERS_S) == 0))
+						{
+							markers_flag = bson_iter_recurse (&iter, &markers_iter);
+						}
+					else if ((BSON_ITER_HOLDS_OID (&iter)) && (strcmp (key_s, MONGO_ID_S) == 0))
+						{
+							id_p = bson_iter_oid (&iter);
+						}
+					else if (((BSON_ITER_HOLDS_INT32 (&iter)) || (BSON_ITER_HOLDS_INT64 (&iter))) && (strcmp (key_s, PGS_REVISION_S) == 0))
+						{
+							revision = bson_iter_as_int64 (&iter);
+						}
+				}
+
+			if (id_p && markers_flag)
+				{
+					bson_iter_t count_iter = markers_iter;
+					PopulationFilter *filter_p;
+
+					while (bson_iter_next (&count_iter))
+						{
+							++ num_markers;
+						}
+
+					filter_p = AddPopulationFilter (filters_p, id_p, num_markers, revision, false);
+
+					if (filter_p)
+						{
+							while (bson_iter_next (&markers_iter))
+								{
+									if (BSON_ITER_HOLDS_UTF8 (&markers_iter))
+										{
+											AddMarkerToPopulationFilter (filter_p, bson_iter_utf8 (&markers_iter, NULL));
+										}
+								}
+						}
+					else
+						{
+							success_flag = false;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Add an empty filter sized for the given number of markers. If sorted_flag
+ * is true, it is inserted in id order, otherwise it is appended and the
+ * caller is responsible for sorting the filters afterwards.
+ */
+static PopulationFilter *AddPopulationFilter (PopulationFilters *filters_p, const bson_oid_t *id_p, const uint32 num_markers, const int64 revision, const bool sorted_flag)
+{
+	uint32 num_bits = num_markers * S_BITS_PER_MARKER;
+	uint64 *bits_p = NULL;
+
+	if (num_bits < S_MIN_NUM_BITS)
+		{
+			num_bits = S_MIN_NUM_BITS;
+		}
+	else
+		{
+			num_bits = (num_bits + 63) & ~63U;
+		}
+
+	bits_p = (uint64 *) AllocMemoryArray (num_bits / 64, sizeof (uint64));
+
+	if (bits_p)
+		{
+			if (filters_p -> pfs_num_filters == filters_p -> pfs_capacity)
+				{
+					const uint32 new_capacity = (filters_p -> pfs_capacity > 0) ? (filters_p -> pfs_capacity * 2) : 64;
+					PopulationFilter *new_filters_p = (PopulationFilter *) AllocMemoryArray (new_capacity, sizeof (PopulationFilter));
+
+					if (new_filters_p)
+						{
+							if (filters_p -> pfs_filters_p)
+								{
+									memcpy (new_filters_p, filters_p -> pfs_filters_p, (filters_p -> pfs_num_filters) * sizeof (PopulationFilter));
+									FreeMemory (filters_p -> pfs_filters_p);
+								}
+
+							filters_p -> pfs_filters_p = new_filters_p;
+							filters_p -> pfs_capacity = new_capacity;
+						}
+				}
+
+			if (filters_p -> pfs_num_filters < filters_p -> pfs_capacity)
+				{
+					uint32 i = filters_p -> pfs_num_filters;
+					PopulationFilter *filter_p;
+
+					if (sorted_flag)
+						{
+							while ((i > 0) && (bson_oid_compare (& (filters_p -> pfs_filters_p [i - 1].pf_id), id_p) > 0))
+								{
+									-- i;
+								}
+
+							memmove (filters_p -> pfs_filters_p + i + 1, filters_p -> pfs_filters_p + i, (filters_p -> pfs_num_filters - i) * sizeof (PopulationFilter));
+						}
+
+					filter_p = filters_p -> pfs_filters_p + i;
+					bson_oid_copy (id_p, & (filter_p -> pf_id));
+					filter_p -> pf_bits_p = bits_p;
+					filter_p -> pf_num_bits = num_bits;
+					filter_p -> pf_revision = revision;
+
+					++ (filters_p -> pfs_num_filters);
+
+					return filter_p;
+				}
+
+			FreeMemory (bits_p);
+		}
+
+	return NULL;
+}
+
+
+static PopulationFilter *FindPopulationFilter (const PopulationFilters *filters_p, const bson_oid_t *id_p)
+{
+	if (filters_p -> pfs_num_filters > 0)
+		{
+			PopulationFilter key;
+
+			bson_oid_copy (id_p, & (key.pf_id));
+
+			return (PopulationFilter *) bsearch (&key, filters_p -> pfs_filters_p, filters_p -> pfs_num_filters, sizeof (PopulationFilter), ComparePopulationFilters);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * The bit positions come from double hashing with the two halves
+ * of a single 64-bit hash, so each marker is only hashed once.
+ */
+static void AddMarkerToPopulationFilter (PopulationFilter *filter_p, const char *escaped_marker_s)
+{
+	const uint64 hash = GetMarkerHash (escaped_marker_s);
+	const uint32 h1 = (uint32) hash;
+	const uint32 h2 = ((uint32) (hash >> 32)) | 1;
+	uint32 i;
+
+	for (i = 0; i < S_NUM_HASHES; ++ i)
+		{
+			const uint32 bit = (h1 + i * h2) % (filter_p -> pf_num_bits);
+
+			filter_p -> pf_bits_p [bit >> 6] |= ((uint64) 1) << (bit & 63);
+		}
+}
+
+
+static bool DoesPopulationFilterHaveMarker (const PopulationFilter *filter_p, const char *escaped_marker_s)
+{
+	const uint64 hash = GetMarkerHash (escaped_marker_s);
+	const uint32 h1 = (uint32) hash;
+	const uint32 h2 = ((uint32) (hash >> 32)) | 1;
+	uint32 i;
+
+	for (i = 0; i < S_NUM_HASHES; ++ i)
+		{
+			const uint32 bit = (h1 + i * h2) % (filter_p -> pf_num_bits);
+
+			if ((filter_p -> pf_bits_p [bit >> 6] & (((uint64) 1) << (bit & 63))) == 0)
+				{
+					return false;
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * A filter can only rule out a marker if no other process has changed
+ * the population since the filter was built.
+ */
+static bool CanPopulationFilterExcludeMarker (const PopulationFilter *filter_p, const char *escaped_marker_s)
+{
+	return ((filter_p -> pf_revision >= 0) && (!DoesPopulationFilterHaveMarker (filter_p, escaped_marker_s)));
+}
+
+
+/*
+ * Add a clause that matches the population only while it is still at the
+ * revision that its filter was built from. Populations that have never
+ * been appended to don't have a revision.
+ */
+static bool AppendUnchangedPopulationToArray (bson_t *array_p, const uint32 index, const PopulationFilter *filter_p)
+{
+	bool success_flag = false;
+	char key_s [16];
+	bson_t population;
+
+	sprintf (key_s, UINT32_FMT, index);
+
+	if (BSON_APPEND_DOCUMENT_BEGIN (array_p, key_s, &population))
+		{
+			if (BSON_APPEND_OID (&population, MONGO_ID_S, & (filter_p -> pf_id)))
+				{
+					if (filter_p -> pf_revision > 0)
+						{
+							success_flag = BSON_APPEND_INT64 (&population, PGS_REVISION_S, filter_p -> pf_revision);
+						}
+					else
+						{
+							bson_t exists;
+
+							if (BSON_APPEND_DOCUMENT_BEGIN (&population, PGS_REVISION_S, &exists))
+								{
+									success_flag = BSON_APPEND_BOOL (&exists, "$exists", false);
+
+									if (!bson_append_document_end (&population, &exists))
+										{
+											success_flag = false;
+										}
+								}
+						}
+				}
+
+			if (!bson_append_document_end (array_p, &population))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * 64-bit FNV-1a
+ */
+static uint64 GetMarkerHash (const char *escaped_marker_s)
+{
+	uint64 hash = 14695981039346656037ULL;
+	const unsigned char *c_p = (const unsigned char *) escaped_marker_s;
+
+	while (*c_p != '\0')
+		{
+			hash ^= *c_p;
+			hash *= 1099511628211ULL;
+			++ c_p;
+		}
+
+	return hash;
+}
+
+
+static void ClearPopulationFilters (PopulationFilters *filters_p)
+{
+	if (filters_p -> pfs_filters_p)
+		{
+			uint32 i;
+
+			for (i = 0; i < filters_p -> pfs_num_filters; ++ i)
+				{
+					FreeMemory (filters_p -> pfs_filters_p [i].pf_bits_p);
+				}
+
+			FreeMemory (filters_p -> pfs_filters_p);
+		}
+
+	filters_p -> pfs_filters_p = NULL;
+	filters_p -> pfs_num_filters = 0;
+	filters_p -> pfs_capacity = 0;
+	filters_p -> pfs_loaded_flag = false;
+}
+
+
+static int ComparePopulationFilters (const void *v0_p, const void *v1_p)
+{
+	const PopulationFilter *f0_p = (const PopulationFilter *) v0_p;
+	const PopulationFilter *f1_p = (const PopulationFilter *) v1_p;
+
+	return bson_oid_compare (& (f0_p -> pf_id), & (f1_p -> pf_id));
+}
@@ -0,0 +1,479 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * population_summaries.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "population_summaries.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+static const char * const S_NUM_MARKERS_S = "markers";
+
+static const char * const S_NUM_PROGENY_S = "progeny";
+
+static const char * const S_CHROMOSOMES_S = "chromosomes";
+
+static const char * const S_NUM_BYTES_S = "bytes";
+
+
+static bool AddMarkerToSummary (const bson_iter_t *marker_iter_p, json_t *progeny_p, json_t *chromosomes_p);
+
+static bool AddChromosomesToSummary (bson_t *summary_p, const json_t *chromosomes_p);
+
+static bool WritePopulationSummary (const bson_oid_t *id_p, const bson_t *summary_p, ParentalGenotypeServiceData *data_p);
+
+static bool CopyBSONDocument (const bson_t *doc_p, void *data_p);
+
+static bool AddPopulationId (const bson_t *doc_p, void *data_p);
+
+static bool AddPopulationId (const bson_t *doc_p, void *data_p)
+{
+	json_t *ids_p = (json_t *) data_p;
+	bson_iter_t iter;
+
+	if ((bson_iter_init_find (&iter, doc_p, MONGO_ID_S)) && (BSON_ITER_HOLDS_OID (&iter)))
+		{
+			return AddCompoundIdToJSONArray (ids_p, bson_iter_oid (&iter));
+		}
+
+	return true;
+}
+
+
+static int CompareStrings (const void *v0_p, const void *v1_p);
+
+
+
+bool SavePopulationSummary (const bson_t *population_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *progeny_p = json_object ();
+
+	if (progeny_p)
+		{
+			json_t *chromosomes_p = json_object ();
+
+			if (chromosomes_p)
+				{
+					bson_iter_t iter;
+
+					if (bson_iter_init (&iter, population_p))
+						{
+							const bson_oid_t *id_p = NULL;
+							const char *name_s = NULL;
+							const char *parent_a_s = NULL;
+							const char *parent_b_s = NULL;
+							int64 num_markers = 0;
+
+							success_flag = true;
+
+							while (success_flag && bson_iter_next (&iter))
+								{
+									const char *key_s = bson_iter_key (&iter);
+
+									if (BSON_ITER_HOLDS_DOCUMENT (&iter))
+										{
+											++ num_markers;
+											success_flag = AddMarkerToSummary (&iter, progeny_p, chromosomes_p);
+										}
+									else if ((BSON_ITER_HOLDS_OID (&iter)) && (strcmp (key_s, MONGO_ID_S) == 0))
+										{
+											id_p = bson_iter_oid (&iter);
+										}
+									else if (BSON_ITER_HOLDS_UTF8 (&iter))
+										{
+											if (strcmp (key_s, PGS_POPULATION_NAME_S) == 0)
+												{
+													name_s = bson_iter_utf8 (&iter, NULL);
+												}
+											else if (strcmp (key_s, PGS_PARENT_A_S) == 0)
+												{
+													parent_a_s = bson_iter_utf8 (&iter, NULL);
+												}
+											else if (strcmp (key_s, PGS_PARENT_B_S) == 0)
+												{
+													parent_b_s = bson_iter_utf8 (&iter, NULL);
+												}
+										}
+								}
+
+							if (success_flag && id_p && name_s)
+								{
+									bson_t *summary_p = bson_new ();
+
+									success_flag = false;
+
+									if (summary_p)
+										{
+											if ((BSON_APPEND_OID (summary_p, MONGO_ID_S, id_p)) &&
+													(BSON_APPEND_UTF8 (summary_p, PGS_POPULATION_NAME_S, name_s)) &&
+													((parent_a_s == NULL) || (BSON_APPEND_UTF8 (summary_p, PGS_PARENT_A_S, parent_a_s))) &&
+													((parent_b_s == NULL) || (BSON_APPEND_UTF8 (summary_p, PGS_PARENT_B_S, parent_b_s))) &&
+													(BSON_APPEND_INT64 (summary_p, S_NUM_MARKERS_S, num_markers)) &&
+													(BSON_APPEND_INT64 (summary_p, S_NUM_PROGENY_S, (int64) json_object_size (progeny_p))) &&
+													(BSON_APPEND_INT64 (summary_p, S_NUM_BYTES_S, (int64) (population_p -> len))) &&
+													(AddChromosomesToSummary (summary_p, chromosomes_p)))
+												{
+													success_flag = WritePopulationSummary (id_p, summary_p, data_p);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build summary for \"%s\"", name_s);
+												}
+
+											bson_destroy (summary_p);
+										}		/* if (summary_p) */
+
+								}		/* if (success_flag && id_p && name_s) */
+							else
+								{
+									PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, population_p, "Failed to get the details for the population summary");
+									success_flag = false;
+								}
+
+						}		/* if (bson_iter_init (&iter, population_p)) */
+
+					json_decref (chromosomes_p);
+				}		/* if (chromosomes_p) */
+
+			json_decref (progeny_p);
+		}		/* if (progeny_p) */
+
+	return success_flag;
+}
+
+
+bool RefreshPopulationSummary (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+			if (query_p)
+				{
+					if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, NULL))
+						{
+							bson_t *population_p = NULL;
+
+							/*
+							 * Take a copy of the population so that the MongoTool
+							 * is free to write the summary
+							 */
+							if ((IterateOverMongoResults (data_p -> pgsd_mongo_p, CopyBSONDocument, &population_p) >= 0) && population_p)
+								{
+									success_flag = SavePopulationSummary (population_p, data_p);
+								}
+
+							if (population_p)
+								{
+									bson_destroy (population_p);
+								}
+						}
+
+					if (!success_flag)
+						{
+							PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, query_p, "Failed to refresh population summary");
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return success_flag;
+}
+
+
+bool RebuildPopulationSummaries (ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = bson_new ();
+
+			if (query_p)
+				{
+					bson_t *opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_INT32 (1), "}");
+
+					if (opts_p)
+						{
+							/*
+							 * Get all of the ids first since writing each summary
+							 * needs the MongoTool that the cursor is using
+							 */
+							if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p))
+								{
+									json_t *ids_p = json_array ();
+
+									if (ids_p)
+										{
+											if (IterateOverMongoResults (data_p -> pgsd_mongo_p, AddPopulationId, ids_p) >= 0)
+												{
+													const size_t num_ids = json_array_size (ids_p);
+													size_t num_saved = 0;
+													size_t i;
+
+													for (i = 0; i < num_ids; ++ i)
+														{
+															bson_oid_t id;
+
+															if (GetIdFromJSONKeyValuePair (json_array_get (ids_p, i), &id))
+																{
+																	if (RefreshPopulationSummary (&id, data_p))
+																		{
+																			++ num_saved;
+																		}
+																}
+														}
+
+													PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Rebuilt " SIZET_FMT " of " SIZET_FMT " population summaries", num_saved, num_ids);
+
+													success_flag = (num_saved == num_ids);
+												}
+
+											json_decref (ids_p);
+										}		/* if (ids_p) */
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return success_flag;
+}
+
+
+json_t *GetPopulationSummaries (const char *name_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_summaries_collection_s))
+		{
+			/*
+			 * Each of the clauses has an index of its own
+			 */
+			bson_t *query_p = IsStringEmpty (name_s) ? bson_new () :
+				BCON_NEW ("$or", "[",
+										"{", PGS_POPULATION_NAME_S, BCON_UTF8 (name_s), "}",
+										"{", PGS_PARENT_A_S, BCON_UTF8 (name_s), "}",
+										"{", PGS_PARENT_B_S, BCON_UTF8 (name_s), "}",
+									"]");
+
+			if (query_p)
+				{
+					bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+					if (!opts_p)
+						{
+							opts_p = bson_new ();
+						}
+
+					if (opts_p)
+						{
+							bson_t *sort_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_INT32 (1));
+
+							if (sort_p)
+								{
+									if (BSON_APPEND_DOCUMENT (opts_p, "sort", sort_p))
+										{
+											results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+										}
+
+									bson_destroy (sort_p);
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_summaries_collection_s)) */
+
+	return results_p;
+}
+
+
+/*
+ * The json objects are used as sets, only their keys matter.
+ */
+static bool AddMarkerToSummary (const bson_iter_t *marker_iter_p, json_t *progeny_p, json_t *chromosomes_p)
+{
+	bool success_flag = true;
+	bson_iter_t iter;
+
+	if (bson_iter_recurse (marker_iter_p, &iter))
+		{
+			while (success_flag && bson_iter_next (&iter))
+				{
+					const char *key_s = bson_iter_key (&iter);
+
+					if (strcmp (key_s, PGS_CHROMOSOME_S) == 0)
+						{
+							if (BSON_ITER_HOLDS_UTF8 (&iter))
+								{
+									const char *chromosome_s = bson_iter_utf8 (&iter, NULL);
+
+									if (!json_object_get (chromosomes_p, chromosome_s))
+										{
+											success_flag = (json_object_set_new (chromosomes_p, chromosome_s, json_true ()) == 0);
+										}
+								}
+						}
+					else if (!IsMarkerMetadataKey (key_s))
+						{
+							if (!json_object_get (progeny_p, key_s))
+								{
+									success_flag = (json_object_set_new (progeny_p, key_s, json_true ()) == 0);
+								}
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AddChromosomesToSummary (bson_t *summary_p, const json_t *chromosomes_p)
+{
+	bool success_flag = false;
+	const size_t num_chromosomes = json_object_size (chromosomes_p);
+	const char **chromosomes_ss = NULL;
+
+	if ((num_chromosomes == 0) || ((chromosomes_ss = (const char **) AllocMemoryArray (num_chromosomes, sizeof (const char *))) != NULL))
+		{
+			bson_t chromosomes;
+			const char *chromosome_s;
+			json_t *value_p;
+			size_t i = 0;
+
+			json_object_foreach ((json_t *) chromosomes_p, chromosome_s, value_p)
+				{
+					* (chromosomes_ss + i) = chromosome_s;
+					++ i;
+				}
+
+			if (num_chromosomes > 1)
+				{
+					qsort (chromosomes_ss, num_chromosomes, sizeof (const char *), CompareStrings);
+				}
+
+			if (BSON_APPEND_ARRAY_BEGIN (summary_p, S_CHROMOSOMES_S, &chromosomes))
+				{
+					success_flag = true;
+
+					for (i = 0; (i < num_chromosomes) && success_flag; ++ i)
+						{
+							char key_s [32];
+
+							sprintf (key_s, SIZET_FMT, i);
+							success_flag = BSON_APPEND_UTF8 (&chromosomes, key_s, * (chromosomes_ss + i));
+						}
+
+					if (!bson_append_array_end (summary_p, &chromosomes))
+						{
+							success_flag = false;
+						}
+				}
+
+			if (chromosomes_ss)
+				{
+					FreeMemory (chromosomes_ss);
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The summary replaces any that is already there so that appending
+ * to a population updates it rather than adding a second one.
+ */
+static bool WritePopulationSummary (const bson_oid_t *id_p, const bson_t *summary_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_summaries_collection_s))
+		{
+			bson_t *selector_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+			if (selector_p)
+				{
+					bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+					if (opts_p)
+						{
+							bson_error_t error;
+
+							if (mongoc_collection_replace_one (data_p -> pgsd_mongo_p -> mt_collection_p, selector_p, summary_p, opts_p, NULL, &error))
+								{
+									success_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save population summary to \"%s\": %s", data_p -> pgsd_summaries_collection_s, error.message);
+								}
+
+							bson_destroy (opts_p);
+						}
+
+					bson_destroy (selector_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool CopyBSONDocument (const bson_t *doc_p, void *data_p)
+{
+	bson_t **copy_pp = (bson_t **) data_p;
+
+	if (*copy_pp == NULL)
+		{
+			*copy_pp = bson_copy (doc_p);
+		}
+
+	return (*copy_pp != NULL);
+}
+
+
+static int CompareStrings (const void *v0_p, const void *v1_p)
+{
+	const char *s0 = * ((const char * const *) v0_p);
+	const char *s1 = * ((const char * const *) v1_p);
+
+	return strcmp (s0, s1);
+}
@@ -0,0 +1,287 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * progeny_genotypes.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <string.h>
+
+#include "progeny_genotypes.h"
+#include "parental_genotype_service.h"
+#include "job_arena.h"
+
+#include "streams.h"
+#include "string_utils.h"
+
+
+static json_t *GetGenotypesByProgeny (const json_t *doc_p);
+
+static bool AddProgenyUpdate (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *accession_s, const json_t *genotypes_p, JobArena *arena_p);
+
+
+
+bool SaveProgenyGenotypes (const bson_oid_t *id_p, const char *population_s, const json_t *doc_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+	json_t *progeny_p = GetGenotypesByProgeny (doc_p);
+
+	if (progeny_p)
+		{
+			if (json_object_size (progeny_p) == 0)
+				{
+					success_flag = true;
+				}
+			else if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s))
+				{
+					/*
+					 * Send all of the progeny in a single unordered bulk
+					 * write rather than a round trip for each of them
+					 */
+					bson_t *opts_p = BCON_NEW ("ordered", BCON_BOOL (false));
+
+					if (opts_p)
+						{
+							mongoc_bulk_operation_t *bulk_p = mongoc_collection_create_bulk_operation_with_opts (data_p -> pgsd_mongo_p -> mt_collection_p, opts_p);
+
+							if (bulk_p)
+								{
+									const char *accession_s;
+									json_t *genotypes_p;
+									JobArena arena;
+
+									InitJobArena (&arena);
+									success_flag = true;
+
+									json_object_foreach (progeny_p, accession_s, genotypes_p)
+										{
+											if (success_flag)
+												{
+													success_flag = AddProgenyUpdate (bulk_p, id_p, population_s, accession_s, genotypes_p, &arena);
+												}
+										}
+
+									ClearJobArena (&arena);
+
+									if (success_flag)
+										{
+											bson_t reply;
+											bson_error_t error;
+
+											if (mongoc_bulk_operation_execute (bulk_p, &reply, &error) == 0)
+												{
+													PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, &reply, "Failed to save progeny for \"%s\" to \"%s\": %s", population_s, data_p -> pgsd_progeny_collection_s, error.message);
+													success_flag = false;
+												}
+
+											bson_destroy (&reply);
+										}
+
+									mongoc_bulk_operation_destroy (bulk_p);
+								}		/* if (bulk_p) */
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+				}		/* else if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s)) */
+
+			json_decref (progeny_p);
+		}		/* if (progeny_p) */
+
+	return success_flag;
+}
+
+
+json_t *GetProgenyGenotypes (const char *accession_s, const char *population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (PGS_ACCESSION_S, BCON_UTF8 (accession_s));
+
+			if (query_p)
+				{
+					if ((IsStringEmpty (population_s)) || (BSON_APPEND_UTF8 (query_p, PGS_POPULATION_S, population_s)))
+						{
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+							results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+							if (opts_p)
+								{
+									bson_destroy (opts_p);
+								}
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_progeny_collection_s)) */
+
+	return results_p;
+}
+
+
+/*
+ * Turn the marker -> accession -> genotype layout of the population
+ * into accession -> marker -> genotype. The genotype values are shared
+ * with doc_p rather than copied.
+ */
+static json_t *GetGenotypesByProgeny (const json_t *doc_p)
+{
+	json_t *progeny_p = json_object ();
+
+	if (progeny_p)
+		{
+			const char *marker_s;
+			json_t *marker_p;
+			bool success_flag = true;
+
+			json_object_foreach ((json_t *) doc_p, marker_s, marker_p)
+				{
+					if (success_flag && IsMarkerEntry (marker_s, marker_p))
+						{
+							const char *key_s;
+							json_t *value_p;
+
+							json_object_foreach (marker_p, key_s, value_p)
+								{
+									if (success_flag && (json_is_string (value_p)) && (!IsMarkerMetadataKey (key_s)))
+										{
+											json_t *genotypes_p = json_object_get (progeny_p, key_s);
+
+											if (!genotypes_p)
+												{
+													genotypes_p = json_object ();
+
+													if (genotypes_p)
+														{
+															if (json_object_set_new (progeny_p, key_s, genotypes_p) != 0)
+																{
+																	json_decref (genotypes_p);
+																	genotypes_p = NULL;
+																}
+														}
+												}
+
+											if (genotypes_p)
+												{
+													success_flag = (json_object_set (genotypes_p, marker_s, value_p) == 0);
+												}
+											else
+												{
+													success_flag = false;
+												}
+										}
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					return progeny_p;
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to arrange genotypes by progeny");
+			json_decref (progeny_p);
+		}		/* if (progeny_p) */
+
+	return NULL;
+}
+
+
+/*
+ * Each marker is set individually so that appending to a population
+ * adds to a line's genotypes rather than replacing them.
+ */
+static bool AddProgenyUpdate (mongoc_bulk_operation_t *bulk_p, const bson_oid_t *id_p, const char *population_s, const char *accession_s, const json_t *genotypes_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	bson_t *selector_p = BCON_NEW (PGS_POPULATION_ID_S, BCON_OID (id_p), PGS_ACCESSION_S, BCON_UTF8 (accession_s));
+
+	if (selector_p)
+		{
+			bson_t *update_p = bson_new ();
+
+			if (update_p)
+				{
+					bson_t fields;
+
+					if (BSON_APPEND_DOCUMENT_BEGIN (update_p, "$set", &fields))
+						{
+							const char *marker_s;
+							json_t *value_p;
+
+							success_flag = BSON_APPEND_UTF8 (&fields, PGS_POPULATION_S, population_s);
+
+							json_object_foreach ((json_t *) genotypes_p, marker_s, value_p)
+								{
+									if (success_flag)
+										{
+											const char *path_s = ConcatenateVarargsStringsInJobArena (arena_p, PGS_GENOTYPES_S, ".", marker_s, NULL);
+
+											success_flag = (path_s != NULL) && (BSON_APPEND_UTF8 (&fields, path_s, json_string_value (value_p)));
+										}
+								}
+
+							/*
+							 * BSON_APPEND_UTF8 () copies the paths so they are no longer needed
+							 */
+							ResetJobArena (arena_p);
+
+							if (!bson_append_document_end (update_p, &fields))
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							bson_t *opts_p = BCON_NEW ("upsert", BCON_BOOL (true));
+
+							success_flag = false;
+
+							if (opts_p)
+								{
+									bson_error_t error;
+
+									if (mongoc_bulk_operation_update_one_with_opts (bulk_p, selector_p, update_p, opts_p, &error))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add progeny \"%s\" to bulk update: %s", accession_s, error.message);
+										}
+
+									bson_destroy (opts_p);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build update for progeny \"%s\"", accession_s);
+						}
+
+					bson_destroy (update_p);
+				}		/* if (update_p) */
+
+			bson_destroy (selector_p);
+		}		/* if (selector_p) */
+
+	return success_flag;
+}
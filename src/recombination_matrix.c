@@ -0,0 +1,583 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * recombination_matrix.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "recombination_matrix.h"
+#include "parental_genotype_service.h"
+#include "parent_genotypes.h"
+#include "genetic_map.h"
+#include "haplotype_blocks.h"
+#include "job_arena.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+typedef struct RecombinationMatrix
+{
+	uint32 rm_num_markers;
+
+	/** The number of 64-bit words in each marker's bitsets. */
+	uint32 rm_num_words;
+
+	/**
+	 * The bitsets of the progeny with parent A's genotype, rm_num_words
+	 * for each marker in turn.
+	 */
+	uint64 *rm_parent_a_p;
+
+	/** The bitsets of the progeny with parent B's genotype. */
+	uint64 *rm_parent_b_p;
+
+	/** The upper triangle of recombinant counts. */
+	uint32 *rm_recombinants_p;
+
+	/** The upper triangle of informative progeny counts. */
+	uint32 *rm_informative_p;
+} RecombinationMatrix;
+
+
+typedef struct MatrixWorker
+{
+	RecombinationMatrix *mw_matrix_p;
+
+	/** The first row for this worker, each worker takes every mw_stride-th row. */
+	uint32 mw_first_row;
+
+	uint32 mw_stride;
+
+	/**
+	 * Each worker has its own copy since checking a SearchDeadline
+	 * updates it.
+	 */
+	SearchDeadline mw_deadline;
+
+	pthread_t mw_thread;
+
+	bool mw_started_flag;
+} MatrixWorker;
+
+
+/*
+ * Below this many rows per thread, the cost of starting
+ * the threads outweighs the time that they save.
+ */
+static const uint32 S_MIN_ROWS_PER_THREAD = 128;
+
+static const char * const S_MARKERS_S = "markers";
+
+static const char * const S_MAPPING_POSITIONS_S = "mapping_positions";
+
+static const char * const S_NUM_PROGENY_S = "num_progeny";
+
+static const char * const S_RECOMBINANTS_S = "recombinants";
+
+static const char * const S_INFORMATIVE_S = "informative";
+
+
+static json_t *GetRecombinationMatrix (const json_t *population_p, const char *chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AllocateRecombinationMatrix (RecombinationMatrix *matrix_p, const uint32 num_markers, const uint32 num_progeny);
+
+static void FreeRecombinationMatrix (RecombinationMatrix *matrix_p);
+
+static void SetGenotypeBits (RecombinationMatrix *matrix_p, const MapMarker *markers_p, const json_t *accession_indexes_p, const json_t *parents_p);
+
+static bool CountRecombinants (RecombinationMatrix *matrix_p, const uint32 max_threads, SearchDeadline *deadline_p);
+
+static void *RunMatrixWorker (void *data_p);
+
+static void CountRecombinantsForRow (RecombinationMatrix *matrix_p, const uint32 row);
+
+static json_t *GetMatrixAsJSON (const RecombinationMatrix *matrix_p, const MapMarker *markers_p, const json_t *population_p, const char *chromosome_s, const uint32 num_progeny);
+
+static bool AddCountsToJSON (json_t *matrix_json_p, const char *key_s, const uint32 *counts_p, const size_t num_counts);
+
+
+
+json_t *GetRecombinationMatrices (const char *population_s, const char *chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *results_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_UTF8 (population_s));
+
+			if (query_p)
+				{
+					bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+					json_t *populations_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+					if (populations_p)
+						{
+							if ((results_p = json_array ()) != NULL)
+								{
+									const size_t num_populations = json_array_size (populations_p);
+									size_t i;
+
+									for (i = 0; (i < num_populations) && results_p; ++ i)
+										{
+											json_t *population_p = json_array_get (populations_p, i);
+											json_t *matrix_p = NULL;
+
+											/*
+											 * A population that is only stored as haplotype blocks
+											 * needs its markers decoding first
+											 */
+											if ((!IsHaplotypeBlocksOnlyPopulation (population_p)) || (AddHaplotypeBlockMarkers (population_p, NULL, data_p, deadline_p)))
+												{
+													matrix_p = GetRecombinationMatrix (population_p, chromosome_s, format, data_p, deadline_p);
+												}
+
+											if ((!matrix_p) || (json_array_append_new (results_p, matrix_p) != 0))
+												{
+													json_decref (results_p);
+													results_p = NULL;
+												}
+										}
+								}
+
+							json_decref (populations_p);
+						}		/* if (populations_p) */
+
+					if (opts_p)
+						{
+							bson_destroy (opts_p);
+						}
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return results_p;
+}
+
+
+static json_t *GetRecombinationMatrix (const json_t *population_p, const char *chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	json_t *result_p = NULL;
+	const char *population_s = GetJSONString (population_p, PGS_POPULATION_NAME_S);
+	bson_oid_t id;
+	json_t *parents_p = NULL;
+
+	if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), &id))
+		{
+			parents_p = GetParentGenotypesByMarker (&id, data_p);
+		}
+
+	if (parents_p)
+		{
+			uint32 num_markers = 0;
+			MapMarker *markers_p = GetMarkersInMapOrder (population_p, chromosome_s, false, &num_markers);
+
+			if (markers_p)
+				{
+					if (num_markers <= data_p -> pgsd_recombination_max_markers)
+						{
+							json_t *accession_indexes_p;
+
+							if ((accession_indexes_p = GetAccessionIndexes (markers_p, num_markers)) != NULL)
+								{
+									const uint32 num_progeny = (uint32) json_object_size (accession_indexes_p);
+									RecombinationMatrix matrix;
+
+									if (AllocateRecombinationMatrix (&matrix, num_markers, num_progeny))
+										{
+											SetGenotypeBits (&matrix, markers_p, accession_indexes_p, parents_p);
+
+											if (CountRecombinants (&matrix, data_p -> pgsd_recombination_threads, deadline_p))
+												{
+													result_p = GetMatrixAsJSON (&matrix, markers_p, population_p, chromosome_s, num_progeny);
+
+													if (result_p && (format == RF_COMPACT_GZIP))
+														{
+															json_t *compressed_p = GetCompressedDocument (result_p);
+
+															json_decref (result_p);
+															result_p = compressed_p;
+														}
+												}
+
+											FreeRecombinationMatrix (&matrix);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate recombination matrix for " UINT32_FMT " markers and " UINT32_FMT " progeny in \"%s\"", num_markers, num_progeny, population_s);
+										}
+
+									json_decref (accession_indexes_p);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has " UINT32_FMT " markers on \"%s\" which is more than the limit of " UINT32_FMT, population_s, num_markers, chromosome_s, data_p -> pgsd_recombination_max_markers);
+						}
+
+					FreeMemory (markers_p);
+				}		/* if (markers_p) */
+
+			json_decref (parents_p);
+		}		/* if (parents_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get parent genotypes for \"%s\"", population_s);
+		}
+
+	return result_p;
+}
+
+
+static bool AllocateRecombinationMatrix (RecombinationMatrix *matrix_p, const uint32 num_markers, const uint32 num_progeny)
+{
+	const uint32 num_words = (num_progeny + 63) / 64;
+	const size_t num_bitset_words = ((size_t) num_markers * (size_t) num_words) + 1;
+	const size_t num_pairs = ((size_t) num_markers * (size_t) (num_markers > 0 ? num_markers - 1 : 0)) / 2 + 1;
+
+	memset (matrix_p, 0, sizeof (RecombinationMatrix));
+
+	matrix_p -> rm_num_markers = num_markers;
+	matrix_p -> rm_num_words = num_words;
+
+	if (((matrix_p -> rm_parent_a_p = (uint64 *) AllocMemoryArray (num_bitset_words, sizeof (uint64))) != NULL) &&
+			((matrix_p -> rm_parent_b_p = (uint64 *) AllocMemoryArray (num_bitset_words, sizeof (uint64))) != NULL) &&
+			((matrix_p -> rm_recombinants_p = (uint32 *) AllocMemoryArray (num_pairs, sizeof (uint32))) != NULL) &&
+			((matrix_p -> rm_informative_p = (uint32 *) AllocMemoryArray (num_pairs, sizeof (uint32))) != NULL))
+		{
+			return true;
+		}
+
+	FreeRecombinationMatrix (matrix_p);
+
+	return false;
+}
+
+
+static void FreeRecombinationMatrix (RecombinationMatrix *matrix_p)
+{
+	if (matrix_p -> rm_parent_a_p)
+		{
+			FreeMemory (matrix_p -> rm_parent_a_p);
+		}
+
+	if (matrix_p -> rm_parent_b_p)
+		{
+			FreeMemory (matrix_p -> rm_parent_b_p);
+		}
+
+	if (matrix_p -> rm_recombinants_p)
+		{
+			FreeMemory (matrix_p -> rm_recombinants_p);
+		}
+
+	if (matrix_p -> rm_informative_p)
+		{
+			FreeMemory (matrix_p -> rm_informative_p);
+		}
+
+	memset (matrix_p, 0, sizeof (RecombinationMatrix));
+}
+
+
+static void SetGenotypeBits (RecombinationMatrix *matrix_p, const MapMarker *markers_p, const json_t *accession_indexes_p, const json_t *parents_p)
+{
+	uint32 i;
+
+	for (i = 0; i < matrix_p -> rm_num_markers; ++ i)
+		{
+			const json_t *parent_genotypes_p = json_object_get (parents_p, markers_p [i].mm_name_s);
+			const char *parent_a_s = json_string_value (json_array_get (parent_genotypes_p, 0));
+			const char *parent_b_s = json_string_value (json_array_get (parent_genotypes_p, 1));
+			uint64 *parent_a_bits_p = matrix_p -> rm_parent_a_p + ((size_t) i * matrix_p -> rm_num_words);
+			uint64 *parent_b_bits_p = matrix_p -> rm_parent_b_p + ((size_t) i * matrix_p -> rm_num_words);
+			const char *accession_s;
+			json_t *value_p;
+
+			ResolveParentGenotypes (&parent_a_s, &parent_b_s);
+
+			json_object_foreach ((json_t *) (markers_p [i].mm_marker_p), accession_s, value_p)
+				{
+					if ((json_is_string (value_p)) && (!IsMarkerMetadataKey (accession_s)))
+						{
+							const GenotypeClass gc = GetGenotypeClass (json_string_value (value_p), parent_a_s, parent_b_s);
+
+							if ((gc == GC_PARENT_A) || (gc == GC_PARENT_B))
+								{
+									const json_int_t index = json_integer_value (json_object_get (accession_indexes_p, accession_s));
+									const uint64 bit = 1ULL << (index & 63);
+
+									if (gc == GC_PARENT_A)
+										{
+											parent_a_bits_p [index >> 6] |= bit;
+										}
+									else
+										{
+											parent_b_bits_p [index >> 6] |= bit;
+										}
+								}
+						}
+				}
+		}
+}
+
+
+static bool CountRecombinants (RecombinationMatrix *matrix_p, const uint32 max_threads, SearchDeadline *deadline_p)
+{
+	bool success_flag = true;
+	uint32 num_threads = matrix_p -> rm_num_markers / S_MIN_ROWS_PER_THREAD;
+
+	if (num_threads > max_threads)
+		{
+			num_threads = max_threads;
+		}
+
+	if (num_threads <= 1)
+		{
+			uint32 i;
+
+			for (i = 0; (i + 1 < matrix_p -> rm_num_markers) && success_flag; ++ i)
+				{
+					if (HasSearchDeadlinePassed (deadline_p))
+						{
+							success_flag = false;
+						}
+					else
+						{
+							CountRecombinantsForRow (matrix_p, i);
+						}
+				}
+		}
+	else
+		{
+			MatrixWorker *workers_p = (MatrixWorker *) AllocMemoryArray (num_threads, sizeof (MatrixWorker));
+
+			success_flag = false;
+
+			if (workers_p)
+				{
+					uint32 i;
+
+					/*
+					 * The rows get shorter towards the bottom of the triangle so
+					 * interleave them rather than giving each thread a block
+					 */
+					for (i = 0; i < num_threads; ++ i)
+						{
+							MatrixWorker *worker_p = workers_p + i;
+
+							worker_p -> mw_matrix_p = matrix_p;
+							worker_p -> mw_first_row = i;
+							worker_p -> mw_stride = num_threads;
+							worker_p -> mw_deadline = *deadline_p;
+
+							worker_p -> mw_started_flag = (pthread_create (& (worker_p -> mw_thread), NULL, RunMatrixWorker, worker_p) == 0);
+
+							if (! (worker_p -> mw_started_flag))
+								{
+									/*
+									 * Do this worker's rows on this thread instead
+									 */
+									RunMatrixWorker (worker_p);
+								}
+						}
+
+					success_flag = true;
+
+					for (i = 0; i < num_threads; ++ i)
+						{
+							if (workers_p [i].mw_started_flag)
+								{
+									pthread_join (workers_p [i].mw_thread, NULL);
+								}
+
+							if (workers_p [i].mw_deadline.sd_expired_flag)
+								{
+									success_flag = false;
+								}
+						}
+
+					FreeMemory (workers_p);
+				}		/* if (workers_p) */
+
+			if (!success_flag)
+				{
+					HasSearchDeadlinePassed (deadline_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static void *RunMatrixWorker (void *data_p)
+{
+	MatrixWorker *worker_p = (MatrixWorker *) data_p;
+	RecombinationMatrix *matrix_p = worker_p -> mw_matrix_p;
+	uint32 i;
+
+	for (i = worker_p -> mw_first_row; i + 1 < matrix_p -> rm_num_markers; i += worker_p -> mw_stride)
+		{
+			if (HasSearchDeadlinePassed (& (worker_p -> mw_deadline)))
+				{
+					break;
+				}
+
+			CountRecombinantsForRow (matrix_p, i);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * This is the hot loop. Each row only writes to its own part of the
+ * triangles so the rows can be done in parallel without locking.
+ */
+static void CountRecombinantsForRow (RecombinationMatrix *matrix_p, const uint32 row)
+{
+	const uint32 num_markers = matrix_p -> rm_num_markers;
+	const uint32 num_words = matrix_p -> rm_num_words;
+	const uint64 *row_a_p = matrix_p -> rm_parent_a_p + ((size_t) row * num_words);
+	const uint64 *row_b_p = matrix_p -> rm_parent_b_p + ((size_t) row * num_words);
+	size_t index = ((size_t) row * (2 * (size_t) num_markers - row - 1)) / 2;
+	uint32 j;
+
+	for (j = row + 1; j < num_markers; ++ j, ++ index)
+		{
+			const uint64 *col_a_p = matrix_p -> rm_parent_a_p + ((size_t) j * num_words);
+			const uint64 *col_b_p = matrix_p -> rm_parent_b_p + ((size_t) j * num_words);
+			uint32 num_recombinants = 0;
+			uint32 num_informative = 0;
+			uint32 k;
+
+			for (k = 0; k < num_words; ++ k)
+				{
+					num_recombinants += (uint32) __builtin_popcountll ((row_a_p [k] & col_b_p [k]) | (row_b_p [k] & col_a_p [k]));
+					num_informative += (uint32) __builtin_popcountll ((row_a_p [k] | row_b_p [k]) & (col_a_p [k] | col_b_p [k]));
+				}
+
+			matrix_p -> rm_recombinants_p [index] = num_recombinants;
+			matrix_p -> rm_informative_p [index] = num_informative;
+		}
+}
+
+
+static json_t *GetMatrixAsJSON (const RecombinationMatrix *matrix_p, const MapMarker *markers_p, const json_t *population_p, const char *chromosome_s, const uint32 num_progeny)
+{
+	json_t *matrix_json_p = json_object ();
+
+	if (matrix_json_p)
+		{
+			json_t *names_p = json_array ();
+
+			if (names_p)
+				{
+					if (json_object_set_new (matrix_json_p, S_MARKERS_S, names_p) == 0)
+						{
+							json_t *positions_p = json_array ();
+
+							if (positions_p)
+								{
+									if (json_object_set_new (matrix_json_p, S_MAPPING_POSITIONS_S, positions_p) == 0)
+										{
+											const size_t num_pairs = ((size_t) (matrix_p -> rm_num_markers) * (size_t) (matrix_p -> rm_num_markers > 0 ? matrix_p -> rm_num_markers - 1 : 0)) / 2;
+											bool success_flag = (SetJSONString (matrix_json_p, PGS_POPULATION_NAME_S, GetJSONString (population_p, PGS_POPULATION_NAME_S))) &&
+												(SetJSONString (matrix_json_p, PGS_CHROMOSOME_S, chromosome_s)) &&
+												(SetJSONInteger (matrix_json_p, S_NUM_PROGENY_S, num_progeny));
+											JobArena arena;
+											uint32 i;
+
+											InitJobArena (&arena);
+
+											for (i = 0; (i < matrix_p -> rm_num_markers) && success_flag; ++ i)
+												{
+													const char *name_s = SearchAndReplaceInStringInJobArena (&arena, markers_p [i].mm_name_s, PGS_ESCAPED_DOT_S, ".");
+													const char *position_s = markers_p [i].mm_position_s;
+
+													success_flag = (name_s != NULL) &&
+														(json_array_append_new (names_p, json_string (name_s)) == 0) &&
+														(json_array_append_new (positions_p, position_s ? json_string (position_s) : json_null ()) == 0);
+
+													ResetJobArena (&arena);
+												}
+
+											ClearJobArena (&arena);
+
+											if (success_flag)
+												{
+													if ((AddCountsToJSON (matrix_json_p, S_RECOMBINANTS_S, matrix_p -> rm_recombinants_p, num_pairs)) &&
+															(AddCountsToJSON (matrix_json_p, S_INFORMATIVE_S, matrix_p -> rm_informative_p, num_pairs)))
+														{
+															return matrix_json_p;
+														}
+												}
+										}
+									else
+										{
+											json_decref (positions_p);
+										}
+								}
+						}
+					else
+						{
+							json_decref (names_p);
+						}
+				}
+
+			json_decref (matrix_json_p);
+		}		/* if (matrix_json_p) */
+
+	return NULL;
+}
+
+
+static bool AddCountsToJSON (json_t *matrix_json_p, const char *key_s, const uint32 *counts_p, const size_t num_counts)
+{
+	json_t *counts_json_p = json_array ();
+
+	if (counts_json_p)
+		{
+			if (json_object_set_new (matrix_json_p, key_s, counts_json_p) == 0)
+				{
+					size_t i;
+
+					for (i = 0; i < num_counts; ++ i)
+						{
+							if (json_array_append_new (counts_json_p, json_integer (counts_p [i])) != 0)
+								{
+									return false;
+								}
+						}
+
+					return true;
+				}
+			else
+				{
+					json_decref (counts_json_p);
+				}
+		}
+
+	return false;
+}
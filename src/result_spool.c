@@ -0,0 +1,538 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * result_spool.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "result_spool.h"
+
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+static const char * const S_SPOOLED_S = "spooled";
+
+
+static bool OpenSpoolFile (ResultSpool *spool_p);
+
+static bool WriteResultToSpoolFile (ResultSpool *spool_p, const json_t *result_p);
+
+static int WriteToSpoolFile (const char *buffer_s, size_t size, void *data_p);
+
+static bool AddSpoolDetailsToServiceJob (const ResultSpool *spool_p, ServiceJob *job_p);
+
+static bool AddSpoolTokenToServiceJob (const char *filename_s, const uint64 offset, const uint32 num_results, const uint64 num_bytes, ServiceJob *job_p);
+
+static char *GetSpoolFilenameFromToken (const char *token_s, const char *directory_s, uint64 *offset_p);
+
+static void ExpireResultSpools (const char *directory_s, const uint32 expiry_s);
+
+
+
+void InitResultSpool (ResultSpool *spool_p, const uint64 budget, const char *directory_s, const uint32 expiry_s)
+{
+	spool_p -> rs_budget = budget;
+	spool_p -> rs_used = 0;
+	spool_p -> rs_directory_s = directory_s;
+	spool_p -> rs_expiry_s = expiry_s;
+	spool_p -> rs_file_f = NULL;
+	spool_p -> rs_filename_s = NULL;
+	spool_p -> rs_num_spooled = 0;
+	spool_p -> rs_spooled_bytes = 0;
+}
+
+
+bool AddResultToResultSpool (ResultSpool *spool_p, ServiceJob *job_p, json_t *result_p)
+{
+	bool success_flag = false;
+
+	if (spool_p -> rs_budget == 0)
+		{
+			success_flag = AddResultToServiceJob (job_p, result_p);
+		}
+	else if (spool_p -> rs_file_f)
+		{
+			/*
+			 * Once we have started spooling, keep going so that the
+			 * results stay in order. The result is only sized as it
+			 * is written.
+			 */
+			if (WriteResultToSpoolFile (spool_p, result_p))
+				{
+					json_decref (result_p);
+					success_flag = true;
+				}
+		}
+	else
+		{
+			/*
+			 * Use the size of the serialised result since that is
+			 * what it will cost when the response is sent.
+			 */
+			const size_t size = json_dumpb (result_p, NULL, 0, JSON_COMPACT);
+
+			if (spool_p -> rs_used + size <= spool_p -> rs_budget)
+				{
+					if (AddResultToServiceJob (job_p, result_p))
+						{
+							spool_p -> rs_used += size;
+							success_flag = true;
+						}
+				}
+			else if (WriteResultToSpoolFile (spool_p, result_p))
+				{
+					json_decref (result_p);
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool SpoolResult (ResultSpool *spool_p, json_t *result_p)
+{
+	if (WriteResultToSpoolFile (spool_p, result_p))
+		{
+			json_decref (result_p);
+			return true;
+		}
+
+	return false;
+}
+
+
+bool FinishResultSpool (ResultSpool *spool_p, ServiceJob *job_p)
+{
+	bool success_flag = true;
+
+	if (spool_p -> rs_file_f)
+		{
+			if (fclose (spool_p -> rs_file_f) != 0)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to close \"%s\"", spool_p -> rs_filename_s);
+					success_flag = false;
+				}
+
+			spool_p -> rs_file_f = NULL;
+
+			if (success_flag)
+				{
+					success_flag = AddSpoolDetailsToServiceJob (spool_p, job_p);
+				}
+
+			if (!success_flag)
+				{
+					unlink (spool_p -> rs_filename_s);
+				}
+
+			FreeCopiedString (spool_p -> rs_filename_s);
+			spool_p -> rs_filename_s = NULL;
+		}
+
+	return success_flag;
+}
+
+
+void DiscardResultSpool (ResultSpool *spool_p)
+{
+	if (spool_p -> rs_file_f)
+		{
+			fclose (spool_p -> rs_file_f);
+			spool_p -> rs_file_f = NULL;
+
+			unlink (spool_p -> rs_filename_s);
+
+			FreeCopiedString (spool_p -> rs_filename_s);
+			spool_p -> rs_filename_s = NULL;
+		}
+}
+
+
+bool AddSpooledResultsToServiceJob (const char *token_s, const uint64 budget, const char *directory_s, const uint32 expiry_s, ServiceJob *job_p)
+{
+	bool success_flag = false;
+	uint64 offset = 0;
+	char *filename_s;
+
+	ExpireResultSpools (directory_s, expiry_s);
+
+	filename_s = GetSpoolFilenameFromToken (token_s, directory_s, &offset);
+
+	if (filename_s)
+		{
+			FILE *spool_f = fopen (filename_s, "r");
+
+			if (spool_f)
+				{
+					if (fseeko (spool_f, (off_t) offset, SEEK_SET) == 0)
+						{
+							char *line_s = NULL;
+							size_t line_size = 0;
+							ssize_t line_length;
+							uint64 used = 0;
+							uint32 num_added = 0;
+							bool more_flag = false;
+
+							success_flag = true;
+
+							/*
+							 * Send back the same budget's worth of results that the search
+							 * kept in memory, always sending at least one so that each
+							 * call makes progress.
+							 */
+							while (success_flag && (!more_flag) && ((line_length = getline (&line_s, &line_size, spool_f)) > 0))
+								{
+									if ((budget != 0) && (num_added > 0) && (used + (uint64) line_length > budget))
+										{
+											more_flag = true;
+										}
+									else
+										{
+											json_error_t error;
+											json_t *result_p = json_loadb (line_s, (size_t) line_length, 0, &error);
+
+											success_flag = false;
+
+											if (result_p)
+												{
+													if (AddResultToServiceJob (job_p, result_p))
+														{
+															offset += (uint64) line_length;
+															used += (uint64) line_length;
+															++ num_added;
+															success_flag = true;
+														}
+													else
+														{
+															json_decref (result_p);
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse result at " UINT64_FMT " in \"%s\": %s", offset, filename_s, error.text);
+												}
+										}
+								}
+
+							if (line_s)
+								{
+									free (line_s);
+								}
+
+							fclose (spool_f);
+
+							if (success_flag)
+								{
+									if (more_flag)
+										{
+											struct stat st;
+											uint64 num_bytes = 0;
+
+											if (stat (filename_s, &st) == 0)
+												{
+													num_bytes = (uint64) (st.st_size) - offset;
+												}
+
+											/*
+											 * Restart the expiry clock since the client is still collecting the results
+											 */
+											utimes (filename_s, NULL);
+
+											success_flag = AddSpoolTokenToServiceJob (filename_s, offset, 0, num_bytes, job_p);
+										}
+									else
+										{
+											/*
+											 * Everything has now been delivered
+											 */
+											unlink (filename_s);
+										}
+								}
+
+						}		/* if (fseeko (spool_f, (off_t) offset, SEEK_SET) == 0) */
+					else
+						{
+							fclose (spool_f);
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to seek to " UINT64_FMT " in \"%s\"", offset, filename_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Spooled results \"%s\" are not available, they may have been collected or expired", token_s);
+				}
+
+			FreeCopiedString (filename_s);
+		}		/* if (filename_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid spool token \"%s\"", token_s);
+		}
+
+	return success_flag;
+}
+
+
+bool HasSpooledResults (const ServiceJob *job_p)
+{
+	return ((job_p -> sj_metadata_p) && (json_object_get (job_p -> sj_metadata_p, S_SPOOLED_S)));
+}
+
+
+static bool OpenSpoolFile (ResultSpool *spool_p)
+{
+	char *filename_s;
+
+	/*
+	 * Clear out any old spools that were never collected before adding another
+	 */
+	ExpireResultSpools (spool_p -> rs_directory_s, spool_p -> rs_expiry_s);
+
+	filename_s = ConcatenateVarargsStrings (spool_p -> rs_directory_s, "/pgs_results_XXXXXX", NULL);
+
+	if (filename_s)
+		{
+			int fd = mkstemp (filename_s);
+
+			if (fd != -1)
+				{
+					FILE *spool_f = fdopen (fd, "w");
+
+					if (spool_f)
+						{
+							spool_p -> rs_file_f = spool_f;
+							spool_p -> rs_filename_s = filename_s;
+
+							PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, UINT64_FMT " bytes of results are over budget, spooling the rest to \"%s\"", spool_p -> rs_used, filename_s);
+
+							return true;
+						}
+
+					close (fd);
+					unlink (filename_s);
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create spool file in \"%s\"", spool_p -> rs_directory_s);
+			FreeCopiedString (filename_s);
+		}
+
+	return false;
+}
+
+
+/*
+ * The results are written one per line so that they can be
+ * read back without loading the whole file.
+ */
+static bool WriteResultToSpoolFile (ResultSpool *spool_p, const json_t *result_p)
+{
+	if ((spool_p -> rs_file_f) || (OpenSpoolFile (spool_p)))
+		{
+			if (json_dump_callback (result_p, WriteToSpoolFile, spool_p, JSON_COMPACT) == 0)
+				{
+					if (fputc ('\n', spool_p -> rs_file_f) != EOF)
+						{
+							++ (spool_p -> rs_num_spooled);
+							++ (spool_p -> rs_spooled_bytes);
+
+							return true;
+						}
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write result to \"%s\"", spool_p -> rs_filename_s);
+		}
+
+	return false;
+}
+
+
+/*
+ * Count the bytes of each result as jansson writes them so that it
+ * doesn't need serialising again just to find its size.
+ */
+static int WriteToSpoolFile (const char *buffer_s, size_t size, void *data_p)
+{
+	ResultSpool *spool_p = (ResultSpool *) data_p;
+
+	if (fwrite (buffer_s, 1, size, spool_p -> rs_file_f) == size)
+		{
+			spool_p -> rs_spooled_bytes += size;
+			return 0;
+		}
+
+	return -1;
+}
+
+
+static bool AddSpoolDetailsToServiceJob (const ResultSpool *spool_p, ServiceJob *job_p)
+{
+	if (AddSpoolTokenToServiceJob (spool_p -> rs_filename_s, 0, spool_p -> rs_num_spooled, spool_p -> rs_spooled_bytes, job_p))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add spooled results \"%s\" to job", spool_p -> rs_filename_s);
+
+	return false;
+}
+
+
+/*
+ * The token is the spool file's unique suffix followed by the offset
+ * of the next result to send, e.g. "aB3xYz:1048576". Only the suffix
+ * is sent so the client never sees, or gets to choose, a path.
+ */
+static bool AddSpoolTokenToServiceJob (const char *filename_s, const uint64 offset, const uint32 num_results, const uint64 num_bytes, ServiceJob *job_p)
+{
+	bool success_flag = false;
+	const char *suffix_s = strrchr (filename_s, '_');
+
+	if (suffix_s)
+		{
+			char offset_s [32];
+			char *token_s;
+
+			snprintf (offset_s, sizeof (offset_s), UINT64_FMT, offset);
+			token_s = ConcatenateVarargsStrings (suffix_s + 1, ":", offset_s, NULL);
+
+			if (token_s)
+				{
+					json_t *details_p = json_object ();
+
+					if (! (job_p -> sj_metadata_p))
+						{
+							job_p -> sj_metadata_p = json_object ();
+						}
+
+					if (details_p)
+						{
+							if ((SetJSONString (details_p, "token", token_s)) &&
+									(SetJSONInteger (details_p, "bytes", (json_int_t) num_bytes)) &&
+									((num_results == 0) || (SetJSONInteger (details_p, "results", num_results))))
+								{
+									if ((job_p -> sj_metadata_p) && (json_object_set_new (job_p -> sj_metadata_p, S_SPOOLED_S, details_p) == 0))
+										{
+											success_flag = true;
+										}
+								}
+
+							if (!success_flag)
+								{
+									json_decref (details_p);
+								}
+						}
+
+					FreeCopiedString (token_s);
+				}		/* if (token_s) */
+
+		}		/* if (suffix_s) */
+
+	return success_flag;
+}
+
+
+static char *GetSpoolFilenameFromToken (const char *token_s, const char *directory_s, uint64 *offset_p)
+{
+	const char *sep_s = strchr (token_s, ':');
+
+	/*
+	 * The suffix is the 6 characters that mkstemp () filled in
+	 */
+	if (sep_s && (sep_s - token_s == 6) && (isdigit (* (sep_s + 1))))
+		{
+			const char *c_p = token_s;
+
+			while ((c_p < sep_s) && (isalnum (*c_p)))
+				{
+					++ c_p;
+				}
+
+			if (c_p == sep_s)
+				{
+					char *end_s = NULL;
+					unsigned long long offset = strtoull (sep_s + 1, &end_s, 10);
+
+					if (end_s && (*end_s == '\0'))
+						{
+							char suffix_s [7];
+
+							memcpy (suffix_s, token_s, 6);
+							suffix_s [6] = '\0';
+
+							*offset_p = (uint64) offset;
+
+							return ConcatenateVarargsStrings (directory_s, "/pgs_results_", suffix_s, NULL);
+						}
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Delete any spool files that haven't been touched for expiry_s seconds.
+ */
+static void ExpireResultSpools (const char *directory_s, const uint32 expiry_s)
+{
+	if (expiry_s > 0)
+		{
+			DIR *dir_p = opendir (directory_s);
+
+			if (dir_p)
+				{
+					const time_t now = time (NULL);
+					struct dirent *entry_p;
+
+					while ((entry_p = readdir (dir_p)) != NULL)
+						{
+							if (strncmp (entry_p -> d_name, "pgs_results_", 12) == 0)
+								{
+									char *filename_s = ConcatenateVarargsStrings (directory_s, "/", entry_p -> d_name, NULL);
+
+									if (filename_s)
+										{
+											struct stat st;
+
+											if ((stat (filename_s, &st) == 0) && (now - st.st_mtime > (time_t) expiry_s))
+												{
+													if (unlink (filename_s) == 0)
+														{
+															PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, "Deleted expired spool file \"%s\"", filename_s);
+														}
+												}
+
+											FreeCopiedString (filename_s);
+										}
+								}
+						}
+
+					closedir (dir_p);
+				}
+		}
+}
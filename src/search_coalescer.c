@@ -0,0 +1,314 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * search_coalescer.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "search_coalescer.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+struct InFlightSearch
+{
+	/** The normalised search parameters. */
+	char *ifs_key_s;
+
+	/** The number of callers that have joined and not yet left. */
+	uint32 ifs_num_refs;
+
+	/** Has the leader published its results? */
+	bool ifs_done_flag;
+
+	/** The leader's results, or NULL if they are not available. */
+	json_t *ifs_results_p;
+
+	/** The leader's job status. */
+	OperationStatus ifs_status;
+
+	/** Signalled when the results are published. */
+	pthread_cond_t ifs_done_cond;
+
+	/** The next search in the list of those that are running. */
+	struct InFlightSearch *ifs_next_p;
+};
+
+
+/*
+ * The searches that are currently running. Both the list and
+ * each of its entries are protected by s_searches_lock.
+ */
+static InFlightSearch *s_searches_p = NULL;
+
+static pthread_mutex_t s_searches_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static InFlightSearch *AllocateInFlightSearch (const char *key_s);
+
+static void FreeInFlightSearch (InFlightSearch *search_p);
+
+static void RemoveInFlightSearch (InFlightSearch *search_p);
+
+
+
+InFlightSearch *JoinInFlightSearch (const char *key_s, bool *leader_flag_p)
+{
+	InFlightSearch *search_p = NULL;
+
+	pthread_mutex_lock (&s_searches_lock);
+
+	search_p = s_searches_p;
+
+	while (search_p && (strcmp (search_p -> ifs_key_s, key_s) != 0))
+		{
+			search_p = search_p -> ifs_next_p;
+		}
+
+	if (search_p)
+		{
+			++ (search_p -> ifs_num_refs);
+			*leader_flag_p = false;
+		}
+	else if ((search_p = AllocateInFlightSearch (key_s)) != NULL)
+		{
+			search_p -> ifs_next_p = s_searches_p;
+			s_searches_p = search_p;
+
+			*leader_flag_p = true;
+		}
+
+	pthread_mutex_unlock (&s_searches_lock);
+
+	return search_p;
+}
+
+
+void PublishInFlightSearch (InFlightSearch *search_p, const json_t *results_p, const OperationStatus status)
+{
+	/*
+	 * Take the copy before locking so the waiting callers aren't held up
+	 */
+	json_t *copied_results_p = NULL;
+
+	/*
+	 * Partial results, e.g. those cut short by the leader's deadline, aren't
+	 * shared since the waiting callers may have the time to get them all.
+	 * Instead they run the search themselves.
+	 */
+	if (results_p && (status == OS_SUCCEEDED))
+		{
+			copied_results_p = json_deep_copy (results_p);
+
+			if (!copied_results_p)
+				{
+					PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, results_p, "Failed to copy results for \"%s\"", search_p -> ifs_key_s);
+				}
+		}
+
+	pthread_mutex_lock (&s_searches_lock);
+
+	search_p -> ifs_results_p = copied_results_p;
+	search_p -> ifs_status = status;
+	search_p -> ifs_done_flag = true;
+
+	/*
+	 * Any later searches must start afresh rather than pick up
+	 * these results since the data may have changed.
+	 */
+	RemoveInFlightSearch (search_p);
+
+	pthread_cond_broadcast (& (search_p -> ifs_done_cond));
+
+	pthread_mutex_unlock (&s_searches_lock);
+}
+
+
+json_t *WaitForInFlightSearch (InFlightSearch *search_p, SearchDeadline *deadline_p, OperationStatus *status_p)
+{
+	json_t *results_p = NULL;
+	bool done_flag;
+
+	pthread_mutex_lock (&s_searches_lock);
+
+	if (deadline_p -> sd_end_time != 0)
+		{
+			/*
+			 * The condition variable uses the monotonic clock, the same
+			 * as the deadline
+			 */
+			struct timespec end_time;
+			int res = 0;
+
+			end_time.tv_sec = (time_t) (deadline_p -> sd_end_time / 1000000000ULL);
+			end_time.tv_nsec = (long) (deadline_p -> sd_end_time % 1000000000ULL);
+
+			while ((! (search_p -> ifs_done_flag)) && (res == 0))
+				{
+					res = pthread_cond_timedwait (& (search_p -> ifs_done_cond), &s_searches_lock, &end_time);
+				}
+		}
+	else
+		{
+			while (! (search_p -> ifs_done_flag))
+				{
+					pthread_cond_wait (& (search_p -> ifs_done_cond), &s_searches_lock);
+				}
+		}
+
+	done_flag = search_p -> ifs_done_flag;
+
+	pthread_mutex_unlock (&s_searches_lock);
+
+	if (!done_flag)
+		{
+			deadline_p -> sd_expired_flag = true;
+		}
+
+	/*
+	 * The results are not changed once they have been published
+	 * so they can be copied without holding the lock.
+	 */
+	if (done_flag && (search_p -> ifs_results_p))
+		{
+			results_p = json_deep_copy (search_p -> ifs_results_p);
+
+			if (results_p)
+				{
+					*status_p = search_p -> ifs_status;
+				}
+		}
+
+	return results_p;
+}
+
+
+void LeaveInFlightSearch (InFlightSearch *search_p)
+{
+	bool free_flag = false;
+
+	pthread_mutex_lock (&s_searches_lock);
+
+	-- (search_p -> ifs_num_refs);
+
+	if (search_p -> ifs_num_refs == 0)
+		{
+			/*
+			 * If the leader failed before publishing, it will still be in the list
+			 */
+			RemoveInFlightSearch (search_p);
+			free_flag = true;
+		}
+
+	pthread_mutex_unlock (&s_searches_lock);
+
+	if (free_flag)
+		{
+			FreeInFlightSearch (search_p);
+		}
+}
+
+
+static InFlightSearch *AllocateInFlightSearch (const char *key_s)
+{
+	char *copied_key_s = EasyCopyToNewString (key_s);
+
+	if (copied_key_s)
+		{
+			InFlightSearch *search_p = (InFlightSearch *) AllocMemory (sizeof (InFlightSearch));
+
+			if (search_p)
+				{
+					pthread_condattr_t attrs;
+
+					if (pthread_condattr_init (&attrs) == 0)
+						{
+							bool success_flag = false;
+
+							if (pthread_condattr_setclock (&attrs, CLOCK_MONOTONIC) == 0)
+								{
+									if (pthread_cond_init (& (search_p -> ifs_done_cond), &attrs) == 0)
+										{
+											search_p -> ifs_key_s = copied_key_s;
+											search_p -> ifs_num_refs = 1;
+											search_p -> ifs_done_flag = false;
+											search_p -> ifs_results_p = NULL;
+											search_p -> ifs_status = OS_IDLE;
+											search_p -> ifs_next_p = NULL;
+
+											success_flag = true;
+										}
+								}
+
+							pthread_condattr_destroy (&attrs);
+
+							if (success_flag)
+								{
+									return search_p;
+								}
+						}
+
+					FreeMemory (search_p);
+				}
+
+			FreeCopiedString (copied_key_s);
+		}		/* if (copied_key_s) */
+
+	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate in-flight search for \"%s\"", key_s);
+
+	return NULL;
+}
+
+
+static void FreeInFlightSearch (InFlightSearch *search_p)
+{
+	if (search_p -> ifs_results_p)
+		{
+			json_decref (search_p -> ifs_results_p);
+		}
+
+	pthread_cond_destroy (& (search_p -> ifs_done_cond));
+	FreeCopiedString (search_p -> ifs_key_s);
+	FreeMemory (search_p);
+}
+
+
+/*
+ * This must be called with s_searches_lock held.
+ */
+static void RemoveInFlightSearch (InFlightSearch *search_p)
+{
+	InFlightSearch **prev_pp = &s_searches_p;
+
+	while (*prev_pp)
+		{
+			if (*prev_pp == search_p)
+				{
+					*prev_pp = search_p -> ifs_next_p;
+					search_p -> ifs_next_p = NULL;
+					return;
+				}
+
+			prev_pp = & ((*prev_pp) -> ifs_next_p);
+		}
+}
@@ -0,0 +1,100 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * search_deadline.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "search_deadline.h"
+#include "job_timings.h"
+
+#include "streams.h"
+
+
+void InitSearchDeadline (SearchDeadline *deadline_p, const uint32 timeout_ms)
+{
+	deadline_p -> sd_end_time = (timeout_ms > 0) ? GetMonotonicTimeInNanoseconds () + (((uint64) timeout_ms) * 1000000ULL) : 0;
+	deadline_p -> sd_expired_flag = false;
+}
+
+
+uint32 GetSearchTimeout (const uint32 *requested_ms_p, const uint32 configured_ms)
+{
+	uint32 timeout_ms = configured_ms;
+
+	if (requested_ms_p && (*requested_ms_p > 0))
+		{
+			/*
+			 * A request can ask for less time than the configured limit but not more
+			 */
+			if ((configured_ms == 0) || (*requested_ms_p < configured_ms))
+				{
+					timeout_ms = *requested_ms_p;
+				}
+		}
+
+	return timeout_ms;
+}
+
+
+bool HasSearchDeadlinePassed (SearchDeadline *deadline_p)
+{
+	if ((! (deadline_p -> sd_expired_flag)) && (deadline_p -> sd_end_time != 0))
+		{
+			if (GetMonotonicTimeInNanoseconds () >= deadline_p -> sd_end_time)
+				{
+					deadline_p -> sd_expired_flag = true;
+				}
+		}
+
+	return deadline_p -> sd_expired_flag;
+}
+
+
+bson_t *GetSearchDeadlineQueryOptions (SearchDeadline *deadline_p)
+{
+	bson_t *opts_p = NULL;
+
+	if (deadline_p -> sd_end_time != 0)
+		{
+			const uint64 now = GetMonotonicTimeInNanoseconds ();
+
+			/*
+			 * A maxTimeMS of 0 means no limit so always ask for at least 1ms
+			 */
+			int64 remaining_ms = 1;
+
+			if (now < deadline_p -> sd_end_time)
+				{
+					remaining_ms = (int64) ((deadline_p -> sd_end_time - now) / 1000000ULL);
+
+					if (remaining_ms < 1)
+						{
+							remaining_ms = 1;
+						}
+				}
+
+			opts_p = BCON_NEW ("maxTimeMS", BCON_INT64 (remaining_ms));
+
+			if (!opts_p)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create query options for maxTimeMS " INT64_FMT, remaining_ms);
+				}
+		}
+
+	return opts_p;
+}
@@ -20,8 +20,29 @@
  *      Author: billy
  */
 
+#include <stdio.h>
+
 #include "search_service.h"
 #include "parental_genotype_service.h"
+#include "job_timings.h"
+#include "marker_index.h"
+#include "population_filters.h"
+#include "population_summaries.h"
+#include "progeny_genotypes.h"
+#include "parent_genotypes.h"
+#include "marker_stats.h"
+#include "recombination_matrix.h"
+#include "breakpoints.h"
+#include "haplotype_blocks.h"
+#include "pattern_search.h"
+#include "matrix_export.h"
+#include "compact_format.h"
+#include "search_coalescer.h"
+#include "search_deadline.h"
+#include "admission_control.h"
+#include "result_spool.h"
+#include "job_arena.h"
+#include "bson_extract.h"
 
 
 #include "audit.h"
@@ -31,14 +52,90 @@
 
 #include "string_parameter.h"
 #include "boolean_parameter.h"
+#include "unsigned_int_parameter.h"
+#include "double_parameter.h"
 
 /*
  * Static declarations
  */
 
+/*
+ * The state passed to AddBSONMarkerResult () or AddBSONFullRecordResult ()
+ * for each population returned by a marker search.
+ */
+typedef struct MarkerCursorSearch
+{
+	ServiceJob *mcs_job_p;
+
+	ResultSpool *mcs_spool_p;
+
+	const char *mcs_marker_s;
+
+	const char *mcs_escaped_marker_s;
+
+	ResponseFormat mcs_format;
+
+	SearchDeadline *mcs_deadline_p;
+
+	JobTimings *mcs_timings_p;
+
+	JobArena *mcs_arena_p;
+
+	uint64 mcs_num_docs;
+
+	uint64 mcs_num_bytes;
+
+	uint64 mcs_num_added;
+
+	/*
+	 * Populations that are only stored as haplotype blocks can't be
+	 * decoded while the cursor is open, so they are kept until after
+	 */
+	json_t *mcs_blocks_only_p;
+} MarkerCursorSearch;
+
+
 static NamedParameterType S_MARKER = { "Marker", PT_KEYWORD };
 static NamedParameterType S_POPULATION = { "Population", PT_KEYWORD };
 static NamedParameterType S_FULL_RECORD = { "Return entire populations", PT_BOOLEAN };
+static NamedParameterType S_MODE = { "Mode", PT_STRING };
+static NamedParameterType S_RESPONSE_FORMAT = { "Response format", PT_STRING };
+static NamedParameterType S_TIMEOUT = { "Timeout", PT_UNSIGNED_INT };
+static NamedParameterType S_PROGENY = { "Progeny", PT_KEYWORD };
+static NamedParameterType S_CHROMOSOME = { "Chromosome", PT_STRING };
+static NamedParameterType S_INTERVAL_START = { "Interval start", PT_SIGNED_REAL };
+static NamedParameterType S_INTERVAL_END = { "Interval end", PT_SIGNED_REAL };
+static NamedParameterType S_MAX_MISSING_RATE = { "Maximum missing rate", PT_UNSIGNED_REAL };
+static NamedParameterType S_MAX_HETEROZYGOSITY = { "Maximum heterozygosity", PT_UNSIGNED_REAL };
+static NamedParameterType S_MIN_P_VALUE = { "Minimum segregation p-value", PT_UNSIGNED_REAL };
+static NamedParameterType S_PATTERN = { "Pattern", PT_STRING };
+static NamedParameterType S_MARKERS = { "Markers", PT_STRING };
+static NamedParameterType S_EXPORT_FORMAT = { "Export format", PT_STRING };
+static NamedParameterType S_SPOOL_TOKEN = { "Spool token", PT_STRING };
+
+
+static const char * const S_MODE_SEARCH_S = "Search";
+static const char * const S_MODE_METRICS_S = "Metrics";
+static const char * const S_MODE_MARKER_PREFIX_S = "Marker prefix";
+static const char * const S_MODE_SUMMARIES_S = "Population summaries";
+static const char * const S_MODE_PROGENY_S = "Progeny";
+static const char * const S_MODE_POLYMORPHIC_S = "Polymorphic markers";
+static const char * const S_MODE_MARKER_STATS_S = "Marker statistics";
+static const char * const S_MODE_RECOMBINATION_S = "Recombination matrix";
+static const char * const S_MODE_BREAKPOINTS_S = "Breakpoints";
+static const char * const S_MODE_HAPLOTYPES_S = "Haplotype blocks";
+static const char * const S_MODE_PATTERN_S = "Genotype pattern";
+static const char * const S_MODE_EXPORT_S = "Export";
+static const char * const S_MODE_SPOOLED_S = "Spooled results";
+
+static const char * const S_FORMAT_JSON_S = "JSON";
+static const char * const S_FORMAT_COMPACT_S = "Compact";
+static const char * const S_FORMAT_COMPACT_GZIP_S = "Compact (gzip)";
+
+static const char * const S_EXPORT_TSV_S = "TSV";
+static const char * const S_EXPORT_CSV_S = "CSV";
+static const char * const S_EXPORT_ABH_S = "ABH";
+static const char * const S_EXPORT_ARROW_S = "Arrow";
 
 
 static const char *GetParentalGenotypeSearchServiceName (const Service *service_p);
@@ -63,17 +160,91 @@ static bool CloseParentalGenotypeSearchService (Service *service_p);
 
 static ServiceMetadata *GetParentalGenotypeSearchServiceMetadata (Service *service_p);
 
-static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, ParentalGenotypeServiceData *data_p);
+static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p);
+
+static json_t *DoPopulationSearch (bson_t *query_p, const char * const population_s, const char * const marker_s, const char * const escaped_marker_s, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p);
 
-static json_t *DoPopulationSearch (bson_t *query_p, const char * const population_s, const char * const marker_s, const char * const escaped_marker_s, ParentalGenotypeServiceData *data_p);
+static json_t *GetFullRecordResult (json_t *entry_p, const ResponseFormat format, JobTimings *timings_p, JobArena *arena_p);
 
 static json_t *GetForNamedMarker (const json_t *src_p, const char * const src_marker_s, const char * const dest_marker_s);
 
+static OperationStatus DoMarkerCursorSearch (ServiceJob *job_p, const char * const marker_s, const char * const escaped_marker_s, const bool full_record_flag, const ResponseFormat format, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p, ResultSpool *spool_p, JobArena *arena_p);
+
+static bool AddBSONMarkerResult (const bson_t *doc_p, void *data_p);
+
+static bool AddMarkerResult (MarkerCursorSearch *search_p, const char *population_s, const char *parent_a_s, const char *parent_b_s, json_t *marker_p);
+
+static bool IsBSONHaplotypeBlocksOnlyPopulation (const bson_t *doc_p);
+
+static bool AddBlocksOnlyPopulation (MarkerCursorSearch *search_p, const bson_t *doc_p);
+
+static void AddBlocksOnlyPopulationResults (MarkerCursorSearch *search_p, const bool full_record_flag, ParentalGenotypeServiceData *data_p);
+
+static bool LoadHaplotypeBlockMarkers (json_t *population_p, const char * const marker_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddBSONFullRecordResult (const bson_t *doc_p, void *data_p);
+
+static bool AddMarkerProjection (bson_t *opts_p, const char * const escaped_marker_s);
+
 static bool CopyJSONString (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s);
 
 static bool CopyJSONObject (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s);
 
-static bool UnescapeAllKeys (json_t *src_p);
+static bool UnescapeAllKeys (json_t *src_p, JobArena *arena_p);
+
+static void DoMetrics (ServiceJob *job_p, ParentalGenotypeServiceData *data_p);
+
+static void DoMarkerPrefixSearch (ServiceJob *job_p, const char * const pattern_s, ParentalGenotypeServiceData *data_p);
+
+static void DoPopulationSummariesSearch (ServiceJob *job_p, const char * const name_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static void DoProgenySearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddProgenyParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static void DoPolymorphicMarkersSearch (ServiceJob *job_p, const char * const population_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddIntervalParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static void DoMarkerStatsSearch (ServiceJob *job_p, const MarkerStatsFilter *filter_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddMarkerStatsParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static void DoRecombinationMatrixSearch (ServiceJob *job_p, const char * const population_s, const char * const chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static void DoBreakpointsSearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static void DoHaplotypeBlocksSearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, const char * const marker_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static void DoPatternSearch (ServiceJob *job_p, const GenotypePattern *pattern_p, const char * const population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddPatternParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static void DoExportSearch (ServiceJob *job_p, const char * const population_s, const char * const markers_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, const ExportFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p);
+
+static bool AddExportParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static bool AddSpoolTokenParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static ExportFormat GetExportFormat (const char * const format_s);
+
+static MetricsSearchMode GetMetricsSearchMode (const char * const marker_s, const char * const population_s, const bool full_record_flag);
+
+static ResponseFormat GetResponseFormat (const char * const format_s);
+
+static bool DoCoalescedSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, const AdmissionClass ac, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p);
+
+static bool DoAdmittedSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, const AdmissionClass ac, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p);
+
+static char *GetSearchKey (const char * const marker_s, const char * const population_s, bool full_record_flag, ResponseFormat format);
+
+static bool AddResponseFormatParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static bool AddTimeoutParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+static void AddTimedOutToServiceJob (ServiceJob *job_p);
+
+static void AddBusyErrorToServiceJob (ServiceJob *job_p, const AdmissionClass ac);
 
 
 /*
@@ -175,7 +346,48 @@ static ParameterSet *GetParentalGenotypeSearchServiceParameters (Service *servic
 
 							if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, S_FULL_RECORD.npt_name_s, "Full Records", "Return the full matching populations for marker search results", &b, PL_ALL)) != NULL)
 								{
-									return param_set_p;
+									StringParameter *mode_param_p = (StringParameter *) EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_MODE.npt_type, S_MODE.npt_name_s, "Mode", "What to do", S_MODE_SEARCH_S, PL_ADVANCED);
+
+									if (mode_param_p)
+										{
+											if (CreateAndAddStringParameterOption (mode_param_p, S_MODE_SEARCH_S, "Search for markers and populations"))
+												{
+													if (CreateAndAddStringParameterOption (mode_param_p, S_MODE_MARKER_PREFIX_S, "Find the markers whose names start with, or match the wildcard pattern, given in the Marker parameter"))
+														{
+															if (CreateAndAddStringParameterOption (mode_param_p, S_MODE_METRICS_S, "Get the service metrics in text exposition format"))
+																{
+																	if ((CreateAndAddStringParameterOption (mode_param_p, S_MODE_SUMMARIES_S, "List the populations with their parents and sizes. If the Population parameter is set, only the populations with that name or parent are listed")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_PROGENY_S, "Get all of the genotypes for the progeny line given in the Progeny parameter, optionally just from the given Population")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_POLYMORPHIC_S, "Get the markers that differ between the parents of the given Population, optionally just those on the given Chromosome and between the interval positions")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_MARKER_STATS_S, "Get the segregation statistics of the markers that pass the quality filters, optionally just those in the given Population or on the given Chromosome")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_RECOMBINATION_S, "Count the recombinants between every pair of markers on the given Chromosome in the given Population")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_BREAKPOINTS_S, "Get the recombination breakpoints for the given Progeny line or for all of the lines in the given Population, optionally just those on the given Chromosome and between the interval positions")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_HAPLOTYPES_S, "Decode the calls of the given Progeny line in the given Population from its haplotype blocks, either at the given Marker or optionally just on the given Chromosome and between the interval positions")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_PATTERN_S, "Find the progeny lines that match every marker=call pair in the Pattern parameter, optionally just in the populations with the given Population name or parent")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_EXPORT_S, "Write the given Population, or the given Markers from every population that has them, as a marker by progeny matrix for each population, optionally just those on the given Chromosome and between the interval positions")) &&
+																			(CreateAndAddStringParameterOption (mode_param_p, S_MODE_SPOOLED_S, "Get the next page of the results that a search spooled to disk, using the token from the \"spooled\" entry in its metadata")))
+																		{
+																			if (AddResponseFormatParameter (data_p, param_set_p, group_p))
+																				{
+																					if (AddTimeoutParameter (data_p, param_set_p, group_p))
+																						{
+																							if ((AddProgenyParameter (data_p, param_set_p, group_p)) && (AddIntervalParameters (data_p, param_set_p, group_p)) && (AddMarkerStatsParameters (data_p, param_set_p, group_p)) && (AddPatternParameter (data_p, param_set_p, group_p)) && (AddExportParameters (data_p, param_set_p, group_p)) && (AddSpoolTokenParameter (data_p, param_set_p, group_p)))
+																								{
+																									return param_set_p;
+																								}
+																						}
+																				}
+																		}
+																}
+														}
+												}
+
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add options to %s parameter", S_MODE.npt_name_s);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_MODE.npt_name_s);
+										}
 								}
 							else
 								{
@@ -219,6 +431,62 @@ static bool GetParentalGenotypeSearchServiceParameterTypesForNamedParameters (co
 		{
 			*pt_p = S_FULL_RECORD.npt_type;
 		}
+	else if (strcmp (param_name_s, S_MODE.npt_name_s) == 0)
+		{
+			*pt_p = S_MODE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_RESPONSE_FORMAT.npt_name_s) == 0)
+		{
+			*pt_p = S_RESPONSE_FORMAT.npt_type;
+		}
+	else if (strcmp (param_name_s, S_TIMEOUT.npt_name_s) == 0)
+		{
+			*pt_p = S_TIMEOUT.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PROGENY.npt_name_s) == 0)
+		{
+			*pt_p = S_PROGENY.npt_type;
+		}
+	else if (strcmp (param_name_s, S_CHROMOSOME.npt_name_s) == 0)
+		{
+			*pt_p = S_CHROMOSOME.npt_type;
+		}
+	else if (strcmp (param_name_s, S_INTERVAL_START.npt_name_s) == 0)
+		{
+			*pt_p = S_INTERVAL_START.npt_type;
+		}
+	else if (strcmp (param_name_s, S_INTERVAL_END.npt_name_s) == 0)
+		{
+			*pt_p = S_INTERVAL_END.npt_type;
+		}
+	else if (strcmp (param_name_s, S_MAX_MISSING_RATE.npt_name_s) == 0)
+		{
+			*pt_p = S_MAX_MISSING_RATE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_MAX_HETEROZYGOSITY.npt_name_s) == 0)
+		{
+			*pt_p = S_MAX_HETEROZYGOSITY.npt_type;
+		}
+	else if (strcmp (param_name_s, S_MIN_P_VALUE.npt_name_s) == 0)
+		{
+			*pt_p = S_MIN_P_VALUE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PATTERN.npt_name_s) == 0)
+		{
+			*pt_p = S_PATTERN.npt_type;
+		}
+	else if (strcmp (param_name_s, S_MARKERS.npt_name_s) == 0)
+		{
+			*pt_p = S_MARKERS.npt_type;
+		}
+	else if (strcmp (param_name_s, S_EXPORT_FORMAT.npt_name_s) == 0)
+		{
+			*pt_p = S_EXPORT_FORMAT.npt_type;
+		}
+	else if (strcmp (param_name_s, S_SPOOL_TOKEN.npt_name_s) == 0)
+		{
+			*pt_p = S_SPOOL_TOKEN.npt_type;
+		}
 	else
 		{
 			success_flag = false;
@@ -254,6 +522,9 @@ static ServiceJobSet *RunParentalGenotypeSearchService (Service *service_p, Para
 	if (service_p -> se_jobs_p)
 		{
 			ServiceJob *job_p = GetServiceJobFromServiceJobSet (service_p -> se_jobs_p, 0);
+			JobTimings timings;
+
+			InitJobTimings (&timings, data_p -> pgsd_timings_flag);
 
 			LogParameterSet (param_set_p, job_p);
 
@@ -261,146 +532,559 @@ static ServiceJobSet *RunParentalGenotypeSearchService (Service *service_p, Para
 
 			if (param_set_p)
 				{
-					const char *marker_s = NULL;
+					const char *mode_s = NULL;
 
-					if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_s))
+					GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MODE.npt_name_s, &mode_s);
+
+					if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_METRICS_S) == 0))
 						{
-							if (!IsStringEmpty (marker_s))
-								{
-									const char *population_s = NULL;
+							DoMetrics (job_p, data_p);
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_SPOOLED_S) == 0))
+						{
+							const char *token_s = NULL;
 
-									if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s))
+							if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_SPOOL_TOKEN.npt_name_s, &token_s)) && (!IsStringEmpty (token_s)))
+								{
+									if (EnterAdmissionControl (AC_LIGHT, 0))
 										{
-											const bool *full_records_flag_p = NULL;
-
-											GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_FULL_RECORD.npt_name_s, &full_records_flag_p);
-
-											DoSearch (job_p, marker_s, population_s, full_records_flag_p ? *full_records_flag_p : false, data_p);
-
-										}		/* if (GetParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &population_value, true)) */
+											/*
+											 * Each page is the same size as the results that a search keeps in memory
+											 */
+											if (AddSpooledResultsToServiceJob (token_s, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s, job_p))
+												{
+													SetServiceJobStatus (job_p, OS_SUCCEEDED);
+												}
+											else
+												{
+													SetServiceJobStatus (job_p, OS_FAILED);
+													AddParameterErrorMessageToServiceJob (job_p, S_SPOOL_TOKEN.npt_name_s, S_SPOOL_TOKEN.npt_type, "The spooled results are not available, they may have already been collected or have expired");
+												}
 
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
 								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_SPOOL_TOKEN.npt_name_s, S_SPOOL_TOKEN.npt_type, "A spool token is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_MARKER_PREFIX_S) == 0))
+						{
+							const char *marker_s = NULL;
 
-						}		/* if (GetParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_value, true)) */
-
-				}		/* if (param_set_p) */
-
-#if DFW_FIELD_TRIAL_SERVICE_DEBUG >= STM_LEVEL_FINE
-			PrintJSONToLog (STM_LEVEL_FINE, __FILE__, __LINE__, job_p -> sj_metadata_p, "metadata 3: ");
-#endif
+							if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_s)) && (!IsStringEmpty (marker_s)))
+								{
+									if (EnterAdmissionControl (AC_LIGHT, 0))
+										{
+											DoMarkerPrefixSearch (job_p, marker_s, data_p);
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_MARKER.npt_name_s, S_MARKER.npt_type, "A marker prefix is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_PROGENY_S) == 0))
+						{
+							const char *accession_s = NULL;
 
-			LogServiceJob (job_p);
-		}		/* if (service_p -> se_jobs_p) */
+							if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PROGENY.npt_name_s, &accession_s)) && (!IsStringEmpty (accession_s)))
+								{
+									const char *population_s = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
 
-	return service_p -> se_jobs_p;
-}
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
 
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
 
-static ServiceMetadata *GetParentalGenotypeSearchServiceMetadata (Service * UNUSED_PARAM (service_p))
-{
-	const char *term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "topic_0625";
-	SchemaTerm *category_p = AllocateSchemaTerm (term_url_s, "Genotype and phenotype",
-																							 "The study of genetic constitution of a living entity, such as an individual, and organism, a cell and so on, "
-																							 "typically with respect to a particular observable phenotypic traits, or resources concerning such traits, which "
-																							 "might be an aspect of biochemistry, physiology, morphology, anatomy, development and so on.");
+									if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+										{
+											DoProgenySearch (job_p, accession_s, population_s, data_p, &deadline);
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_PROGENY.npt_name_s, S_PROGENY.npt_type, "A progeny line is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_POLYMORPHIC_S) == 0))
+						{
+							const char *population_s = NULL;
 
-	if (category_p)
-		{
-			SchemaTerm *subcategory_p;
+							if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s)) && (!IsStringEmpty (population_s)))
+								{
+									const char *chromosome_s = NULL;
+									const double64 *start_p = NULL;
+									const double64 *end_p = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
 
-			term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "operation_0304";
-			subcategory_p = AllocateSchemaTerm (term_url_s, "Query and retrieval", "Search or query a data resource and retrieve entries and / or annotation.");
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, &chromosome_s);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_START.npt_name_s, &start_p);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_END.npt_name_s, &end_p);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
 
-			if (subcategory_p)
-				{
-					ServiceMetadata *metadata_p = AllocateServiceMetadata (category_p, subcategory_p);
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
 
-					if (metadata_p)
+									if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+										{
+											DoPolymorphicMarkersSearch (job_p, population_s, chromosome_s, start_p, end_p, data_p, &deadline);
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_POPULATION.npt_name_s, S_POPULATION.npt_type, "A population is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_RECOMBINATION_S) == 0))
 						{
-							SchemaTerm *input_p;
-
-							term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "data_0968";
-							input_p = AllocateSchemaTerm (term_url_s, "Keyword",
-																						"Boolean operators (AND, OR and NOT) and wildcard characters may be allowed. Keyword(s) or phrase(s) used (typically) for text-searching purposes.");
+							const char *population_s = NULL;
 
-							if (input_p)
+							if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s)) && (!IsStringEmpty (population_s)))
 								{
-									if (AddSchemaTermToServiceMetadataInput (metadata_p, input_p))
+									const char *chromosome_s = NULL;
+
+									if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, &chromosome_s)) && (!IsStringEmpty (chromosome_s)))
 										{
-											SchemaTerm *output_p;
+											const char *format_s = NULL;
+											const uint32 *timeout_p = NULL;
+											SearchDeadline deadline;
 
+											GetCurrentStringParameterValueFromParameterSet (param_set_p, S_RESPONSE_FORMAT.npt_name_s, &format_s);
+											GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
 
-											/* Genotype */
-											term_url_s = CONTEXT_PREFIX_EXPERIMENTAL_FACTOR_ONTOLOGY_S "EFO_0000513";
-											output_p = AllocateSchemaTerm (term_url_s, "genotype", "Information, making the distinction between the actual physical material "
-																										 "(e.g. a cell) and the information about the genetic content (genotype).");
+											InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
 
-											if (output_p)
+											if (EnterAdmissionControl (AC_HEAVY, deadline.sd_end_time))
 												{
-													if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p))
-														{
-															return metadata_p;
-														}		/* if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p)) */
-													else
-														{
-															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add output term %s to service metadata", term_url_s);
-															FreeSchemaTerm (output_p);
-														}
-
-												}		/* if (output_p) */
+													DoRecombinationMatrixSearch (job_p, population_s, chromosome_s, GetResponseFormat (format_s), data_p, &deadline);
+													LeaveAdmissionControl (AC_HEAVY);
+												}
 											else
 												{
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate output term %s for service metadata", term_url_s);
+													AddBusyErrorToServiceJob (job_p, AC_HEAVY);
 												}
-
-										}		/* if (AddSchemaTermToServiceMetadataInput (metadata_p, input_p)) */
+										}
 									else
 										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add input term %s to service metadata", term_url_s);
-											FreeSchemaTerm (input_p);
+											AddParameterErrorMessageToServiceJob (job_p, S_CHROMOSOME.npt_name_s, S_CHROMOSOME.npt_type, "A chromosome is required");
 										}
-
-								}		/* if (input_p) */
+								}
 							else
 								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate input term %s for service metadata", term_url_s);
+									AddParameterErrorMessageToServiceJob (job_p, S_POPULATION.npt_name_s, S_POPULATION.npt_type, "A population is required");
 								}
-
-							FreeServiceMetadata (metadata_p);
-						}		/* if (metadata_p) */
-					else
-						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate service metadata");
 						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_MARKER_STATS_S) == 0))
+						{
+							MarkerStatsFilter filter = { NULL, NULL, NULL, NULL, NULL };
+							const uint32 *timeout_p = NULL;
+							SearchDeadline deadline;
 
-				}		/* if (subcategory_p) */
-			else
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate sub-category term %s for service metadata", term_url_s);
-				}
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, & (filter.msf_population_s));
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, & (filter.msf_chromosome_s));
+							GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_MAX_MISSING_RATE.npt_name_s, & (filter.msf_max_missing_rate_p));
+							GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_MAX_HETEROZYGOSITY.npt_name_s, & (filter.msf_max_heterozygosity_p));
+							GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_MIN_P_VALUE.npt_name_s, & (filter.msf_min_p_value_p));
+							GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
 
-		}		/* if (category_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate category term %s for service metadata", term_url_s);
-		}
+							InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
 
-	return NULL;
-}
+							if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+								{
+									DoMarkerStatsSearch (job_p, &filter, data_p, &deadline);
+									LeaveAdmissionControl (AC_LIGHT);
+								}
+							else
+								{
+									AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_BREAKPOINTS_S) == 0))
+						{
+							const char *accession_s = NULL;
+							const char *population_s = NULL;
 
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PROGENY.npt_name_s, &accession_s);
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s);
 
-static ParameterSet *IsResourceForParentalGenotypeSearchService (Service * UNUSED_PARAM (service_p), DataResource * UNUSED_PARAM (resource_p), Handler * UNUSED_PARAM (handler_p))
-{
-	return NULL;
-}
+							if ((!IsStringEmpty (accession_s)) || (!IsStringEmpty (population_s)))
+								{
+									const char *chromosome_s = NULL;
+									const double64 *start_p = NULL;
+									const double64 *end_p = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
 
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, &chromosome_s);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_START.npt_name_s, &start_p);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_END.npt_name_s, &end_p);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+									if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+										{
+											DoBreakpointsSearch (job_p, accession_s, population_s, chromosome_s, start_p, end_p, data_p, &deadline);
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_PROGENY.npt_name_s, S_PROGENY.npt_type, "A progeny line or population is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_HAPLOTYPES_S) == 0))
+						{
+							const char *accession_s = NULL;
+							const char *population_s = NULL;
+
+							if (! ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PROGENY.npt_name_s, &accession_s)) && (!IsStringEmpty (accession_s))))
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_PROGENY.npt_name_s, S_PROGENY.npt_type, "A progeny line is required");
+								}
+							else if (! ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s)) && (!IsStringEmpty (population_s))))
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_POPULATION.npt_name_s, S_POPULATION.npt_type, "A population is required");
+								}
+							else
+								{
+									const char *marker_s = NULL;
+									const char *chromosome_s = NULL;
+									const double64 *start_p = NULL;
+									const double64 *end_p = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
+
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_s);
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, &chromosome_s);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_START.npt_name_s, &start_p);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_END.npt_name_s, &end_p);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+									if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+										{
+											DoHaplotypeBlocksSearch (job_p, accession_s, population_s, marker_s, chromosome_s, start_p, end_p, data_p, &deadline);
+											LeaveAdmissionControl (AC_LIGHT);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+										}
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_PATTERN_S) == 0))
+						{
+							const char *pattern_s = NULL;
+							GenotypePattern *pattern_p = NULL;
+
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PATTERN.npt_name_s, &pattern_s);
+
+							if ((pattern_p = ParseGenotypePattern (pattern_s)) != NULL)
+								{
+									const char *population_s = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
+
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+									/*
+									 * This can look at every population and uses its own threads
+									 */
+									if (EnterAdmissionControl (AC_HEAVY, deadline.sd_end_time))
+										{
+											DoPatternSearch (job_p, pattern_p, population_s, data_p, &deadline);
+											LeaveAdmissionControl (AC_HEAVY);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_HEAVY);
+										}
+
+									FreeGenotypePattern (pattern_p);
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_PATTERN.npt_name_s, S_PATTERN.npt_type, "A pattern of marker=call pairs, separated by commas, is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_EXPORT_S) == 0))
+						{
+							const char *population_s = NULL;
+							const char *markers_s = NULL;
+
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s);
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MARKERS.npt_name_s, &markers_s);
+
+							if ((!IsStringEmpty (population_s)) || (!IsStringEmpty (markers_s)))
+								{
+									const char *format_s = NULL;
+									const char *chromosome_s = NULL;
+									const double64 *start_p = NULL;
+									const double64 *end_p = NULL;
+									const uint32 *timeout_p = NULL;
+									SearchDeadline deadline;
+
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_EXPORT_FORMAT.npt_name_s, &format_s);
+									GetCurrentStringParameterValueFromParameterSet (param_set_p, S_CHROMOSOME.npt_name_s, &chromosome_s);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_START.npt_name_s, &start_p);
+									GetCurrentDoubleParameterValueFromParameterSet (param_set_p, S_INTERVAL_END.npt_name_s, &end_p);
+									GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+									InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+									if (EnterAdmissionControl (AC_HEAVY, deadline.sd_end_time))
+										{
+											DoExportSearch (job_p, population_s, markers_s, chromosome_s, start_p, end_p, GetExportFormat (format_s), data_p, &deadline);
+											LeaveAdmissionControl (AC_HEAVY);
+										}
+									else
+										{
+											AddBusyErrorToServiceJob (job_p, AC_HEAVY);
+										}
+								}
+							else
+								{
+									AddParameterErrorMessageToServiceJob (job_p, S_POPULATION.npt_name_s, S_POPULATION.npt_type, "A population or a list of markers is required");
+								}
+						}
+					else if ((mode_s != NULL) && (strcmp (mode_s, S_MODE_SUMMARIES_S) == 0))
+						{
+							const char *population_s = NULL;
+							const uint32 *timeout_p = NULL;
+							SearchDeadline deadline;
+
+							GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s);
+							GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+							InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+							if (EnterAdmissionControl (AC_LIGHT, deadline.sd_end_time))
+								{
+									DoPopulationSummariesSearch (job_p, population_s, data_p, &deadline);
+									LeaveAdmissionControl (AC_LIGHT);
+								}
+							else
+								{
+									AddBusyErrorToServiceJob (job_p, AC_LIGHT);
+								}
+						}
+					else
+						{
+							const char *marker_s = NULL;
+
+							if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_s))
+								{
+									if (!IsStringEmpty (marker_s))
+										{
+											const char *population_s = NULL;
+
+											if (GetCurrentStringParameterValueFromParameterSet (param_set_p, S_POPULATION.npt_name_s, &population_s))
+												{
+													const bool *full_records_flag_p = NULL;
+													const char *format_s = NULL;
+													const uint32 *timeout_p = NULL;
+													bool full_record_flag;
+													uint64 start_time;
+													SearchDeadline deadline;
+													AdmissionClass ac;
+													bool admitted_flag;
+
+													GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_FULL_RECORD.npt_name_s, &full_records_flag_p);
+													full_record_flag = full_records_flag_p ? *full_records_flag_p : false;
+
+													GetCurrentStringParameterValueFromParameterSet (param_set_p, S_RESPONSE_FORMAT.npt_name_s, &format_s);
+
+													GetCurrentUnsignedIntParameterValueFromParameterSet (param_set_p, S_TIMEOUT.npt_name_s, &timeout_p);
+
+													start_time = GetMonotonicTimeInNanoseconds ();
+													InitSearchDeadline (&deadline, GetSearchTimeout (timeout_p, data_p -> pgsd_search_timeout_ms));
+
+													ac = GetSearchAdmissionClass (marker_s, population_s, full_record_flag);
+
+													/*
+													 * A coalesced search only takes an admission slot if it
+													 * has to run the queries itself
+													 */
+													if (data_p -> pgsd_coalesce_searches_flag)
+														{
+															admitted_flag = DoCoalescedSearch (job_p, marker_s, population_s, full_record_flag, GetResponseFormat (format_s), ac, data_p, &timings, &deadline);
+														}
+													else
+														{
+															admitted_flag = DoAdmittedSearch (job_p, marker_s, population_s, full_record_flag, GetResponseFormat (format_s), ac, data_p, &timings, &deadline);
+														}
+
+													if (admitted_flag)
+														{
+															AddSearchToServiceMetrics (data_p -> pgsd_metrics_p, GetMetricsSearchMode (marker_s, population_s, full_record_flag),
+																												 (GetServiceJobStatus (job_p) == OS_SUCCEEDED), GetMonotonicTimeInNanoseconds () - start_time,
+																												 timings.jt_round_trips, timings.jt_docs_fetched);
+														}
+
+												}		/* if (GetParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &population_value, true)) */
+
+										}
+
+								}		/* if (GetParameterValueFromParameterSet (param_set_p, S_MARKER.npt_name_s, &marker_value, true)) */
+
+						}
+
+				}		/* if (param_set_p) */
+
+#if DFW_FIELD_TRIAL_SERVICE_DEBUG >= STM_LEVEL_FINE
+			PrintJSONToLog (STM_LEVEL_FINE, __FILE__, __LINE__, job_p -> sj_metadata_p, "metadata 3: ");
+#endif
+
+			AddJobTimingsToServiceJob (&timings, job_p);
+			LogServiceJob (job_p);
+		}		/* if (service_p -> se_jobs_p) */
+
+	return service_p -> se_jobs_p;
+}
+
+
+static ServiceMetadata *GetParentalGenotypeSearchServiceMetadata (Service * UNUSED_PARAM (service_p))
+{
+	const char *term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "topic_0625";
+	SchemaTerm *category_p = AllocateSchemaTerm (term_url_s, "Genotype and phenotype",
+																							 "The study of genetic constitution of a living entity, such as an individual, and organism, a cell and so on, "
+																							 "typically with respect to a particular observable phenotypic traits, or resources concerning such traits, which "
+																							 "might be an aspect of biochemistry, physiology, morphology, anatomy, development and so on.");
+
+	if (category_p)
+		{
+			SchemaTerm *subcategory_p;
+
+			term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "operation_0304";
+			subcategory_p = AllocateSchemaTerm (term_url_s, "Query and retrieval", "Search or query a data resource and retrieve entries and / or annotation.");
+
+			if (subcategory_p)
+				{
+					ServiceMetadata *metadata_p = AllocateServiceMetadata (category_p, subcategory_p);
+
+					if (metadata_p)
+						{
+							SchemaTerm *input_p;
+
+							term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "data_0968";
+							input_p = AllocateSchemaTerm (term_url_s, "Keyword",
+																						"Boolean operators (AND, OR and NOT) and wildcard characters may be allowed. Keyword(s) or phrase(s) used (typically) for text-searching purposes.");
+
+							if (input_p)
+								{
+									if (AddSchemaTermToServiceMetadataInput (metadata_p, input_p))
+										{
+											SchemaTerm *output_p;
+
+
+											/* Genotype */
+											term_url_s = CONTEXT_PREFIX_EXPERIMENTAL_FACTOR_ONTOLOGY_S "EFO_0000513";
+											output_p = AllocateSchemaTerm (term_url_s, "genotype", "Information, making the distinction between the actual physical material "
+																										 "(e.g. a cell) and the information about the genetic content (genotype).");
+
+											if (output_p)
+												{
+													if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p))
+														{
+															return metadata_p;
+														}		/* if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p)) */
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add output term %s to service metadata", term_url_s);
+															FreeSchemaTerm (output_p);
+														}
+
+												}		/* if (output_p) */
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate output term %s for service metadata", term_url_s);
+												}
+
+										}		/* if (AddSchemaTermToServiceMetadataInput (metadata_p, input_p)) */
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add input term %s to service metadata", term_url_s);
+											FreeSchemaTerm (input_p);
+										}
+
+								}		/* if (input_p) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate input term %s for service metadata", term_url_s);
+								}
+
+							FreeServiceMetadata (metadata_p);
+						}		/* if (metadata_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate service metadata");
+						}
+
+				}		/* if (subcategory_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate sub-category term %s for service metadata", term_url_s);
+				}
+
+		}		/* if (category_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate category term %s for service metadata", term_url_s);
+		}
+
+	return NULL;
+}
+
+
+static ParameterSet *IsResourceForParentalGenotypeSearchService (Service * UNUSED_PARAM (service_p), DataResource * UNUSED_PARAM (resource_p), Handler * UNUSED_PARAM (handler_p))
+{
+	return NULL;
+}
 
 
 
-static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, ParentalGenotypeServiceData *data_p)
+
+static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p)
 {
 	OperationStatus status = OS_FAILED_TO_START;
 	bson_t *query_p = bson_new ();
+	ResultSpool spool;
+	JobArena arena;
+
+	InitResultSpool (&spool, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s);
+	InitJobArena (&arena);
 
 	if (query_p)
 		{
@@ -417,12 +1101,13 @@ static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char
 				{
 					if (!IsStringEmpty (population_s))
 						{
-							if ((results_p = DoPopulationSearch (query_p, population_s, marker_s, escaped_marker_s, data_p)) != NULL)
+							if ((results_p = DoPopulationSearch (query_p, population_s, marker_s, escaped_marker_s, data_p, timings_p, deadline_p)) != NULL)
 								{
 									/*
 									 * Check whether we need to amalgamate the results
 									 */
 									size_t num_results = json_array_size (results_p);
+									const uint64 amalgamation_start = StartJobTimer (timings_p);
 
 									if (num_results > 0)
 										{
@@ -489,12 +1174,7 @@ static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char
 
 										}		/* if (num_results > 0) */
 
-									/*
-									 * Since we've done a search for a population with no marker specified,
-									 * we need to return all of the markers, i.e. the full record, so
-									 * we need to make sure that the flag for this is set.
-									 */
-									full_record_flag = true;
+									StopJobTimer (timings_p, JTS_AMALGAMATION, amalgamation_start);
 								}
 							else
 								{
@@ -505,26 +1185,14 @@ static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char
 						}		/* if (IsStringEmpty (population_s)) */
 					else if (!IsStringEmpty (marker_s))
 						{
-							if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
-								{
-									bson_t *child_p = BCON_NEW ("$exists", BCON_BOOL (true));
-
-									if (child_p)
-										{
-											if (BSON_APPEND_DOCUMENT (query_p, escaped_marker_s ? escaped_marker_s : marker_s, child_p))
-												{
-													results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, NULL);
-												}
-
-											bson_destroy (child_p);
-										}
-									else
-										{
-
-										}
-
-								}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_accessions_collection_s)) */
-
+							/*
+							 * Read the populations from the cursor one at a time so that
+							 * only the results that fit within the budget are kept in
+							 * memory. If only the marker and population details are
+							 * returned, they are read straight from the BSON rather than
+							 * converting the whole population.
+							 */
+							status = DoMarkerCursorSearch (job_p, marker_s, escaped_marker_s ? escaped_marker_s : marker_s, full_record_flag, format, data_p, timings_p, deadline_p, &spool, &arena);
 						}		/* if (IsStringEmpty (marker_s)) */
 					else
 						{
@@ -542,79 +1210,34 @@ static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char
 									size_t num_added = 0;
 									const size_t num_results = json_array_size (results_p);
 
-									for (i = 0; i < num_results; ++ i)
+									/*
+									 * Since we've done a search for a population, we need to return
+									 * all of the markers, i.e. the full records. Stop wrapping the
+									 * results if we run out of time and send back what we have so far.
+									 */
+									for (i = 0; (i < num_results) && (!HasSearchDeadlinePassed (deadline_p)); ++ i)
 										{
 											json_t *entry_p = json_array_get (results_p, i);
-											const char *name_s = GetJSONString (entry_p, PGS_POPULATION_NAME_S);
-											json_t *dest_record_p = NULL;
-
-											json_object_del (entry_p, MONGO_ID_S);
+											json_t *dest_record_p = GetFullRecordResult (entry_p, format, timings_p, &arena);
 
-
-											if (full_record_flag)
+											if (dest_record_p)
 												{
-													/*
-													 * We need to escape any keys that have [dot] in them
-													 */
-
-													if (UnescapeAllKeys (entry_p))
+													if (AddResultToResultSpool (&spool, job_p, dest_record_p))
 														{
-															dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, name_s, entry_p);
+															++ num_added;
 														}
 													else
 														{
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, entry_p, "UnescapeAllKeys failed");
+															json_decref (dest_record_p);
 														}
-												}
-											else
-												{
-													json_t *doc_p = json_object ();
-
-													if (doc_p)
-														{
-															if (CopyJSONString (entry_p, PGS_PARENT_A_S, doc_p, NULL))
-																{
-																	if (CopyJSONString (entry_p, PGS_PARENT_B_S, doc_p, NULL))
-																		{
-																			json_t *marker_p = json_object_get (entry_p, escaped_marker_s ? escaped_marker_s : marker_s);
 
-																			if (marker_p)
-																				{
-																					if (json_object_set (doc_p, marker_s, marker_p) == 0)
-																						{
-																							dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, name_s, doc_p);
-																						}
-																				}
+												}		/* if (dest_record_p) */
 
-																		}		/* if (CopyJSONString (entry_p, doc_p, PGS_PARENT_B_S)) */
-																	else
-																		{
-																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, entry_p, "Failed to copy %s", PGS_PARENT_B_S);
-																		}
-
-																}		/* if (CopyJSONString (entry_p, doc_p, PGS_PARENT_A_S)) */
-															else
-																{
-																	PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, entry_p, "Failed to copy %s", PGS_PARENT_A_S);
-																}
-
-															json_decref (doc_p);
-														}		/* if (doc_p) */
-
-												}
-
-											if (dest_record_p)
-												{
-													if (AddResultToServiceJob (job_p, dest_record_p))
-														{
-															++ num_added;
-														}
-													else
-														{
-															json_decref (dest_record_p);
-														}
-
-												}		/* if (dest_record_p) */
+											/*
+											 * Release each raw record as soon as it has been wrapped so
+											 * that we don't hold two copies of every result at once
+											 */
+											json_array_set_new (results_p, i, json_null ());
 
 											if (population_s)
 												{
@@ -651,11 +1274,37 @@ static void DoSearch (ServiceJob *job_p, const char * const marker_s, const char
 			bson_destroy (query_p);
 		}		/* if (query_p) */
 
+	if (timings_p -> jt_enabled_flag)
+		{
+			AddJobArenaToServiceJob (&arena, job_p);
+		}
+
+	ClearJobArena (&arena);
+
+	if (!FinishResultSpool (&spool, job_p))
+		{
+			/*
+			 * The spooled results are lost but any that were kept
+			 * in memory can still be sent back
+			 */
+			status = (spool.rs_used > 0) ? OS_PARTIALLY_SUCCEEDED : OS_FAILED;
+		}
+
+	if (HasSearchDeadlinePassed (deadline_p))
+		{
+			/*
+			 * Whatever we have gathered before running out of time
+			 * is still sent back.
+			 */
+			status = OS_PARTIALLY_SUCCEEDED;
+			AddTimedOutToServiceJob (job_p);
+		}
+
 	SetServiceJobStatus (job_p, status);
 }
 
 
-static json_t *DoPopulationSearch (bson_t *query_p, const char * const population_s, const char * const marker_s, const char * const escaped_marker_s, ParentalGenotypeServiceData *data_p)
+static json_t *DoPopulationSearch (bson_t *query_p, const char * const population_s, const char * const marker_s, const char * const escaped_marker_s, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p)
 {
 	json_t *results_p = NULL;
 
@@ -667,7 +1316,17 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 
 					if (results_p)
 						{
-							json_t *population_id_results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, NULL);
+							const uint64 lookup_start = StartJobTimer (timings_p);
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+							json_t *population_id_results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+							StopJobTimer (timings_p, JTS_VARIETIES_LOOKUP, lookup_start);
+							AddMongoFetchToJobTimings (timings_p, population_id_results_p);
+
+							if (opts_p)
+								{
+									bson_destroy (opts_p);
+								}
 
 							if (population_id_results_p)
 								{
@@ -675,7 +1334,7 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 									size_t i = 0;
 									bool success_flag = true;
 
-									while ((i < num_results) && success_flag)
+									while ((i < num_results) && success_flag && (!HasSearchDeadlinePassed (deadline_p)))
 										{
 											const json_t *entry_p = json_array_get (population_id_results_p, i);
 											const json_t *population_ids_p = json_object_get (entry_p, PGS_VARIETY_IDS_S);
@@ -689,7 +1348,7 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 
 															if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
 																{
-																	while ((j < num_ids) && success_flag)
+																	while ((j < num_ids) && success_flag && (!HasSearchDeadlinePassed (deadline_p)))
 																		{
 																			const json_t *population_id_p = json_array_get (population_ids_p, j);
 																			bson_oid_t population_oid;
@@ -697,63 +1356,89 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 
 																			if (GetIdFromJSONKeyValuePair (population_id_p, &population_oid))
 																				{
-																					/*
-																					 * Now we have the id we can get the population
-																					 */
-																					 bson_t *pop_query_p = bson_new ();
-
-																					 if (pop_query_p)
-																						 {
-																							 if (BSON_APPEND_OID (pop_query_p, "_id", &population_oid))
-																								 {
-																									 json_t *populations_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, pop_query_p, NULL);
-
-																									 if (populations_p)
-																										 {
-																											 if ((json_is_array (populations_p)) && (json_array_size (populations_p) == 1))
-																												 {
-																													 json_t *population_p = json_array_get (populations_p, 0);
-
-																													 if (IsStringEmpty (marker_s))
-																														 {
-																															 /*
-																															  * Add all of the markers
-																															  */
-																															 if (json_array_append (results_p, population_p) == 0)
-																																 {
-																																	 added_flag = true;
-																																 }
-																														 }
-																													 else
+																						/*
+																						 * Now we have the id we can get the population
+																						 */
+																						 bson_t *pop_query_p = bson_new ();
+
+																						 if (pop_query_p)
+																							 {
+																								 if (BSON_APPEND_OID (pop_query_p, "_id", &population_oid))
+																									 {
+																										 /*
+																										  * If the population's filter shows that it can't contain the marker,
+																										  * it is only returned if it has been changed since the filter was built.
+																										  */
+																										 const int32 num_excluded = ((data_p -> pgsd_population_filters_flag) && (!IsStringEmpty (marker_s))) ? AddPopulationFilterToQuery (pop_query_p, &population_oid, escaped_marker_s ? escaped_marker_s : marker_s) : 0;
+																										 const uint64 fetch_start = StartJobTimer (timings_p);
+																										 bson_t *pop_opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+																										 json_t *populations_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, pop_query_p, pop_opts_p);
+
+																										 StopJobTimer (timings_p, JTS_POPULATION_FETCH, fetch_start);
+																										 AddMongoFetchToJobTimings (timings_p, populations_p);
+
+																										 if (pop_opts_p)
+																											 {
+																												 bson_destroy (pop_opts_p);
+																											 }
+
+																										 if (populations_p)
+																											 {
+																												 if ((json_is_array (populations_p)) && (json_array_size (populations_p) == 1))
+																													 {
+																														 json_t *population_p = json_array_get (populations_p, 0);
+
+																														 if (!LoadHaplotypeBlockMarkers (population_p, marker_s, data_p, deadline_p))
+																															 {
+																																 PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the markers for \"%s\" from its haplotype blocks", population_s);
+																															 }
+																														 else if (IsStringEmpty (marker_s))
+																															 {
+																																 /*
+																																  * Add all of the markers
+																																  */
+																																 if (json_array_append (results_p, population_p) == 0)
+																																	 {
+																																		 added_flag = true;
+																																	 }
+																															 }
+																														 else
+																															 {
+																																 /*
+																																  * Just add our marker
+																																  */
+																																 json_t *marker_only_p = GetForNamedMarker (population_p, escaped_marker_s ? escaped_marker_s : marker_s, marker_s);
+
+																																 if (marker_only_p)
+																																	 {
+																																		 if (json_array_append_new (results_p, marker_only_p) == 0)
+																																			 {
+																																				 added_flag = true;
+																																			 }
+																																		 else
+																																			 {
+																																				 json_decref (marker_only_p);
+																																			 }
+																																	 }
+
+																															 }
+
+																													 }		/* if ((json_is_array (populations_p)) && (json_array_size (populations_p) == 1)) */
+																													 else if ((num_excluded > 0) && (json_is_array (populations_p)) && (json_array_size (populations_p) == 0))
 																														 {
 																															 /*
-																															  * Just add our marker
+																															  * It hasn't changed since its filter showed that it doesn't have the marker
 																															  */
-																															 json_t *marker_only_p = GetForNamedMarker (population_p, escaped_marker_s ? escaped_marker_s : marker_s, marker_s);
-
-																															 if (marker_only_p)
-																																 {
-																																	 if (json_array_append_new (results_p, marker_only_p) == 0)
-																																		 {
-																																			 added_flag = true;
-																																		 }
-																																	 else
-																																		 {
-																																			 json_decref (marker_only_p);
-																																		 }
-																																 }
-
+																															 added_flag = true;
 																														 }
 
-																												 }		/* if ((json_is_array (populations_p)) && (json_array_size (populations_p) == 1)) */
+																												 json_decref (populations_p);
+																											 }		/* if (populations_p) */
 
-																											 json_decref (populations_p);
-																										 }		/* if (populations_p) */
+																									 }		/* if (BSON_APPEND_OID (pop_query_p, "_id", &population_oid)) */
 
-																								 }		/* if (BSON_APPEND_OID (pop_query_p, "_id", &population_oid)) */
-
-																							 bson_destroy (pop_query_p);
-																						 }		/* if (pop_query_p) */
+																								 bson_destroy (pop_query_p);
+																							 }		/* if (pop_query_p) */
 
 																				}		/* if (GetIdFromJSONKeyValuePair (population_id_p, &population_oid)) */
 																			else
@@ -765,8 +1450,12 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 																				{
 																					++ j;
 																				}
-																			else
+																			else if (!HasSearchDeadlinePassed (deadline_p))
 																				{
+																					/*
+																					 * If the query was stopped by maxTimeMS, keep the
+																					 * populations that we already have
+																					 */
 																					success_flag = false;
 																				}
 																		}		/* while ((j < num_ids) && success_flag) */
@@ -803,6 +1492,62 @@ static json_t *DoPopulationSearch (bson_t *query_p, const char * const populatio
 }
 
 
+/*
+ * Wrap a whole population from a search as a result, in the requested
+ * format.
+ */
+static json_t *GetFullRecordResult (json_t *entry_p, const ResponseFormat format, JobTimings *timings_p, JobArena *arena_p)
+{
+	const char *name_s = GetJSONString (entry_p, PGS_POPULATION_NAME_S);
+	json_t *dest_record_p = NULL;
+
+	json_object_del (entry_p, MONGO_ID_S);
+
+	if (format != RF_JSON)
+		{
+			/*
+			 * The compact layout unescapes the marker names itself
+			 */
+			const uint64 wrapping_start = StartJobTimer (timings_p);
+			json_t *compact_p = GetPopulationInCompactFormat (entry_p, format, arena_p);
+
+			if (compact_p)
+				{
+					dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, name_s, compact_p);
+					json_decref (compact_p);
+				}
+
+			StopJobTimer (timings_p, JTS_RESULT_WRAPPING, wrapping_start);
+		}
+	else
+		{
+			/*
+			 * We need to escape any keys that have [dot] in them
+			 */
+
+			const uint64 unescape_start = StartJobTimer (timings_p);
+			const bool unescaped_flag = UnescapeAllKeys (entry_p, arena_p);
+
+			StopJobTimer (timings_p, JTS_UNESCAPE_KEYS, unescape_start);
+
+			if (unescaped_flag)
+				{
+					const uint64 wrapping_start = StartJobTimer (timings_p);
+
+					dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, name_s, entry_p);
+
+					StopJobTimer (timings_p, JTS_RESULT_WRAPPING, wrapping_start);
+				}
+			else
+				{
+					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, entry_p, "UnescapeAllKeys failed");
+				}
+		}
+
+	return dest_record_p;
+}
+
+
 
 static json_t *GetForNamedMarker (const json_t *src_p, const char * const src_marker_s, const char * const dest_marker_s)
 {
@@ -834,80 +1579,1562 @@ static json_t *GetForNamedMarker (const json_t *src_p, const char * const src_ma
 }
 
 
-static bool CopyJSONString (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s)
+static OperationStatus DoMarkerCursorSearch (ServiceJob *job_p, const char * const marker_s, const char * const escaped_marker_s, const bool full_record_flag, const ResponseFormat format, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p, ResultSpool *spool_p, JobArena *arena_p)
 {
-	bool success_flag = false;
-	const char *value_s = GetJSONString (src_p, src_key_s);
+	OperationStatus status = OS_FAILED;
 
-	if (value_s)
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
 		{
-			if (SetJSONString (dest_p, dest_key_s ? dest_key_s : src_key_s, value_s))
+			/*
+			 * Populations that are only stored as haplotype blocks
+			 * list their markers rather than having them as fields
+			 */
+			bson_t *query_p = BCON_NEW ("$or", "[",
+																		"{", escaped_marker_s, "{", "$exists", BCON_BOOL (true), "}", "}",
+																		"{", PGS_MARKERS_S, BCON_UTF8 (escaped_marker_s), "}",
+																	"]");
+
+			if (query_p)
 				{
-					success_flag = true;
+					/*
+					 * Skip the populations whose filters show that they
+					 * can't have the marker
+					 */
+					const int32 num_excluded = (data_p -> pgsd_population_filters_flag) ? AddPopulationFiltersToQuery (query_p, escaped_marker_s) : 0;
+
+					if (num_excluded >= 0)
+						{
+							bson_t *opts_p = GetSearchDeadlineQueryOptions (deadline_p);
+
+							if (!opts_p)
+								{
+									opts_p = bson_new ();
+								}
+
+							if (opts_p)
+								{
+									/*
+									 * Full records need the whole population, otherwise only
+									 * the details that go into the result are fetched
+									 */
+									if (full_record_flag || (AddMarkerProjection (opts_p, escaped_marker_s)))
+										{
+											const uint64 fetch_start = StartJobTimer (timings_p);
+
+											if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p))
+												{
+													MarkerCursorSearch search;
+
+													StopJobTimer (timings_p, JTS_MARKER_FETCH, fetch_start);
+
+													search.mcs_job_p = job_p;
+													search.mcs_spool_p = spool_p;
+													search.mcs_marker_s = marker_s;
+													search.mcs_escaped_marker_s = escaped_marker_s;
+													search.mcs_format = format;
+													search.mcs_deadline_p = deadline_p;
+													search.mcs_timings_p = timings_p;
+													search.mcs_arena_p = arena_p;
+													search.mcs_num_docs = 0;
+													search.mcs_num_bytes = 0;
+													search.mcs_num_added = 0;
+													search.mcs_blocks_only_p = json_array ();
+
+													if (search.mcs_blocks_only_p)
+														{
+															if (IterateOverMongoResults (data_p -> pgsd_mongo_p, full_record_flag ? AddBSONFullRecordResult : AddBSONMarkerResult, &search) < 0)
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read results for marker \"%s\"", marker_s);
+																}
+
+															AddBSONFetchToJobTimings (timings_p, search.mcs_num_docs, search.mcs_num_bytes);
+
+															AddBlocksOnlyPopulationResults (&search, full_record_flag, data_p);
+
+															json_decref (search.mcs_blocks_only_p);
+														}
+
+													if (search.mcs_num_added == search.mcs_num_docs)
+														{
+															status = OS_SUCCEEDED;
+														}
+													else if (search.mcs_num_added > 0)
+														{
+															status = OS_PARTIALLY_SUCCEEDED;
+														}
+
+												}		/* if (FindMatchingMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, opts_p)) */
+											else
+												{
+													PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, query_p, "Failed to find populations with marker \"%s\"", marker_s);
+												}
+										}
+
+									bson_destroy (opts_p);
+								}		/* if (opts_p) */
+						}		/* if (num_excluded >= 0) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return status;
+}
+
+
+/*
+ * Pull the name, parents and requested marker out of a population and
+ * add them straight to the job's results. Nothing else in the
+ * document is converted.
+ */
+static bool AddBSONMarkerResult (const bson_t *doc_p, void *data_p)
+{
+	MarkerCursorSearch *search_p = (MarkerCursorSearch *) data_p;
+	const char *parent_a_s;
+	const char *parent_b_s;
+	bson_iter_t iter;
+
+	++ (search_p -> mcs_num_docs);
+	search_p -> mcs_num_bytes += doc_p -> len;
+
+	if (HasSearchDeadlinePassed (search_p -> mcs_deadline_p))
+		{
+			return false;
+		}
+
+	if (IsBSONHaplotypeBlocksOnlyPopulation (doc_p))
+		{
+			return AddBlocksOnlyPopulation (search_p, doc_p);
+		}
+
+	parent_a_s = GetBSONString (doc_p, PGS_PARENT_A_S);
+	parent_b_s = GetBSONString (doc_p, PGS_PARENT_B_S);
+
+	if (parent_a_s && parent_b_s)
+		{
+			if ((bson_iter_init_find (&iter, doc_p, search_p -> mcs_escaped_marker_s)) && (BSON_ITER_HOLDS_DOCUMENT (&iter)))
+				{
+					json_t *marker_p = GetBSONIterAsJSON (&iter);
+
+					if (marker_p)
+						{
+							if (AddMarkerResult (search_p, GetBSONString (doc_p, PGS_POPULATION_NAME_S), parent_a_s, parent_b_s, marker_p))
+								{
+									++ (search_p -> mcs_num_added);
+								}
+						}
 				}
 		}
+	else
+		{
+			PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to get %s and %s", PGS_PARENT_A_S, PGS_PARENT_B_S);
+		}
 
-	return success_flag;
+	return true;
 }
 
 
-static bool CopyJSONObject (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s)
+/*
+ * Wrap the parents and a marker as a result and add it to the job's
+ * results. This takes ownership of marker_p.
+ */
+static bool AddMarkerResult (MarkerCursorSearch *search_p, const char *population_s, const char *parent_a_s, const char *parent_b_s, json_t *marker_p)
 {
 	bool success_flag = false;
-	json_t *value_p = json_object_get (src_p, src_key_s);
+	const uint64 wrapping_start = StartJobTimer (search_p -> mcs_timings_p);
+	json_t *result_p = json_object ();
 
-	if (value_p)
+	if (result_p)
 		{
-			if (json_object_set (dest_p, dest_key_s ? dest_key_s : src_key_s, value_p) == 0)
+			if ((SetJSONString (result_p, PGS_PARENT_A_S, parent_a_s)) && (SetJSONString (result_p, PGS_PARENT_B_S, parent_b_s)))
 				{
-					success_flag = true;
+					if (json_object_set_new (result_p, search_p -> mcs_marker_s, marker_p) == 0)
+						{
+							json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, population_s, result_p);
+
+							marker_p = NULL;
+
+							if (dest_record_p)
+								{
+									if (AddResultToResultSpool (search_p -> mcs_spool_p, search_p -> mcs_job_p, dest_record_p))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											json_decref (dest_record_p);
+										}
+								}
+						}
 				}
+
+			json_decref (result_p);
+		}		/* if (result_p) */
+
+	if (marker_p)
+		{
+			json_decref (marker_p);
 		}
 
+	StopJobTimer (search_p -> mcs_timings_p, JTS_RESULT_WRAPPING, wrapping_start);
+
 	return success_flag;
 }
 
 
-static bool UnescapeAllKeys (json_t *src_p)
+/*
+ * Convert each population to JSON only as it is read from the cursor
+ * so that no more than one of them is held at once apart from the
+ * results that fit within the budget.
+ */
+static bool AddBSONFullRecordResult (const bson_t *doc_p, void *data_p)
 {
-	const char *key_s;
-	json_t *value_p;
-	void *tmp_p;
+	MarkerCursorSearch *search_p = (MarkerCursorSearch *) data_p;
+	json_t *entry_p;
 
-	json_object_foreach_safe (src_p, tmp_p, key_s, value_p)
+	++ (search_p -> mcs_num_docs);
+	search_p -> mcs_num_bytes += doc_p -> len;
+
+	if (HasSearchDeadlinePassed (search_p -> mcs_deadline_p))
 		{
-			if (strstr (key_s, PGS_ESCAPED_DOT_S))
-				{
-					char *unescaped_key_s = NULL;
+			return false;
+		}
+
+	if (IsBSONHaplotypeBlocksOnlyPopulation (doc_p))
+		{
+			return AddBlocksOnlyPopulation (search_p, doc_p);
+		}
+
+	entry_p = ConvertBSONToJSON (doc_p);
+
+	if (entry_p)
+		{
+			json_t *dest_record_p = GetFullRecordResult (entry_p, search_p -> mcs_format, search_p -> mcs_timings_p, search_p -> mcs_arena_p);
 
-					if (SearchAndReplaceInString (key_s, &unescaped_key_s, PGS_ESCAPED_DOT_S, "."))
+			if (dest_record_p)
+				{
+					if (AddResultToResultSpool (search_p -> mcs_spool_p, search_p -> mcs_job_p, dest_record_p))
 						{
-							if (json_object_set (src_p, unescaped_key_s, value_p) == 0)
-								{
-									if (json_object_del (src_p, key_s) != 0)
-										{
-											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, src_p, "Failed to delete \"%s\" key", key_s);
-											return false;
-										}
+							++ (search_p -> mcs_num_added);
+						}
+					else
+						{
+							json_decref (dest_record_p);
+						}
+				}
 
-								}		/* if (json_object_set (src_p, value_p) != 0) */
-							else
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, src_p, "Failed to set \"%s\" key", unescaped_key_s);
-									return false;
-								}
+			json_decref (entry_p);
+		}
+	else
+		{
+			PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to convert population to JSON");
+		}
 
-							if (unescaped_key_s)
-								{
-									FreeCopiedString (unescaped_key_s);
-								}
+	return true;
+}
 
-						}		/* if (SearchAndReplaceInString (key_s, &unescaped_key_s, PGS_ESCAPED_DOT_S, ".")) */
 
-				}		/* if (strstr (key_s, PGS_ESCAPED_DOT_S)) */
+static bool IsBSONHaplotypeBlocksOnlyPopulation (const bson_t *doc_p)
+{
+	bson_iter_t iter;
 
-		}		/* json_object_foreach_safe (src_p, key_s, value_p) */
+	return ((bson_iter_init_find (&iter, doc_p, PGS_HAPLOTYPE_BLOCKS_ONLY_S)) && (BSON_ITER_HOLDS_BOOL (&iter)) && (bson_iter_bool (&iter)));
+}
+
+
+static bool AddBlocksOnlyPopulation (MarkerCursorSearch *search_p, const bson_t *doc_p)
+{
+	json_t *population_p = ConvertBSONToJSON (doc_p);
+
+	if (population_p)
+		{
+			if (json_array_append_new (search_p -> mcs_blocks_only_p, population_p) != 0)
+				{
+					json_decref (population_p);
+				}
+		}
+	else
+		{
+			PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to convert population to JSON");
+		}
 
 	return true;
 }
 
+
+/*
+ * Now that the cursor has finished, decode the populations that
+ * are only stored as haplotype blocks and add their results.
+ */
+static void AddBlocksOnlyPopulationResults (MarkerCursorSearch *search_p, const bool full_record_flag, ParentalGenotypeServiceData *data_p)
+{
+	const size_t num_populations = json_array_size (search_p -> mcs_blocks_only_p);
+	size_t i;
+
+	for (i = 0; (i < num_populations) && (!HasSearchDeadlinePassed (search_p -> mcs_deadline_p)); ++ i)
+		{
+			json_t *population_p = json_array_get (search_p -> mcs_blocks_only_p, i);
+
+			if (LoadHaplotypeBlockMarkers (population_p, full_record_flag ? NULL : search_p -> mcs_marker_s, data_p, search_p -> mcs_deadline_p))
+				{
+					if (full_record_flag)
+						{
+							json_t *dest_record_p = GetFullRecordResult (population_p, search_p -> mcs_format, search_p -> mcs_timings_p, search_p -> mcs_arena_p);
+
+							if (dest_record_p)
+								{
+									if (AddResultToResultSpool (search_p -> mcs_spool_p, search_p -> mcs_job_p, dest_record_p))
+										{
+											++ (search_p -> mcs_num_added);
+										}
+									else
+										{
+											json_decref (dest_record_p);
+										}
+								}
+						}
+					else
+						{
+							const char *parent_a_s = GetJSONString (population_p, PGS_PARENT_A_S);
+							const char *parent_b_s = GetJSONString (population_p, PGS_PARENT_B_S);
+							json_t *marker_p = json_object_get (population_p, search_p -> mcs_escaped_marker_s);
+
+							if (parent_a_s && parent_b_s && marker_p)
+								{
+									if (AddMarkerResult (search_p, GetJSONString (population_p, PGS_POPULATION_NAME_S), parent_a_s, parent_b_s, json_incref (marker_p)))
+										{
+											++ (search_p -> mcs_num_added);
+										}
+								}
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, population_p, "Failed to get %s, %s and \"%s\"", PGS_PARENT_A_S, PGS_PARENT_B_S, search_p -> mcs_marker_s);
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" from the haplotype blocks of \"%s\"", search_p -> mcs_marker_s, GetJSONString (population_p, PGS_POPULATION_NAME_S));
+				}
+		}
+}
+
+
+/*
+ * If a population is only stored as haplotype blocks, decode its markers
+ * back into it so that it can be used like any other population. Decoding
+ * uses the haplotype blocks collection so the MongoTool is set back to the
+ * populations afterwards.
+ */
+static bool LoadHaplotypeBlockMarkers (json_t *population_p, const char * const marker_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	bool success_flag = true;
+
+	if (IsHaplotypeBlocksOnlyPopulation (population_p))
+		{
+			success_flag = AddHaplotypeBlockMarkers (population_p, marker_s, data_p, deadline_p);
+
+			if (!SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AddMarkerProjection (bson_t *opts_p, const char * const escaped_marker_s)
+{
+	bson_t projection;
+
+	if (BSON_APPEND_DOCUMENT_BEGIN (opts_p, "projection", &projection))
+		{
+			const bool projection_flag = (BSON_APPEND_INT32 (&projection, PGS_POPULATION_NAME_S, 1)) &&
+				(BSON_APPEND_INT32 (&projection, PGS_PARENT_A_S, 1)) &&
+				(BSON_APPEND_INT32 (&projection, PGS_PARENT_B_S, 1)) &&
+				(BSON_APPEND_INT32 (&projection, PGS_HAPLOTYPE_BLOCKS_ONLY_S, 1)) &&
+				(BSON_APPEND_INT32 (&projection, escaped_marker_s, 1));
+
+			if ((bson_append_document_end (opts_p, &projection)) && projection_flag)
+				{
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static bool CopyJSONString (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s)
+{
+	bool success_flag = false;
+	const char *value_s = GetJSONString (src_p, src_key_s);
+
+	if (value_s)
+		{
+			if (SetJSONString (dest_p, dest_key_s ? dest_key_s : src_key_s, value_s))
+				{
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool CopyJSONObject (const json_t *src_p, const char *src_key_s, json_t *dest_p, const char *dest_key_s)
+{
+	bool success_flag = false;
+	json_t *value_p = json_object_get (src_p, src_key_s);
+
+	if (value_p)
+		{
+			if (json_object_set (dest_p, dest_key_s ? dest_key_s : src_key_s, value_p) == 0)
+				{
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool UnescapeAllKeys (json_t *src_p, JobArena *arena_p)
+{
+	const char *key_s;
+	json_t *value_p;
+	void *tmp_p;
+
+	json_object_foreach_safe (src_p, tmp_p, key_s, value_p)
+		{
+			if (strstr (key_s, PGS_ESCAPED_DOT_S))
+				{
+					const char *unescaped_key_s = SearchAndReplaceInStringInJobArena (arena_p, key_s, PGS_ESCAPED_DOT_S, ".");
+
+					if (unescaped_key_s)
+						{
+							if (json_object_set (src_p, unescaped_key_s, value_p) == 0)
+								{
+									if (json_object_del (src_p, key_s) != 0)
+										{
+											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, src_p, "Failed to delete \"%s\" key", key_s);
+											return false;
+										}
+
+								}		/* if (json_object_set (src_p, value_p) != 0) */
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, src_p, "Failed to set \"%s\" key", unescaped_key_s);
+									return false;
+								}
+
+						}		/* if (unescaped_key_s) */
+
+				}		/* if (strstr (key_s, PGS_ESCAPED_DOT_S)) */
+
+		}		/* json_object_foreach_safe (src_p, key_s, value_p) */
+
+	/*
+	 * json_object_set () copies the keys so they are no longer needed
+	 */
+	ResetJobArena (arena_p);
+
+	return true;
+}
+
+
+static void DoMetrics (ServiceJob *job_p, ParentalGenotypeServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	char *metrics_s = GetServiceMetricsAsText (data_p -> pgsd_metrics_p);
+
+	if (metrics_s)
+		{
+			json_t *doc_p = json_object ();
+
+			if (doc_p)
+				{
+					if (SetJSONString (doc_p, "content_type", "text/plain; version=0.0.4"))
+						{
+							if (SetJSONString (doc_p, "metrics", metrics_s))
+								{
+									json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, "metrics", doc_p);
+
+									if (dest_record_p)
+										{
+											if (AddResultToServiceJob (job_p, dest_record_p))
+												{
+													status = OS_SUCCEEDED;
+												}
+											else
+												{
+													json_decref (dest_record_p);
+												}
+										}
+								}
+						}
+
+					json_decref (doc_p);
+				}		/* if (doc_p) */
+
+			FreeCopiedString (metrics_s);
+		}		/* if (metrics_s) */
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static MetricsSearchMode GetMetricsSearchMode (const char * const marker_s, const char * const population_s, const bool full_record_flag)
+{
+	MetricsSearchMode mode;
+
+	if (IsStringEmpty (population_s))
+		{
+			mode = full_record_flag ? MSM_FULL_RECORD : MSM_MARKER;
+		}
+	else
+		{
+			mode = IsStringEmpty (marker_s) ? MSM_POPULATION : MSM_MARKER_AND_POPULATION;
+		}
+
+	return mode;
+}
+
+
+/*
+ * If an identical search is already running, wait for its results
+ * rather than sending the same queries to the database again. The
+ * waiting doesn't use an admission slot, only running the search does.
+ *
+ * Returns false if the search had to be run but couldn't get a slot.
+ */
+static bool DoCoalescedSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, const AdmissionClass ac, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p)
+{
+	bool admitted_flag = true;
+	bool done_flag = false;
+	char *key_s = GetSearchKey (marker_s, population_s, full_record_flag, format);
+
+	if (key_s)
+		{
+			bool leader_flag = false;
+			InFlightSearch *search_p = JoinInFlightSearch (key_s, &leader_flag);
+
+			if (search_p)
+				{
+					if (leader_flag)
+						{
+							admitted_flag = DoAdmittedSearch (job_p, marker_s, population_s, full_record_flag, format, ac, data_p, timings_p, deadline_p);
+
+							/*
+							 * If we couldn't get a slot, there are no results to share and
+							 * the waiting callers will try to run the search themselves.
+							 * The same goes for results that went over budget, since only
+							 * those in memory could be shared and the spool file is deleted
+							 * once it has been collected.
+							 */
+							PublishInFlightSearch (search_p, (admitted_flag && !HasSpooledResults (job_p)) ? job_p -> sj_result_p : NULL, GetServiceJobStatus (job_p));
+
+							done_flag = true;
+						}
+					else
+						{
+							OperationStatus status = OS_FAILED;
+							json_t *results_p = WaitForInFlightSearch (search_p, deadline_p, &status);
+
+							if (deadline_p -> sd_expired_flag)
+								{
+									/*
+									 * We ran out of time waiting so there is nothing to send back
+									 */
+									done_flag = true;
+
+									SetServiceJobStatus (job_p, OS_PARTIALLY_SUCCEEDED);
+									AddTimedOutToServiceJob (job_p);
+								}
+							else if (results_p)
+								{
+									size_t i;
+									json_t *result_p;
+
+									done_flag = true;
+
+									json_array_foreach (results_p, i, result_p)
+										{
+											/*
+											 * AddResultToServiceJob () takes ownership of the result
+											 */
+											json_incref (result_p);
+
+											if (!AddResultToServiceJob (job_p, result_p))
+												{
+													json_decref (result_p);
+													status = OS_PARTIALLY_SUCCEEDED;
+												}
+										}
+
+									SetServiceJobStatus (job_p, status);
+
+									if (! (job_p -> sj_metadata_p))
+										{
+											job_p -> sj_metadata_p = json_object ();
+										}
+
+									if (job_p -> sj_metadata_p)
+										{
+											SetJSONBoolean (job_p -> sj_metadata_p, "coalesced", true);
+										}
+
+								}
+
+							if (results_p)
+								{
+									json_decref (results_p);
+								}
+
+							AddCacheLookupToServiceMetrics (data_p -> pgsd_metrics_p, done_flag);
+						}
+
+					LeaveInFlightSearch (search_p);
+				}		/* if (search_p) */
+
+			FreeCopiedString (key_s);
+		}		/* if (key_s) */
+
+	/*
+	 * If the search couldn't be shared, run it ourselves
+	 */
+	if (!done_flag)
+		{
+			admitted_flag = DoAdmittedSearch (job_p, marker_s, population_s, full_record_flag, format, ac, data_p, timings_p, deadline_p);
+		}
+
+	return admitted_flag;
+}
+
+
+/*
+ * Any time spent waiting for a slot counts towards the deadline.
+ */
+static bool DoAdmittedSearch (ServiceJob *job_p, const char * const marker_s, const char * const population_s, bool full_record_flag, const ResponseFormat format, const AdmissionClass ac, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, SearchDeadline *deadline_p)
+{
+	if (EnterAdmissionControl (ac, deadline_p -> sd_end_time))
+		{
+			DoSearch (job_p, marker_s, population_s, full_record_flag, format, data_p, timings_p, deadline_p);
+			LeaveAdmissionControl (ac);
+
+			return true;
+		}
+	else
+		{
+			AddBusyErrorToServiceJob (job_p, ac);
+		}
+
+	return false;
+}
+
+
+/*
+ * Build a key from the parameters that affect the results. A population
+ * search always returns full records and the format is only used for
+ * full records, so these are normalised to stop them splitting the
+ * same search in two.
+ */
+static char *GetSearchKey (const char * const marker_s, const char * const population_s, bool full_record_flag, ResponseFormat format)
+{
+	char *key_s = NULL;
+	char format_s [16];
+
+	if (!IsStringEmpty (population_s))
+		{
+			full_record_flag = true;
+		}
+
+	if (!full_record_flag)
+		{
+			format = RF_JSON;
+		}
+
+	snprintf (format_s, sizeof (format_s), "%d", (int) format);
+
+	key_s = ConcatenateVarargsStrings (marker_s ? marker_s : "", "\t", population_s ? population_s : "", "\t", full_record_flag ? "1" : "0", "\t", format_s, NULL);
+
+	if (!key_s)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to make search key for marker \"%s\", population \"%s\"", marker_s ? marker_s : "", population_s ? population_s : "");
+		}
+
+	return key_s;
+}
+
+
+static ResponseFormat GetResponseFormat (const char * const format_s)
+{
+	ResponseFormat format = RF_JSON;
+
+	if (format_s)
+		{
+			if (strcmp (format_s, S_FORMAT_COMPACT_S) == 0)
+				{
+					format = RF_COMPACT;
+				}
+			else if (strcmp (format_s, S_FORMAT_COMPACT_GZIP_S) == 0)
+				{
+					format = RF_COMPACT_GZIP;
+				}
+		}
+
+	return format;
+}
+
+
+static bool AddResponseFormatParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	StringParameter *param_p = (StringParameter *) EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_RESPONSE_FORMAT.npt_type, S_RESPONSE_FORMAT.npt_name_s, "Response format", "The layout to use when returning entire populations", S_FORMAT_JSON_S, PL_ADVANCED);
+
+	if (param_p)
+		{
+			if (CreateAndAddStringParameterOption (param_p, S_FORMAT_JSON_S, "Each marker maps accession names to genotypes"))
+				{
+					if (CreateAndAddStringParameterOption (param_p, S_FORMAT_COMPACT_S, "The accession names are listed once and each marker has an array of genotypes in the same order"))
+						{
+							if (CreateAndAddStringParameterOption (param_p, S_FORMAT_COMPACT_GZIP_S, "The compact layout, gzip-compressed and base64-encoded"))
+								{
+									return true;
+								}
+						}
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add options to %s parameter", S_RESPONSE_FORMAT.npt_name_s);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_RESPONSE_FORMAT.npt_name_s);
+		}
+
+	return false;
+}
+
+
+static bool AddTimeoutParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	const uint32 timeout = ((ParentalGenotypeServiceData *) data_p) -> pgsd_search_timeout_ms;
+
+	if (EasyCreateAndAddUnsignedIntParameterToParameterSet (data_p, param_set_p, group_p, S_TIMEOUT.npt_type, S_TIMEOUT.npt_name_s, "Timeout", "The maximum time, in milliseconds, that the search can take. 0 uses the service's limit and any longer time is cut down to it", &timeout, PL_ADVANCED))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_TIMEOUT.npt_name_s);
+
+	return false;
+}
+
+
+static bool AddProgenyParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PROGENY.npt_type, S_PROGENY.npt_name_s, "Progeny", "The accession of the progeny line to get the genotypes for", NULL, PL_ADVANCED))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_PROGENY.npt_name_s);
+
+	return false;
+}
+
+
+static bool AddIntervalParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_CHROMOSOME.npt_type, S_CHROMOSOME.npt_name_s, "Chromosome", "Only get the markers on this chromosome", NULL, PL_ADVANCED))
+		{
+			if (EasyCreateAndAddDoubleParameterToParameterSet (data_p, param_set_p, group_p, S_INTERVAL_START.npt_type, S_INTERVAL_START.npt_name_s, "Interval start", "Only get the markers at or after this mapping position", NULL, PL_ADVANCED))
+				{
+					if (EasyCreateAndAddDoubleParameterToParameterSet (data_p, param_set_p, group_p, S_INTERVAL_END.npt_type, S_INTERVAL_END.npt_name_s, "Interval end", "Only get the markers at or before this mapping position", NULL, PL_ADVANCED))
+						{
+							return true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_INTERVAL_END.npt_name_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_INTERVAL_START.npt_name_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_CHROMOSOME.npt_name_s);
+		}
+
+	return false;
+}
+
+
+static bool AddMarkerStatsParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddDoubleParameterToParameterSet (data_p, param_set_p, group_p, S_MAX_MISSING_RATE.npt_type, S_MAX_MISSING_RATE.npt_name_s, "Maximum missing rate", "Only get the markers where at most this proportion, from 0 to 1, of the progeny calls are missing", NULL, PL_ADVANCED))
+		{
+			if (EasyCreateAndAddDoubleParameterToParameterSet (data_p, param_set_p, group_p, S_MAX_HETEROZYGOSITY.npt_type, S_MAX_HETEROZYGOSITY.npt_name_s, "Maximum heterozygosity", "Only get the markers where at most this proportion, from 0 to 1, of the progeny calls are heterozygous", NULL, PL_ADVANCED))
+				{
+					if (EasyCreateAndAddDoubleParameterToParameterSet (data_p, param_set_p, group_p, S_MIN_P_VALUE.npt_type, S_MIN_P_VALUE.npt_name_s, "Minimum segregation p-value", "Only get the markers whose chi-square test for segregation distortion has at least this p-value", NULL, PL_ADVANCED))
+						{
+							return true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_MIN_P_VALUE.npt_name_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_MAX_HETEROZYGOSITY.npt_name_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_MAX_MISSING_RATE.npt_name_s);
+		}
+
+	return false;
+}
+
+
+static bool AddPatternParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PATTERN.npt_type, S_PATTERN.npt_name_s, "Pattern", "The marker=call pairs that the progeny lines must match, separated by commas. A call of A or B is the genotype of that parent, H is any other call and - is a missing call", NULL, PL_ADVANCED))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_PATTERN.npt_name_s);
+
+	return false;
+}
+
+
+static bool AddSpoolTokenParameter (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_SPOOL_TOKEN.npt_type, S_SPOOL_TOKEN.npt_name_s, "Spool token", "The token of the spooled results to get", NULL, PL_ADVANCED))
+		{
+			return true;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_SPOOL_TOKEN.npt_name_s);
+
+	return false;
+}
+
+
+static bool AddExportParameters (ServiceData *data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	if (EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_MARKERS.npt_type, S_MARKERS.npt_name_s, "Markers", "The markers to export, separated by commas", NULL, PL_ADVANCED))
+		{
+			StringParameter *param_p = (StringParameter *) EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_EXPORT_FORMAT.npt_type, S_EXPORT_FORMAT.npt_name_s, "Export format", "The file format to export populations as", S_EXPORT_TSV_S, PL_ADVANCED);
+
+			if (param_p)
+				{
+					if ((CreateAndAddStringParameterOption (param_p, S_EXPORT_TSV_S, "Tab-separated with the genotypes as they were submitted")) &&
+							(CreateAndAddStringParameterOption (param_p, S_EXPORT_CSV_S, "Comma-separated with the genotypes as they were submitted")) &&
+							(CreateAndAddStringParameterOption (param_p, S_EXPORT_ABH_S, "Comma-separated with the genotypes coded as A, B, H or - for R/qtl")) &&
+							(CreateAndAddStringParameterOption (param_p, S_EXPORT_ARROW_S, "Arrow IPC file, in base64-encoded parts, with a dictionary-encoded column for each progeny line")))
+						{
+							return true;
+						}
+
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add options to %s parameter", S_EXPORT_FORMAT.npt_name_s);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_EXPORT_FORMAT.npt_name_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_MARKERS.npt_name_s);
+		}
+
+	return false;
+}
+
+
+static ExportFormat GetExportFormat (const char * const format_s)
+{
+	ExportFormat format = EF_TSV;
+
+	if (format_s)
+		{
+			if (strcmp (format_s, S_EXPORT_CSV_S) == 0)
+				{
+					format = EF_CSV;
+				}
+			else if (strcmp (format_s, S_EXPORT_ABH_S) == 0)
+				{
+					format = EF_ABH;
+				}
+			else if (strcmp (format_s, S_EXPORT_ARROW_S) == 0)
+				{
+					format = EF_ARROW;
+				}
+		}
+
+	return format;
+}
+
+
+static void AddTimedOutToServiceJob (ServiceJob *job_p)
+{
+	if (! (job_p -> sj_metadata_p))
+		{
+			job_p -> sj_metadata_p = json_object ();
+		}
+
+	if (job_p -> sj_metadata_p)
+		{
+			SetJSONBoolean (job_p -> sj_metadata_p, "timed_out", true);
+		}
+}
+
+
+static void AddBusyErrorToServiceJob (ServiceJob *job_p, const AdmissionClass ac)
+{
+	char *error_s = ConcatenateVarargsStrings ("Too many ", GetAdmissionClassAsString (ac), " requests are running, please try again later", NULL);
+
+	SetServiceJobStatus (job_p, OS_FAILED_TO_START);
+
+	if (error_s)
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, error_s);
+			FreeCopiedString (error_s);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Too many requests are running, please try again later");
+		}
+}
+
+
+static void DoMarkerPrefixSearch (ServiceJob *job_p, const char * const pattern_s, ParentalGenotypeServiceData *data_p)
+{
+	OperationStatus status = OS_FAILED;
+	size_t num_matches = 0;
+	json_t *results_p = SearchMarkerIndex (pattern_s, data_p -> pgsd_marker_index_max_results, &num_matches);
+
+	AddCacheLookupToServiceMetrics (data_p -> pgsd_metrics_p, (results_p != NULL));
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, "marker"), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			/*
+			 * Let the client know if there were more matches than we returned
+			 */
+			if (num_matches > num_results)
+				{
+					if (! (job_p -> sj_metadata_p))
+						{
+							job_p -> sj_metadata_p = json_object ();
+						}
+
+					if (job_p -> sj_metadata_p)
+						{
+							SetJSONInteger (job_p -> sj_metadata_p, "total_matches", num_matches);
+						}
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "The marker index is not available");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoPopulationSummariesSearch (ServiceJob *job_p, const char * const name_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetPopulationSummaries (name_s, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the population summaries");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoProgenySearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetProgenyGenotypes (accession_s, population_s, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+			JobArena arena;
+
+			InitJobArena (&arena);
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *genotypes_p = json_object_get (entry_p, PGS_GENOTYPES_S);
+
+					json_object_del (entry_p, MONGO_ID_S);
+
+					if ((genotypes_p == NULL) || (UnescapeAllKeys (genotypes_p, &arena)))
+						{
+							json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_S), entry_p);
+
+							if (dest_record_p)
+								{
+									if (AddResultToServiceJob (job_p, dest_record_p))
+										{
+											++ num_added;
+										}
+									else
+										{
+											json_decref (dest_record_p);
+										}
+								}
+						}
+				}
+
+			ClearJobArena (&arena);
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the progeny genotypes");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoPolymorphicMarkersSearch (ServiceJob *job_p, const char * const population_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetPolymorphicMarkers (population_s, chromosome_s, start_p, end_p, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the polymorphic markers");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoMarkerStatsSearch (ServiceJob *job_p, const MarkerStatsFilter *filter_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetMarkerStats (filter_p, data_p, deadline_p);
+
+	if (results_p)
+		{
+			/*
+			 * There is a result for every matching marker so a loose
+			 * filter can return a lot of them
+			 */
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+			ResultSpool spool;
+
+			InitResultSpool (&spool, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s);
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_MARKER_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToResultSpool (&spool, job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (FinishResultSpool (&spool, job_p))
+				{
+					if (num_added == num_results)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if (num_added > 0)
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+				}
+			else if (spool.rs_used > 0)
+				{
+					/*
+					 * The spooled results are lost but any that were kept
+					 * in memory can still be sent back
+					 */
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the marker statistics");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoRecombinationMatrixSearch (ServiceJob *job_p, const char * const population_s, const char * const chromosome_s, const ResponseFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetRecombinationMatrices (population_s, chromosome_s, format, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to calculate the recombination matrix");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoBreakpointsSearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetBreakpoints (accession_s, population_s, chromosome_s, start_p, end_p, data_p, deadline_p);
+
+	if (results_p)
+		{
+			/*
+			 * A whole population has a result for each of its lines
+			 */
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+			ResultSpool spool;
+
+			InitResultSpool (&spool, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s);
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_ACCESSION_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToResultSpool (&spool, job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (FinishResultSpool (&spool, job_p))
+				{
+					if (num_added == num_results)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if (num_added > 0)
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+				}
+			else if (spool.rs_used > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to get the breakpoints");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoHaplotypeBlocksSearch (ServiceJob *job_p, const char * const accession_s, const char * const population_s, const char * const marker_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetHaplotypeBlockGenotypes (population_s, accession_s, marker_s, chromosome_s, start_p, end_p, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (num_added == num_results)
+				{
+					status = OS_SUCCEEDED;
+				}
+			else if (num_added > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to decode the haplotype blocks");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoPatternSearch (ServiceJob *job_p, const GenotypePattern *pattern_p, const char * const population_s, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	json_t *results_p = GetProgenyMatchingPattern (pattern_p, population_s, data_p, deadline_p);
+
+	if (results_p)
+		{
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+			ResultSpool spool;
+
+			InitResultSpool (&spool, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s);
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToResultSpool (&spool, job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (FinishResultSpool (&spool, job_p))
+				{
+					if (num_added == num_results)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if (num_added > 0)
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+				}
+			else if (spool.rs_used > 0)
+				{
+					status = OS_PARTIALLY_SUCCEEDED;
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else if (HasSearchDeadlinePassed (deadline_p))
+		{
+			AddTimedOutToServiceJob (job_p);
+		}
+	else
+		{
+			AddGeneralErrorMessageToServiceJob (job_p, "Failed to match the genotype pattern");
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
+
+
+static void DoExportSearch (ServiceJob *job_p, const char * const population_s, const char * const markers_s, const char * const chromosome_s, const double64 *start_p, const double64 *end_p, const ExportFormat format, ParentalGenotypeServiceData *data_p, SearchDeadline *deadline_p)
+{
+	OperationStatus status = OS_FAILED;
+	ResultSpool spool;
+	json_t *results_p;
+
+	InitResultSpool (&spool, data_p -> pgsd_result_budget, data_p -> pgsd_spool_directory_s, data_p -> pgsd_spool_expiry_s);
+
+	results_p = ExportPopulationMatrices (population_s, markers_s, chromosome_s, start_p, end_p, format, &spool, data_p, deadline_p);
+
+	if (results_p)
+		{
+			/*
+			 * The matrices themselves are collected with the spool's token so
+			 * each population just gets a summary as a result of its own
+			 */
+			const size_t num_results = json_array_size (results_p);
+			size_t num_added = 0;
+			size_t i;
+
+			for (i = 0; i < num_results; ++ i)
+				{
+					json_t *entry_p = json_array_get (results_p, i);
+					json_t *dest_record_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, GetJSONString (entry_p, PGS_POPULATION_NAME_S), entry_p);
+
+					if (dest_record_p)
+						{
+							if (AddResultToServiceJob (job_p, dest_record_p))
+								{
+									++ num_added;
+								}
+							else
+								{
+									json_decref (dest_record_p);
+								}
+						}
+				}
+
+			if (FinishResultSpool (&spool, job_p))
+				{
+					if (num_added == num_results)
+						{
+							status = OS_SUCCEEDED;
+						}
+					else if (num_added > 0)
+						{
+							status = OS_PARTIALLY_SUCCEEDED;
+						}
+				}
+			else
+				{
+					AddGeneralErrorMessageToServiceJob (job_p, "Failed to spool the exported populations");
+				}
+
+			json_decref (results_p);
+		}		/* if (results_p) */
+	else
+		{
+			/*
+			 * Nothing can be collected from a failed export so don't
+			 * leave its spool file behind
+			 */
+			DiscardResultSpool (&spool);
+
+			if (HasSearchDeadlinePassed (deadline_p))
+				{
+					AddTimedOutToServiceJob (job_p);
+				}
+			else
+				{
+					AddGeneralErrorMessageToServiceJob (job_p, "Failed to export the populations");
+				}
+		}
+
+	SetServiceJobStatus (job_p, status);
+}
@@ -0,0 +1,299 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * service_metrics.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "service_metrics.h"
+
+#include "byte_buffer.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/*
+ * There is only ever one set of metrics per process and both the
+ * search and submission services point to it.
+ */
+static ServiceMetrics s_metrics;
+
+
+static const uint32 S_LATENCY_BUCKET_LIMITS_MS [PGS_NUM_LATENCY_BUCKETS] =
+{
+	1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000
+};
+
+
+static const char * const S_SEARCH_MODE_NAMES_SS [MSM_NUM_MODES] =
+{
+	"marker",
+	"population",
+	"marker_and_population",
+	"full_record"
+};
+
+
+static void AddToLatencyHistogram (LatencyHistogram *histogram_p, const uint64 duration_ns);
+
+static uint64 GetCounter (const uint64 *counter_p);
+
+static void IncrementCounter (uint64 *counter_p, const uint64 value);
+
+static bool AppendFormattedText (ByteBuffer *buffer_p, const char *format_s, ...);
+
+static bool AppendLatencyHistogram (ByteBuffer *buffer_p, const char *name_s, const char *labels_s, const LatencyHistogram *histogram_p);
+
+
+
+ServiceMetrics *GetServiceMetrics (void)
+{
+	return &s_metrics;
+}
+
+
+void AddSearchToServiceMetrics (ServiceMetrics *metrics_p, const MetricsSearchMode mode, const bool success_flag, const uint64 duration_ns, const uint32 round_trips, const uint64 num_docs)
+{
+	IncrementCounter (& (metrics_p -> sm_searches [mode]), 1);
+
+	if (!success_flag)
+		{
+			IncrementCounter (& (metrics_p -> sm_failed_searches [mode]), 1);
+		}
+
+	AddToLatencyHistogram (& (metrics_p -> sm_search_latencies [mode]), duration_ns);
+
+	IncrementCounter (& (metrics_p -> sm_mongo_round_trips), round_trips);
+	IncrementCounter (& (metrics_p -> sm_mongo_documents), num_docs);
+}
+
+
+void AddSubmissionToServiceMetrics (ServiceMetrics *metrics_p, const bool success_flag, const uint64 duration_ns, const size_t num_rows, const uint32 round_trips, const uint64 num_docs)
+{
+	IncrementCounter (& (metrics_p -> sm_submissions), 1);
+
+	if (success_flag)
+		{
+			IncrementCounter (& (metrics_p -> sm_submission_rows), num_rows);
+		}
+	else
+		{
+			IncrementCounter (& (metrics_p -> sm_failed_submissions), 1);
+		}
+
+	AddToLatencyHistogram (& (metrics_p -> sm_submission_latencies), duration_ns);
+
+	IncrementCounter (& (metrics_p -> sm_mongo_round_trips), round_trips);
+	IncrementCounter (& (metrics_p -> sm_mongo_documents), num_docs);
+}
+
+
+void AddCacheLookupToServiceMetrics (ServiceMetrics *metrics_p, const bool hit_flag)
+{
+	IncrementCounter (hit_flag ? & (metrics_p -> sm_cache_hits) : & (metrics_p -> sm_cache_misses), 1);
+}
+
+
+char *GetServiceMetricsAsText (const ServiceMetrics *metrics_p)
+{
+	char *text_s = NULL;
+	ByteBuffer *buffer_p = AllocateByteBuffer (4096);
+
+	if (buffer_p)
+		{
+			bool success_flag = AppendFormattedText (buffer_p, "# HELP pgs_search_requests_total The number of searches by mode.\n# TYPE pgs_search_requests_total counter\n");
+			MetricsSearchMode mode = 0;
+
+			while ((mode < MSM_NUM_MODES) && success_flag)
+				{
+					success_flag = AppendFormattedText (buffer_p, "pgs_search_requests_total{mode=\"%s\"} " UINT64_FMT "\n", S_SEARCH_MODE_NAMES_SS [mode], GetCounter (& (metrics_p -> sm_searches [mode])));
+					++ mode;
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendFormattedText (buffer_p, "# HELP pgs_search_failures_total The number of searches by mode that did not succeed.\n# TYPE pgs_search_failures_total counter\n");
+				}
+
+			mode = 0;
+			while ((mode < MSM_NUM_MODES) && success_flag)
+				{
+					success_flag = AppendFormattedText (buffer_p, "pgs_search_failures_total{mode=\"%s\"} " UINT64_FMT "\n", S_SEARCH_MODE_NAMES_SS [mode], GetCounter (& (metrics_p -> sm_failed_searches [mode])));
+					++ mode;
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendFormattedText (buffer_p, "# HELP pgs_search_latency_seconds The time taken to run each search.\n# TYPE pgs_search_latency_seconds histogram\n");
+				}
+
+			mode = 0;
+			while ((mode < MSM_NUM_MODES) && success_flag)
+				{
+					char labels_s [64];
+
+					snprintf (labels_s, sizeof (labels_s), "mode=\"%s\"", S_SEARCH_MODE_NAMES_SS [mode]);
+					success_flag = AppendLatencyHistogram (buffer_p, "pgs_search_latency_seconds", labels_s, & (metrics_p -> sm_search_latencies [mode]));
+					++ mode;
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendFormattedText (buffer_p,
+						"# HELP pgs_mongo_round_trips_total The number of queries sent to the database.\n# TYPE pgs_mongo_round_trips_total counter\npgs_mongo_round_trips_total " UINT64_FMT "\n"
+						"# HELP pgs_mongo_documents_total The number of documents returned by the database.\n# TYPE pgs_mongo_documents_total counter\npgs_mongo_documents_total " UINT64_FMT "\n",
+						GetCounter (& (metrics_p -> sm_mongo_round_trips)),
+						GetCounter (& (metrics_p -> sm_mongo_documents)));
+				}
+
+			if (success_flag)
+				{
+					const uint64 hits = GetCounter (& (metrics_p -> sm_cache_hits));
+					const uint64 misses = GetCounter (& (metrics_p -> sm_cache_misses));
+					const double ratio = (hits + misses > 0) ? ((double) hits) / ((double) (hits + misses)) : 0.0;
+
+					success_flag = AppendFormattedText (buffer_p,
+						"# HELP pgs_cache_hits_total The number of lookups answered from memory.\n# TYPE pgs_cache_hits_total counter\npgs_cache_hits_total " UINT64_FMT "\n"
+						"# HELP pgs_cache_misses_total The number of lookups that needed the database.\n# TYPE pgs_cache_misses_total counter\npgs_cache_misses_total " UINT64_FMT "\n"
+						"# HELP pgs_cache_hit_ratio The proportion of lookups answered from memory.\n# TYPE pgs_cache_hit_ratio gauge\npgs_cache_hit_ratio %g\n",
+						hits, misses, ratio);
+				}
+
+			if (success_flag)
+				{
+					const uint64 rows = GetCounter (& (metrics_p -> sm_submission_rows));
+					const uint64 submission_us = GetCounter (& (metrics_p -> sm_submission_latencies.lh_sum_us));
+					const double rows_per_second = (submission_us > 0) ? ((double) rows) / (((double) submission_us) / 1000000.0) : 0.0;
+
+					success_flag = AppendFormattedText (buffer_p,
+						"# HELP pgs_submissions_total The number of submissions.\n# TYPE pgs_submissions_total counter\npgs_submissions_total " UINT64_FMT "\n"
+						"# HELP pgs_submission_failures_total The number of submissions that did not succeed.\n# TYPE pgs_submission_failures_total counter\npgs_submission_failures_total " UINT64_FMT "\n"
+						"# HELP pgs_submission_rows_total The number of table rows submitted successfully.\n# TYPE pgs_submission_rows_total counter\npgs_submission_rows_total " UINT64_FMT "\n"
+						"# HELP pgs_submission_rows_per_second The mean number of rows stored per second of submission time.\n# TYPE pgs_submission_rows_per_second gauge\npgs_submission_rows_per_second %g\n"
+						"# HELP pgs_submission_latency_seconds The time taken to run each submission.\n# TYPE pgs_submission_latency_seconds histogram\n",
+						GetCounter (& (metrics_p -> sm_submissions)),
+						GetCounter (& (metrics_p -> sm_failed_submissions)),
+						rows, rows_per_second);
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendLatencyHistogram (buffer_p, "pgs_submission_latency_seconds", NULL, & (metrics_p -> sm_submission_latencies));
+				}
+
+			if (success_flag)
+				{
+					text_s = EasyCopyToNewString (GetByteBufferData (buffer_p));
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write metrics");
+				}
+
+			FreeByteBuffer (buffer_p);
+		}		/* if (buffer_p) */
+
+	return text_s;
+}
+
+
+static void AddToLatencyHistogram (LatencyHistogram *histogram_p, const uint64 duration_ns)
+{
+	const uint64 duration_us = duration_ns / 1000;
+	size_t i = 0;
+
+	while ((i < PGS_NUM_LATENCY_BUCKETS) && (duration_us > S_LATENCY_BUCKET_LIMITS_MS [i] * 1000ULL))
+		{
+			++ i;
+		}
+
+	IncrementCounter (& (histogram_p -> lh_buckets [i]), 1);
+	IncrementCounter (& (histogram_p -> lh_count), 1);
+	IncrementCounter (& (histogram_p -> lh_sum_us), duration_us);
+}
+
+
+static bool AppendLatencyHistogram (ByteBuffer *buffer_p, const char *name_s, const char *labels_s, const LatencyHistogram *histogram_p)
+{
+	bool success_flag = true;
+	const char *sep_s = labels_s ? "," : "";
+	uint64 cumulative_count = 0;
+	size_t i = 0;
+
+	if (!labels_s)
+		{
+			labels_s = "";
+		}
+
+	while ((i < PGS_NUM_LATENCY_BUCKETS) && success_flag)
+		{
+			cumulative_count += GetCounter (& (histogram_p -> lh_buckets [i]));
+			success_flag = AppendFormattedText (buffer_p, "%s_bucket{%s%sle=\"%g\"} " UINT64_FMT "\n", name_s, labels_s, sep_s, ((double) S_LATENCY_BUCKET_LIMITS_MS [i]) / 1000.0, cumulative_count);
+			++ i;
+		}
+
+	if (success_flag)
+		{
+			cumulative_count += GetCounter (& (histogram_p -> lh_buckets [PGS_NUM_LATENCY_BUCKETS]));
+
+			success_flag = AppendFormattedText (buffer_p,
+				"%s_bucket{%s%sle=\"+Inf\"} " UINT64_FMT "\n"
+				"%s_sum{%s} %g\n"
+				"%s_count{%s} " UINT64_FMT "\n",
+				name_s, labels_s, sep_s, cumulative_count,
+				name_s, labels_s, ((double) GetCounter (& (histogram_p -> lh_sum_us))) / 1000000.0,
+				name_s, labels_s, cumulative_count);
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendFormattedText (ByteBuffer *buffer_p, const char *format_s, ...)
+{
+	bool success_flag = false;
+	char local_buffer_s [2048];
+	int res;
+	va_list args;
+
+	va_start (args, format_s);
+	res = vsnprintf (local_buffer_s, sizeof (local_buffer_s), format_s, args);
+	va_end (args);
+
+	if ((res >= 0) && (((size_t) res) < sizeof (local_buffer_s)))
+		{
+			success_flag = AppendToByteBuffer (buffer_p, local_buffer_s, (size_t) res);
+		}
+
+	return success_flag;
+}
+
+
+static uint64 GetCounter (const uint64 *counter_p)
+{
+	return __atomic_load_n (counter_p, __ATOMIC_RELAXED);
+}
+
+
+static void IncrementCounter (uint64 *counter_p, const uint64 value)
+{
+	__atomic_fetch_add (counter_p, value, __ATOMIC_RELAXED);
+}
@@ -24,6 +24,19 @@
 
 #include "submission_service.h"
 #include "parental_genotype_service.h"
+#include "job_timings.h"
+#include "marker_index.h"
+#include "population_filters.h"
+#include "population_summaries.h"
+#include "progeny_genotypes.h"
+#include "parent_genotypes.h"
+#include "marker_stats.h"
+#include "breakpoints.h"
+#include "haplotype_blocks.h"
+#include "admission_control.h"
+#include "genotype_table_file.h"
+#include "vcf_file.h"
+#include "job_arena.h"
 
 #include "audit.h"
 #include "streams.h"
@@ -32,6 +45,7 @@
 #include "schema_keys.h"
 
 #include "json_parameter.h"
+#include "boolean_parameter.h"
 
 /*
  * Static declarations
@@ -39,7 +53,21 @@
 
 static const char * const S_ID_S = "id";
 
+/*
+ * The error code that MongoDB returns when an insert would break a
+ * unique index
+ */
+static const uint32 S_DUPLICATE_KEY_ERROR_CODE = 11000;
+
+static const uint32 S_NUM_APPEND_ATTEMPTS = 2;
+
 static NamedParameterType S_SET_DATA = { "Data", PT_JSON_TABLE };
+static NamedParameterType S_DATA_FILE = { "Data file", PT_FILE_TO_READ };
+static NamedParameterType S_PARENT_A_SAMPLE = { "Parent A sample", PT_STRING };
+static NamedParameterType S_PARENT_B_SAMPLE = { "Parent B sample", PT_STRING };
+static NamedParameterType S_GENETIC_MAP_FILE = { "Genetic map file", PT_FILE_TO_READ };
+static NamedParameterType S_APPEND = { "Append to existing population", PT_BOOLEAN };
+
 
 
 static const char *GetParentalGenotypeSubmissionServiceName (const Service *service_p);
@@ -65,21 +93,45 @@ static ServiceMetadata *GetParentalGenotypeSubmissionServiceMetadata (Service *s
 static bool GetParentalGenotypeSubmissionServiceParameterTypesForNamedParameters (const Service *service_p, const char *param_name_s, ParameterType *pt_p);
 
 
-static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p);
+static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p, JobArena *arena_p);
 
-static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p);
+static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p, JobArena *arena_p);
 
 static const char *AddParentRow (json_t *doc_p, json_t *genotypes_p, const char *key_s);
 
-static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotypeServiceData *data_p);
+static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+static bool AddTableToPopulation (json_t *doc_p, const json_t *data_json_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+static bool OpenDataFile (const char *filename_s, const ParameterSet *param_set_p, GenotypeTableFile **file_pp, VCFFile **vcf_pp, ParentalGenotypeServiceData *data_p, ServiceJob *job_p);
+
+static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_ss, const json_t *data_json_p, GenotypeTableFile *file_p, VCFFile *vcf_p, const bool append_flag, ServiceJob *job_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, JobArena *arena_p);
+
+static bool SaveVarieties (const char *parent_a_s, const char *parent_b_s, const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p);
+
+static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool *mongo_p, JobTimings *timings_p);
+
+static const char *GetAccession (const json_t *genotypes_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+static bool AppendToPopulation (const char *name_s, const char *parent_a_s, const char *parent_b_s, const bson_oid_t *new_id_p, const json_t *doc_p, bson_oid_t *population_id_p, int64 *revision_p, ServiceJob *job_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p);
+
+static bool FindPopulationToAppendTo (const char *name_s, const char *parent_a_s, const char *parent_b_s, bson_oid_t *id_p, bool *exists_flag_p, ServiceJob *job_p, ParentalGenotypeServiceData *data_p);
+
+static bool GetPopulationIdFromReply (const bson_t *reply_p, bson_oid_t *id_p, int64 *revision_p);
+
+static bool IsIdInJSONArray (const json_t *ids_p, const bson_oid_t *id_p);
+
+static json_t *GetPopulationById (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p);
 
-static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_ss, const json_t *data_json_p, ParentalGenotypeServiceData *data_p);
+static bool SaveMapDerivedData (const bson_oid_t *id_p, const char *population_s, json_t *doc_p, const bool append_flag, ParentalGenotypeServiceData *data_p, JobTimings *timings_p);
 
-static bool SaveVarieties (const char *parent_a_s, const char *parent_b_s, const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p);
+static bool SaveHaplotypeBlocksOnlyPopulation (const bson_oid_t *id_p, const char *population_s, json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p);
 
-static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool *mongo_p);
+static bson_t *GetHaplotypeBlocksOnlyPopulation (const json_t *doc_p);
 
-static char *GetAccession (const json_t *genotypes_p, ParentalGenotypeServiceData *data_p);
+static void RemovePopulationData (const bson_oid_t *id_p, const char *population_s, ParentalGenotypeServiceData *data_p);
+
+static bool RemovePopulationDataFromCollection (const bson_oid_t *id_p, const char *key_s, const char *collection_s, ParentalGenotypeServiceData *data_p);
 
 
 /*
@@ -175,7 +227,32 @@ static ParameterSet *GetParentalGenotypeSubmissionServiceParameters (Service *se
 				{
 					if (AddParameterKeyStringValuePair (param_p, PA_TABLE_COLUMN_HEADERS_PLACEMENT_S, PA_TABLE_COLUMN_HEADERS_PLACEMENT_FIRST_ROW_S))
 						{
-							return param_set_p;
+							bool b = false;
+
+							if ((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_DATA_FILE.npt_type, S_DATA_FILE.npt_name_s, "Data file", "A tab or comma-separated file of the parental-cross data, laid out in the same way as the Data table, to use instead of it", NULL, PL_ADVANCED)) != NULL)
+								{
+									if (((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PARENT_A_SAMPLE.npt_type, S_PARENT_A_SAMPLE.npt_name_s, "Parent A sample", "If the data file is a VCF file, the sample to use as Parent A. If this is not given, the first sample is used", NULL, PL_ADVANCED)) != NULL) &&
+											((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_PARENT_B_SAMPLE.npt_type, S_PARENT_B_SAMPLE.npt_name_s, "Parent B sample", "If the data file is a VCF file, the sample to use as Parent B. If this is not given, the second sample is used", NULL, PL_ADVANCED)) != NULL) &&
+											((param_p = EasyCreateAndAddStringParameterToParameterSet (data_p, param_set_p, group_p, S_GENETIC_MAP_FILE.npt_type, S_GENETIC_MAP_FILE.npt_name_s, "Genetic map file", "If the data file is a VCF file, a tab or comma-separated file with a marker, chromosome and mapping position on each line to use instead of the CHROM and POS of each variant", NULL, PL_ADVANCED)) != NULL))
+										{
+											if ((param_p = EasyCreateAndAddBooleanParameterToParameterSet (data_p, param_set_p, group_p, S_APPEND.npt_name_s, "Append", "If a population with the same parents already exists, add these markers and progeny to it rather than creating a new one", &b, PL_ADVANCED)) != NULL)
+												{
+													return param_set_p;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_APPEND.npt_name_s);
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add the VCF parameters");
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s parameter", S_DATA_FILE.npt_name_s);
+								}
 						}
 				}
 			else
@@ -202,6 +279,26 @@ static bool GetParentalGenotypeSubmissionServiceParameterTypesForNamedParameters
 		{
 			*pt_p = S_SET_DATA.npt_type;
 		}
+	else if (strcmp (param_name_s, S_DATA_FILE.npt_name_s) == 0)
+		{
+			*pt_p = S_DATA_FILE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PARENT_A_SAMPLE.npt_name_s) == 0)
+		{
+			*pt_p = S_PARENT_A_SAMPLE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_PARENT_B_SAMPLE.npt_name_s) == 0)
+		{
+			*pt_p = S_PARENT_B_SAMPLE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_GENETIC_MAP_FILE.npt_name_s) == 0)
+		{
+			*pt_p = S_GENETIC_MAP_FILE.npt_type;
+		}
+	else if (strcmp (param_name_s, S_APPEND.npt_name_s) == 0)
+		{
+			*pt_p = S_APPEND.npt_type;
+		}
 	else
 		{
 			success_flag = false;
@@ -240,42 +337,135 @@ static ServiceJobSet *RunParentalGenotypeSubmissionService (Service *service_p,
 		{
 			OperationStatus status = OS_FAILED_TO_START;
 			ServiceJob *job_p = GetServiceJobFromServiceJobSet (service_p -> se_jobs_p, 0);
+			const uint64 start_time = GetMonotonicTimeInNanoseconds ();
+			size_t num_rows = 0;
+			JobTimings timings;
+			JobArena arena;
+
+			InitJobTimings (&timings, data_p -> pgsd_timings_flag);
+			InitJobArena (&arena);
 
 			LogParameterSet (param_set_p, job_p);
 
 			if (param_set_p)
 				{
 					const json_t *data_json_p = NULL;
+					const char *filename_s = NULL;
+					GenotypeTableFile *file_p = NULL;
+					VCFFile *vcf_p = NULL;
+
+					/*
+					 * A file is used in preference to the table
+					 */
+					if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_DATA_FILE.npt_name_s, &filename_s)) && (!IsStringEmpty (filename_s)))
+						{
+							status = OS_FAILED;
 
-					if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_SET_DATA.npt_name_s, &data_json_p))
+							OpenDataFile (filename_s, param_set_p, &file_p, &vcf_p, data_p, job_p);
+						}
+					else if (GetCurrentJSONParameterValueFromParameterSet (param_set_p, S_SET_DATA.npt_name_s, &data_json_p))
 						{
 							status = OS_FAILED;
+						}
+
+					if (data_json_p || file_p || vcf_p)
+						{
+							const char *parent_a_s = NULL;
+							const char *parent_b_s = NULL;
+							const bool *append_flag_p = NULL;
+							AdmissionClass ac;
+
+							if (file_p)
+								{
+									ac = GetSubmissionAdmissionClassByCells (GetGenotypeTableFileNumCells (file_p));
+								}
+							else if (vcf_p)
+								{
+									ac = GetSubmissionAdmissionClassByCells (GetVCFFileNumCells (vcf_p));
+								}
+							else
+								{
+									ac = GetSubmissionAdmissionClass (data_json_p);
+								}
+
 
-							if (data_json_p)
+							if (EnterAdmissionControl (ac, 0))
 								{
-									const char *parent_a_s = NULL;
-									const char *parent_b_s = NULL;
-									bson_oid_t *id_p = SaveMarkers (&parent_a_s, &parent_b_s, data_json_p, data_p);
+									bson_oid_t *id_p = NULL;
+
+									GetCurrentBooleanParameterValueFromParameterSet (param_set_p, S_APPEND.npt_name_s, &append_flag_p);
+
+									id_p = SaveMarkers (&parent_a_s, &parent_b_s, data_json_p, file_p, vcf_p, append_flag_p ? *append_flag_p : false, job_p, data_p, &timings, &arena);
+
+									if (file_p)
+										{
+											num_rows = GetGenotypeTableFileNumRows (file_p);
+										}
+									else if (vcf_p)
+										{
+											num_rows = GetVCFFileNumRows (vcf_p);
+										}
+									else
+										{
+											num_rows = json_array_size (data_json_p);
+										}
 
 									if (id_p)
 										{
-											if (SaveVarieties (parent_a_s, parent_b_s, id_p, data_p))
+											const uint64 varieties_start = StartJobTimer (&timings);
+
+											if (SaveVarieties (parent_a_s, parent_b_s, id_p, data_p, &timings))
 												{
 													status = OS_SUCCEEDED;
 												}
 
+											StopJobTimer (&timings, JTS_SAVE_VARIETIES, varieties_start);
+
 											FreeBSONOid (id_p);
 										}		/* if (id_p) */
 
-								}		/* if (data_json_p) */
+									LeaveAdmissionControl (ac);
+								}		/* if (EnterAdmissionControl (ac, 0)) */
+							else
+								{
+									status = OS_FAILED_TO_START;
+									AddGeneralErrorMessageToServiceJob (job_p, "Too many submissions are running, please try again later");
+								}
 
+						}		/* if (data_json_p || file_p || vcf_p) */
 
-						}		/* if (GetParameterValueFromParameterSet (param_set_p, S_SET_DATA.npt_name_s, &data_value, true)) */
+					/*
+					 * The parents' names point into the file's rows so it
+					 * can't be closed until the varieties have been saved
+					 */
+					if (file_p)
+						{
+							CloseGenotypeTableFile (file_p);
+						}
 
+					if (vcf_p)
+						{
+							CloseVCFFile (vcf_p);
+						}
 
 				}		/* if (param_set_p) */
 
 			SetServiceJobStatus (job_p, status);
+
+			if (status != OS_FAILED_TO_START)
+				{
+					AddSubmissionToServiceMetrics (data_p -> pgsd_metrics_p, (status == OS_SUCCEEDED), GetMonotonicTimeInNanoseconds () - start_time, num_rows, timings.jt_round_trips, timings.jt_docs_fetched);
+				}
+
+			AddJobTimingsToServiceJob (&timings, job_p);
+
+			if (timings.jt_enabled_flag)
+				{
+					AddJobArenaToServiceJob (&arena, job_p);
+				}
+
+			ClearJobArena (&arena);
+
 			LogServiceJob (job_p);
 		}		/* if (service_p -> se_jobs_p) */
 
@@ -283,6 +473,64 @@ static ServiceJobSet *RunParentalGenotypeSubmissionService (Service *service_p,
 }
 
 
+/*
+ * Open a submitted file as either a VCF file or a genotype table.
+ */
+static bool OpenDataFile (const char *filename_s, const ParameterSet *param_set_p, GenotypeTableFile **file_pp, VCFFile **vcf_pp, ParentalGenotypeServiceData *data_p, ServiceJob *job_p)
+{
+	char *path_s = GetImportFilePath (filename_s, data_p);
+
+	if (path_s)
+		{
+			if (IsVCFFile (path_s))
+				{
+					const char *parent_a_s = NULL;
+					const char *parent_b_s = NULL;
+					const char *map_filename_s = NULL;
+					char *map_path_s = NULL;
+					bool map_flag = true;
+
+					GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PARENT_A_SAMPLE.npt_name_s, &parent_a_s);
+					GetCurrentStringParameterValueFromParameterSet (param_set_p, S_PARENT_B_SAMPLE.npt_name_s, &parent_b_s);
+
+					if ((GetCurrentStringParameterValueFromParameterSet (param_set_p, S_GENETIC_MAP_FILE.npt_name_s, &map_filename_s)) && (!IsStringEmpty (map_filename_s)))
+						{
+							if ((map_path_s = GetImportFilePath (map_filename_s, data_p)) == NULL)
+								{
+									map_flag = false;
+									AddParameterErrorMessageToServiceJob (job_p, S_GENETIC_MAP_FILE.npt_name_s, S_GENETIC_MAP_FILE.npt_type, "The genetic map could not be found in the import directory");
+								}
+						}
+
+					if (map_flag)
+						{
+							*vcf_pp = OpenVCFFile (path_s, parent_a_s, parent_b_s, map_path_s);
+						}
+
+					if (map_path_s)
+						{
+							FreeCopiedString (map_path_s);
+						}
+				}
+			else
+				{
+					*file_pp = OpenGenotypeTableFile (path_s);
+				}
+
+			FreeCopiedString (path_s);
+		}		/* if (path_s) */
+
+	if ((*file_pp) || (*vcf_pp))
+		{
+			return true;
+		}
+
+	AddParameterErrorMessageToServiceJob (job_p, S_DATA_FILE.npt_name_s, S_DATA_FILE.npt_type, "The file could not be read as a VCF file or a table of parental-cross data");
+
+	return false;
+}
+
+
 static ServiceMetadata *GetParentalGenotypeSubmissionServiceMetadata (Service *service_p)
 {
 	const char *term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "topic_0625";
@@ -373,7 +621,7 @@ static ServiceMetadata *GetParentalGenotypeSubmissionServiceMetadata (Service *s
 }
 
 
-static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p)
+static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p, JobArena *arena_p)
 {
 	bool success_flag = true;
 	void *iter_p = json_object_iter (chromosomes_p);
@@ -398,11 +646,11 @@ static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p)
 									 * allows these, the current version of the mongo-c driver (1.13)
 									 * does not, so we need to do the escaping ourselves
 									 */
-									char *escaped_marker_s = NULL;
+									const char *escaped_marker_s = SearchAndReplaceInStringInJobArena (arena_p, key_s, ".", PGS_ESCAPED_DOT_S);
 
-									if (SearchAndReplaceInString (key_s, &escaped_marker_s, ".", PGS_ESCAPED_DOT_S))
+									if (escaped_marker_s)
 										{
-											if (json_object_set_new (doc_p, escaped_marker_s ? escaped_marker_s : key_s, marker_p)  == 0)
+											if (json_object_set_new (doc_p, escaped_marker_s, marker_p)  == 0)
 												{
 													if (SetJSONString (marker_p, PGS_CHROMOSOME_S, value_s))
 														{
@@ -410,12 +658,7 @@ static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p)
 														}
 												}
 
-											if (escaped_marker_s)
-												{
-													FreeCopiedString (escaped_marker_s);
-												}
-
-										}		/* if (SearchAndReplaceInString (key_s, &escaped_marker_s, ".", PGS_DOT_S)) */
+										}		/* if (escaped_marker_s) */
 
 									if (!added_flag)
 										{
@@ -447,7 +690,7 @@ static bool AddChromosomes (json_t *doc_p, json_t *chromosomes_p)
 
 
 
-static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p)
+static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p, JobArena *arena_p)
 {
 	bool success_flag = true;
 	void *iter_p = json_object_iter (mappings_p);
@@ -467,12 +710,12 @@ static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p)
 							 * allows these, the current version of the mongo-c driver (1.13)
 							 * does not, so we need to do the escaping ourselves
 							 */
-							char *escaped_key_s = NULL;
+							const char *escaped_key_s = SearchAndReplaceInStringInJobArena (arena_p, key_s, ".", PGS_ESCAPED_DOT_S);
 
-							if (SearchAndReplaceInString (key_s, &escaped_key_s, ".", PGS_ESCAPED_DOT_S))
+							if (escaped_key_s)
 								{
 									/* use key and value ... */
-									json_t *marker_p = json_object_get (doc_p, escaped_key_s ? escaped_key_s : key_s);
+									json_t *marker_p = json_object_get (doc_p, escaped_key_s);
 
 									if (marker_p)
 										{
@@ -488,12 +731,7 @@ static bool AddGeneticMappingPositions (json_t *doc_p, json_t *mappings_p)
 											success_flag = false;
 										}
 
-									if (escaped_key_s)
-										{
-											FreeCopiedString (escaped_key_s);
-										}
-
-								}		/* if (SearchAndReplaceInString (key_s, &escaped_marker_s, ".", PGS_DOT_S)) */
+								}		/* if (escaped_key_s) */
 
 
 
@@ -529,83 +767,18 @@ static const char *AddParentRow (json_t *doc_p, json_t *genotypes_p, const char
 }
 
 
-/*
- * Paragon x Watkins 1190[0-9][0-9][0-9]" to "ParW[0-9][0-9][0-9]"
- */
-static char *GetAccession (const json_t *genotypes_p, ParentalGenotypeServiceData *data_p)
+static const char *GetAccession (const json_t *genotypes_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p)
 {
-	char *parents_s = NULL;
 	const char *accession_s = GetJSONString (genotypes_p, S_ID_S);
 
-	if (accession_s)
-		{
-			bool success_flag = true;
-
-			if (data_p -> pgsd_name_mappings_p)
-				{
-					void *iterator_p = json_object_iter (data_p -> pgsd_name_mappings_p);
-
-					while (iterator_p && success_flag)
-						{
-							const char *key_s = json_object_iter_key (iterator_p);
-					    const size_t key_length = strlen (key_s);
-
-							if (strncmp (accession_s, key_s, key_length) == 0)
-								{
-									json_t *value_p = json_object_iter_value (iterator_p);
-
-									if (json_is_string (value_p))
-										{
-											const char *value_s = json_string_value (value_p);
-
-											accession_s += key_length;
-											parents_s = ConcatenateStrings (value_s, accession_s);
-
-											if (!parents_s)
-												{
-													success_flag = false;
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to concatenate \"%s\" and \"%s\"", value_s, accession_s);
-												}		/* if (!parents_s) */
-
-										}		/* if (json_is_string (value_p)) */
-									else
-										{
-											success_flag  = false;
-											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, data_p -> pgsd_name_mappings_p, "Value for \"%s\" is not a string", key_s);
-										}
-
-								}		/* if (strncmp (accession_s, key_s, key_length) == 0) */
-
-							if (success_flag)
-								{
-									iterator_p = json_object_iter_next (data_p -> pgsd_name_mappings_p, iterator_p);
-								}
-
-						}		/* while (iterator_p && success_flag) */
-
-				}		/* if (data_p -> pgsd_name_mappings_p) */
-
-			if (success_flag && (parents_s == NULL))
-				{
-					parents_s = EasyCopyToNewString (accession_s);
-
-					if (!parents_s)
-						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy \"%s\"", accession_s);
-						}		/* if (!parents_s) */
-
-				}
-
-		}		/* if (accession_s) */
-
-	return parents_s;
+	return accession_s ? GetMappedAccession (accession_s, data_p, arena_p) : NULL;
 }
 
 
-static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotypeServiceData *data_p)
+static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p)
 {
 	bool success_flag = true;
-	char *accession_s = GetAccession (genotypes_p, data_p);
+	const char *accession_s = GetAccession (genotypes_p, data_p, arena_p);
 
 	if (accession_s)
 		{
@@ -626,14 +799,14 @@ static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotyp
 									 * allows these, the current version of the mongo-c driver (1.13)
 									 * does not, so we need to do the escaping ourselves
 									 */
-									char *escaped_key_s = NULL;
+									const char *escaped_key_s = SearchAndReplaceInStringInJobArena (arena_p, key_s, ".", PGS_ESCAPED_DOT_S);
 
-									if (SearchAndReplaceInString (key_s, &escaped_key_s, ".", PGS_ESCAPED_DOT_S))
+									if (escaped_key_s)
 										{
 											/*
 											 * use key and value ...
 											 */
-											json_t *marker_p = json_object_get (doc_p, escaped_key_s ? escaped_key_s : key_s);
+											json_t *marker_p = json_object_get (doc_p, escaped_key_s);
 
 											if (marker_p)
 												{
@@ -650,12 +823,7 @@ static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotyp
 													success_flag = false;
 												}
 
-											if (escaped_key_s)
-												{
-													FreeCopiedString (escaped_key_s);
-												}
-
-										}		/* if (SearchAndReplaceInString (key_s, &escaped_marker_s, ".", PGS_DOT_S)) */
+										}		/* if (escaped_key_s) */
 
 								}		/* if (value_s) */
 							else
@@ -669,7 +837,6 @@ static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotyp
 					iter_p = json_object_iter_next (genotypes_p, iter_p);
 				}
 
-			FreeCopiedString (accession_s);
 		}		/* if (accession_s) */
 	else
 		{
@@ -682,10 +849,93 @@ static bool AddGenotypesRow (json_t *doc_p, json_t *genotypes_p, ParentalGenotyp
 }
 
 
-static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_ss, const json_t *data_json_p, ParentalGenotypeServiceData *data_p)
+/*
+	The organisation is:
+	1 row = marker name
+	2 row = chromosome / linkage group name
+	3 row = genetic mapping position
+	4 row = Parent A (always Paragon for this set)
+	5 row = Parent B (always a Watkins landrace accession in format "Watkins 1190[0-9][0-9][0-9]"
+	6 to last row = individuals of that population, progenies from the cross of Parent A with Parent B
+
+	We abbreviate the population names from correctly: "Paragon x Watkins 1190[0-9][0-9][0-9]" to "ParW[0-9][0-9][0-9]".
+	The code 1190xxx was the original number these lines were stored in the germplasm resource unit.
+ */
+static bool AddTableToPopulation (json_t *doc_p, const json_t *data_json_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, ParentalGenotypeServiceData *data_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+
+	if (json_is_array (data_json_p))
+		{
+			const size_t num_rows = json_array_size (data_json_p);
+
+			/*
+			 * There are 2 header rows, so the actual genotype data doesn't
+			 * start until row 3
+			 */
+			if (num_rows >= 3)
+				{
+					/*
+					 * Since the first row, the marker names, is used as the headers, the first entry should be
+					 * the chromosome / linkage group name
+					 */
+					size_t row_index = 0;
+					json_t *row_p = json_array_get (data_json_p, row_index);
+
+					if (AddChromosomes (doc_p, row_p, arena_p))
+						{
+							/*
+							 * genetic mapping position
+							 */
+							row_p = json_array_get (data_json_p, ++ row_index);
+
+							if (AddGeneticMappingPositions (doc_p, row_p, arena_p))
+								{
+									*parent_a_row_pp = json_array_get (data_json_p, ++ row_index);
+									*parent_b_row_pp = json_array_get (data_json_p, ++ row_index);
+
+									success_flag = ((*parent_a_row_pp != NULL) && (*parent_b_row_pp != NULL));
+
+									++ row_index;
+
+									while ((row_index < num_rows) && success_flag)
+										{
+											row_p = json_array_get (data_json_p, row_index);
+
+											if (AddGenotypesRow (doc_p, row_p, data_p, arena_p))
+												{
+													++ row_index;
+												}
+											else
+												{
+													success_flag = false;
+												}
+
+											/*
+											 * The escaped keys for this row have all been copied
+											 * into doc_p so the arena can be reused for the next one
+											 */
+											ResetJobArena (arena_p);
+
+										}		/* while ((row_index < num_rows) && success_flag) */
+
+								}		/* if (AddGeneticMappingPositions (doc_p, row_p, arena_p)) */
+
+						}		/* if (AddChromosomes (doc_p, chromosomes_p)) */
+
+				}		/* if (num_rows >= 3) */
+
+		}		/* if (json_is_array (data_json_p)) */
+
+	return success_flag;
+}
+
+
+static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_ss, const json_t *data_json_p, GenotypeTableFile *file_p, VCFFile *vcf_p, const bool append_flag, ServiceJob *job_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p, JobArena *arena_p)
 {
 	bson_oid_t *id_p = NULL;
 	bool success_flag = false;
+	uint64 stage_start = StartJobTimer (timings_p);
 	json_t *doc_p = json_object ();
 
 	if (doc_p)
@@ -696,150 +946,214 @@ static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_
 				{
 					if (AddCompoundIdToJSON (doc_p, id_p))
 						{
+							const json_t *parent_a_row_p = NULL;
+							const json_t *parent_b_row_p = NULL;
+							bool added_flag = false;
+
 							/*
-								The organisation is:
-								1 row = marker name
-								2 row = chromosome / linkage group name
-								3 row = genetic mapping position
-								4 row = Parent A (always Paragon for this set)
-								5 row = Parent B (always a Watkins landrace accession in format "Watkins 1190[0-9][0-9][0-9]"
-								6 to last row = individuals of that population, progenies from the cross of Parent A with Parent B
-
-								We abbreviate the population names from correctly: "Paragon x Watkins 1190[0-9][0-9][0-9]" to "ParW[0-9][0-9][0-9]".
-								The code 1190xxx was the original number these lines were stored in the germplasm resource unit.
+							 * A file is parsed straight into doc_p rather
+							 * than being converted to a table first
 							 */
-							if (json_is_array (data_json_p))
+							if (file_p)
+								{
+									added_flag = AddGenotypeTableFileToPopulation (file_p, doc_p, &parent_a_row_p, &parent_b_row_p, data_p, arena_p);
+								}
+							else if (vcf_p)
+								{
+									added_flag = AddVCFFileToPopulation (vcf_p, doc_p, &parent_a_row_p, &parent_b_row_p, data_p, arena_p);
+								}
+							else
 								{
-									const size_t num_rows = json_array_size (data_json_p);
+									added_flag = AddTableToPopulation (doc_p, data_json_p, &parent_a_row_p, &parent_b_row_p, data_p, arena_p);
+								}
 
-									/*
-									 * There are 2 header rows, so the actual genotype data doesn't
-									 * start until row 3
-									 */
-									if (num_rows >= 3)
+							StopJobTimer (timings_p, JTS_BUILD_MARKERS, stage_start);
+
+							if (added_flag)
+								{
+									const char *parent_a_s = AddParentRow (doc_p, (json_t *) parent_a_row_p, PGS_PARENT_A_S);
+
+									if (parent_a_s)
 										{
-											/*
-											 * Since the first row, the marker names, is used as the headers, the first entry should be
-											 * the chromosome / linkage group name
-											 */
-											size_t row_index = 0;
-											json_t *row_p = json_array_get (data_json_p, row_index);
+											const char *parent_b_s = AddParentRow (doc_p, (json_t *) parent_b_row_p, PGS_PARENT_B_S);
 
-											if (AddChromosomes (doc_p, row_p))
+											if (parent_b_s)
 												{
-													/*
-													 * genetic mapping position
-													 */
-													row_p = json_array_get (data_json_p, ++ row_index);
+													char *name_s = ConcatenateVarargsStrings (parent_a_s, " x ", parent_b_s, NULL);
 
-													if (AddGeneticMappingPositions (doc_p, row_p))
+													if (name_s)
 														{
-															row_p = json_array_get (data_json_p, ++ row_index);
-															const char *parent_a_s = AddParentRow (doc_p, row_p, PGS_PARENT_A_S);
-
-															if (parent_a_s)
+															if (SetJSONString (doc_p, PGS_POPULATION_NAME_S, name_s))
 																{
-																	row_p = json_array_get (data_json_p, ++ row_index);
-																	const char *parent_b_s = AddParentRow (doc_p, row_p, PGS_PARENT_B_S);
+																	bool saved_flag = false;
+																	bool blocks_only_flag = false;
+																	int64 revision = 0;
 
-																	if (parent_b_s)
-																		{
-																			char *name_s = ConcatenateVarargsStrings (parent_a_s, " x ", parent_b_s, NULL);
+																	success_flag = true;
+																	stage_start = StartJobTimer (timings_p);
 
-																			if (name_s)
+																	if (append_flag)
+																		{
+																			/*
+																			 * Only the new markers and progeny are sent. If no population
+																			 * has this name yet, the same call creates it under our id and
+																			 * claims the name so that concurrent appends can't each insert
+																			 * their own copy.
+																			 */
+																			bson_oid_t population_id;
+
+																			if (AppendToPopulation (name_s, parent_a_s, parent_b_s, id_p, doc_p, &population_id, &revision, job_p, data_p, arena_p))
 																				{
-																					if (SetJSONString (doc_p, PGS_POPULATION_NAME_S, name_s))
+																					bson_oid_copy (&population_id, id_p);
+																					saved_flag = true;
+
+																					/*
+																					 * Only the new markers and progeny were sent so the summary
+																					 * has to come from the updated population
+																					 */
+																					if (!RefreshPopulationSummary (&population_id, data_p))
 																						{
-																							success_flag = true;
+																							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to update the summary for \"%s\"", name_s);
+																						}
+																				}
+																			else
+																				{
+																					success_flag = false;
+																				}
+
+																		}		/* if (append_flag) */
 
-																							++ row_index;
+																	if (success_flag && !saved_flag)
+																		{
+																			/*
+																			 * Save the document
+																			 */
+																			bson_t *bson_doc_p = ConvertJSONToBSON (doc_p);
 
-																							while ((row_index < num_rows) && success_flag)
+																			if (bson_doc_p)
+																				{
+																					/*
+																					 * Is the doc ok to save in one go?
+																					 */
+																					if (bson_doc_p -> len < BSON_MAX_SIZE)
+																						{
+																							if (SaveMongoDataFromBSON (data_p -> pgsd_mongo_p, bson_doc_p, data_p -> pgsd_populations_collection_s, NULL))
 																								{
-																									row_p = json_array_get (data_json_p, row_index);
+																									saved_flag = true;
 
-																									if (AddGenotypesRow (doc_p, row_p, data_p))
-																										{
-																											++ row_index;
-																										}
-																									else
+																									if (!SavePopulationSummary (bson_doc_p, data_p))
 																										{
-																											success_flag = false;
+																											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the summary for \"%s\"", name_s);
 																										}
+																								}
+																							else
+																								{
+																									success_flag = false;
+																									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to save to \"%s\" -> \"%s\"", data_p -> pgsd_database_s, data_p -> pgsd_populations_collection_s);
+																								}
 
-																								}		/* while ((row_index < num_rows) && success_flag) */
-
-																							if (success_flag)
+																							bson_destroy (bson_doc_p);
+																						}
+																					else
+																						{
+																							/*
+																							 * The calls are too large for a single document so they are
+																							 * only kept in the haplotype blocks and the population
+																							 * document just lists its markers
+																							 */
+																							PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "\"%s\" is " UINT32_FMT " bytes so its calls will only be stored as haplotype blocks", name_s, bson_doc_p -> len);
+
+																							if (SaveHaplotypeBlocksOnlyPopulation (id_p, name_s, doc_p, parent_a_row_p, parent_b_row_p, data_p, timings_p))
 																								{
-																									/*
-																									 * Save the document
-																									 */
-																									bson_t *bson_doc_p = ConvertJSONToBSON (doc_p);
+																									saved_flag = true;
+																									blocks_only_flag = true;
 
-																									if (bson_doc_p)
+																									if (!SavePopulationSummary (bson_doc_p, data_p))
 																										{
-																											/*
-																											 * Is the doc ok to save in one go?
-																											 */
-																											if (bson_doc_p -> len < BSON_MAX_SIZE)
-																												{
-																													if (SaveMongoDataFromBSON (data_p -> pgsd_mongo_p, bson_doc_p, data_p -> pgsd_populations_collection_s, NULL))
-																														{
-																															*parent_a_ss = parent_a_s;
-																															*parent_b_ss = parent_b_s;
-																														}
-																													else
-																														{
-																															success_flag = false;
-																															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, doc_p, "Failed to save to \"%s\" -> \"%s\"", data_p -> pgsd_database_s, data_p -> pgsd_populations_collection_s);
-																														}
-
-																													bson_destroy (bson_doc_p);
-																												}
-																											else
-																												{
-																													/*
-																													 * We need to break the doc up into more
-																													 * manageable chunks so make a guess at how
-																													 * many docs we need
-																													 */
-																													size_t num_docs = (size_t) ((double) (bson_doc_p -> len) / (double) BSON_MAX_SIZE) + 1;
-
-
-																													/*
-																													 * Free the memory of the large doc
-																													 */
-																													bson_destroy (bson_doc_p);
-
-																												}
-
-
-																										}		/* if (bson_doc_p) */
-
-
+																											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the summary for \"%s\"", name_s);
+																										}
+																								}
+																							else
+																								{
+																									success_flag = false;
+																									AddGeneralErrorMessageToServiceJob (job_p, "The population is too large to be saved as a single document and storing it as haplotype blocks failed");
 																								}
 
-																						}		/* if (SetJSONString (doc_p, PGS_POPULATION_NAME_S, name_s)) */
-
-																					FreeCopiedString (name_s);
-																				}		/* if (name_s) */
+																							bson_destroy (bson_doc_p);
+																						}
 
+																				}		/* if (bson_doc_p) */
 
-																		}		/* if (parent_b_s) */
+																		}		/* if (success_flag && !saved_flag) */
 
-																}		/* if (parent_a_s) */
+																	if (saved_flag)
+																		{
+																			*parent_a_ss = parent_a_s;
+																			*parent_b_ss = parent_b_s;
 
-														}		/* if (AddGeneticMappingPositions (doc_p, row_p)) */
+																			if (data_p -> pgsd_marker_index_flag)
+																				{
+																					AddPopulationToMarkerIndex (id_p, name_s, doc_p);
+																				}
 
-												}		/* if (AddChromosomes (doc_p, chromosomes_p)) */
+																			if (data_p -> pgsd_population_filters_flag)
+																				{
+																					AddPopulationToFilters (id_p, doc_p, revision);
+																				}
+																		}
 
-										}		/* if (num_rows >= 3) */
+																	StopJobTimer (timings_p, JTS_SAVE_MARKERS, stage_start);
 
-								}		/* if (json_is_array (data_json_p)) */
+																	if (saved_flag)
+																		{
+																			stage_start = StartJobTimer (timings_p);
 
-						}		/* if (AddCompoundIdToJSON (doc_p, id_p)) */
+																			if (!SaveProgenyGenotypes (id_p, name_s, doc_p, data_p))
+																				{
+																					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the progeny genotypes for \"%s\"", name_s);
+																				}
 
-				}		/* if (id_p) */
+																			StopJobTimer (timings_p, JTS_SAVE_PROGENY, stage_start);
+
+																			/*
+																			 * A population that is only stored as haplotype blocks has
+																			 * already saved these before its population document
+																			 */
+																			if (!blocks_only_flag)
+																				{
+																					/*
+																					 * Since an append only has the new markers, the parent genotypes
+																					 * are merged with any that are already stored
+																					 */
+																					if (!SaveParentGenotypes (id_p, name_s, doc_p, parent_a_row_p, parent_b_row_p, append_flag, data_p))
+																						{
+																							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the parent genotypes for \"%s\"", name_s);
+																						}
+
+																					/*
+																					 * The population document has all of the calls so the
+																					 * marker searches still work without the haplotype blocks
+																					 */
+																					if (!SaveMapDerivedData (id_p, name_s, doc_p, append_flag, data_p, timings_p))
+																						{
+																							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the haplotype blocks for \"%s\"", name_s);
+																						}
+																				}
+																		}
+																}		/* if (SetJSONString (doc_p, PGS_POPULATION_NAME_S, name_s)) */
+
+															FreeCopiedString (name_s);
+														}		/* if (name_s) */
+
+												}		/* if (parent_b_s) */
+
+										}		/* if (parent_a_s) */
+
+								}		/* if (added_flag) */
+
+						}		/* if (AddCompoundIdToJSON (doc_p, id_p)) */
+
+				}		/* if (id_p) */
 
 
 			json_decref (doc_p);
@@ -858,16 +1172,16 @@ static bson_oid_t *SaveMarkers (const char **parent_a_ss, const char **parent_b_
 }
 
 
-static bool SaveVarieties (const char *parent_a_s, const char *parent_b_s, const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p)
+static bool SaveVarieties (const char *parent_a_s, const char *parent_b_s, const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p)
 {
 	bool success_flag = false;
 	MongoTool *tool_p = data_p -> pgsd_mongo_p;
 
 	if (SetMongoToolCollection (tool_p, data_p -> pgsd_varieties_collection_s))
 		{
-			if (SaveVariety (parent_a_s, id_p, tool_p))
+			if (SaveVariety (parent_a_s, id_p, tool_p, timings_p))
 				{
-					if (SaveVariety (parent_b_s, id_p, tool_p))
+					if (SaveVariety (parent_b_s, id_p, tool_p, timings_p))
 						{
 							success_flag = true;
 						}
@@ -880,7 +1194,7 @@ static bool SaveVarieties (const char *parent_a_s, const char *parent_b_s, const
 }
 
 
-static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool *mongo_p)
+static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool *mongo_p, JobTimings *timings_p)
 {
 	bool success_flag = false;
 	bson_t *query_p = bson_new ();
@@ -896,6 +1210,8 @@ static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool
 					 */
 					json_t *results_p = GetAllMongoResultsAsJSON (mongo_p, query_p, NULL);
 
+					AddMongoFetchToJobTimings (timings_p, results_p);
+
 					if (results_p)
 						{
 							if (json_is_array (results_p))
@@ -913,7 +1229,15 @@ static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool
 
 													if (json_is_array (marker_ids_p))
 														{
-															if (AddCompoundIdToJSONArray (marker_ids_p, id_p))
+															/*
+															 * Appending to an existing population reuses its id
+															 * so it may already be listed
+															 */
+															if (IsIdInJSONArray (marker_ids_p, id_p))
+																{
+																	success_flag = true;
+																}
+															else if (AddCompoundIdToJSONArray (marker_ids_p, id_p))
 																{
 																	if (SaveMongoData (mongo_p, accession_data_p, NULL, query_p))
 																		{
@@ -978,6 +1302,596 @@ static bool SaveVariety (const char *parent_s, const bson_oid_t *id_p, MongoTool
 }
 
 
+/*
+ * Rather than replacing the stored document, set each of the marker
+ * fields individually, e.g. "marker.accession": "genotype", so that
+ * only the new values are sent and any existing ones are kept.
+ *
+ * If a population with this name already exists, it must be for the
+ * same parents and is updated by its id. If there isn't one, the update
+ * is a findAndModify upsert on the claimed name, which has a unique
+ * index, so if two appends race to create the population, only one of
+ * them can insert it under its new_id_p. The other gets a duplicate key
+ * error and looks the population up again.
+ *
+ * The id of the population that was updated is stored in
+ * population_id_p and its revision, which is incremented by every
+ * append so that other processes can tell that it has changed, is
+ * stored in revision_p.
+ */
+static bool AppendToPopulation (const char *name_s, const char *parent_a_s, const char *parent_b_s, const bson_oid_t *new_id_p, const json_t *doc_p, bson_oid_t *population_id_p, int64 *revision_p, ServiceJob *job_p, ParentalGenotypeServiceData *data_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	bson_t *fields_p = bson_new ();
+
+	if (fields_p)
+		{
+			const char *marker_s;
+			json_t *marker_p;
+
+			success_flag = true;
+
+			json_object_foreach ((json_t *) doc_p, marker_s, marker_p)
+				{
+					if (success_flag && IsMarkerEntry (marker_s, marker_p))
+						{
+							const char *key_s;
+							json_t *value_p;
+
+							json_object_foreach (marker_p, key_s, value_p)
+								{
+									if (success_flag && json_is_string (value_p))
+										{
+											const char *path_s = ConcatenateVarargsStringsInJobArena (arena_p, marker_s, ".", key_s, NULL);
+
+											success_flag = false;
+
+											if (path_s)
+												{
+													if (BSON_APPEND_UTF8 (fields_p, path_s, json_string_value (value_p)))
+														{
+															success_flag = true;
+														}
+												}
+										}
+								}
+
+							/*
+							 * BSON_APPEND_UTF8 () copies the paths so they are no longer needed
+							 */
+							ResetJobArena (arena_p);
+						}
+				}
+
+			if (success_flag)
+				{
+					success_flag = BSON_APPEND_UTF8 (fields_p, PGS_CLAIMED_NAME_S, name_s);
+				}
+
+			if (success_flag)
+				{
+					success_flag = false;
+
+					if (fields_p -> len < BSON_MAX_SIZE)
+						{
+							bool retry_flag = true;
+							uint32 i;
+
+							for (i = 0; (i < S_NUM_APPEND_ATTEMPTS) && retry_flag; ++ i)
+								{
+									bson_oid_t existing_id;
+									bool exists_flag = false;
+
+									retry_flag = false;
+
+									if (FindPopulationToAppendTo (name_s, parent_a_s, parent_b_s, &existing_id, &exists_flag, job_p, data_p))
+										{
+											bson_t *query_p = NULL;
+
+											if (exists_flag)
+												{
+													query_p = BCON_NEW (MONGO_ID_S, BCON_OID (&existing_id));
+												}
+											else
+												{
+													query_p = BCON_NEW (PGS_CLAIMED_NAME_S, BCON_UTF8 (name_s), PGS_PARENT_A_S, BCON_UTF8 (parent_a_s), PGS_PARENT_B_S, BCON_UTF8 (parent_b_s));
+												}
+
+											if (query_p)
+												{
+													bson_t *update_p = BCON_NEW ("$set", BCON_DOCUMENT (fields_p),
+																											 "$inc", "{", PGS_REVISION_S, BCON_INT32 (1), "}",
+																											 "$setOnInsert", "{", MONGO_ID_S, BCON_OID (new_id_p), PGS_POPULATION_NAME_S, BCON_UTF8 (name_s), "}");
+
+													if (update_p)
+														{
+															bson_t *return_fields_p = BCON_NEW (MONGO_ID_S, BCON_BOOL (true), PGS_REVISION_S, BCON_BOOL (true));
+
+															if (return_fields_p)
+																{
+																	bson_t reply;
+																	bson_error_t error;
+
+																	if (mongoc_collection_find_and_modify (data_p -> pgsd_mongo_p -> mt_collection_p, query_p, NULL, update_p, return_fields_p, false, !exists_flag, true, &reply, &error))
+																		{
+																			if (GetPopulationIdFromReply (&reply, population_id_p, revision_p))
+																				{
+																					success_flag = true;
+																				}
+																			else if (exists_flag)
+																				{
+																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Population \"%s\" was removed while appending to it", name_s);
+																					AddGeneralErrorMessageToServiceJob (job_p, "The population was removed while appending to it");
+																				}
+																			else
+																				{
+																					PrintBSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, &reply, "Failed to get the id of population \"%s\"", name_s);
+																				}
+																		}
+																	else if ((!exists_flag) && (error.code == S_DUPLICATE_KEY_ERROR_CODE))
+																		{
+																			/*
+																			 * Another append has claimed the name since we looked, so
+																			 * look again to find its population and check its parents.
+																			 */
+																			retry_flag = true;
+																		}
+																	else
+																		{
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to append to population \"%s\" in \"%s\" -> \"%s\": %s", name_s, data_p -> pgsd_database_s, data_p -> pgsd_populations_collection_s, error.message);
+																		}
+
+																	bson_destroy (&reply);
+																	bson_destroy (return_fields_p);
+																}		/* if (return_fields_p) */
+
+															bson_destroy (update_p);
+														}		/* if (update_p) */
+
+													bson_destroy (query_p);
+												}		/* if (query_p) */
+
+										}		/* if (FindPopulationToAppendTo (name_s, parent_a_s, parent_b_s, &existing_id, &exists_flag, job_p, data_p)) */
+
+								}		/* for (i = 0; (i < S_NUM_APPEND_ATTEMPTS) && retry_flag; ++ i) */
+
+							if (retry_flag)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to claim the name \"%s\" after " UINT32_FMT " attempts", name_s, S_NUM_APPEND_ATTEMPTS);
+									AddGeneralErrorMessageToServiceJob (job_p, "The population name is being claimed by another submission, please try again");
+								}
+
+						}		/* if (fields_p -> len < BSON_MAX_SIZE) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The update of " UINT32_FMT " bytes is too large to send in one go", fields_p -> len);
+							AddGeneralErrorMessageToServiceJob (job_p, "The markers to append are too large to send in one go, please append them in smaller parts");
+						}
+				}
+
+			bson_destroy (fields_p);
+		}		/* if (fields_p) */
+
+	return success_flag;
+}
+
+
+/*
+ * Look for the population that an append would update. Only an
+ * existing population for the same parents can be appended to, and if
+ * plain submissions have saved more than one population under this name
+ * there is no way to tell which one is meant, so both are errors.
+ */
+static bool FindPopulationToAppendTo (const char *name_s, const char *parent_a_s, const char *parent_b_s, bson_oid_t *id_p, bool *exists_flag_p, ServiceJob *job_p, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (PGS_POPULATION_NAME_S, BCON_UTF8 (name_s));
+
+			if (query_p)
+				{
+					bson_t *opts_p = BCON_NEW ("projection", "{", MONGO_ID_S, BCON_BOOL (true), PGS_PARENT_A_S, BCON_BOOL (true), PGS_PARENT_B_S, BCON_BOOL (true), PGS_HAPLOTYPE_BLOCKS_ONLY_S, BCON_BOOL (true), "}",
+																		 "limit", BCON_INT64 (2));
+
+					if (opts_p)
+						{
+							json_t *results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, opts_p);
+
+							if (results_p)
+								{
+									const size_t num_results = json_array_size (results_p);
+
+									if (num_results == 0)
+										{
+											*exists_flag_p = false;
+											success_flag = true;
+										}
+									else if (num_results == 1)
+										{
+											const json_t *population_p = json_array_get (results_p, 0);
+											const char *existing_a_s = GetJSONString (population_p, PGS_PARENT_A_S);
+											const char *existing_b_s = GetJSONString (population_p, PGS_PARENT_B_S);
+
+											if (IsHaplotypeBlocksOnlyPopulation (population_p))
+												{
+													/*
+													 * Its calls are only in its haplotype blocks, which would have
+													 * to be rebuilt from the whole population to add to them
+													 */
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Population \"%s\" is only stored as haplotype blocks so it can't be appended to", name_s);
+													AddGeneralErrorMessageToServiceJob (job_p, "The population is stored as haplotype blocks because of its size so it can't be appended to, please resubmit the whole population instead");
+												}
+											else if (existing_a_s && existing_b_s && (strcmp (existing_a_s, parent_a_s) == 0) && (strcmp (existing_b_s, parent_b_s) == 0))
+												{
+													if (GetIdFromJSONKeyValuePair (json_object_get (population_p, MONGO_ID_S), id_p))
+														{
+															*exists_flag_p = true;
+															success_flag = true;
+														}
+													else
+														{
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, population_p, "Failed to get the id of population \"%s\"", name_s);
+														}
+												}
+											else
+												{
+													char *error_s = ConcatenateVarargsStrings ("The population \"", name_s, "\" already exists for the parents \"", existing_a_s ? existing_a_s : "", "\" and \"", existing_b_s ? existing_b_s : "", "\"", NULL);
+
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Population \"%s\" has parents \"%s\" and \"%s\", not \"%s\" and \"%s\"", name_s, existing_a_s ? existing_a_s : "", existing_b_s ? existing_b_s : "", parent_a_s, parent_b_s);
+
+													if (error_s)
+														{
+															AddGeneralErrorMessageToServiceJob (job_p, error_s);
+															FreeCopiedString (error_s);
+														}
+													else
+														{
+															AddGeneralErrorMessageToServiceJob (job_p, "The population already exists for different parents");
+														}
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "There is more than one population called \"%s\" so it is not clear which one to append to", name_s);
+											AddGeneralErrorMessageToServiceJob (job_p, "There is more than one population with this name so it is not clear which one to append to");
+										}
+
+									json_decref (results_p);
+								}		/* if (results_p) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to search for population \"%s\" in \"%s\" -> \"%s\"", name_s, data_p -> pgsd_database_s, data_p -> pgsd_populations_collection_s);
+								}
+
+							bson_destroy (opts_p);
+						}		/* if (opts_p) */
+
+					bson_destroy (query_p);
+				}		/* if (query_p) */
+
+		}		/* if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s)) */
+
+	return success_flag;
+}
+
+
+/*
+ * The findAndModify reply has the updated document, or the inserted
+ * one, projected down to its id and revision in "value".
+ */
+static bool GetPopulationIdFromReply (const bson_t *reply_p, bson_oid_t *id_p, int64 *revision_p)
+{
+	bool success_flag = false;
+	bson_iter_t reply_iter;
+
+	if ((bson_iter_init_find (&reply_iter, reply_p, "value")) && (BSON_ITER_HOLDS_DOCUMENT (&reply_iter)))
+		{
+			bson_iter_t value_iter;
+
+			if ((bson_iter_recurse (&reply_iter, &value_iter)) && (bson_iter_find (&value_iter, MONGO_ID_S)) && (BSON_ITER_HOLDS_OID (&value_iter)))
+				{
+					bson_oid_copy (bson_iter_oid (&value_iter), id_p);
+
+					if ((bson_iter_recurse (&reply_iter, &value_iter)) && (bson_iter_find (&value_iter, PGS_REVISION_S)) && ((BSON_ITER_HOLDS_INT32 (&value_iter)) || (BSON_ITER_HOLDS_INT64 (&value_iter))))
+						{
+							*revision_p = bson_iter_as_int64 (&value_iter);
+							success_flag = true;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool IsIdInJSONArray (const json_t *ids_p, const bson_oid_t *id_p)
+{
+	const size_t num_ids = json_array_size (ids_p);
+	size_t i;
+
+	for (i = 0; i < num_ids; ++ i)
+		{
+			bson_oid_t oid;
+
+			if (GetIdFromJSONKeyValuePair (json_array_get (ids_p, i), &oid))
+				{
+					if (bson_oid_equal (&oid, id_p))
+						{
+							return true;
+						}
+				}
+		}
+
+	return false;
+}
+
+
+static json_t *GetPopulationById (const bson_oid_t *id_p, ParentalGenotypeServiceData *data_p)
+{
+	json_t *population_p = NULL;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, data_p -> pgsd_populations_collection_s))
+		{
+			bson_t *query_p = BCON_NEW (MONGO_ID_S, BCON_OID (id_p));
+
+			if (query_p)
+				{
+					json_t *results_p = GetAllMongoResultsAsJSON (data_p -> pgsd_mongo_p, query_p, NULL);
+
+					if (results_p)
+						{
+							if ((population_p = json_array_get (results_p, 0)) != NULL)
+								{
+									json_incref (population_p);
+								}
+
+							json_decref (results_p);
+						}
+
+					bson_destroy (query_p);
+				}
+		}
+
+	return population_p;
+}
+
+
+/*
+ * The marker statistics, breakpoints and haplotype blocks depend on
+ * every progeny call at a marker and on the order of the markers along
+ * the map, so when appending they are worked out again from the whole
+ * of the updated population. They all use the stored parent genotypes,
+ * which have already been merged with any new ones.
+ *
+ * Failing to save the statistics or breakpoints is only a warning,
+ * since they can be worked out again later. This returns whether the
+ * haplotype blocks were saved, as a population that is too large for
+ * its calls to be in its population document has no other copy of them.
+ */
+static bool SaveMapDerivedData (const bson_oid_t *id_p, const char *population_s, json_t *doc_p, const bool append_flag, ParentalGenotypeServiceData *data_p, JobTimings *timings_p)
+{
+	bool success_flag = false;
+	json_t *population_p = append_flag ? GetPopulationById (id_p, data_p) : json_incref (doc_p);
+
+	if (population_p)
+		{
+			json_t *parents_p = GetParentGenotypesByMarker (id_p, data_p);
+
+			if (parents_p)
+				{
+					uint64 stage_start = StartJobTimer (timings_p);
+
+					if (!SaveMarkerStats (id_p, population_s, population_p, parents_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the marker statistics for \"%s\"", population_s);
+						}
+
+					StopJobTimer (timings_p, JTS_SAVE_MARKER_STATS, stage_start);
+
+					stage_start = StartJobTimer (timings_p);
+
+					if (!SaveBreakpoints (id_p, population_s, population_p, parents_p, data_p))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save the breakpoints for \"%s\"", population_s);
+						}
+
+					StopJobTimer (timings_p, JTS_SAVE_BREAKPOINTS, stage_start);
+
+					stage_start = StartJobTimer (timings_p);
+
+					if (SaveHaplotypeBlocks (id_p, population_s, population_p, parents_p, data_p))
+						{
+							success_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save the haplotype blocks for \"%s\"", population_s);
+						}
+
+					StopJobTimer (timings_p, JTS_SAVE_HAPLOTYPE_BLOCKS, stage_start);
+
+					json_decref (parents_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the parent genotypes for \"%s\"", population_s);
+				}
+
+			json_decref (population_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get \"%s\" to update the data derived from its map", population_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Save a population whose calls are too large for a single document.
+ * Its haplotype blocks, along with the parent genotypes that they are
+ * built from, are saved first and then a population document with just
+ * the names of its markers. Nothing else has been saved for the population
+ * yet, so if any of these fail everything under its id is removed again
+ * rather than leaving a population without its calls.
+ */
+static bool SaveHaplotypeBlocksOnlyPopulation (const bson_oid_t *id_p, const char *population_s, json_t *doc_p, const json_t *parent_a_row_p, const json_t *parent_b_row_p, ParentalGenotypeServiceData *data_p, JobTimings *timings_p)
+{
+	bool success_flag = false;
+
+	if (SaveParentGenotypes (id_p, population_s, doc_p, parent_a_row_p, parent_b_row_p, false, data_p))
+		{
+			if (SaveMapDerivedData (id_p, population_s, doc_p, false, data_p, timings_p))
+				{
+					bson_t *population_p = GetHaplotypeBlocksOnlyPopulation (doc_p);
+
+					if (population_p)
+						{
+							if (population_p -> len < BSON_MAX_SIZE)
+								{
+									if (SaveMongoDataFromBSON (data_p -> pgsd_mongo_p, population_p, data_p -> pgsd_populations_collection_s, NULL))
+										{
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save \"%s\" to \"%s\" -> \"%s\"", population_s, data_p -> pgsd_database_s, data_p -> pgsd_populations_collection_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The list of markers for \"%s\" is " UINT32_FMT " bytes which is too large to save", population_s, population_p -> len);
+								}
+
+							bson_destroy (population_p);
+						}		/* if (population_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build the list of markers for \"%s\"", population_s);
+						}
+
+				}		/* if (SaveMapDerivedData (id_p, population_s, doc_p, false, data_p, timings_p)) */
+
+		}		/* if (SaveParentGenotypes (id_p, population_s, doc_p, parent_a_row_p, parent_b_row_p, false, data_p)) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to save the parent genotypes for \"%s\"", population_s);
+		}
+
+	if (!success_flag)
+		{
+			RemovePopulationData (id_p, population_s, data_p);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Everything apart from the markers is kept as it is and the
+ * markers are replaced by an array of their escaped names.
+ */
+static bson_t *GetHaplotypeBlocksOnlyPopulation (const json_t *doc_p)
+{
+	bson_t *population_p = NULL;
+	json_t *header_p = json_object ();
+
+	if (header_p)
+		{
+			json_t *markers_p = json_array ();
+
+			if (markers_p)
+				{
+					if (json_object_set_new (header_p, PGS_MARKERS_S, markers_p) == 0)
+						{
+							const char *key_s;
+							json_t *value_p;
+							bool success_flag = SetJSONBoolean (header_p, PGS_HAPLOTYPE_BLOCKS_ONLY_S, true);
+
+							json_object_foreach ((json_t *) doc_p, key_s, value_p)
+								{
+									if (success_flag)
+										{
+											if (IsMarkerEntry (key_s, value_p))
+												{
+													success_flag = (json_array_append_new (markers_p, json_string (key_s)) == 0);
+												}
+											else
+												{
+													success_flag = (json_object_set (header_p, key_s, value_p) == 0);
+												}
+										}
+								}
+
+							if (success_flag)
+								{
+									population_p = ConvertJSONToBSON (header_p);
+								}
+						}
+					else
+						{
+							json_decref (markers_p);
+						}
+				}		/* if (markers_p) */
+
+			json_decref (header_p);
+		}		/* if (header_p) */
+
+	return population_p;
+}
+
+
+/*
+ * The marker statistics and the progeny lines, which hold the
+ * breakpoints, refer to the population by its id in a field of
+ * their own while the others use it as their own id.
+ */
+static void RemovePopulationData (const bson_oid_t *id_p, const char *population_s, ParentalGenotypeServiceData *data_p)
+{
+	if (!RemovePopulationDataFromCollection (id_p, MONGO_ID_S, data_p -> pgsd_parent_genotypes_collection_s, data_p))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the parent genotypes for \"%s\"", population_s);
+		}
+
+	if (!RemovePopulationDataFromCollection (id_p, PGS_POPULATION_ID_S, data_p -> pgsd_marker_stats_collection_s, data_p))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the marker statistics for \"%s\"", population_s);
+		}
+
+	if (!RemovePopulationDataFromCollection (id_p, PGS_POPULATION_ID_S, data_p -> pgsd_progeny_collection_s, data_p))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the breakpoints for \"%s\"", population_s);
+		}
+
+	if (!RemovePopulationDataFromCollection (id_p, MONGO_ID_S, data_p -> pgsd_haplotype_blocks_collection_s, data_p))
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to remove the haplotype blocks for \"%s\"", population_s);
+		}
+}
+
+
+static bool RemovePopulationDataFromCollection (const bson_oid_t *id_p, const char *key_s, const char *collection_s, ParentalGenotypeServiceData *data_p)
+{
+	bool success_flag = false;
+
+	if (SetMongoToolCollection (data_p -> pgsd_mongo_p, collection_s))
+		{
+			bson_t *query_p = BCON_NEW (key_s, BCON_OID (id_p));
+
+			if (query_p)
+				{
+					success_flag = RemoveMongoDocumentsByBSON (data_p -> pgsd_mongo_p, query_p, false);
+					bson_destroy (query_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
 static ParameterSet *IsResourceForParentalGenotypeSubmissionService (Service * UNUSED_PARAM (service_p), DataResource * UNUSED_PARAM (resource_p), Handler * UNUSED_PARAM (handler_p))
 {
 	return NULL;
@@ -0,0 +1,1727 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * vcf_file.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "vcf_file.h"
+#include "parental_genotype_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "json_util.h"
+
+
+struct VCFFile
+{
+	char *vf_filename_s;
+
+	/**
+	 * The mapped file or, for gzip and BGZF files, a buffer with the
+	 * part of the file that has been decompressed so far.
+	 */
+	const char *vf_data_s;
+
+	size_t vf_size;
+
+	/** Whether vf_data_s is mapped rather than allocated. */
+	bool vf_mapped_flag;
+
+	/**
+	 * The stream that gzip and BGZF files are decompressed from, a
+	 * buffer at a time, which is positioned after vf_data_s.
+	 */
+	gzFile vf_gz_f;
+
+	/** The size of the buffer for gzip and BGZF files. */
+	size_t vf_capacity;
+
+	/** The start of the first line after the header. */
+	const char *vf_variants_s;
+
+	/** The number of lines after the header. */
+	size_t vf_num_variants;
+
+	/** The names of the samples in column order. */
+	const char **vf_samples_ss;
+
+	uint32 vf_num_samples;
+
+	uint32 vf_parent_a_index;
+
+	uint32 vf_parent_b_index;
+
+	/**
+	 * The chromosome and mapping position of each marker on the
+	 * genetic map or <code>NULL</code> if there isn't a map.
+	 */
+	json_t *vf_map_p;
+
+	json_t *vf_parent_a_row_p;
+
+	json_t *vf_parent_b_row_p;
+
+	/** The sample names and their mapped accessions. */
+	JobArena vf_arena;
+};
+
+
+/*
+ * A parsed variant that is waiting to be added to the population.
+ */
+typedef struct VCFMarker
+{
+	/** The marker's unescaped name, from its worker's arena. */
+	const char *vm_name_s;
+
+	json_t *vm_marker_p;
+
+	json_t *vm_parent_a_call_p;
+
+	json_t *vm_parent_b_call_p;
+} VCFMarker;
+
+
+/*
+ * Parses a chunk of whole lines of the file. The workers only create
+ * their own JSON values and read from the genetic map so they can run
+ * without any locking.
+ */
+typedef struct VCFWorker
+{
+	const VCFFile *vw_vcf_p;
+
+	/** The accession of each sample column, or NULL for the parents. */
+	const char **vw_accessions_ss;
+
+	const char *vw_start_s;
+
+	const char *vw_end_s;
+
+	VCFMarker *vw_markers_p;
+
+	size_t vw_num_markers;
+
+	/** The number of variants that were skipped for not being on the map. */
+	size_t vw_num_unmapped;
+
+	JobArena vw_arena;
+
+	bool vw_success_flag;
+
+	pthread_t vw_thread;
+
+	bool vw_started_flag;
+} VCFWorker;
+
+
+typedef enum VCFColumn
+{
+	VC_CHROM,
+
+	VC_POS,
+
+	VC_ID,
+
+	VC_REF,
+
+	VC_ALT,
+
+	VC_QUAL,
+
+	VC_FILTER,
+
+	VC_INFO,
+
+	VC_FORMAT,
+
+	VC_FIRST_SAMPLE
+} VCFColumn;
+
+
+/*
+ * The approximate size of the chunk that each worker parses. Each batch
+ * of chunks is added to the population before the next one is parsed
+ * so that only a batch's worth of parsed variants are held at once.
+ */
+static const size_t S_CHUNK_SIZE = 4 * 1024 * 1024;
+
+#define S_MAX_ALLELES (64)
+
+#define S_MAX_PLOIDY (8)
+
+/*
+ * Calls longer than this are built in the worker's arena
+ */
+#define S_CALL_BUFFER_SIZE (256)
+
+static const char * const S_FILE_FORMAT_S = "##fileformat=VCF";
+
+static const char * const S_HEADER_S = "#CHROM\t";
+
+static const char * const S_MISSING_CALL_S = "-";
+
+/*
+ * The key that the first column of each row of a submitted table has.
+ */
+static const char * const S_ID_S = "id";
+
+
+static bool IsGzippedFile (const int fd);
+
+static bool ReadGzippedHeader (VCFFile *vcf_p);
+
+static bool ReadGzippedData (VCFFile *vcf_p, const size_t size);
+
+static void EstimateGzippedVariants (VCFFile *vcf_p, const size_t compressed_size);
+
+static void FreeVCFData (const char *data_s, const size_t size, const bool mapped_flag);
+
+static bool ReadVCFHeader (VCFFile *vcf_p, const char *parent_a_s, const char *parent_b_s);
+
+static bool GetParentIndex (const VCFFile *vcf_p, const char *parent_s, const uint32 default_index, uint32 *index_p);
+
+static json_t *LoadGeneticMap (const char *filename_s);
+
+static bool AddGeneticMapLine (json_t *map_p, char *line_s, const size_t line_number);
+
+static json_t *GetVCFParentRow (const char *parent_s);
+
+static const char *GetChunkEnd (const char *start_s, const char *end_s);
+
+static bool AddMappedVariants (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p);
+
+static bool AddGzippedVariants (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p);
+
+static const char *AddVariantsBatch (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, const char *position_s, const char *end_s, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p);
+
+static void RunVCFWorkers (VCFWorker *workers_p, const uint32 num_workers);
+
+static void *RunVCFWorker (void *data_p);
+
+static bool ParseVariant (VCFWorker *worker_p, const char *line_s, const char *line_end_s, VCFMarker *marker_p);
+
+static const char *GetVCFField (const char **position_ss, const char *line_end_s, size_t *length_p);
+
+static bool GetGenotypeIndex (const char *format_s, const size_t format_length, uint32 *index_p);
+
+static uint32 GetAlleles (const char *ref_s, const size_t ref_length, const char *alt_s, const size_t alt_length, const char **alleles_ss, size_t *allele_lengths_p);
+
+static json_t *GetCall (const char *sample_s, const size_t sample_length, const uint32 gt_index, const char **alleles_ss, const size_t *allele_lengths_p, const uint32 num_alleles, JobArena *arena_p);
+
+static bool MergeVCFWorker (VCFWorker *worker_p, VCFFile *vcf_p, json_t *doc_p, size_t *num_markers_p, JobArena *arena_p);
+
+static void ClearVCFWorker (VCFWorker *worker_p);
+
+static char *CopyToArena (const char *value_s, const size_t length, JobArena *arena_p);
+
+
+
+bool IsVCFFile (const char *filename_s)
+{
+	bool vcf_flag = false;
+
+	/*
+	 * gzread () reads uncompressed files as they are, so this
+	 * checks plain and compressed files alike
+	 */
+	gzFile in_f = gzopen (filename_s, "rb");
+
+	if (in_f)
+		{
+			char buffer_s [32];
+			const size_t l = strlen (S_FILE_FORMAT_S);
+
+			if (gzread (in_f, buffer_s, (unsigned int) l) == (int) l)
+				{
+					vcf_flag = (strncmp (buffer_s, S_FILE_FORMAT_S, l) == 0);
+				}
+
+			gzclose (in_f);
+		}
+
+	return vcf_flag;
+}
+
+
+VCFFile *OpenVCFFile (const char *filename_s, const char *parent_a_s, const char *parent_b_s, const char *map_filename_s)
+{
+	int fd = open (filename_s, O_RDONLY);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size > 0))
+				{
+					VCFFile *vcf_p = (VCFFile *) AllocMemory (sizeof (VCFFile));
+
+					if (vcf_p)
+						{
+							const size_t size = (size_t) st.st_size;
+							bool read_flag = false;
+
+							memset (vcf_p, 0, sizeof (VCFFile));
+							InitJobArena (& (vcf_p -> vf_arena));
+
+							if ((vcf_p -> vf_filename_s = EasyCopyToNewString (filename_s)) != NULL)
+								{
+									/*
+									 * Plain files are mapped but compressed ones are decompressed
+									 * a buffer at a time, so only the header is read for now
+									 */
+									if ((vcf_p -> vf_mapped_flag = !IsGzippedFile (fd)) == true)
+										{
+											void *data_p = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+											if (data_p != MAP_FAILED)
+												{
+													madvise (data_p, size, MADV_SEQUENTIAL);
+
+													vcf_p -> vf_data_s = (const char *) data_p;
+													vcf_p -> vf_size = size;
+													read_flag = true;
+												}
+										}
+									else
+										{
+											read_flag = ReadGzippedHeader (vcf_p);
+										}
+
+									if (read_flag)
+										{
+											if (ReadVCFHeader (vcf_p, parent_a_s, parent_b_s))
+												{
+													if (vcf_p -> vf_gz_f)
+														{
+															EstimateGzippedVariants (vcf_p, size);
+														}
+
+													if ((map_filename_s == NULL) || ((vcf_p -> vf_map_p = LoadGeneticMap (map_filename_s)) != NULL))
+														{
+															/*
+															 * The mapping, and the decompressing stream, stay valid
+															 * without the descriptor
+															 */
+															close (fd);
+
+															return vcf_p;
+														}
+												}
+										}
+								}
+
+							CloseVCFFile (vcf_p);
+						}		/* if (vcf_p) */
+
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is empty", filename_s);
+				}
+
+			close (fd);
+		}		/* if (fd != -1) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open VCF file \"%s\"", filename_s);
+
+	return NULL;
+}
+
+
+size_t GetVCFFileNumRows (const VCFFile *vcf_p)
+{
+	return vcf_p -> vf_num_samples + 2;
+}
+
+
+uint64 GetVCFFileNumCells (const VCFFile *vcf_p)
+{
+	return ((uint64) (vcf_p -> vf_num_samples + 3)) * ((uint64) (vcf_p -> vf_num_variants));
+}
+
+
+bool AddVCFFileToPopulation (VCFFile *vcf_p, json_t *doc_p, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp, const ParentalGenotypeServiceData *data_p, JobArena *arena_p)
+{
+	bool success_flag = false;
+	const uint32 num_threads = (data_p -> pgsd_import_threads > 0) ? data_p -> pgsd_import_threads : 1;
+	const char **accessions_ss = (const char **) AllocMemoryArray (vcf_p -> vf_num_samples, sizeof (const char *));
+
+	if (accessions_ss)
+		{
+			VCFWorker *workers_p = (VCFWorker *) AllocMemoryArray (num_threads, sizeof (VCFWorker));
+
+			if (workers_p)
+				{
+					uint32 i;
+
+					success_flag = true;
+
+					for (i = 0; (i < vcf_p -> vf_num_samples) && success_flag; ++ i)
+						{
+							if ((i != vcf_p -> vf_parent_a_index) && (i != vcf_p -> vf_parent_b_index))
+								{
+									accessions_ss [i] = GetMappedAccession (vcf_p -> vf_samples_ss [i], data_p, & (vcf_p -> vf_arena));
+									success_flag = (accessions_ss [i] != NULL);
+								}
+						}
+
+					if (success_flag)
+						{
+							if (((vcf_p -> vf_parent_a_row_p = GetVCFParentRow (vcf_p -> vf_samples_ss [vcf_p -> vf_parent_a_index])) == NULL) ||
+									((vcf_p -> vf_parent_b_row_p = GetVCFParentRow (vcf_p -> vf_samples_ss [vcf_p -> vf_parent_b_index])) == NULL))
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag)
+						{
+							size_t num_markers = 0;
+							size_t num_unmapped = 0;
+
+							for (i = 0; i < num_threads; ++ i)
+								{
+									workers_p [i].vw_vcf_p = vcf_p;
+									workers_p [i].vw_accessions_ss = accessions_ss;
+									InitJobArena (& (workers_p [i].vw_arena));
+								}
+
+							if (vcf_p -> vf_mapped_flag)
+								{
+									success_flag = AddMappedVariants (vcf_p, workers_p, num_threads, doc_p, &num_markers, &num_unmapped, arena_p);
+								}
+							else
+								{
+									success_flag = AddGzippedVariants (vcf_p, workers_p, num_threads, doc_p, &num_markers, &num_unmapped, arena_p);
+								}
+
+							for (i = 0; i < num_threads; ++ i)
+								{
+									ClearJobArena (& (workers_p [i].vw_arena));
+								}
+
+							if (num_unmapped > 0)
+								{
+									PrintLog (STM_LEVEL_INFO, __FILE__, __LINE__, SIZET_FMT " variants in \"%s\" were skipped since they aren't on the genetic map", num_unmapped, vcf_p -> vf_filename_s);
+								}
+
+							if (success_flag)
+								{
+									if (num_markers > 0)
+										{
+											*parent_a_row_pp = vcf_p -> vf_parent_a_row_p;
+											*parent_b_row_pp = vcf_p -> vf_parent_b_row_p;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has no variants to add", vcf_p -> vf_filename_s);
+											success_flag = false;
+										}
+								}
+						}		/* if (success_flag) */
+
+					FreeMemory (workers_p);
+				}		/* if (workers_p) */
+
+			FreeMemory (accessions_ss);
+		}		/* if (accessions_ss) */
+
+	return success_flag;
+}
+
+
+void CloseVCFFile (VCFFile *vcf_p)
+{
+	if (vcf_p -> vf_parent_a_row_p)
+		{
+			json_decref (vcf_p -> vf_parent_a_row_p);
+		}
+
+	if (vcf_p -> vf_parent_b_row_p)
+		{
+			json_decref (vcf_p -> vf_parent_b_row_p);
+		}
+
+	if (vcf_p -> vf_map_p)
+		{
+			json_decref (vcf_p -> vf_map_p);
+		}
+
+	if (vcf_p -> vf_gz_f)
+		{
+			gzclose (vcf_p -> vf_gz_f);
+		}
+
+	if (vcf_p -> vf_data_s)
+		{
+			FreeVCFData (vcf_p -> vf_data_s, vcf_p -> vf_size, vcf_p -> vf_mapped_flag);
+		}
+
+	ClearJobArena (& (vcf_p -> vf_arena));
+
+	if (vcf_p -> vf_filename_s)
+		{
+			FreeCopiedString (vcf_p -> vf_filename_s);
+		}
+
+	FreeMemory (vcf_p);
+}
+
+
+static bool IsGzippedFile (const int fd)
+{
+	unsigned char magic [2];
+
+	return ((pread (fd, magic, 2, 0) == 2) && (magic [0] == 0x1F) && (magic [1] == 0x8B));
+}
+
+
+/*
+ * Decompress the file until the buffer has the whole header, up to and
+ * including the #CHROM line, and at least a chunk of the variants after
+ * it, which are used to estimate how many variants there are. So only
+ * the header has to fit in memory rather than the whole file.
+ *
+ * BGZF files are a series of gzip members and gzread () carries on
+ * through concatenated members, so these are read the same way as
+ * plain gzip files.
+ */
+static bool ReadGzippedHeader (VCFFile *vcf_p)
+{
+	if ((vcf_p -> vf_gz_f = gzopen (vcf_p -> vf_filename_s, "rb")) != NULL)
+		{
+			const size_t header_length = strlen (S_HEADER_S);
+			size_t line_start = 0;
+			size_t variants_start = 0;
+			bool header_flag = false;
+
+			while (ReadGzippedData (vcf_p, S_CHUNK_SIZE))
+				{
+					if (!header_flag)
+						{
+							const char *line_s = vcf_p -> vf_data_s + line_start;
+							const char *end_s = vcf_p -> vf_data_s + vcf_p -> vf_size;
+							const char *line_end_s;
+
+							/*
+							 * Stop at the #CHROM line or at the first line that isn't
+							 * part of the header, which ReadVCFHeader () will report
+							 */
+							while ((!header_flag) && ((line_end_s = (const char *) memchr (line_s, '\n', end_s - line_s)) != NULL))
+								{
+									if ((*line_s != '#') || (strncmp (line_s, S_HEADER_S, header_length) == 0))
+										{
+											variants_start = (size_t) (line_end_s + 1 - vcf_p -> vf_data_s);
+											header_flag = true;
+										}
+									else
+										{
+											line_s = line_end_s + 1;
+										}
+								}
+
+							line_start = (size_t) (line_s - vcf_p -> vf_data_s);
+						}
+
+					if ((gzeof (vcf_p -> vf_gz_f)) || ((header_flag) && (vcf_p -> vf_size - variants_start >= S_CHUNK_SIZE)))
+						{
+							if (vcf_p -> vf_size > 0)
+								{
+									return true;
+								}
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is empty", vcf_p -> vf_filename_s);
+							return false;
+						}
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open \"%s\" for decompression", vcf_p -> vf_filename_s);
+		}
+
+	return false;
+}
+
+
+/*
+ * Decompress up to size more bytes onto the end of the buffer,
+ * growing it if needed.
+ */
+static bool ReadGzippedData (VCFFile *vcf_p, const size_t size)
+{
+	char *data_s = (char *) vcf_p -> vf_data_s;
+	int num_read;
+
+	if (vcf_p -> vf_size + size > vcf_p -> vf_capacity)
+		{
+			const size_t capacity = vcf_p -> vf_size + size;
+
+			data_s = (char *) (data_s ? ReallocMemory (data_s, capacity, vcf_p -> vf_capacity) : AllocMemory (capacity));
+
+			if (!data_s)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to grow the buffer for \"%s\" to " SIZET_FMT " bytes", vcf_p -> vf_filename_s, capacity);
+					return false;
+				}
+
+			vcf_p -> vf_data_s = data_s;
+			vcf_p -> vf_capacity = capacity;
+		}
+
+	if ((num_read = gzread (vcf_p -> vf_gz_f, data_s + vcf_p -> vf_size, (unsigned int) size)) >= 0)
+		{
+			int error_code = Z_OK;
+
+			vcf_p -> vf_size += (size_t) num_read;
+
+			/*
+			 * gzread () treats a file that stops part of the way through a
+			 * gzip member as if it had reached the end, so check for that
+			 */
+			if ((gzeof (vcf_p -> vf_gz_f)) && (gzerror (vcf_p -> vf_gz_f, &error_code)) && (error_code == Z_BUF_ERROR))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" is truncated", vcf_p -> vf_filename_s);
+					return false;
+				}
+
+			return true;
+		}
+	else
+		{
+			int error_code = Z_OK;
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to decompress \"%s\": %s", vcf_p -> vf_filename_s, gzerror (vcf_p -> vf_gz_f, &error_code));
+		}
+
+	return false;
+}
+
+
+/*
+ * ReadVCFHeader () can only count the variants that have been
+ * decompressed so far. Unless that is all of them, scale the count up
+ * by how much of the compressed file has been read.
+ */
+static void EstimateGzippedVariants (VCFFile *vcf_p, const size_t compressed_size)
+{
+	if (!gzeof (vcf_p -> vf_gz_f))
+		{
+			const z_off_t compressed_read = gzoffset (vcf_p -> vf_gz_f);
+			const size_t header_size = (size_t) (vcf_p -> vf_variants_s - vcf_p -> vf_data_s);
+			const size_t variants_size = vcf_p -> vf_size - header_size;
+
+			if ((compressed_read > 0) && (variants_size > 0) && (vcf_p -> vf_num_variants > 0))
+				{
+					const double64 total_size = ((double64) compressed_size) * ((double64) (vcf_p -> vf_size)) / ((double64) compressed_read);
+					const double64 line_size = ((double64) variants_size) / ((double64) (vcf_p -> vf_num_variants));
+
+					if (total_size > (double64) (vcf_p -> vf_size))
+						{
+							vcf_p -> vf_num_variants = (size_t) ((total_size - (double64) header_size) / line_size);
+						}
+				}
+		}
+}
+
+
+static void FreeVCFData (const char *data_s, const size_t size, const bool mapped_flag)
+{
+	if (mapped_flag)
+		{
+			munmap ((void *) data_s, size);
+		}
+	else
+		{
+			FreeMemory ((void *) data_s);
+		}
+}
+
+
+/*
+ * Skip the meta-information lines and get the samples from the
+ * #CHROM line.
+ */
+static bool ReadVCFHeader (VCFFile *vcf_p, const char *parent_a_s, const char *parent_b_s)
+{
+	const char *line_s = vcf_p -> vf_data_s;
+	const char *end_s = line_s + vcf_p -> vf_size;
+	const size_t header_length = strlen (S_HEADER_S);
+
+	if (strncmp (line_s, S_FILE_FORMAT_S, strlen (S_FILE_FORMAT_S)) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" doesn't start with \"%s\"", vcf_p -> vf_filename_s, S_FILE_FORMAT_S);
+			return false;
+		}
+
+	while ((line_s < end_s) && (*line_s == '#'))
+		{
+			const char *line_end_s = (const char *) memchr (line_s, '\n', end_s - line_s);
+
+			if (!line_end_s)
+				{
+					line_end_s = end_s;
+				}
+
+			if (((size_t) (line_end_s - line_s) > header_length) && (strncmp (line_s, S_HEADER_S, header_length) == 0))
+				{
+					const char *position_s = line_s;
+					const char *column_end_s = ((line_end_s > line_s) && (* (line_end_s - 1) == '\r')) ? line_end_s - 1 : line_end_s;
+					uint32 num_columns = 0;
+					size_t length;
+
+					while (GetVCFField (&position_s, column_end_s, &length))
+						{
+							++ num_columns;
+						}
+
+					if (num_columns >= VC_FIRST_SAMPLE + 2)
+						{
+							vcf_p -> vf_num_samples = num_columns - VC_FIRST_SAMPLE;
+							vcf_p -> vf_samples_ss = (const char **) AllocFromJobArena (& (vcf_p -> vf_arena), vcf_p -> vf_num_samples * sizeof (const char *));
+
+							if (vcf_p -> vf_samples_ss)
+								{
+									uint32 i;
+
+									position_s = line_s;
+
+									for (i = 0; i < num_columns; ++ i)
+										{
+											const char *sample_s = GetVCFField (&position_s, column_end_s, &length);
+
+											if (i >= VC_FIRST_SAMPLE)
+												{
+													if ((vcf_p -> vf_samples_ss [i - VC_FIRST_SAMPLE] = CopyToArena (sample_s, length, & (vcf_p -> vf_arena))) == NULL)
+														{
+															return false;
+														}
+												}
+										}
+
+									if ((GetParentIndex (vcf_p, parent_a_s, 0, & (vcf_p -> vf_parent_a_index))) && (GetParentIndex (vcf_p, parent_b_s, 1, & (vcf_p -> vf_parent_b_index))))
+										{
+											if (vcf_p -> vf_parent_a_index != vcf_p -> vf_parent_b_index)
+												{
+													const char *c_p = line_end_s;
+
+													vcf_p -> vf_variants_s = (line_end_s < end_s) ? line_end_s + 1 : end_s;
+
+													/*
+													 * Count the lines for admission control
+													 */
+													c_p = vcf_p -> vf_variants_s;
+
+													while ((c_p < end_s) && ((c_p = (const char *) memchr (c_p, '\n', end_s - c_p)) != NULL))
+														{
+															++ (vcf_p -> vf_num_variants);
+															++ c_p;
+														}
+
+													if ((vcf_p -> vf_size > 0) && (vcf_p -> vf_data_s [vcf_p -> vf_size - 1] != '\n'))
+														{
+															++ (vcf_p -> vf_num_variants);
+														}
+
+													return true;
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Both parents are \"%s\"", vcf_p -> vf_samples_ss [vcf_p -> vf_parent_a_index]);
+												}
+										}
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" needs a FORMAT column and at least 2 samples", vcf_p -> vf_filename_s);
+						}
+
+					return false;
+				}		/* if (strncmp (line_s, S_HEADER_S, header_length) == 0) */
+
+			line_s = line_end_s + 1;
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has no \"#CHROM\" header line", vcf_p -> vf_filename_s);
+
+	return false;
+}
+
+
+static bool GetParentIndex (const VCFFile *vcf_p, const char *parent_s, const uint32 default_index, uint32 *index_p)
+{
+	if (IsStringEmpty (parent_s))
+		{
+			*index_p = default_index;
+			return true;
+		}
+	else
+		{
+			uint32 i;
+
+			for (i = 0; i < vcf_p -> vf_num_samples; ++ i)
+				{
+					if (strcmp (vcf_p -> vf_samples_ss [i], parent_s) == 0)
+						{
+							*index_p = i;
+							return true;
+						}
+				}
+
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has no sample called \"%s\"", vcf_p -> vf_filename_s, parent_s);
+		}
+
+	return false;
+}
+
+
+static json_t *LoadGeneticMap (const char *filename_s)
+{
+	FILE *map_f = fopen (filename_s, "r");
+
+	if (map_f)
+		{
+			json_t *map_p = json_object ();
+
+			if (map_p)
+				{
+					char *line_s = NULL;
+					size_t line_size = 0;
+					size_t line_number = 0;
+					bool success_flag = true;
+
+					while (success_flag && (getline (&line_s, &line_size, map_f) != -1))
+						{
+							++ line_number;
+							success_flag = AddGeneticMapLine (map_p, line_s, line_number);
+						}
+
+					/*
+					 * getline () allocates its buffer with malloc ()
+					 */
+					if (line_s)
+						{
+							free (line_s);
+						}
+
+					if (success_flag)
+						{
+							if (json_object_size (map_p) > 0)
+								{
+									fclose (map_f);
+									return map_p;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "The genetic map \"%s\" is empty", filename_s);
+								}
+						}
+
+					json_decref (map_p);
+				}		/* if (map_p) */
+
+			fclose (map_f);
+		}		/* if (map_f) */
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load genetic map \"%s\"", filename_s);
+
+	return NULL;
+}
+
+
+/*
+ * Each line is a marker, its chromosome and its mapping position separated
+ * by tabs or commas. The first line is skipped if its position isn't a
+ * number since it will be the column headings.
+ */
+static bool AddGeneticMapLine (json_t *map_p, char *line_s, const size_t line_number)
+{
+	char *fields_ss [3];
+	const char delimiter = (strchr (line_s, '\t') != NULL) ? '\t' : ',';
+	uint32 num_fields = 0;
+	char *field_s = line_s;
+
+	line_s [strcspn (line_s, "\r\n")] = '\0';
+
+	if (*line_s == '\0')
+		{
+			return true;
+		}
+
+	while (field_s)
+		{
+			char *next_s = strchr (field_s, delimiter);
+
+			if (next_s)
+				{
+					*next_s = '\0';
+					++ next_s;
+				}
+
+			if (num_fields < 3)
+				{
+					fields_ss [num_fields] = field_s;
+				}
+
+			++ num_fields;
+			field_s = next_s;
+		}
+
+	if (num_fields == 3)
+		{
+			char *end_s = NULL;
+
+			strtod (fields_ss [2], &end_s);
+
+			if ((end_s != fields_ss [2]) && (*end_s == '\0'))
+				{
+					json_t *entry_p = json_object ();
+
+					if (entry_p)
+						{
+							if ((SetJSONString (entry_p, PGS_CHROMOSOME_S, fields_ss [1])) && (SetJSONString (entry_p, PGS_MAPPING_POSITION_S, fields_ss [2])))
+								{
+									if (json_object_set_new (map_p, fields_ss [0], entry_p) == 0)
+										{
+											return true;
+										}
+								}
+							else
+								{
+									json_decref (entry_p);
+								}
+						}
+
+					return false;
+				}
+			else if (line_number == 1)
+				{
+					return true;
+				}
+		}
+
+	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Line " SIZET_FMT " of the genetic map should have a marker, chromosome and numeric mapping position", line_number);
+
+	return false;
+}
+
+
+/*
+ * The parent rows are kept in the same form as the rows of a submitted
+ * table since that is what SaveParentGenotypes () expects.
+ */
+static json_t *GetVCFParentRow (const char *parent_s)
+{
+	json_t *row_p = json_object ();
+
+	if (row_p)
+		{
+			if (SetJSONString (row_p, S_ID_S, parent_s))
+				{
+					return row_p;
+				}
+
+			json_decref (row_p);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Get the end of the line that a chunk starting at start_s
+ * finishes in.
+ */
+static const char *GetChunkEnd (const char *start_s, const char *end_s)
+{
+	if ((size_t) (end_s - start_s) > S_CHUNK_SIZE)
+		{
+			const char *chunk_end_s = start_s + S_CHUNK_SIZE;
+			const char *line_end_s = (const char *) memchr (chunk_end_s, '\n', end_s - chunk_end_s);
+
+			return line_end_s ? line_end_s + 1 : end_s;
+		}
+
+	return end_s;
+}
+
+
+/*
+ * The whole file is mapped so each batch can be parsed straight from it.
+ */
+static bool AddMappedVariants (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p)
+{
+	const char *position_s = vcf_p -> vf_variants_s;
+	const char *end_s = vcf_p -> vf_data_s + vcf_p -> vf_size;
+	const long page_size = sysconf (_SC_PAGESIZE);
+
+	while (position_s < end_s)
+		{
+			const char *batch_s = position_s;
+
+			if ((position_s = AddVariantsBatch (vcf_p, workers_p, num_threads, position_s, end_s, doc_p, num_markers_p, num_unmapped_p, arena_p)) == NULL)
+				{
+					return false;
+				}
+
+			/*
+			 * The batch's lines have all been copied so let the
+			 * kernel drop their pages.
+			 */
+			if (page_size > 0)
+				{
+					const char *start_s = vcf_p -> vf_data_s + (((batch_s - vcf_p -> vf_data_s) / page_size) * page_size);
+
+					madvise ((void *) start_s, position_s - start_s, MADV_DONTNEED);
+				}
+		}
+
+	return true;
+}
+
+
+/*
+ * The file is decompressed a batch at a time into the same buffer. Only
+ * the whole lines in the buffer are parsed and any partial line at the
+ * end of it is carried over to the start of the next batch, so no more
+ * than a batch of the file is held in memory at once.
+ */
+static bool AddGzippedVariants (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p)
+{
+	const size_t batch_size = num_threads * S_CHUNK_SIZE;
+	char *data_s = (char *) vcf_p -> vf_data_s;
+	bool success_flag = true;
+
+	/*
+	 * Move the variants that were read along with the header
+	 * to the start of the buffer
+	 */
+	vcf_p -> vf_size -= (size_t) (vcf_p -> vf_variants_s - data_s);
+	memmove (data_s, vcf_p -> vf_variants_s, vcf_p -> vf_size);
+	vcf_p -> vf_variants_s = data_s;
+
+	while (success_flag && ((vcf_p -> vf_size > 0) || (!gzeof (vcf_p -> vf_gz_f))))
+		{
+			if ((vcf_p -> vf_size < batch_size) && (!gzeof (vcf_p -> vf_gz_f)))
+				{
+					success_flag = ReadGzippedData (vcf_p, batch_size - vcf_p -> vf_size);
+				}
+
+			if (success_flag)
+				{
+					const char *start_s = vcf_p -> vf_data_s;
+					const char *end_s = start_s + vcf_p -> vf_size;
+					const char *batch_end_s = end_s;
+
+					if (!gzeof (vcf_p -> vf_gz_f))
+						{
+							while ((batch_end_s > start_s) && (* (batch_end_s - 1) != '\n'))
+								{
+									-- batch_end_s;
+								}
+						}
+
+					if (batch_end_s > start_s)
+						{
+							const char *position_s = start_s;
+
+							while (success_flag && (position_s < batch_end_s))
+								{
+									if ((position_s = AddVariantsBatch (vcf_p, workers_p, num_threads, position_s, batch_end_s, doc_p, num_markers_p, num_unmapped_p, arena_p)) == NULL)
+										{
+											success_flag = false;
+										}
+								}
+
+							if (success_flag)
+								{
+									vcf_p -> vf_size = (size_t) (end_s - batch_end_s);
+									memmove ((char *) start_s, batch_end_s, vcf_p -> vf_size);
+								}
+						}
+					else if (vcf_p -> vf_size > 0)
+						{
+							/*
+							 * The buffer doesn't have a whole line yet so read more of it
+							 */
+							success_flag = ReadGzippedData (vcf_p, S_CHUNK_SIZE);
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Parse up to a chunk of lines for each worker, starting at position_s,
+ * and then add the variants in file order. This returns where the next
+ * batch starts or NULL upon error.
+ */
+static const char *AddVariantsBatch (VCFFile *vcf_p, VCFWorker *workers_p, const uint32 num_threads, const char *position_s, const char *end_s, json_t *doc_p, size_t *num_markers_p, size_t *num_unmapped_p, JobArena *arena_p)
+{
+	bool success_flag = true;
+	uint32 num_workers = 0;
+	uint32 i;
+
+	while ((num_workers < num_threads) && (position_s < end_s))
+		{
+			VCFWorker *worker_p = workers_p + num_workers;
+
+			worker_p -> vw_start_s = position_s;
+			worker_p -> vw_end_s = position_s = GetChunkEnd (position_s, end_s);
+
+			++ num_workers;
+		}
+
+	RunVCFWorkers (workers_p, num_workers);
+
+	for (i = 0; i < num_workers; ++ i)
+		{
+			VCFWorker *worker_p = workers_p + i;
+
+			if (success_flag)
+				{
+					success_flag = (worker_p -> vw_success_flag) && (MergeVCFWorker (worker_p, vcf_p, doc_p, num_markers_p, arena_p));
+				}
+
+			*num_unmapped_p += worker_p -> vw_num_unmapped;
+			ClearVCFWorker (worker_p);
+		}
+
+	return success_flag ? position_s : NULL;
+}
+
+
+static void RunVCFWorkers (VCFWorker *workers_p, const uint32 num_workers)
+{
+	uint32 i;
+
+	if (num_workers == 1)
+		{
+			RunVCFWorker (workers_p);
+			return;
+		}
+
+	for (i = 0; i < num_workers; ++ i)
+		{
+			VCFWorker *worker_p = workers_p + i;
+
+			worker_p -> vw_started_flag = (pthread_create (& (worker_p -> vw_thread), NULL, RunVCFWorker, worker_p) == 0);
+
+			if (! (worker_p -> vw_started_flag))
+				{
+					/*
+					 * Do this worker's chunk on this thread instead
+					 */
+					RunVCFWorker (worker_p);
+				}
+		}
+
+	for (i = 0; i < num_workers; ++ i)
+		{
+			if (workers_p [i].vw_started_flag)
+				{
+					pthread_join (workers_p [i].vw_thread, NULL);
+					workers_p [i].vw_started_flag = false;
+				}
+		}
+}
+
+
+static void *RunVCFWorker (void *data_p)
+{
+	VCFWorker *worker_p = (VCFWorker *) data_p;
+	const char *line_s = worker_p -> vw_start_s;
+	const char *end_s = worker_p -> vw_end_s;
+	size_t num_lines = 1;
+	const char *c_p = line_s;
+
+	while ((c_p < end_s) && ((c_p = (const char *) memchr (c_p, '\n', end_s - c_p)) != NULL))
+		{
+			++ num_lines;
+			++ c_p;
+		}
+
+	worker_p -> vw_num_markers = 0;
+	worker_p -> vw_num_unmapped = 0;
+	worker_p -> vw_success_flag = false;
+
+	if ((worker_p -> vw_markers_p = (VCFMarker *) AllocMemoryArray (num_lines, sizeof (VCFMarker))) != NULL)
+		{
+			worker_p -> vw_success_flag = true;
+
+			while ((line_s < end_s) && (worker_p -> vw_success_flag))
+				{
+					const char *line_end_s = (const char *) memchr (line_s, '\n', end_s - line_s);
+					const char *next_line_s;
+
+					if (line_end_s)
+						{
+							next_line_s = line_end_s + 1;
+						}
+					else
+						{
+							line_end_s = end_s;
+							next_line_s = end_s;
+						}
+
+					if ((line_end_s > line_s) && (* (line_end_s - 1) == '\r'))
+						{
+							-- line_end_s;
+						}
+
+					if ((line_end_s > line_s) && (*line_s != '#'))
+						{
+							VCFMarker *marker_p = worker_p -> vw_markers_p + worker_p -> vw_num_markers;
+
+							if (ParseVariant (worker_p, line_s, line_end_s, marker_p))
+								{
+									if (marker_p -> vm_marker_p)
+										{
+											++ (worker_p -> vw_num_markers);
+										}
+									else
+										{
+											++ (worker_p -> vw_num_unmapped);
+										}
+								}
+							else
+								{
+									worker_p -> vw_success_flag = false;
+								}
+						}
+
+					line_s = next_line_s;
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Parse a line into marker_p. If the variant isn't on the genetic map,
+ * the marker is left empty.
+ */
+static bool ParseVariant (VCFWorker *worker_p, const char *line_s, const char *line_end_s, VCFMarker *marker_p)
+{
+	const VCFFile *vcf_p = worker_p -> vw_vcf_p;
+	const char *fields_ss [VC_FIRST_SAMPLE];
+	size_t lengths_p [VC_FIRST_SAMPLE];
+	const char *position_s = line_s;
+	uint32 i;
+
+	memset (marker_p, 0, sizeof (VCFMarker));
+
+	for (i = 0; i < VC_FIRST_SAMPLE; ++ i)
+		{
+			if ((fields_ss [i] = GetVCFField (&position_s, line_end_s, lengths_p + i)) == NULL)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Variant \"%.*s\" has too few columns", (int) (line_end_s - line_s), line_s);
+					return false;
+				}
+		}
+
+	/*
+	 * Use the ID if it has one and CHROM:POS otherwise
+	 */
+	if ((lengths_p [VC_ID] == 0) || ((lengths_p [VC_ID] == 1) && (*fields_ss [VC_ID] == '.')))
+		{
+			char *chromosome_s = CopyToArena (fields_ss [VC_CHROM], lengths_p [VC_CHROM], & (worker_p -> vw_arena));
+			char *pos_s = CopyToArena (fields_ss [VC_POS], lengths_p [VC_POS], & (worker_p -> vw_arena));
+
+			if (chromosome_s && pos_s)
+				{
+					marker_p -> vm_name_s = ConcatenateVarargsStringsInJobArena (& (worker_p -> vw_arena), chromosome_s, ":", pos_s, NULL);
+				}
+		}
+	else
+		{
+			marker_p -> vm_name_s = CopyToArena (fields_ss [VC_ID], lengths_p [VC_ID], & (worker_p -> vw_arena));
+		}
+
+	if (marker_p -> vm_name_s)
+		{
+			const json_t *map_entry_p = NULL;
+
+			if (vcf_p -> vf_map_p)
+				{
+					if ((map_entry_p = json_object_get (vcf_p -> vf_map_p, marker_p -> vm_name_s)) == NULL)
+						{
+							return true;
+						}
+				}
+
+			if ((marker_p -> vm_marker_p = json_object ()) != NULL)
+				{
+					bool success_flag = false;
+
+					if (map_entry_p)
+						{
+							success_flag = (SetJSONString (marker_p -> vm_marker_p, PGS_CHROMOSOME_S, GetJSONString (map_entry_p, PGS_CHROMOSOME_S))) &&
+								(SetJSONString (marker_p -> vm_marker_p, PGS_MAPPING_POSITION_S, GetJSONString (map_entry_p, PGS_MAPPING_POSITION_S)));
+						}
+					else
+						{
+							success_flag = (json_object_set_new (marker_p -> vm_marker_p, PGS_CHROMOSOME_S, json_stringn (fields_ss [VC_CHROM], lengths_p [VC_CHROM])) == 0) &&
+								(json_object_set_new (marker_p -> vm_marker_p, PGS_MAPPING_POSITION_S, json_stringn (fields_ss [VC_POS], lengths_p [VC_POS])) == 0);
+						}
+
+					if (success_flag)
+						{
+							uint32 gt_index;
+
+							success_flag = false;
+
+							if (GetGenotypeIndex (fields_ss [VC_FORMAT], lengths_p [VC_FORMAT], &gt_index))
+								{
+									const char *alleles_ss [S_MAX_ALLELES];
+									size_t allele_lengths_p [S_MAX_ALLELES];
+									const uint32 num_alleles = GetAlleles (fields_ss [VC_REF], lengths_p [VC_REF], fields_ss [VC_ALT], lengths_p [VC_ALT], alleles_ss, allele_lengths_p);
+
+									if (num_alleles > 0)
+										{
+											success_flag = true;
+
+											for (i = 0; (i < vcf_p -> vf_num_samples) && success_flag; ++ i)
+												{
+													size_t length;
+													const char *sample_s = GetVCFField (&position_s, line_end_s, &length);
+
+													if (sample_s)
+														{
+															json_t *call_p = GetCall (sample_s, length, gt_index, alleles_ss, allele_lengths_p, num_alleles, & (worker_p -> vw_arena));
+
+															if (call_p)
+																{
+																	if (i == vcf_p -> vf_parent_a_index)
+																		{
+																			marker_p -> vm_parent_a_call_p = call_p;
+																		}
+																	else if (i == vcf_p -> vf_parent_b_index)
+																		{
+																			marker_p -> vm_parent_b_call_p = call_p;
+																		}
+																	else
+																		{
+																			success_flag = (json_object_set_new (marker_p -> vm_marker_p, worker_p -> vw_accessions_ss [i], call_p) == 0);
+																		}
+																}
+															else
+																{
+																	success_flag = false;
+																}
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has " UINT32_FMT " samples but there are " UINT32_FMT " in the header", marker_p -> vm_name_s, i, vcf_p -> vf_num_samples);
+															success_flag = false;
+														}
+												}
+
+											if (success_flag && (position_s <= line_end_s))
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has more samples than the header", marker_p -> vm_name_s);
+													success_flag = false;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has more than %d alleles", marker_p -> vm_name_s, S_MAX_ALLELES);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "\"%s\" has no GT field", marker_p -> vm_name_s);
+								}
+						}
+
+					if (success_flag)
+						{
+							return true;
+						}
+
+					json_decref (marker_p -> vm_marker_p);
+					marker_p -> vm_marker_p = NULL;
+
+					if (marker_p -> vm_parent_a_call_p)
+						{
+							json_decref (marker_p -> vm_parent_a_call_p);
+							marker_p -> vm_parent_a_call_p = NULL;
+						}
+
+					if (marker_p -> vm_parent_b_call_p)
+						{
+							json_decref (marker_p -> vm_parent_b_call_p);
+							marker_p -> vm_parent_b_call_p = NULL;
+						}
+
+				}		/* if ((marker_p -> vm_marker_p = json_object ()) != NULL) */
+
+		}		/* if (marker_p -> vm_name_s) */
+
+	return false;
+}
+
+
+/*
+ * Get the next tab-separated field on a line, or NULL if there
+ * aren't any more.
+ */
+static const char *GetVCFField (const char **position_ss, const char *line_end_s, size_t *length_p)
+{
+	const char *field_s = *position_ss;
+
+	if (field_s <= line_end_s)
+		{
+			const char *tab_s = (const char *) memchr (field_s, '\t', line_end_s - field_s);
+
+			if (!tab_s)
+				{
+					tab_s = line_end_s;
+				}
+
+			*length_p = tab_s - field_s;
+			*position_ss = tab_s + 1;
+
+			return field_s;
+		}
+
+	return NULL;
+}
+
+
+static bool GetGenotypeIndex (const char *format_s, const size_t format_length, uint32 *index_p)
+{
+	const char *end_s = format_s + format_length;
+	uint32 index = 0;
+
+	while (format_s < end_s)
+		{
+			const char *colon_s = (const char *) memchr (format_s, ':', end_s - format_s);
+
+			if (!colon_s)
+				{
+					colon_s = end_s;
+				}
+
+			if (((colon_s - format_s) == 2) && (format_s [0] == 'G') && (format_s [1] == 'T'))
+				{
+					*index_p = index;
+					return true;
+				}
+
+			format_s = colon_s + 1;
+			++ index;
+		}
+
+	return false;
+}
+
+
+/*
+ * Get REF followed by each of the ALT alleles. Returns 0 if there are
+ * too many of them.
+ */
+static uint32 GetAlleles (const char *ref_s, const size_t ref_length, const char *alt_s, const size_t alt_length, const char **alleles_ss, size_t *allele_lengths_p)
+{
+	const char *end_s = alt_s + alt_length;
+	uint32 num_alleles = 1;
+
+	*alleles_ss = ref_s;
+	*allele_lengths_p = ref_length;
+
+	/*
+	 * An ALT of "." means that there aren't any
+	 */
+	if ((alt_length == 1) && (*alt_s == '.'))
+		{
+			return num_alleles;
+		}
+
+	while (alt_s < end_s)
+		{
+			const char *comma_s = (const char *) memchr (alt_s, ',', end_s - alt_s);
+
+			if (!comma_s)
+				{
+					comma_s = end_s;
+				}
+
+			if (num_alleles == S_MAX_ALLELES)
+				{
+					return 0;
+				}
+
+			alleles_ss [num_alleles] = alt_s;
+			allele_lengths_p [num_alleles] = comma_s - alt_s;
+			++ num_alleles;
+
+			alt_s = comma_s + 1;
+		}
+
+	return num_alleles;
+}
+
+
+/*
+ * Convert a sample's GT into its alleles. The alleles are sorted so
+ * that calls are the same whether or not they are phased.
+ */
+static json_t *GetCall (const char *sample_s, const size_t sample_length, const uint32 gt_index, const char **alleles_ss, const size_t *allele_lengths_p, const uint32 num_alleles, JobArena *arena_p)
+{
+	const char *end_s = sample_s + sample_length;
+	const char *gt_s = sample_s;
+	uint32 indexes_p [S_MAX_PLOIDY];
+	uint32 ploidy = 0;
+	uint32 i;
+
+	/*
+	 * Find the GT subfield
+	 */
+	for (i = 0; (i < gt_index) && gt_s; ++ i)
+		{
+			gt_s = (const char *) memchr (gt_s, ':', end_s - gt_s);
+
+			if (gt_s)
+				{
+					++ gt_s;
+				}
+		}
+
+	if (gt_s)
+		{
+			const char *gt_end_s = (const char *) memchr (gt_s, ':', end_s - gt_s);
+
+			if (!gt_end_s)
+				{
+					gt_end_s = end_s;
+				}
+
+			while (gt_s < gt_end_s)
+				{
+					uint32 index = 0;
+					const char *digit_s = gt_s;
+
+					while ((gt_s < gt_end_s) && (*gt_s >= '0') && (*gt_s <= '9'))
+						{
+							index = (index * 10) + (*gt_s - '0');
+							++ gt_s;
+						}
+
+					/*
+					 * Any missing or unknown alleles make the whole call missing
+					 */
+					if ((gt_s == digit_s) || (index >= num_alleles) || (ploidy == S_MAX_PLOIDY))
+						{
+							return json_string (S_MISSING_CALL_S);
+						}
+
+					indexes_p [ploidy] = index;
+					++ ploidy;
+
+					if (gt_s < gt_end_s)
+						{
+							if ((*gt_s == '/') || (*gt_s == '|'))
+								{
+									++ gt_s;
+								}
+							else
+								{
+									return json_string (S_MISSING_CALL_S);
+								}
+						}
+				}
+		}
+
+	if (ploidy > 0)
+		{
+			char buffer_s [S_CALL_BUFFER_SIZE];
+			char *call_s = buffer_s;
+			size_t length = ploidy - 1;
+
+			for (i = 1; i < ploidy; ++ i)
+				{
+					const uint32 index = indexes_p [i];
+					uint32 j = i;
+
+					while ((j > 0) && (indexes_p [j - 1] > index))
+						{
+							indexes_p [j] = indexes_p [j - 1];
+							-- j;
+						}
+
+					indexes_p [j] = index;
+				}
+
+			for (i = 0; i < ploidy; ++ i)
+				{
+					length += allele_lengths_p [indexes_p [i]];
+				}
+
+			if (length > S_CALL_BUFFER_SIZE)
+				{
+					call_s = (char *) AllocFromJobArena (arena_p, length);
+				}
+
+			if (call_s)
+				{
+					char *c_p = call_s;
+
+					for (i = 0; i < ploidy; ++ i)
+						{
+							if (i > 0)
+								{
+									*c_p = '/';
+									++ c_p;
+								}
+
+							memcpy (c_p, alleles_ss [indexes_p [i]], allele_lengths_p [indexes_p [i]]);
+							c_p += allele_lengths_p [indexes_p [i]];
+						}
+
+					return json_stringn (call_s, length);
+				}
+
+			return NULL;
+		}
+
+	return json_string (S_MISSING_CALL_S);
+}
+
+
+static bool MergeVCFWorker (VCFWorker *worker_p, VCFFile *vcf_p, json_t *doc_p, size_t *num_markers_p, JobArena *arena_p)
+{
+	size_t i;
+
+	for (i = 0; i < worker_p -> vw_num_markers; ++ i)
+		{
+			VCFMarker *marker_p = worker_p -> vw_markers_p + i;
+
+			/*
+			 * The marker name may contain full stops and although MongoDB 3.6+
+			 * allows these, the current version of the mongo-c driver (1.13)
+			 * does not, so we need to do the escaping ourselves
+			 */
+			const char *escaped_marker_s = SearchAndReplaceInStringInJobArena (arena_p, marker_p -> vm_name_s, ".", PGS_ESCAPED_DOT_S);
+
+			if (!escaped_marker_s)
+				{
+					return false;
+				}
+
+			if (json_object_get (doc_p, escaped_marker_s))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Marker \"%s\" is in \"%s\" more than once", marker_p -> vm_name_s, vcf_p -> vf_filename_s);
+					return false;
+				}
+
+			else
+				{
+					const int marker_res = json_object_set_new (doc_p, escaped_marker_s, marker_p -> vm_marker_p);
+					const int parent_a_res = json_object_set_new (vcf_p -> vf_parent_a_row_p, marker_p -> vm_name_s, marker_p -> vm_parent_a_call_p);
+					const int parent_b_res = json_object_set_new (vcf_p -> vf_parent_b_row_p, marker_p -> vm_name_s, marker_p -> vm_parent_b_call_p);
+
+					/*
+					 * json_object_set_new () takes the values even if it fails
+					 */
+					marker_p -> vm_marker_p = NULL;
+					marker_p -> vm_parent_a_call_p = NULL;
+					marker_p -> vm_parent_b_call_p = NULL;
+
+					if ((marker_res != 0) || (parent_a_res != 0) || (parent_b_res != 0))
+						{
+							return false;
+						}
+				}
+
+			++ (*num_markers_p);
+
+			ResetJobArena (arena_p);
+		}
+
+	return true;
+}
+
+
+/*
+ * Free any variants that weren't added and get the worker
+ * ready for its next chunk.
+ */
+static void ClearVCFWorker (VCFWorker *worker_p)
+{
+	if (worker_p -> vw_markers_p)
+		{
+			size_t i;
+
+			for (i = 0; i < worker_p -> vw_num_markers; ++ i)
+				{
+					VCFMarker *marker_p = worker_p -> vw_markers_p + i;
+
+					if (marker_p -> vm_marker_p)
+						{
+							json_decref (marker_p -> vm_marker_p);
+						}
+
+					if (marker_p -> vm_parent_a_call_p)
+						{
+							json_decref (marker_p -> vm_parent_a_call_p);
+						}
+
+					if (marker_p -> vm_parent_b_call_p)
+						{
+							json_decref (marker_p -> vm_parent_b_call_p);
+						}
+				}
+
+			FreeMemory (worker_p -> vw_markers_p);
+			worker_p -> vw_markers_p = NULL;
+		}
+
+	worker_p -> vw_num_markers = 0;
+	worker_p -> vw_num_unmapped = 0;
+	ResetJobArena (& (worker_p -> vw_arena));
+}
+
+
+static char *CopyToArena (const char *value_s, const size_t length, JobArena *arena_p)
+{
+	char *copy_s = (char *) AllocFromJobArena (arena_p, length + 1);
+
+	if (copy_s)
+		{
+			memcpy (copy_s, value_s, length);
+			copy_s [length] = '\0';
+		}
+
+	return copy_s;
+}
@@ -0,0 +1,268 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * admission_control_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include <unistd.h>
+
+#include "admission_control.c"
+#include "unit_test.h"
+
+
+#define NUM_WAITERS (3)
+
+
+typedef struct AdmissionOrder
+{
+	uint32 ao_order [NUM_WAITERS];
+
+	uint32 ao_num_admitted;
+
+	pthread_mutex_t ao_lock;
+} AdmissionOrder;
+
+
+typedef struct Waiter
+{
+	uint32 w_id;
+
+	bool w_admitted_flag;
+
+	AdmissionOrder *w_order_p;
+} Waiter;
+
+
+static void ConfigureQueue (const char *class_s, const json_int_t max_running, const json_int_t max_queued, const json_int_t max_wait_ms);
+
+static uint32 GetNumQueued (const AdmissionClass ac);
+
+static void WaitForNumQueued (const AdmissionClass ac, const uint32 num_queued);
+
+static void *RunWaiter (void *data_p);
+
+static void TestClasses (void);
+
+static void TestFullQueue (void);
+
+static void TestTimeouts (void);
+
+static void TestOrdering (void);
+
+
+
+int main (void)
+{
+	TestClasses ();
+	TestFullQueue ();
+	TestTimeouts ();
+	TestOrdering ();
+
+	return FinishUnitTests ("admission_control_test");
+}
+
+
+static void TestClasses (void)
+{
+	json_t *config_p = json_pack ("{s:i}", "bulk_threshold_cells", 1000);
+
+	CHECK (GetSearchAdmissionClass ("m1", NULL, false) == AC_LIGHT);
+	CHECK (GetSearchAdmissionClass (NULL, NULL, false) == AC_HEAVY);
+	CHECK (GetSearchAdmissionClass ("m1", "A x B", false) == AC_HEAVY);
+	CHECK (GetSearchAdmissionClass ("m1", NULL, true) == AC_HEAVY);
+
+	CHECK (config_p != NULL);
+	ConfigureAdmissionControl (config_p);
+	json_decref (config_p);
+
+	CHECK (GetSubmissionAdmissionClassByCells (1000) == AC_HEAVY);
+	CHECK (GetSubmissionAdmissionClassByCells (1001) == AC_BULK);
+
+	CHECK_STRING (GetAdmissionClassAsString (AC_BULK), "bulk");
+}
+
+
+/*
+ * With no room to queue, a request is turned away straight
+ * away rather than waiting for its deadline.
+ */
+static void TestFullQueue (void)
+{
+	uint64 start;
+
+	ConfigureQueue ("heavy", 1, 0, 60000);
+
+	CHECK (EnterAdmissionControl (AC_HEAVY, 0));
+
+	start = GetMonotonicTimeInNanoseconds ();
+	CHECK (!EnterAdmissionControl (AC_HEAVY, 0));
+	CHECK (GetMonotonicTimeInNanoseconds () - start < 1000000000ULL);
+
+	LeaveAdmissionControl (AC_HEAVY);
+
+	CHECK (EnterAdmissionControl (AC_HEAVY, 0));
+	LeaveAdmissionControl (AC_HEAVY);
+}
+
+
+/*
+ * A queued request gives up at whichever is sooner of the class's
+ * maximum wait and its own end time, and leaves the queue when it does.
+ */
+static void TestTimeouts (void)
+{
+	uint64 start;
+	uint64 elapsed;
+
+	ConfigureQueue ("heavy", 1, 4, 100);
+
+	CHECK (EnterAdmissionControl (AC_HEAVY, 0));
+
+	start = GetMonotonicTimeInNanoseconds ();
+	CHECK (!EnterAdmissionControl (AC_HEAVY, 0));
+	elapsed = GetMonotonicTimeInNanoseconds () - start;
+
+	CHECK (elapsed >= 90000000ULL);
+	CHECK (elapsed < 5000000000ULL);
+	CHECK (GetNumQueued (AC_HEAVY) == 0);
+
+	ConfigureQueue ("heavy", 1, 4, 60000);
+
+	start = GetMonotonicTimeInNanoseconds ();
+	CHECK (!EnterAdmissionControl (AC_HEAVY, start + 50000000ULL));
+	elapsed = GetMonotonicTimeInNanoseconds () - start;
+
+	CHECK (elapsed >= 40000000ULL);
+	CHECK (elapsed < 5000000000ULL);
+	CHECK (GetNumQueued (AC_HEAVY) == 0);
+
+	LeaveAdmissionControl (AC_HEAVY);
+}
+
+
+/*
+ * Requests that are queued behind a full class are let in
+ * in the order that they arrived.
+ */
+static void TestOrdering (void)
+{
+	AdmissionOrder order;
+	Waiter waiters [NUM_WAITERS];
+	pthread_t threads [NUM_WAITERS];
+	uint32 i;
+
+	memset (&order, 0, sizeof (AdmissionOrder));
+	pthread_mutex_init (& (order.ao_lock), NULL);
+
+	ConfigureQueue ("light", 1, NUM_WAITERS, 0);
+
+	CHECK (EnterAdmissionControl (AC_LIGHT, 0));
+
+	for (i = 0; i < NUM_WAITERS; ++ i)
+		{
+			waiters [i].w_id = i;
+			waiters [i].w_admitted_flag = false;
+			waiters [i].w_order_p = &order;
+
+			CHECK (pthread_create (threads + i, NULL, RunWaiter, waiters + i) == 0);
+
+			/*
+			 * Make sure that each one is queued before starting the next
+			 */
+			WaitForNumQueued (AC_LIGHT, i + 1);
+		}
+
+	LeaveAdmissionControl (AC_LIGHT);
+
+	for (i = 0; i < NUM_WAITERS; ++ i)
+		{
+			pthread_join (threads [i], NULL);
+			CHECK (waiters [i].w_admitted_flag);
+		}
+
+	CHECK (order.ao_num_admitted == NUM_WAITERS);
+
+	for (i = 0; i < order.ao_num_admitted; ++ i)
+		{
+			CHECK (order.ao_order [i] == i);
+		}
+
+	pthread_mutex_destroy (& (order.ao_lock));
+}
+
+
+static void *RunWaiter (void *data_p)
+{
+	Waiter *waiter_p = (Waiter *) data_p;
+
+	if (EnterAdmissionControl (AC_LIGHT, 0))
+		{
+			AdmissionOrder *order_p = waiter_p -> w_order_p;
+
+			waiter_p -> w_admitted_flag = true;
+
+			pthread_mutex_lock (& (order_p -> ao_lock));
+			order_p -> ao_order [order_p -> ao_num_admitted ++] = waiter_p -> w_id;
+			pthread_mutex_unlock (& (order_p -> ao_lock));
+
+			/*
+			 * Hold the slot for a while so that the others stay queued
+			 */
+			usleep (10000);
+
+			LeaveAdmissionControl (AC_LIGHT);
+		}
+
+	return NULL;
+}
+
+
+static void ConfigureQueue (const char *class_s, const json_int_t max_running, const json_int_t max_queued, const json_int_t max_wait_ms)
+{
+	json_t *config_p = json_pack ("{s:{s:I,s:I,s:I}}", class_s, "max_running", max_running, "max_queued", max_queued, "max_wait_ms", max_wait_ms);
+
+	CHECK (config_p != NULL);
+
+	ConfigureAdmissionControl (config_p);
+	json_decref (config_p);
+}
+
+
+static uint32 GetNumQueued (const AdmissionClass ac)
+{
+	uint32 num_queued;
+
+	pthread_mutex_lock (&s_admission_lock);
+	num_queued = s_queues [ac].aq_num_queued;
+	pthread_mutex_unlock (&s_admission_lock);
+
+	return num_queued;
+}
+
+
+static void WaitForNumQueued (const AdmissionClass ac, const uint32 num_queued)
+{
+	uint32 i;
+
+	for (i = 0; (i < 5000) && (GetNumQueued (ac) < num_queued); ++ i)
+		{
+			usleep (1000);
+		}
+
+	CHECK (GetNumQueued (ac) == num_queued);
+}
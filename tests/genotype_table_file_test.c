@@ -0,0 +1,461 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * genotype_table_file_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "genotype_table_file.c"
+#include "unit_test.h"
+
+
+#define NUM_WIDE_MARKERS (100)
+
+
+static void TestTabSeparated (const char *directory_s);
+
+static void TestCommaSeparated (const char *directory_s);
+
+static void TestWideTable (const char *directory_s);
+
+static void TestInvalidTables (const char *directory_s);
+
+static json_t *LoadTable (const char *directory_s, const char *contents_s, const json_t *name_mappings_p, GenotypeTableFile **file_pp, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp);
+
+static char *WriteTable (const char *directory_s, const char *contents_s);
+
+static void CheckMarker (const json_t *doc_p, const char *escaped_marker_s, const char *chromosome_s, const char *position_s, const char *accession_s, const char *call_s);
+
+
+
+int main (void)
+{
+	char directory_s [] = "/tmp/pgs_genotype_table_test_XXXXXX";
+
+	if (mkdtemp (directory_s))
+		{
+			TestTabSeparated (directory_s);
+			TestCommaSeparated (directory_s);
+			TestWideTable (directory_s);
+			TestInvalidTables (directory_s);
+
+			rmdir (directory_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	return FinishUnitTests ("genotype_table_file_test");
+}
+
+
+/*
+ * A tab-separated table with Windows line endings, a blank line, marker
+ * names with full stops, commas in its values and no final line ending.
+ */
+static void TestTabSeparated (const char *directory_s)
+{
+	const char *table_s =
+		"id\tm1\tm.2\tm3\r\n"
+		"chromosome\t1\t1\t2\r\n"
+		"mapping_position\t0.5\t12\t3,5\r\n"
+		"\r\n"
+		"Parent A\tAA\tCC\tGG\r\n"
+		"Parent B\tTT\tGG\tCC\r\n"
+		"P_1\tAA\tGG\t\r\n"
+		"P_2\tAT\t-\tCC";
+	json_t *mappings_p = json_pack ("{s:s}", "P_", "Progeny-");
+	GenotypeTableFile *file_p = NULL;
+	const json_t *parent_a_p = NULL;
+	const json_t *parent_b_p = NULL;
+	json_t *doc_p = LoadTable (directory_s, table_s, mappings_p, &file_p, &parent_a_p, &parent_b_p);
+
+	CHECK (doc_p != NULL);
+
+	if (doc_p)
+		{
+			CHECK (json_object_size (doc_p) == 3);
+
+			CheckMarker (doc_p, "m1", "1", "0.5", "Progeny-1", "AA");
+			CheckMarker (doc_p, "m1", "1", "0.5", "Progeny-2", "AT");
+			CheckMarker (doc_p, "m[dot]2", "1", "12", "Progeny-1", "GG");
+			CheckMarker (doc_p, "m[dot]2", "1", "12", "Progeny-2", "-");
+			CheckMarker (doc_p, "m3", "2", "3,5", "Progeny-1", "");
+			CheckMarker (doc_p, "m3", "2", "3,5", "Progeny-2", "CC");
+
+			/*
+			 * The parent rows keep the names as they were submitted
+			 */
+			CHECK_STRING (GetJSONString (parent_a_p, S_ID_S), "Parent A");
+			CHECK_STRING (GetJSONString (parent_a_p, "m.2"), "CC");
+			CHECK_STRING (GetJSONString (parent_b_p, S_ID_S), "Parent B");
+			CHECK_STRING (GetJSONString (parent_b_p, "m3"), "CC");
+
+			json_decref (doc_p);
+		}
+
+	if (file_p)
+		{
+			CHECK (file_p -> gtf_delimiter == '\t');
+			CHECK (GetGenotypeTableFileNumRows (file_p) == 6);
+			CHECK (GetGenotypeTableFileNumCells (file_p) == 28);
+
+			CloseGenotypeTableFile (file_p);
+		}
+
+	json_decref (mappings_p);
+}
+
+
+/*
+ * A comma-separated table with quoted values, some of which have the
+ * delimiter, line endings or doubled quotes in them.
+ */
+static void TestCommaSeparated (const char *directory_s)
+{
+	const char *table_s =
+		"id,\"m,1\",m2,\"m \"\"3\"\"\"\n"
+		"chromosome,1,\"1\",2\n"
+		"mapping_position,1.5,2.5,\"3.5\"\n"
+		"Parent A,A,C,G\n"
+		"Parent B,T,G,C\n"
+		"\"Line, 1\",A,\"G\nC\",\"\"\"G\"\"\"\n"
+		"Line 2,T,a\"b,\"\"\n"
+		"\n";
+	GenotypeTableFile *file_p = NULL;
+	const json_t *parent_a_p = NULL;
+	const json_t *parent_b_p = NULL;
+	json_t *doc_p = LoadTable (directory_s, table_s, NULL, &file_p, &parent_a_p, &parent_b_p);
+
+	CHECK (doc_p != NULL);
+
+	if (doc_p)
+		{
+			CHECK (json_object_size (doc_p) == 3);
+
+			CheckMarker (doc_p, "m,1", "1", "1.5", "Line, 1", "A");
+			CheckMarker (doc_p, "m2", "1", "2.5", "Line, 1", "G\nC");
+			CheckMarker (doc_p, "m \"3\"", "2", "3.5", "Line, 1", "\"G\"");
+			CheckMarker (doc_p, "m,1", "1", "1.5", "Line 2", "T");
+
+			/*
+			 * A quote that isn't at the start of a field is just part of the value
+			 */
+			CheckMarker (doc_p, "m2", "1", "2.5", "Line 2", "a\"b");
+			CheckMarker (doc_p, "m \"3\"", "2", "3.5", "Line 2", "");
+
+			CHECK_STRING (GetJSONString (parent_a_p, "m \"3\""), "G");
+			CHECK_STRING (GetJSONString (parent_b_p, "m,1"), "T");
+
+			json_decref (doc_p);
+		}
+
+	if (file_p)
+		{
+			CHECK (file_p -> gtf_delimiter == ',');
+			CHECK (GetGenotypeTableFileNumRows (file_p) == 6);
+
+			CloseGenotypeTableFile (file_p);
+		}
+}
+
+
+/*
+ * Enough columns for the fields and quoted values to cross the
+ * scanner's block boundaries at different offsets.
+ */
+static void TestWideTable (const char *directory_s)
+{
+	const char * const rows_ss [] = { "id", "chromosome", "mapping_position", "Parent A", "Parent B", "p1", "p2", "p3", NULL };
+	const char * const *row_ss = rows_ss;
+	ByteBuffer *buffer_p = AllocateByteBuffer (4096);
+	uint32 i;
+
+	CHECK (buffer_p != NULL);
+
+	if (buffer_p)
+		{
+			bool success_flag = true;
+
+			while (*row_ss && success_flag)
+				{
+					const size_t row = row_ss - rows_ss;
+
+					success_flag = AppendStringToByteBuffer (buffer_p, *row_ss);
+
+					for (i = 0; (i < NUM_WIDE_MARKERS) && success_flag; ++ i)
+						{
+							char value_s [64];
+
+							switch (row)
+								{
+									case TR_MARKERS:
+										sprintf (value_s, "\tmarker." UINT32_FMT, i);
+										break;
+
+									case TR_CHROMOSOMES:
+										sprintf (value_s, "\t" UINT32_FMT, i % 7);
+										break;
+
+									case TR_MAPPING_POSITIONS:
+										sprintf (value_s, "\t%.2f", i * 0.37);
+										break;
+
+									default:
+										/*
+										 * Mix in some quoted values of varying lengths
+										 */
+										if ((i + row) % 3 == 0)
+											{
+												sprintf (value_s, "\t\"%.*s\"", (int) ((i + row) % 11) + 1, "ACGTACGTACGT");
+											}
+										else
+											{
+												sprintf (value_s, "\t%.*s", (int) ((i + row) % 5) + 1, "ACGTA");
+											}
+										break;
+								}
+
+							success_flag = AppendStringToByteBuffer (buffer_p, value_s);
+						}
+
+					if (success_flag)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+						}
+
+					++ row_ss;
+				}
+
+			CHECK (success_flag);
+
+			if (success_flag)
+				{
+					GenotypeTableFile *file_p = NULL;
+					const json_t *parent_a_p = NULL;
+					const json_t *parent_b_p = NULL;
+					json_t *doc_p = LoadTable (directory_s, GetByteBufferData (buffer_p), NULL, &file_p, &parent_a_p, &parent_b_p);
+
+					CHECK (doc_p != NULL);
+
+					if (doc_p)
+						{
+							CHECK (json_object_size (doc_p) == NUM_WIDE_MARKERS);
+
+							for (i = 0; i < NUM_WIDE_MARKERS; ++ i)
+								{
+									const size_t row = 6;
+									char marker_s [64];
+									char chromosome_s [16];
+									char position_s [32];
+									char call_s [16];
+
+									sprintf (marker_s, "marker[dot]" UINT32_FMT, i);
+									sprintf (chromosome_s, UINT32_FMT, i % 7);
+									sprintf (position_s, "%.2f", i * 0.37);
+
+									if ((i + row) % 3 == 0)
+										{
+											sprintf (call_s, "%.*s", (int) ((i + row) % 11) + 1, "ACGTACGTACGT");
+										}
+									else
+										{
+											sprintf (call_s, "%.*s", (int) ((i + row) % 5) + 1, "ACGTA");
+										}
+
+									CheckMarker (doc_p, marker_s, chromosome_s, position_s, "p2", call_s);
+								}
+
+							json_decref (doc_p);
+						}
+
+					if (file_p)
+						{
+							CHECK (GetGenotypeTableFileNumCells (file_p) == 8 * (NUM_WIDE_MARKERS + 1));
+							CloseGenotypeTableFile (file_p);
+						}
+				}
+
+			FreeByteBuffer (buffer_p);
+		}
+}
+
+
+static void TestInvalidTables (const char *directory_s)
+{
+	const char * const invalid_tables_ss [] =
+		{
+			/* empty */
+			"",
+
+			/* ragged row */
+			"id\tm1\tm2\nchromosome\t1\t1\nmapping_position\t1\t2\nParent A\tA\tC\nParent B\tT\nP1\tA\tC\n",
+
+			/* unclosed quote */
+			"id,m1,m2\nchromosome,1,1\nmapping_position,1,2\nParent A,A,\"C\nParent B,T,G\n",
+
+			/* no parent rows */
+			"id\tm1\tm2\nchromosome\t1\t1\nmapping_position\t1\t2\n",
+
+			/* no markers */
+			"id\nchromosome\nmapping_position\nParent A\nParent B\nP1\n",
+
+			NULL
+		};
+	const char * const *table_ss = invalid_tables_ss;
+
+	while (*table_ss)
+		{
+			char *filename_s = WriteTable (directory_s, *table_ss);
+
+			if (filename_s)
+				{
+					GenotypeTableFile *file_p = OpenGenotypeTableFile (filename_s);
+
+					CHECK (file_p == NULL);
+
+					if (file_p)
+						{
+							printf ("opened invalid table \"%s\"\n", *table_ss);
+							CloseGenotypeTableFile (file_p);
+						}
+
+					unlink (filename_s);
+					FreeCopiedString (filename_s);
+				}
+			else
+				{
+					CHECK (false);
+				}
+
+			++ table_ss;
+		}
+
+	/*
+	 * A marker can only be in one column, even if it only differs by being escaped
+	 */
+	{
+		GenotypeTableFile *file_p = NULL;
+		const json_t *parent_a_p = NULL;
+		const json_t *parent_b_p = NULL;
+		json_t *doc_p = LoadTable (directory_s, "id\tm.1\tm[dot]1\nchromosome\t1\t1\nmapping_position\t1\t2\nParent A\tA\tC\nParent B\tT\tG\n", NULL, &file_p, &parent_a_p, &parent_b_p);
+
+		CHECK (file_p != NULL);
+		CHECK (doc_p == NULL);
+
+		if (file_p)
+			{
+				CloseGenotypeTableFile (file_p);
+			}
+	}
+}
+
+
+/*
+ * Write a table to a file, open it and add it to a new population document.
+ * The file is deleted straight away since it stays mapped until it is closed.
+ */
+static json_t *LoadTable (const char *directory_s, const char *contents_s, const json_t *name_mappings_p, GenotypeTableFile **file_pp, const json_t **parent_a_row_pp, const json_t **parent_b_row_pp)
+{
+	json_t *doc_p = NULL;
+	char *filename_s = WriteTable (directory_s, contents_s);
+
+	if (filename_s)
+		{
+			GenotypeTableFile *file_p = OpenGenotypeTableFile (filename_s);
+
+			CHECK (file_p != NULL);
+
+			if (file_p)
+				{
+					ParentalGenotypeServiceData data;
+					JobArena arena;
+
+					memset (&data, 0, sizeof (ParentalGenotypeServiceData));
+					data.pgsd_name_mappings_p = (json_t *) name_mappings_p;
+
+					InitJobArena (&arena);
+
+					if ((doc_p = json_object ()) != NULL)
+						{
+							if (!AddGenotypeTableFileToPopulation (file_p, doc_p, parent_a_row_pp, parent_b_row_pp, &data, &arena))
+								{
+									json_decref (doc_p);
+									doc_p = NULL;
+								}
+						}
+
+					ClearJobArena (&arena);
+
+					*file_pp = file_p;
+				}
+
+			unlink (filename_s);
+			FreeCopiedString (filename_s);
+		}
+
+	return doc_p;
+}
+
+
+static char *WriteTable (const char *directory_s, const char *contents_s)
+{
+	char *filename_s = ConcatenateVarargsStrings (directory_s, "/table_XXXXXX", NULL);
+
+	if (filename_s)
+		{
+			int fd = mkstemp (filename_s);
+
+			if (fd != -1)
+				{
+					const size_t length = strlen (contents_s);
+					const bool written_flag = (write (fd, contents_s, length) == (ssize_t) length);
+
+					close (fd);
+
+					if (written_flag)
+						{
+							return filename_s;
+						}
+
+					unlink (filename_s);
+				}
+
+			FreeCopiedString (filename_s);
+		}
+
+	return NULL;
+}
+
+
+static void CheckMarker (const json_t *doc_p, const char *escaped_marker_s, const char *chromosome_s, const char *position_s, const char *accession_s, const char *call_s)
+{
+	const json_t *marker_p = json_object_get (doc_p, escaped_marker_s);
+
+	if (marker_p)
+		{
+			CHECK_STRING (GetJSONString (marker_p, PGS_CHROMOSOME_S), chromosome_s);
+			CHECK_STRING (GetJSONString (marker_p, PGS_MAPPING_POSITION_S), position_s);
+			CHECK_STRING (GetJSONString (marker_p, accession_s), call_s);
+		}
+	else
+		{
+			printf ("No marker \"%s\"\n", escaped_marker_s);
+			CHECK (false);
+		}
+}
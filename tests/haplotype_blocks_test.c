@@ -0,0 +1,404 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * haplotype_blocks_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "haplotype_blocks.c"
+#include "unit_test.h"
+
+
+#define NUM_PROGENY (8)
+
+#define NUM_MAPPED_MARKERS (30)
+
+#define NUM_UNMAPPED_MARKERS (5)
+
+
+static const char * const S_POPULATION_S = "Test x Cross";
+
+
+static void TestVarints (void);
+
+static void TestRoundTrip (const bson_t *doc_p, const json_t *population_p);
+
+static void TestSingleMarker (const bson_t *doc_p, const json_t *population_p);
+
+static void TestInterval (const bson_t *doc_p, const json_t *population_p);
+
+static bool AddMarker (json_t *population_p, json_t *parents_p, const char *marker_s, const char *chromosome_s, const char *position_s, const char *parent_a_s, const char *parent_b_s);
+
+static void CheckDecodedMarker (const json_t *decoded_marker_p, const json_t *marker_p, const char *escaped_marker_s);
+
+static uint32 GetRandomNumber (void);
+
+
+
+int main (void)
+{
+	json_t *population_p = json_pack ("{s:s}", PGS_POPULATION_NAME_S, S_POPULATION_S);
+	json_t *parents_p = json_object ();
+	bool success_flag = (population_p != NULL) && (parents_p != NULL);
+	uint32 i;
+	uint32 j;
+	char marker_s [64];
+	char position_s [32];
+
+	TestVarints ();
+
+	/*
+	 * Two chromosomes with dots in their marker names, which are escaped in the
+	 * population but not in the blocks, a marker without a mapping position and
+	 * some markers that aren't on the map at all
+	 */
+	for (i = 1; (i <= 2) && success_flag; ++ i)
+		{
+			char chromosome_s [8];
+
+			sprintf (chromosome_s, UINT32_FMT, i);
+
+			for (j = 0; (j < NUM_MAPPED_MARKERS) && success_flag; ++ j)
+				{
+					sprintf (marker_s, "chr" UINT32_FMT "[dot]m" UINT32_FMT, i, j);
+					sprintf (position_s, "%.1f", (NUM_MAPPED_MARKERS - j) * 1.5);
+
+					/*
+					 * Check that a marker with missing parents still round trips
+					 */
+					if (j == 3)
+						{
+							success_flag = AddMarker (population_p, parents_p, marker_s, chromosome_s, position_s, "-", "-");
+						}
+					else
+						{
+							success_flag = AddMarker (population_p, parents_p, marker_s, chromosome_s, position_s, "AA", "BB");
+						}
+				}
+		}
+
+	if (success_flag)
+		{
+			success_flag = AddMarker (population_p, parents_p, "chr2[dot]unplaced", "2", NULL, "AA", "BB");
+		}
+
+	for (i = 0; (i < NUM_UNMAPPED_MARKERS) && success_flag; ++ i)
+		{
+			sprintf (marker_s, "unmapped_" UINT32_FMT, i);
+			success_flag = AddMarker (population_p, parents_p, marker_s, NULL, (i == 0) ? "12.5" : NULL, "AA", "BB");
+		}
+
+	CHECK (success_flag);
+
+	if (success_flag)
+		{
+			bson_oid_t id;
+			bson_t *doc_p;
+
+			bson_oid_init (&id, NULL);
+
+			doc_p = EncodeHaplotypeBlocks (&id, S_POPULATION_S, population_p, parents_p);
+			CHECK (doc_p != NULL);
+
+			if (doc_p)
+				{
+					TestRoundTrip (doc_p, population_p);
+					TestSingleMarker (doc_p, population_p);
+					TestInterval (doc_p, population_p);
+
+					bson_destroy (doc_p);
+				}
+		}
+
+	json_decref (population_p);
+	json_decref (parents_p);
+
+	return FinishUnitTests ("haplotype_blocks_test");
+}
+
+
+static void TestVarints (void)
+{
+	const uint32 values [] = { 0, 1, 127, 128, 300, 16383, 16384, 2097152, 0xFFFFFFFF };
+	const size_t num_values = sizeof (values) / sizeof (values [0]);
+	size_t i;
+
+	for (i = 0; i < num_values; ++ i)
+		{
+			uint8 buffer [10];
+			const size_t length = EncodeVarint (buffer, values [i]);
+			const uint8_t *data_p = buffer;
+			uint32 value = 0;
+
+			CHECK (length >= 1);
+			CHECK (length <= 5);
+			CHECK (DecodeVarint (&data_p, buffer + length, &value));
+			CHECK (value == values [i]);
+			CHECK (data_p == buffer + length);
+
+			/*
+			 * A truncated varint is an error
+			 */
+			if (length > 1)
+				{
+					data_p = buffer;
+					CHECK (!DecodeVarint (&data_p, buffer + length - 1, &value));
+					CHECK (data_p == buffer);
+				}
+		}
+}
+
+
+/*
+ * Decoding every marker should give back the population that was encoded.
+ */
+static void TestRoundTrip (const bson_t *doc_p, const json_t *population_p)
+{
+	HaplotypeMarkers markers;
+	json_t *decoded_p = json_object ();
+
+	markers.hm_population_p = decoded_p;
+	markers.hm_marker_s = NULL;
+	markers.hm_num_docs = 0;
+
+	CHECK (AddBSONHaplotypeMarkers (doc_p, &markers));
+	CHECK (markers.hm_num_docs == 1);
+
+	if (decoded_p)
+		{
+			const char *key_s;
+			json_t *value_p;
+			size_t num_markers = 0;
+
+			json_object_foreach ((json_t *) population_p, key_s, value_p)
+				{
+					if (IsMarkerEntry (key_s, value_p))
+						{
+							CheckDecodedMarker (json_object_get (decoded_p, key_s), value_p, key_s);
+							++ num_markers;
+						}
+				}
+
+			CHECK (num_markers == 2 * NUM_MAPPED_MARKERS + 1 + NUM_UNMAPPED_MARKERS);
+			CHECK (json_object_size (decoded_p) == num_markers);
+
+			json_decref (decoded_p);
+		}
+}
+
+
+static void TestSingleMarker (const bson_t *doc_p, const json_t *population_p)
+{
+	HaplotypeMarkers markers;
+	json_t *decoded_p = json_object ();
+
+	/*
+	 * The marker is asked for by its unescaped name
+	 */
+	markers.hm_population_p = decoded_p;
+	markers.hm_marker_s = "chr2.m17";
+	markers.hm_num_docs = 0;
+
+	CHECK (AddBSONHaplotypeMarkers (doc_p, &markers));
+
+	if (decoded_p)
+		{
+			CHECK (json_object_size (decoded_p) == 1);
+			CheckDecodedMarker (json_object_get (decoded_p, "chr2[dot]m17"), json_object_get (population_p, "chr2[dot]m17"), "chr2[dot]m17");
+
+			json_decref (decoded_p);
+		}
+}
+
+
+/*
+ * Decode a single line's calls on part of a chromosome in the same
+ * way as GetHaplotypeBlockGenotypes ().
+ */
+static void TestInterval (const bson_t *doc_p, const json_t *population_p)
+{
+	const double64 start = 10.0;
+	const double64 end = 20.0;
+	HaplotypeSearch search;
+
+	memset (&search, 0, sizeof (HaplotypeSearch));
+	search.hs_accession_s = "progeny_5";
+	search.hs_chromosome_s = "1";
+	search.hs_start_p = &start;
+	search.hs_end_p = &end;
+	search.hs_results_p = json_array ();
+
+	CHECK (AddBSONHaplotypeGenotypes (doc_p, &search));
+
+	if (search.hs_results_p)
+		{
+			const json_t *result_p = json_array_get (search.hs_results_p, 0);
+
+			CHECK (json_array_size (search.hs_results_p) == 1);
+
+			if (result_p)
+				{
+					const json_t *genotypes_p = json_object_get (result_p, PGS_GENOTYPES_S);
+					size_t num_expected = 0;
+					const char *key_s;
+					json_t *value_p;
+
+					CHECK_STRING (GetJSONString (result_p, PGS_POPULATION_NAME_S), S_POPULATION_S);
+					CHECK_STRING (GetJSONString (result_p, PGS_ACCESSION_S), "progeny_5");
+
+					json_object_foreach ((json_t *) population_p, key_s, value_p)
+						{
+							if (IsMarkerEntry (key_s, value_p))
+								{
+									const char *chromosome_s = GetJSONString (value_p, PGS_CHROMOSOME_S);
+									const char *position_s = GetJSONString (value_p, PGS_MAPPING_POSITION_S);
+									const char *call_s = GetJSONString (value_p, search.hs_accession_s);
+
+									if ((chromosome_s) && (strcmp (chromosome_s, "1") == 0) && (position_s) && (call_s))
+										{
+											const double64 position = strtod (position_s, NULL);
+
+											if ((position >= start) && (position <= end))
+												{
+													char *marker_s = NULL;
+
+													CHECK (SearchAndReplaceInString (key_s, &marker_s, PGS_ESCAPED_DOT_S, "."));
+													CHECK_STRING (GetJSONString (genotypes_p, marker_s ? marker_s : key_s), call_s);
+
+													if (marker_s)
+														{
+															FreeCopiedString (marker_s);
+														}
+
+													++ num_expected;
+												}
+										}
+								}
+						}
+
+					CHECK (num_expected > 0);
+					CHECK (json_object_size (genotypes_p) == num_expected);
+				}
+
+			json_decref (search.hs_results_p);
+		}
+}
+
+
+/*
+ * Each progeny line mostly stays with the same parent's call for long runs
+ * of markers, with the odd crossover, heterozygous, missing or absent call.
+ */
+static bool AddMarker (json_t *population_p, json_t *parents_p, const char *marker_s, const char *chromosome_s, const char *position_s, const char *parent_a_s, const char *parent_b_s)
+{
+	static uint32 s_parents [NUM_PROGENY];
+	json_t *marker_p = json_object ();
+
+	if (marker_p)
+		{
+			if ((json_object_set_new (population_p, marker_s, marker_p) == 0) &&
+					(json_object_set_new (parents_p, marker_s, json_pack ("[s,s]", parent_a_s, parent_b_s)) == 0))
+				{
+					bool success_flag = ((chromosome_s == NULL) || (SetJSONString (marker_p, PGS_CHROMOSOME_S, chromosome_s))) &&
+						((position_s == NULL) || (SetJSONString (marker_p, PGS_MAPPING_POSITION_S, position_s)));
+					const bool missing_parents_flag = (strcmp (parent_a_s, "-") == 0);
+					uint32 i;
+
+					for (i = 0; (i < NUM_PROGENY) && success_flag; ++ i)
+						{
+							const uint32 r = GetRandomNumber () % 100;
+							char accession_s [32];
+							const char *call_s = NULL;
+
+							sprintf (accession_s, "progeny_" UINT32_FMT, i);
+
+							if (r < 10)
+								{
+									s_parents [i] = 1 - s_parents [i];
+								}
+
+							if (r >= 95)
+								{
+									/* absent */
+								}
+							else if (r >= 92)
+								{
+									call_s = "-";
+								}
+							else if (r >= 87)
+								{
+									call_s = "AB";
+								}
+							else if (missing_parents_flag)
+								{
+									call_s = (s_parents [i] == 0) ? "A" : "B";
+								}
+							else
+								{
+									call_s = (s_parents [i] == 0) ? parent_a_s : parent_b_s;
+								}
+
+							if (call_s)
+								{
+									success_flag = SetJSONString (marker_p, accession_s, call_s);
+								}
+						}
+
+					return success_flag;
+				}
+		}
+
+	return false;
+}
+
+
+static void CheckDecodedMarker (const json_t *decoded_marker_p, const json_t *marker_p, const char *escaped_marker_s)
+{
+	CHECK (decoded_marker_p != NULL);
+	CHECK (marker_p != NULL);
+
+	if (decoded_marker_p && marker_p)
+		{
+			const char *key_s;
+			json_t *value_p;
+
+			if (json_object_size (decoded_marker_p) != json_object_size (marker_p))
+				{
+					printf ("\"%s\" has " SIZET_FMT " entries after decoding and " SIZET_FMT " before\n", escaped_marker_s, json_object_size (decoded_marker_p), json_object_size (marker_p));
+				}
+
+			CHECK (json_object_size (decoded_marker_p) == json_object_size (marker_p));
+
+			json_object_foreach ((json_t *) marker_p, key_s, value_p)
+				{
+					CHECK_STRING (GetJSONString (decoded_marker_p, key_s), json_string_value (value_p));
+				}
+		}
+}
+
+
+/*
+ * A fixed sequence so that every run tests the same population.
+ */
+static uint32 GetRandomNumber (void)
+{
+	static uint32 s_state = 12345;
+
+	s_state = s_state * 1103515245 + 12345;
+
+	return (s_state >> 16) & 0x7FFF;
+}
@@ -0,0 +1,346 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * population_filters_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "population_filters.c"
+#include "unit_test.h"
+
+
+#define NUM_MARKERS (200)
+
+#define NUM_ABSENT_MARKERS (1000)
+
+
+static void TestExclusion (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p);
+
+static void TestQueries (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p);
+
+static void TestRevisions (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p);
+
+static void TestUnloaded (const bson_oid_t *id_a_p);
+
+static json_t *GetPopulation (const char *prefix_s, const uint32 num_markers);
+
+static void CheckExcludedPopulation (const bson_t *query_p, const uint32 index, const bson_oid_t *id_p, const int64 revision);
+
+static const char *FindExcludableMarker (const bson_oid_t *id_p);
+
+
+
+int main (void)
+{
+	bson_oid_t id_a;
+	bson_oid_t id_b;
+	json_t *population_a_p;
+	json_t *population_b_p;
+
+	bson_oid_init (&id_a, NULL);
+	bson_oid_init (&id_b, NULL);
+
+	population_a_p = GetPopulation ("a_", NUM_MARKERS);
+	population_b_p = GetPopulation ("b_", NUM_MARKERS);
+
+	/*
+	 * Start with an empty set of filters rather than loading them from the database
+	 */
+	s_filters.pfs_loaded_flag = true;
+
+	/*
+	 * Add them out of order to check that the filters are kept sorted
+	 */
+	CHECK (AddPopulationToFilters (&id_b, population_b_p, 0));
+	CHECK (AddPopulationToFilters (&id_a, population_a_p, 0));
+	CHECK (s_filters.pfs_num_filters == 2);
+	CHECK (bson_oid_compare (& (s_filters.pfs_filters_p [0].pf_id), & (s_filters.pfs_filters_p [1].pf_id)) < 0);
+
+	TestExclusion (&id_a, &id_b);
+	TestQueries (&id_a, &id_b);
+	TestRevisions (&id_a, &id_b);
+	TestUnloaded (&id_a);
+
+	json_decref (population_a_p);
+	json_decref (population_b_p);
+
+	return FinishUnitTests ("population_filters_test");
+}
+
+
+/*
+ * A filter must never rule out one of its own markers and
+ * should rule out nearly all of the markers that it lacks.
+ */
+static void TestExclusion (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p)
+{
+	const PopulationFilter *filter_a_p = FindPopulationFilter (&s_filters, id_a_p);
+	const PopulationFilter *filter_b_p = FindPopulationFilter (&s_filters, id_b_p);
+
+	CHECK (filter_a_p != NULL);
+	CHECK (filter_b_p != NULL);
+
+	if (filter_a_p && filter_b_p)
+		{
+			uint32 num_excluded = 0;
+			uint32 i;
+			char marker_s [32];
+
+			CHECK (filter_a_p -> pf_num_bits >= NUM_MARKERS * S_BITS_PER_MARKER);
+			CHECK ((filter_a_p -> pf_num_bits & 63) == 0);
+
+			for (i = 0; i < NUM_MARKERS; ++ i)
+				{
+					sprintf (marker_s, "a_" UINT32_FMT, i);
+					CHECK (!CanPopulationFilterExcludeMarker (filter_a_p, marker_s));
+
+					sprintf (marker_s, "b_" UINT32_FMT, i);
+					CHECK (!CanPopulationFilterExcludeMarker (filter_b_p, marker_s));
+				}
+
+			for (i = 0; i < NUM_ABSENT_MARKERS; ++ i)
+				{
+					sprintf (marker_s, "absent_" UINT32_FMT, i);
+
+					if (CanPopulationFilterExcludeMarker (filter_a_p, marker_s))
+						{
+							++ num_excluded;
+						}
+				}
+
+			/*
+			 * The false positive rate should be about 1% so allow for up to 5%
+			 */
+			printf ("excluded " UINT32_FMT " of %d absent markers\n", num_excluded, NUM_ABSENT_MARKERS);
+			CHECK (num_excluded >= (NUM_ABSENT_MARKERS * 95) / 100);
+		}
+}
+
+
+static void TestQueries (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p)
+{
+	bson_t *query_p = bson_new ();
+	const char *absent_marker_s = FindExcludableMarker (id_a_p);
+
+	/*
+	 * Only the population without the marker is excluded
+	 */
+	CHECK (AddPopulationFiltersToQuery (query_p, "a_7") == 1);
+	CheckExcludedPopulation (query_p, 0, id_b_p, 0);
+	bson_destroy (query_p);
+
+	query_p = bson_new ();
+	CHECK (AddPopulationFilterToQuery (query_p, id_a_p, "a_7") == 0);
+	CHECK (!bson_has_field (query_p, "$nor"));
+	bson_destroy (query_p);
+
+	CHECK (absent_marker_s != NULL);
+
+	if (absent_marker_s)
+		{
+			query_p = bson_new ();
+			CHECK (AddPopulationFilterToQuery (query_p, id_a_p, absent_marker_s) == 1);
+			CheckExcludedPopulation (query_p, 0, id_a_p, 0);
+			bson_destroy (query_p);
+		}
+}
+
+
+static void TestRevisions (const bson_oid_t *id_a_p, const bson_oid_t *id_b_p)
+{
+	const PopulationFilter *filter_a_p = FindPopulationFilter (&s_filters, id_a_p);
+	json_t *appended_p = GetPopulation ("appended_", 1);
+	const char *absent_marker_s;
+	bson_t *query_p;
+
+	/*
+	 * Appending the next revision keeps the filter usable and adds the new markers
+	 */
+	CHECK (CanPopulationFilterExcludeMarker (filter_a_p, "appended_0"));
+	CHECK (AddPopulationToFilters (id_a_p, appended_p, 1));
+	CHECK (filter_a_p -> pf_revision == 1);
+	CHECK (!CanPopulationFilterExcludeMarker (filter_a_p, "appended_0"));
+	CHECK (!CanPopulationFilterExcludeMarker (filter_a_p, "a_7"));
+
+	absent_marker_s = FindExcludableMarker (id_a_p);
+	CHECK (absent_marker_s != NULL);
+
+	if (absent_marker_s)
+		{
+			/*
+			 * The query only skips the population while it is still at that revision
+			 */
+			query_p = bson_new ();
+			CHECK (AddPopulationFilterToQuery (query_p, id_a_p, absent_marker_s) == 1);
+			CheckExcludedPopulation (query_p, 0, id_a_p, 1);
+			bson_destroy (query_p);
+		}
+
+	/*
+	 * A skipped revision means that another process has changed the
+	 * population so its filter can't rule anything out any more
+	 */
+	CHECK (AddPopulationToFilters (id_a_p, appended_p, 3));
+	CHECK (filter_a_p -> pf_revision == -1);
+
+	if (absent_marker_s)
+		{
+			CHECK (!CanPopulationFilterExcludeMarker (filter_a_p, absent_marker_s));
+
+			query_p = bson_new ();
+			CHECK (AddPopulationFilterToQuery (query_p, id_a_p, absent_marker_s) == 0);
+			bson_destroy (query_p);
+
+			query_p = bson_new ();
+			CHECK (AddPopulationFiltersToQuery (query_p, absent_marker_s) == 1);
+			CheckExcludedPopulation (query_p, 0, id_b_p, 0);
+			bson_destroy (query_p);
+		}
+
+	/*
+	 * and it stays unusable
+	 */
+	CHECK (AddPopulationToFilters (id_a_p, appended_p, 4));
+	CHECK (filter_a_p -> pf_revision == -1);
+
+	json_decref (appended_p);
+}
+
+
+static void TestUnloaded (const bson_oid_t *id_a_p)
+{
+	bson_t *query_p = bson_new ();
+	json_t *population_p = GetPopulation ("c_", 1);
+	bson_oid_t id_c;
+
+	ClearPopulationFilters (&s_filters);
+
+	CHECK (AddPopulationFiltersToQuery (query_p, "absent_0") == 0);
+	CHECK (AddPopulationFilterToQuery (query_p, id_a_p, "absent_0") == 0);
+	CHECK (!bson_has_field (query_p, "$nor"));
+
+	/*
+	 * Populations aren't added until the filters have been loaded
+	 */
+	bson_oid_init (&id_c, NULL);
+	CHECK (AddPopulationToFilters (&id_c, population_p, 0));
+	CHECK (s_filters.pfs_num_filters == 0);
+
+	json_decref (population_p);
+	bson_destroy (query_p);
+}
+
+
+static json_t *GetPopulation (const char *prefix_s, const uint32 num_markers)
+{
+	json_t *population_p = json_pack ("{s:s}", "name", prefix_s);
+	uint32 i;
+
+	for (i = 0; i < num_markers; ++ i)
+		{
+			char marker_s [32];
+
+			sprintf (marker_s, "%s" UINT32_FMT, prefix_s, i);
+			json_object_set_new (population_p, marker_s, json_pack ("{s:s}", "accession_1", "A"));
+		}
+
+	return population_p;
+}
+
+
+/*
+ * Check that the given entry of the query's $nor array matches the
+ * population while it is at the given revision.
+ */
+static void CheckExcludedPopulation (const bson_t *query_p, const uint32 index, const bson_oid_t *id_p, const int64 revision)
+{
+	bson_iter_t nor_iter;
+	bson_iter_t populations_iter;
+	bool found_flag = false;
+
+	if ((bson_iter_init_find (&nor_iter, query_p, "$nor")) && (BSON_ITER_HOLDS_ARRAY (&nor_iter)) && (bson_iter_recurse (&nor_iter, &populations_iter)))
+		{
+			char key_s [16];
+
+			sprintf (key_s, UINT32_FMT, index);
+
+			if (bson_iter_find (&populations_iter, key_s))
+				{
+					bson_iter_t population_iter;
+					bson_iter_t field_iter;
+
+					found_flag = true;
+
+					CHECK (bson_iter_recurse (&populations_iter, &population_iter));
+					CHECK (bson_iter_find (&population_iter, MONGO_ID_S));
+					CHECK (BSON_ITER_HOLDS_OID (&population_iter));
+					CHECK (bson_oid_equal (bson_iter_oid (&population_iter), id_p));
+
+					CHECK (bson_iter_recurse (&populations_iter, &field_iter));
+					CHECK (bson_iter_find (&field_iter, PGS_REVISION_S));
+
+					if (revision > 0)
+						{
+							CHECK (BSON_ITER_HOLDS_INT64 (&field_iter));
+							CHECK (bson_iter_int64 (&field_iter) == revision);
+						}
+					else
+						{
+							bson_iter_t exists_iter;
+
+							CHECK (BSON_ITER_HOLDS_DOCUMENT (&field_iter));
+							CHECK (bson_iter_recurse (&field_iter, &exists_iter));
+							CHECK (bson_iter_find (&exists_iter, "$exists"));
+							CHECK (!bson_iter_bool (&exists_iter));
+						}
+				}
+
+			/*
+			 * There should be no more entries
+			 */
+			CHECK (!bson_iter_next (&populations_iter));
+		}
+
+	CHECK (found_flag);
+}
+
+
+/*
+ * Get a marker that the population's filter rules out.
+ */
+static const char *FindExcludableMarker (const bson_oid_t *id_p)
+{
+	static char marker_s [32];
+	const PopulationFilter *filter_p = FindPopulationFilter (&s_filters, id_p);
+
+	if (filter_p)
+		{
+			uint32 i;
+
+			for (i = 0; i < NUM_ABSENT_MARKERS; ++ i)
+				{
+					sprintf (marker_s, "absent_" UINT32_FMT, i);
+
+					if (CanPopulationFilterExcludeMarker (filter_p, marker_s))
+						{
+							return marker_s;
+						}
+				}
+		}
+
+	return NULL;
+}
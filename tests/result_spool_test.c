@@ -0,0 +1,355 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * result_spool_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "result_spool.c"
+#include "unit_test.h"
+
+
+#define NUM_RESULTS (20)
+
+
+static void TestTokenParsing (void);
+
+static void TestSpoolRoundTrip (const char *directory_s);
+
+static void TestExpiry (const char *directory_s);
+
+static bool CreateFile (const char *directory_s, const char *name_s, const time_t age);
+
+static bool DoesFileExist (const char *directory_s, const char *name_s);
+
+static const char *GetSpoolToken (const ServiceJob *job_p);
+
+static uint32 TakeResults (ServiceJob *job_p, uint32 *next_p);
+
+
+
+int main (void)
+{
+	char directory_s [] = "/tmp/pgs_result_spool_test_XXXXXX";
+
+	TestTokenParsing ();
+
+	if (mkdtemp (directory_s))
+		{
+			TestSpoolRoundTrip (directory_s);
+			TestExpiry (directory_s);
+
+			rmdir (directory_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	return FinishUnitTests ("result_spool_test");
+}
+
+
+static void TestTokenParsing (void)
+{
+	const char * const invalid_tokens_ss [] =
+		{
+			"",
+			"aB3xYz",
+			"aB3xYz:",
+			"aB3xY:10",
+			"aB3xYzz:10",
+			"aB3x/z:10",
+			"../../:10",
+			"aB3xYz:-1",
+			"aB3xYz:12a",
+			"aB3xYz:1:2",
+			NULL
+		};
+	const char * const *token_ss = invalid_tokens_ss;
+	uint64 offset = 0;
+	char *filename_s = GetSpoolFilenameFromToken ("aB3xYz:1048576", "/spool", &offset);
+
+	CHECK_STRING (filename_s, "/spool/pgs_results_aB3xYz");
+	CHECK (offset == 1048576);
+
+	if (filename_s)
+		{
+			FreeCopiedString (filename_s);
+		}
+
+	filename_s = GetSpoolFilenameFromToken ("000000:0", "/spool", &offset);
+	CHECK_STRING (filename_s, "/spool/pgs_results_000000");
+	CHECK (offset == 0);
+
+	if (filename_s)
+		{
+			FreeCopiedString (filename_s);
+		}
+
+	while (*token_ss)
+		{
+			offset = 42;
+			filename_s = GetSpoolFilenameFromToken (*token_ss, "/spool", &offset);
+
+			if (filename_s)
+				{
+					printf ("token \"%s\" was accepted as \"%s\"\n", *token_ss, filename_s);
+					FreeCopiedString (filename_s);
+				}
+
+			CHECK (filename_s == NULL);
+			CHECK (offset == 42);
+
+			++ token_ss;
+		}
+}
+
+
+/*
+ * Results over the budget go to the spool and are then collected
+ * a page at a time, in order, until the spool is used up.
+ */
+static void TestSpoolRoundTrip (const char *directory_s)
+{
+	ResultSpool spool;
+	ServiceJob job;
+	uint32 next = 0;
+	uint32 num_in_memory;
+	uint32 num_pages = 0;
+	uint32 i;
+	const char *token_s;
+
+	memset (&job, 0, sizeof (ServiceJob));
+
+	InitResultSpool (&spool, 100, directory_s, 3600);
+
+	for (i = 0; i < NUM_RESULTS; ++ i)
+		{
+			json_t *result_p = json_pack ("{s:I,s:s}", "index", (json_int_t) i, "padding", "0123456789");
+
+			CHECK (result_p != NULL);
+			CHECK (AddResultToResultSpool (&spool, &job, result_p));
+		}
+
+	CHECK (FinishResultSpool (&spool, &job));
+	CHECK (spool.rs_num_spooled > 0);
+	CHECK (HasSpooledResults (&job));
+
+	num_in_memory = TakeResults (&job, &next);
+	CHECK (num_in_memory > 0);
+	CHECK (num_in_memory + spool.rs_num_spooled == NUM_RESULTS);
+
+	while (((token_s = GetSpoolToken (&job)) != NULL) && (num_pages < NUM_RESULTS))
+		{
+			char *token_copy_s = EasyCopyToNewString (token_s);
+
+			json_decref (job.sj_metadata_p);
+			job.sj_metadata_p = NULL;
+
+			CHECK (AddSpooledResultsToServiceJob (token_copy_s, 100, directory_s, 3600, &job));
+			CHECK (TakeResults (&job, &next) > 0);
+
+			if (HasSpooledResults (&job))
+				{
+					CHECK (strcmp (token_copy_s, GetSpoolToken (&job)) != 0);
+				}
+			else
+				{
+					/*
+					 * Once collected, the same token can't be used again
+					 */
+					CHECK (!AddSpooledResultsToServiceJob (token_copy_s, 100, directory_s, 3600, &job));
+				}
+
+			FreeCopiedString (token_copy_s);
+			++ num_pages;
+		}
+
+	CHECK (num_pages > 1);
+	CHECK (next == NUM_RESULTS);
+
+	if (job.sj_metadata_p)
+		{
+			json_decref (job.sj_metadata_p);
+		}
+}
+
+
+static void TestExpiry (const char *directory_s)
+{
+	CHECK (CreateFile (directory_s, "pgs_results_old000", 1000));
+	CHECK (CreateFile (directory_s, "pgs_results_new000", 0));
+	CHECK (CreateFile (directory_s, "other_file", 1000));
+
+	/*
+	 * An expiry of 0 keeps the files forever
+	 */
+	ExpireResultSpools (directory_s, 0);
+	CHECK (DoesFileExist (directory_s, "pgs_results_old000"));
+
+	ExpireResultSpools (directory_s, 100);
+	CHECK (!DoesFileExist (directory_s, "pgs_results_old000"));
+	CHECK (DoesFileExist (directory_s, "pgs_results_new000"));
+	CHECK (DoesFileExist (directory_s, "other_file"));
+
+	CHECK (CreateFile (directory_s, "pgs_results_old000", 1000));
+
+	{
+		ServiceJob job;
+
+		memset (&job, 0, sizeof (ServiceJob));
+
+		/*
+		 * Collecting expires any old spools first
+		 */
+		CHECK (!AddSpooledResultsToServiceJob ("old000:0", 0, directory_s, 100, &job));
+		CHECK (!DoesFileExist (directory_s, "pgs_results_old000"));
+		CHECK (AddSpooledResultsToServiceJob ("new000:0", 0, directory_s, 100, &job));
+		CHECK (!DoesFileExist (directory_s, "pgs_results_new000"));
+
+		if (job.sj_result_p)
+			{
+				CHECK (json_array_size (job.sj_result_p) == 1);
+				json_decref (job.sj_result_p);
+			}
+		else
+			{
+				CHECK (false);
+			}
+	}
+
+	{
+		char *filename_s = ConcatenateVarargsStrings (directory_s, "/other_file", NULL);
+
+		if (filename_s)
+			{
+				unlink (filename_s);
+				FreeCopiedString (filename_s);
+			}
+	}
+}
+
+
+static bool CreateFile (const char *directory_s, const char *name_s, const time_t age)
+{
+	bool success_flag = false;
+	char *filename_s = ConcatenateVarargsStrings (directory_s, "/", name_s, NULL);
+
+	if (filename_s)
+		{
+			FILE *out_f = fopen (filename_s, "w");
+
+			if (out_f)
+				{
+					if (fputs ("{\"index\":0}\n", out_f) >= 0)
+						{
+							struct timeval times [2];
+
+							gettimeofday (times, NULL);
+							times [0].tv_sec -= age;
+							times [1] = times [0];
+
+							success_flag = true;
+
+							if (fclose (out_f) != 0)
+								{
+									success_flag = false;
+								}
+							else if ((age > 0) && (utimes (filename_s, times) != 0))
+								{
+									success_flag = false;
+								}
+						}
+					else
+						{
+							fclose (out_f);
+						}
+				}
+
+			FreeCopiedString (filename_s);
+		}
+
+	return success_flag;
+}
+
+
+static bool DoesFileExist (const char *directory_s, const char *name_s)
+{
+	bool exists_flag = false;
+	char *filename_s = ConcatenateVarargsStrings (directory_s, "/", name_s, NULL);
+
+	if (filename_s)
+		{
+			struct stat st;
+
+			exists_flag = (stat (filename_s, &st) == 0);
+			FreeCopiedString (filename_s);
+		}
+
+	return exists_flag;
+}
+
+
+static const char *GetSpoolToken (const ServiceJob *job_p)
+{
+	const char *token_s = NULL;
+
+	if (job_p -> sj_metadata_p)
+		{
+			const json_t *details_p = json_object_get (job_p -> sj_metadata_p, S_SPOOLED_S);
+
+			if (details_p)
+				{
+					token_s = GetJSONString (details_p, "token");
+				}
+		}
+
+	return token_s;
+}
+
+
+/*
+ * Check that the job's results carry on from where the last ones
+ * finished and then clear them.
+ */
+static uint32 TakeResults (ServiceJob *job_p, uint32 *next_p)
+{
+	uint32 num_results = 0;
+
+	if (job_p -> sj_result_p)
+		{
+			size_t i;
+			json_t *result_p;
+
+			json_array_foreach (job_p -> sj_result_p, i, result_p)
+				{
+					int index = -1;
+
+					CHECK (GetJSONInteger (result_p, "index", &index));
+					CHECK (index == (int) *next_p);
+
+					++ (*next_p);
+					++ num_results;
+				}
+
+			json_decref (job_p -> sj_result_p);
+			job_p -> sj_result_p = NULL;
+		}
+
+	return num_results;
+}
@@ -0,0 +1,77 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * unit_test.h
+ *
+ *  Created on: 19 Oct 2026
+ *
+ * Each test program includes the source file of the module that it
+ * tests, so that it can check that module's static functions too, and
+ * is linked against the rest of the service's modules.
+ */
+
+#ifndef SERVICES_PARENTAL_GENOTYPE_SERVICE_TESTS_UNIT_TEST_H_
+#define SERVICES_PARENTAL_GENOTYPE_SERVICE_TESTS_UNIT_TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+
+static unsigned int s_num_checks = 0;
+
+static unsigned int s_num_failures = 0;
+
+
+#define CHECK(cond) \
+	do \
+		{ \
+			++ s_num_checks; \
+			if (! (cond)) \
+				{ \
+					++ s_num_failures; \
+					printf ("%s:%d: CHECK (%s) failed\n", __FILE__, __LINE__, #cond); \
+				} \
+		} \
+	while (0)
+
+
+#define CHECK_STRING(value_s, expected_s) \
+	do \
+		{ \
+			const char *check_value_s = (value_s); \
+			const char *check_expected_s = (expected_s); \
+			++ s_num_checks; \
+			if ((check_value_s == NULL) || (strcmp (check_value_s, check_expected_s) != 0)) \
+				{ \
+					++ s_num_failures; \
+					printf ("%s:%d: %s is \"%s\", expected \"%s\"\n", __FILE__, __LINE__, #value_s, check_value_s ? check_value_s : "(null)", check_expected_s); \
+				} \
+		} \
+	while (0)
+
+
+/*
+ * Print the totals and get the exit code for the test program.
+ */
+static int FinishUnitTests (const char *name_s)
+{
+	printf ("%s: %u checks, %u failed\n", name_s, s_num_checks, s_num_failures);
+
+	return (s_num_failures == 0) ? 0 : 1;
+}
+
+
+#endif /* SERVICES_PARENTAL_GENOTYPE_SERVICE_TESTS_UNIT_TEST_H_ */
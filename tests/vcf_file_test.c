@@ -0,0 +1,681 @@
+/*
+** Copyright 2014-2018 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * vcf_file_test.c
+ *
+ *  Created on: 19 Oct 2026
+ */
+
+#include "vcf_file.c"
+#include "unit_test.h"
+
+
+/*
+ * Enough variants for the file to be more than a chunk, so that it is
+ * split between the workers and, when it is compressed, decompressed
+ * over more than one batch.
+ */
+#define NUM_LARGE_VARIANTS (250000)
+
+
+static const char * const S_SMALL_VCF_S =
+	"##fileformat=VCFv4.2\n"
+	"##source=vcf_file_test\n"
+	"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\tL_1\tL_2\tL_3\n"
+	"1\t100\tsnp.1\tA\tG\t.\tPASS\t.\tGT\t0/0\t1/1\t0/1\t1|0\t./.\n"
+	"1\t200\t.\tC\tT,TA\t.\tPASS\t.\tDP:GT\t5:0/0\t7:1/2\t3:2/0\t1:2|2\t4:0/3\n"
+	"2\t50\tsnp3\tG\t.\t.\tPASS\t.\tGT:DP\t0/0:1\t0:2\t.:3\t0/0\t0|0:9\r\n";
+
+
+static void TestSmallFile (const char *directory_s);
+
+static void TestParentsAndMap (const char *directory_s);
+
+static void TestInvalidFiles (const char *directory_s);
+
+static void TestLargeFile (const char *directory_s);
+
+static json_t *LoadVCF (const char *filename_s, const char *parent_a_s, const char *parent_b_s, const char *map_filename_s, const uint32 num_threads, json_t **parent_a_row_pp, json_t **parent_b_row_pp, uint64 *num_cells_p);
+
+static char *GetTestFilename (const char *directory_s, const char *name_s);
+
+static bool WriteTestFile (const char *filename_s, const char *contents_s);
+
+static bool WriteGzippedFile (const char *filename_s, const char *contents_s);
+
+static bool WriteLargeFiles (const char *plain_filename_s, const char *gzipped_filename_s);
+
+static bool TruncateFile (const char *filename_s, const off_t num_bytes);
+
+static void CheckCall (const json_t *doc_p, const char *escaped_marker_s, const char *accession_s, const char *call_s);
+
+
+
+int main (void)
+{
+	char directory_s [] = "/tmp/pgs_vcf_test_XXXXXX";
+
+	if (mkdtemp (directory_s))
+		{
+			TestSmallFile (directory_s);
+			TestParentsAndMap (directory_s);
+			TestInvalidFiles (directory_s);
+			TestLargeFile (directory_s);
+
+			rmdir (directory_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	return FinishUnitTests ("vcf_file_test");
+}
+
+
+/*
+ * The same variants, plain and gzipped, should give the same population.
+ */
+static void TestSmallFile (const char *directory_s)
+{
+	char *plain_filename_s = GetTestFilename (directory_s, "small.vcf");
+	char *gzipped_filename_s = GetTestFilename (directory_s, "small.vcf.gz");
+
+	if (plain_filename_s && gzipped_filename_s)
+		{
+			CHECK (WriteTestFile (plain_filename_s, S_SMALL_VCF_S));
+			CHECK (WriteGzippedFile (gzipped_filename_s, S_SMALL_VCF_S));
+
+			CHECK (IsVCFFile (plain_filename_s));
+			CHECK (IsVCFFile (gzipped_filename_s));
+
+			{
+				json_t *parent_a_p = NULL;
+				json_t *parent_b_p = NULL;
+				json_t *gz_parent_a_p = NULL;
+				json_t *gz_parent_b_p = NULL;
+				uint64 num_cells = 0;
+				uint64 gz_num_cells = 0;
+				json_t *doc_p = LoadVCF (plain_filename_s, NULL, NULL, NULL, 2, &parent_a_p, &parent_b_p, &num_cells);
+				json_t *gz_doc_p = LoadVCF (gzipped_filename_s, NULL, NULL, NULL, 1, &gz_parent_a_p, &gz_parent_b_p, &gz_num_cells);
+
+				CHECK (doc_p != NULL);
+				CHECK (gz_doc_p != NULL);
+
+				if (doc_p)
+					{
+						CHECK (json_object_size (doc_p) == 3);
+						CHECK (num_cells == 24);
+
+						CHECK_STRING (GetJSONString (json_object_get (doc_p, "snp[dot]1"), PGS_CHROMOSOME_S), "1");
+						CHECK_STRING (GetJSONString (json_object_get (doc_p, "snp[dot]1"), PGS_MAPPING_POSITION_S), "100");
+						CheckCall (doc_p, "snp[dot]1", "Line 1", "A/G");
+						CheckCall (doc_p, "snp[dot]1", "Line 2", "A/G");
+						CheckCall (doc_p, "snp[dot]1", "Line 3", "-");
+
+						/*
+						 * A variant without an ID is named by its position and
+						 * GT doesn't have to be the first subfield
+						 */
+						CHECK_STRING (GetJSONString (json_object_get (doc_p, "1:200"), PGS_MAPPING_POSITION_S), "200");
+						CheckCall (doc_p, "1:200", "Line 1", "C/TA");
+						CheckCall (doc_p, "1:200", "Line 2", "TA/TA");
+						CheckCall (doc_p, "1:200", "Line 3", "-");
+
+						CheckCall (doc_p, "snp3", "Line 1", "-");
+						CheckCall (doc_p, "snp3", "Line 2", "G/G");
+						CheckCall (doc_p, "snp3", "Line 3", "G/G");
+
+						CHECK (json_object_get (json_object_get (doc_p, "snp3"), "P1") == NULL);
+
+						/*
+						 * The parent rows use the unescaped marker names
+						 */
+						CHECK_STRING (GetJSONString (parent_a_p, S_ID_S), "P1");
+						CHECK_STRING (GetJSONString (parent_a_p, "snp.1"), "A/A");
+						CHECK_STRING (GetJSONString (parent_b_p, S_ID_S), "P2");
+						CHECK_STRING (GetJSONString (parent_b_p, "1:200"), "T/TA");
+						CHECK_STRING (GetJSONString (parent_b_p, "snp3"), "G");
+					}
+
+				if (doc_p && gz_doc_p)
+					{
+						CHECK (json_equal (doc_p, gz_doc_p));
+						CHECK (json_equal (parent_a_p, gz_parent_a_p));
+						CHECK (json_equal (parent_b_p, gz_parent_b_p));
+						CHECK (num_cells == gz_num_cells);
+					}
+
+				json_decref (doc_p);
+				json_decref (gz_doc_p);
+				json_decref (parent_a_p);
+				json_decref (parent_b_p);
+				json_decref (gz_parent_a_p);
+				json_decref (gz_parent_b_p);
+			}
+
+			/*
+			 * Without the end of its gzip trailer, all of the lines can still be
+			 * decompressed but the file is incomplete so it must be rejected
+			 */
+			CHECK (TruncateFile (gzipped_filename_s, 4));
+
+			{
+				VCFFile *vcf_p = OpenVCFFile (gzipped_filename_s, NULL, NULL, NULL);
+
+				CHECK (vcf_p == NULL);
+
+				if (vcf_p)
+					{
+						CloseVCFFile (vcf_p);
+					}
+			}
+
+			unlink (plain_filename_s);
+			unlink (gzipped_filename_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	if (plain_filename_s)
+		{
+			FreeCopiedString (plain_filename_s);
+		}
+
+	if (gzipped_filename_s)
+		{
+			FreeCopiedString (gzipped_filename_s);
+		}
+}
+
+
+static void TestParentsAndMap (const char *directory_s)
+{
+	char *vcf_filename_s = GetTestFilename (directory_s, "parents.vcf");
+	char *map_filename_s = GetTestFilename (directory_s, "map.csv");
+
+	if (vcf_filename_s && map_filename_s)
+		{
+			json_t *parent_a_p = NULL;
+			json_t *parent_b_p = NULL;
+			json_t *doc_p;
+
+			CHECK (WriteTestFile (vcf_filename_s, S_SMALL_VCF_S));
+			CHECK (WriteTestFile (map_filename_s, "marker,chromosome,position\nsnp.1,3,12.5\n\n1:200,3,20\n"));
+
+			/*
+			 * Any of the samples can be a parent
+			 */
+			doc_p = LoadVCF (vcf_filename_s, "L_2", "P1", NULL, 1, &parent_a_p, &parent_b_p, NULL);
+			CHECK (doc_p != NULL);
+
+			if (doc_p)
+				{
+					CHECK_STRING (GetJSONString (parent_a_p, S_ID_S), "L_2");
+					CHECK_STRING (GetJSONString (parent_a_p, "snp.1"), "A/G");
+					CHECK_STRING (GetJSONString (parent_b_p, S_ID_S), "P1");
+					CheckCall (doc_p, "snp[dot]1", "P2", "G/G");
+					CHECK (json_object_get (json_object_get (doc_p, "snp[dot]1"), "Line 2") == NULL);
+
+					json_decref (doc_p);
+					json_decref (parent_a_p);
+					json_decref (parent_b_p);
+				}
+
+			/*
+			 * The map's positions are used and any variants that aren't on it are skipped
+			 */
+			doc_p = LoadVCF (vcf_filename_s, NULL, NULL, map_filename_s, 1, &parent_a_p, &parent_b_p, NULL);
+			CHECK (doc_p != NULL);
+
+			if (doc_p)
+				{
+					CHECK (json_object_size (doc_p) == 2);
+					CHECK (json_object_get (doc_p, "snp3") == NULL);
+					CHECK_STRING (GetJSONString (json_object_get (doc_p, "snp[dot]1"), PGS_CHROMOSOME_S), "3");
+					CHECK_STRING (GetJSONString (json_object_get (doc_p, "snp[dot]1"), PGS_MAPPING_POSITION_S), "12.5");
+					CHECK_STRING (GetJSONString (json_object_get (doc_p, "1:200"), PGS_MAPPING_POSITION_S), "20");
+					CHECK (json_object_get (parent_a_p, "snp3") == NULL);
+
+					json_decref (doc_p);
+					json_decref (parent_a_p);
+					json_decref (parent_b_p);
+				}
+
+			CHECK (OpenVCFFile (vcf_filename_s, "P1", "P1", NULL) == NULL);
+			CHECK (OpenVCFFile (vcf_filename_s, "P3", NULL, NULL) == NULL);
+
+			/*
+			 * A map whose positions aren't numbers
+			 */
+			CHECK (WriteTestFile (map_filename_s, "snp.1,3,12.5\n1:200,3,twenty\n"));
+			CHECK (OpenVCFFile (vcf_filename_s, NULL, NULL, map_filename_s) == NULL);
+
+			unlink (vcf_filename_s);
+			unlink (map_filename_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	if (vcf_filename_s)
+		{
+			FreeCopiedString (vcf_filename_s);
+		}
+
+	if (map_filename_s)
+		{
+			FreeCopiedString (map_filename_s);
+		}
+}
+
+
+static void TestInvalidFiles (const char *directory_s)
+{
+	const char * const unopenable_files_ss [] =
+		{
+			/* empty */
+			"",
+
+			/* no file format line */
+			"#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\t.\tA\tG\t.\t.\t.\tGT\t0\t1\n",
+
+			/* no header line */
+			"##fileformat=VCFv4.2\n1\t1\t.\tA\tG\t.\t.\t.\tGT\t0\t1\n",
+
+			/* only one sample */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\n1\t1\t.\tA\tG\t.\t.\t.\tGT\t0\n",
+
+			NULL
+		};
+	const char * const unloadable_files_ss [] =
+		{
+			/* duplicate marker */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\tm1\tA\tG\t.\t.\t.\tGT\t0\t1\n1\t2\tm1\tA\tG\t.\t.\t.\tGT\t0\t1\n",
+
+			/* missing sample */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\tm1\tA\tG\t.\t.\t.\tGT\t0\n",
+
+			/* extra sample */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\tm1\tA\tG\t.\t.\t.\tGT\t0\t1\t1\n",
+
+			/* no GT */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\tm1\tA\tG\t.\t.\t.\tDP\t3\t4\n",
+
+			/* too few columns */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n1\t1\tm1\tA\tG\n",
+
+			/* no variants */
+			"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\n",
+
+			NULL
+		};
+	char *filename_s = GetTestFilename (directory_s, "invalid.vcf");
+
+	if (filename_s)
+		{
+			const char * const *contents_ss = unopenable_files_ss;
+
+			while (*contents_ss)
+				{
+					VCFFile *vcf_p;
+
+					CHECK (WriteTestFile (filename_s, *contents_ss));
+
+					if ((vcf_p = OpenVCFFile (filename_s, NULL, NULL, NULL)) != NULL)
+						{
+							printf ("opened invalid VCF file \"%s\"\n", *contents_ss);
+							CloseVCFFile (vcf_p);
+							CHECK (false);
+						}
+
+					++ contents_ss;
+				}
+
+			contents_ss = unloadable_files_ss;
+
+			while (*contents_ss)
+				{
+					json_t *parent_a_p = NULL;
+					json_t *parent_b_p = NULL;
+					json_t *doc_p;
+
+					CHECK (WriteTestFile (filename_s, *contents_ss));
+
+					if ((doc_p = LoadVCF (filename_s, NULL, NULL, NULL, 1, &parent_a_p, &parent_b_p, NULL)) != NULL)
+						{
+							printf ("loaded invalid VCF file \"%s\"\n", *contents_ss);
+							json_decref (doc_p);
+							json_decref (parent_a_p);
+							json_decref (parent_b_p);
+							CHECK (false);
+						}
+
+					++ contents_ss;
+				}
+
+			unlink (filename_s);
+			FreeCopiedString (filename_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+}
+
+
+/*
+ * A file of a few chunks, parsed by several workers when it is mapped and
+ * decompressed over several batches when it is gzipped, should give the
+ * same population either way. A truncated copy of the gzipped file must
+ * be an error rather than a population with the variants that it still has.
+ */
+static void TestLargeFile (const char *directory_s)
+{
+	char *plain_filename_s = GetTestFilename (directory_s, "large.vcf");
+	char *gzipped_filename_s = GetTestFilename (directory_s, "large.vcf.gz");
+
+	if (plain_filename_s && gzipped_filename_s && WriteLargeFiles (plain_filename_s, gzipped_filename_s))
+		{
+			json_t *parent_a_p = NULL;
+			json_t *parent_b_p = NULL;
+			json_t *gz_parent_a_p = NULL;
+			json_t *gz_parent_b_p = NULL;
+			uint64 num_cells = 0;
+			uint64 gz_num_cells = 0;
+			json_t *doc_p = LoadVCF (plain_filename_s, NULL, NULL, NULL, 4, &parent_a_p, &parent_b_p, &num_cells);
+			json_t *gz_doc_p = LoadVCF (gzipped_filename_s, NULL, NULL, NULL, 1, &gz_parent_a_p, &gz_parent_b_p, &gz_num_cells);
+
+			CHECK (doc_p != NULL);
+			CHECK (gz_doc_p != NULL);
+
+			if (doc_p && gz_doc_p)
+				{
+					CHECK (json_object_size (doc_p) == NUM_LARGE_VARIANTS);
+					CHECK (json_object_size (parent_a_p) == NUM_LARGE_VARIANTS + 1);
+					CHECK (num_cells == ((uint64) NUM_LARGE_VARIANTS) * 7);
+
+					CHECK (json_equal (doc_p, gz_doc_p));
+					CHECK (json_equal (parent_a_p, gz_parent_a_p));
+					CHECK (json_equal (parent_b_p, gz_parent_b_p));
+
+					/*
+					 * Only part of the compressed file is read when it is
+					 * opened so its size is an estimate
+					 */
+					printf ("estimated " UINT64_FMT " cells for " UINT64_FMT "\n", gz_num_cells, num_cells);
+					CHECK (gz_num_cells > (num_cells * 8) / 10);
+					CHECK (gz_num_cells < (num_cells * 12) / 10);
+				}
+
+			json_decref (doc_p);
+			json_decref (gz_doc_p);
+			json_decref (parent_a_p);
+			json_decref (parent_b_p);
+			json_decref (gz_parent_a_p);
+			json_decref (gz_parent_b_p);
+
+			CHECK (TruncateFile (gzipped_filename_s, 0));
+
+			doc_p = LoadVCF (gzipped_filename_s, NULL, NULL, NULL, 1, &parent_a_p, &parent_b_p, NULL);
+			CHECK (doc_p == NULL);
+
+			if (doc_p)
+				{
+					json_decref (doc_p);
+					json_decref (parent_a_p);
+					json_decref (parent_b_p);
+				}
+
+			unlink (plain_filename_s);
+			unlink (gzipped_filename_s);
+		}
+	else
+		{
+			CHECK (false);
+		}
+
+	if (plain_filename_s)
+		{
+			FreeCopiedString (plain_filename_s);
+		}
+
+	if (gzipped_filename_s)
+		{
+			FreeCopiedString (gzipped_filename_s);
+		}
+}
+
+
+/*
+ * Load a VCF file into a new population document, mapping any accessions
+ * starting with "L_" to "Line ". The parent rows belong to the VCFFile so
+ * they get an extra reference before it is closed.
+ */
+static json_t *LoadVCF (const char *filename_s, const char *parent_a_s, const char *parent_b_s, const char *map_filename_s, const uint32 num_threads, json_t **parent_a_row_pp, json_t **parent_b_row_pp, uint64 *num_cells_p)
+{
+	json_t *doc_p = NULL;
+	VCFFile *vcf_p = OpenVCFFile (filename_s, parent_a_s, parent_b_s, map_filename_s);
+
+	if (vcf_p)
+		{
+			ParentalGenotypeServiceData data;
+			json_t *mappings_p = json_pack ("{s:s}", "L_", "Line ");
+
+			memset (&data, 0, sizeof (ParentalGenotypeServiceData));
+			data.pgsd_name_mappings_p = mappings_p;
+			data.pgsd_import_threads = num_threads;
+
+			if (num_cells_p)
+				{
+					*num_cells_p = GetVCFFileNumCells (vcf_p);
+				}
+
+			if ((doc_p = json_object ()) != NULL)
+				{
+					const json_t *parent_a_row_p = NULL;
+					const json_t *parent_b_row_p = NULL;
+					JobArena arena;
+
+					InitJobArena (&arena);
+
+					if (AddVCFFileToPopulation (vcf_p, doc_p, &parent_a_row_p, &parent_b_row_p, &data, &arena))
+						{
+							*parent_a_row_pp = json_incref ((json_t *) parent_a_row_p);
+							*parent_b_row_pp = json_incref ((json_t *) parent_b_row_p);
+						}
+					else
+						{
+							json_decref (doc_p);
+							doc_p = NULL;
+						}
+
+					ClearJobArena (&arena);
+				}
+
+			json_decref (mappings_p);
+			CloseVCFFile (vcf_p);
+		}
+
+	return doc_p;
+}
+
+
+static char *GetTestFilename (const char *directory_s, const char *name_s)
+{
+	return ConcatenateVarargsStrings (directory_s, "/", name_s, NULL);
+}
+
+
+static bool WriteTestFile (const char *filename_s, const char *contents_s)
+{
+	bool success_flag = false;
+	FILE *out_f = fopen (filename_s, "w");
+
+	if (out_f)
+		{
+			success_flag = (fputs (contents_s, out_f) >= 0);
+
+			if (fclose (out_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Compress each line as a separate gzip member, as BGZF does with
+ * its blocks, so reading has to carry on across the members.
+ */
+static bool WriteGzippedFile (const char *filename_s, const char *contents_s)
+{
+	bool success_flag = true;
+	const char *mode_s = "wb";
+
+	while (*contents_s && success_flag)
+		{
+			gzFile out_f = gzopen (filename_s, mode_s);
+
+			success_flag = false;
+
+			if (out_f)
+				{
+					const char *line_end_s = strchr (contents_s, '\n');
+					const size_t length = line_end_s ? (size_t) (line_end_s + 1 - contents_s) : strlen (contents_s);
+
+					success_flag = (gzwrite (out_f, contents_s, (unsigned int) length) == (int) length);
+
+					if (gzclose (out_f) != Z_OK)
+						{
+							success_flag = false;
+						}
+
+					contents_s += length;
+					mode_s = "ab";
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool WriteLargeFiles (const char *plain_filename_s, const char *gzipped_filename_s)
+{
+	bool success_flag = false;
+	FILE *out_f = fopen (plain_filename_s, "w");
+
+	if (out_f)
+		{
+			gzFile gz_f = gzopen (gzipped_filename_s, "wb");
+
+			if (gz_f)
+				{
+					const char * const calls_ss [] = { "0/0", "0/1", "1/1", "1|0", "./.", "0/2" };
+					const uint32 num_calls = sizeof (calls_ss) / sizeof (calls_ss [0]);
+					char line_s [256];
+					uint32 seed = 12345;
+					uint32 i;
+
+					success_flag = true;
+
+					strcpy (line_s, "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tP1\tP2\tL_1\tL_2\n");
+
+					for (i = 0; (i <= NUM_LARGE_VARIANTS) && success_flag; ++ i)
+						{
+							size_t length;
+
+							if (i > 0)
+								{
+									uint32 j;
+
+									sprintf (line_s, "chr" UINT32_FMT "\t" UINT32_FMT "\t%s", (i % 5) + 1, i * 10, (i % 3 == 0) ? "." : "m.");
+
+									if (i % 3 != 0)
+										{
+											sprintf (line_s + strlen (line_s), UINT32_FMT, i);
+										}
+
+									strcat (line_s, "\tA\tC,G\t.\tPASS\t.\tGT");
+
+									for (j = 0; j < 4; ++ j)
+										{
+											seed = seed * 1103515245 + 12345;
+											strcat (line_s, "\t");
+											strcat (line_s, calls_ss [(seed >> 16) % num_calls]);
+										}
+
+									strcat (line_s, "\n");
+								}
+
+							length = strlen (line_s);
+
+							success_flag = (fputs (line_s, out_f) >= 0) && (gzwrite (gz_f, line_s, (unsigned int) length) == (int) length);
+						}
+
+					if (gzclose (gz_f) != Z_OK)
+						{
+							success_flag = false;
+						}
+				}
+
+			if (fclose (out_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Cut num_bytes off the end of a file or, if num_bytes is 0, its last third.
+ */
+static bool TruncateFile (const char *filename_s, const off_t num_bytes)
+{
+	struct stat st;
+
+	if (stat (filename_s, &st) == 0)
+		{
+			const off_t size = st.st_size - ((num_bytes > 0) ? num_bytes : (st.st_size / 3));
+
+			return ((size > 0) && (truncate (filename_s, size) == 0));
+		}
+
+	return false;
+}
+
+
+static void CheckCall (const json_t *doc_p, const char *escaped_marker_s, const char *accession_s, const char *call_s)
+{
+	const json_t *marker_p = json_object_get (doc_p, escaped_marker_s);
+
+	if (marker_p)
+		{
+			CHECK_STRING (GetJSONString (marker_p, accession_s), call_s);
+		}
+	else
+		{
+			printf ("No marker \"%s\"\n", escaped_marker_s);
+			CHECK (false);
+		}
+}